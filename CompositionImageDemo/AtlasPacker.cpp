@@ -0,0 +1,247 @@
+#include "pch.h"
+#include "AtlasPacker.h"
+
+SkylinePacker::SkylinePacker(uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0)
+    {
+        throw std::invalid_argument("Packer size must be non-zero");
+    }
+    m_width = width;
+    m_height = height;
+    Reset();
+}
+
+void SkylinePacker::Reset()
+{
+    m_skyline = { { 0, 0, m_width } };
+    m_usedArea = 0;
+}
+
+std::optional<uint32_t> SkylinePacker::Fit(size_t index, uint32_t width, uint32_t height) const
+{
+    auto x = m_skyline[index].X;
+    if (x + width > m_width)
+    {
+        return std::nullopt;
+    }
+    // The rect has to sit on top of the highest node it spans.
+    uint32_t y = 0;
+    auto remaining = width;
+    for (auto i = index; remaining > 0; i++)
+    {
+        y = std::max(y, m_skyline[i].Y);
+        if (y + height > m_height)
+        {
+            return std::nullopt;
+        }
+        remaining -= std::min(remaining, m_skyline[i].Width);
+    }
+    return y;
+}
+
+std::optional<SurfacePoint> SkylinePacker::Pack(uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0)
+    {
+        throw std::invalid_argument("Rect size must be non-zero");
+    }
+
+    auto bestIndex = m_skyline.size();
+    uint32_t bestTop = std::numeric_limits<uint32_t>::max();
+    uint32_t bestWidth = std::numeric_limits<uint32_t>::max();
+    uint32_t bestY = 0;
+    for (size_t i = 0; i < m_skyline.size(); i++)
+    {
+        if (auto y = Fit(i, width, height))
+        {
+            // Lowest top edge wins, ties go to the narrowest spot.
+            auto top = *y + height;
+            if (top < bestTop || (top == bestTop && m_skyline[i].Width < bestWidth))
+            {
+                bestIndex = i;
+                bestTop = top;
+                bestWidth = m_skyline[i].Width;
+                bestY = *y;
+            }
+        }
+    }
+    if (bestIndex == m_skyline.size())
+    {
+        return std::nullopt;
+    }
+
+    SurfacePoint result = { static_cast<int32_t>(m_skyline[bestIndex].X), static_cast<int32_t>(bestY) };
+    m_skyline.insert(m_skyline.begin() + bestIndex, { m_skyline[bestIndex].X, bestTop, width });
+
+    // Cut away whatever the new node covers from the nodes after it.
+    auto end = m_skyline[bestIndex].X + width;
+    for (auto i = bestIndex + 1; i < m_skyline.size();)
+    {
+        auto& node = m_skyline[i];
+        if (node.X >= end)
+        {
+            break;
+        }
+        auto overlap = end - node.X;
+        if (overlap >= node.Width)
+        {
+            m_skyline.erase(m_skyline.begin() + i);
+            continue;
+        }
+        node.X += overlap;
+        node.Width -= overlap;
+        break;
+    }
+
+    // Merge neighbours at the same height.
+    for (size_t i = 0; i + 1 < m_skyline.size();)
+    {
+        if (m_skyline[i].Y == m_skyline[i + 1].Y)
+        {
+            m_skyline[i].Width += m_skyline[i + 1].Width;
+            m_skyline.erase(m_skyline.begin() + i + 1);
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    m_usedArea += static_cast<uint64_t>(width) * height;
+    return result;
+}
+
+ImageAtlas::ImageAtlas(uint32_t pageWidth, uint32_t pageHeight, uint32_t padding)
+{
+    if (pageWidth <= padding || pageHeight <= padding)
+    {
+        throw std::invalid_argument("Page must be bigger than the padding");
+    }
+    m_pageWidth = pageWidth;
+    m_pageHeight = pageHeight;
+    m_padding = padding;
+}
+
+std::optional<AtlasEntry> ImageAtlas::Place(uint32_t width, uint32_t height)
+{
+    // Padding goes on the right and bottom of every image. Pages are one
+    // padding wider and taller in the packer's eyes, so images can still touch
+    // the far edges.
+    for (uint32_t page = 0; page < m_pages.size(); page++)
+    {
+        if (auto position = m_pages[page].Pack(width + m_padding, height + m_padding))
+        {
+            return AtlasEntry{ page, { position->X, position->Y, width, height } };
+        }
+    }
+    m_pages.emplace_back(m_pageWidth + m_padding, m_pageHeight + m_padding);
+    auto page = static_cast<uint32_t>(m_pages.size() - 1);
+    if (auto position = m_pages.back().Pack(width + m_padding, height + m_padding))
+    {
+        return AtlasEntry{ page, { position->X, position->Y, width, height } };
+    }
+    m_pages.pop_back();
+    return std::nullopt;
+}
+
+AtlasImageId ImageAtlas::Insert(uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0 || width > m_pageWidth || height > m_pageHeight)
+    {
+        throw std::invalid_argument("Image doesn't fit in an atlas page");
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto entry = Place(width, height);
+    if (!entry)
+    {
+        // A fresh page always has room for anything that passed the size check.
+        throw std::logic_error("Failed to place image in an empty page");
+    }
+    auto id = m_nextId++;
+    m_entries.emplace(id, *entry);
+    m_liveArea += static_cast<uint64_t>(width) * height;
+    m_stats.Inserts++;
+    m_stats.InsertTime += std::chrono::steady_clock::now() - start;
+    return id;
+}
+
+void ImageAtlas::Remove(AtlasImageId id)
+{
+    auto it = m_entries.find(id);
+    if (it == m_entries.end())
+    {
+        throw std::out_of_range("Image isn't in the atlas");
+    }
+    auto area = static_cast<uint64_t>(it->second.Rect.Width) * it->second.Rect.Height;
+    m_liveArea -= area;
+    m_deadArea += area;
+    m_entries.erase(it);
+    m_stats.Removes++;
+}
+
+std::optional<AtlasEntry> ImageAtlas::Find(AtlasImageId id) const
+{
+    auto it = m_entries.find(id);
+    if (it == m_entries.end())
+    {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+double ImageAtlas::PackingEfficiency() const
+{
+    if (m_pages.empty())
+    {
+        return 0.0;
+    }
+    return static_cast<double>(m_liveArea) / (static_cast<double>(m_pageWidth) * m_pageHeight * m_pages.size());
+}
+
+double ImageAtlas::FragmentedFraction() const
+{
+    if (m_pages.empty())
+    {
+        return 0.0;
+    }
+    return static_cast<double>(m_deadArea) / (static_cast<double>(m_pageWidth) * m_pageHeight * m_pages.size());
+}
+
+std::vector<AtlasMove> ImageAtlas::Defragment()
+{
+    // Skyline packing does best when the tallest rects go in first.
+    std::vector<std::pair<AtlasImageId, AtlasEntry>> images(m_entries.begin(), m_entries.end());
+    std::stable_sort(images.begin(), images.end(), [](auto const& first, auto const& second)
+        {
+            return first.second.Rect.Height > second.second.Rect.Height;
+        });
+
+    for (auto& page : m_pages)
+    {
+        page.Reset();
+    }
+    std::vector<AtlasMove> moves;
+    for (auto const& [id, from] : images)
+    {
+        auto to = Place(from.Rect.Width, from.Rect.Height);
+        if (!to)
+        {
+            throw std::logic_error("Failed to place image in an empty page");
+        }
+        if (to->Page != from.Page || to->Rect.X != from.Rect.X || to->Rect.Y != from.Rect.Y)
+        {
+            moves.push_back({ id, from, *to });
+        }
+        m_entries[id] = *to;
+    }
+    while (!m_pages.empty() && m_pages.back().UsedArea() == 0)
+    {
+        m_pages.pop_back();
+    }
+
+    m_deadArea = 0;
+    m_stats.Defragmentations++;
+    m_stats.ImagesMoved += moves.size();
+    return moves;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include "SurfaceBackend.h"
+
+// Places rectangles in a fixed-size area using the skyline bottom-left
+// heuristic. The skyline is the top edge of everything placed so far, and each
+// new rect goes wherever its top edge would end up lowest. Space can't be
+// freed again, other than by resetting the whole packer.
+class SkylinePacker
+{
+public:
+    SkylinePacker(uint32_t width, uint32_t height);
+
+    uint32_t Width() const { return m_width; }
+    uint32_t Height() const { return m_height; }
+    // Returns std::nullopt if the rect doesn't fit anywhere.
+    std::optional<SurfacePoint> Pack(uint32_t width, uint32_t height);
+    void Reset();
+    uint64_t UsedArea() const { return m_usedArea; }
+
+private:
+    struct SkylineNode
+    {
+        uint32_t X;
+        uint32_t Y;
+        uint32_t Width;
+    };
+
+    // Returns the y the rect would sit at if its left edge were at node 'index'.
+    std::optional<uint32_t> Fit(size_t index, uint32_t width, uint32_t height) const;
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    std::vector<SkylineNode> m_skyline;
+    uint64_t m_usedArea = 0;
+};
+
+using AtlasImageId = uint32_t;
+
+struct AtlasEntry
+{
+    uint32_t Page = 0;
+    SurfaceRect Rect;
+};
+
+// Where an image was and where it went when the atlas was defragmented. The
+// pixels need to be uploaded again at the new location.
+struct AtlasMove
+{
+    AtlasImageId Id = 0;
+    AtlasEntry From;
+    AtlasEntry To;
+};
+
+struct ImageAtlasStats
+{
+    uint64_t Inserts = 0;
+    uint64_t Removes = 0;
+    uint64_t Defragmentations = 0;
+    uint64_t ImagesMoved = 0;
+    std::chrono::nanoseconds InsertTime = {};
+};
+
+// Packs many small images into a few large pages, so a grid of thumbnails
+// doesn't need a surface per image. Pages are added as needed and are all the
+// same size. The atlas only decides where things go, the caller owns the
+// surfaces and the pixels.
+//
+// Removing an image leaves a hole, since skyline packing can't reuse space.
+// Once enough of the atlas is holes, Defragment repacks the live images and
+// says which ones moved.
+class ImageAtlas
+{
+public:
+    // 'padding' pixels are left between images so that filtering at the edge of
+    // one image doesn't pick up its neighbours.
+    ImageAtlas(uint32_t pageWidth = 2048, uint32_t pageHeight = 2048, uint32_t padding = 1);
+
+    uint32_t PageWidth() const { return m_pageWidth; }
+    uint32_t PageHeight() const { return m_pageHeight; }
+    uint32_t PageCount() const { return static_cast<uint32_t>(m_pages.size()); }
+
+    // Throws std::invalid_argument if the image is bigger than a page.
+    AtlasImageId Insert(uint32_t width, uint32_t height);
+    void Remove(AtlasImageId id);
+    // Returns std::nullopt for ids that aren't in the atlas.
+    std::optional<AtlasEntry> Find(AtlasImageId id) const;
+    size_t ImageCount() const { return m_entries.size(); }
+
+    // Live image area over the area of all pages.
+    double PackingEfficiency() const;
+    // Area lost to removed images over the area of all pages.
+    double FragmentedFraction() const;
+    bool NeedsDefragment(double threshold = 0.25) const { return FragmentedFraction() > threshold; }
+    // Repacks every live image, tallest first. Pages that end up empty are
+    // dropped from the end.
+    std::vector<AtlasMove> Defragment();
+
+    ImageAtlasStats const& Stats() const { return m_stats; }
+
+private:
+    std::optional<AtlasEntry> Place(uint32_t width, uint32_t height);
+
+    uint32_t m_pageWidth = 0;
+    uint32_t m_pageHeight = 0;
+    uint32_t m_padding = 0;
+    std::vector<SkylinePacker> m_pages;
+    std::map<AtlasImageId, AtlasEntry> m_entries;
+    AtlasImageId m_nextId = 1;
+    uint64_t m_liveArea = 0;
+    uint64_t m_deadArea = 0;
+    ImageAtlasStats m_stats;
+};
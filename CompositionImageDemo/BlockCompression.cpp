@@ -0,0 +1,991 @@
+#include "pch.h"
+#include "BlockCompression.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+namespace
+{
+    // A 4x4 block of pixels. Channels are kept in memory order: B, G, R, A.
+    struct Block
+    {
+        uint8_t Pixels[16][4];
+    };
+
+    // Interpolation weights (out of 64) for BC7's 4-bit indices.
+    constexpr std::array<int, 16> Bc7Weights = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+    // How far each BC1 index sits between color0 and color1.
+    constexpr std::array<float, 4> Bc1Weights = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+    void LoadBlock(PixelBuffer const& image, uint32_t blockX, uint32_t blockY, Block& block)
+    {
+        auto x = blockX * 4;
+        auto y = blockY * 4;
+        if (x + 4 <= image.Width && y + 4 <= image.Height)
+        {
+            for (uint32_t row = 0; row < 4; row++)
+            {
+                memcpy(block.Pixels[row * 4], image.Row(y + row) + x * 4, 16);
+            }
+            return;
+        }
+
+        // Blocks that hang off the edge of the image repeat the last row and column.
+        for (uint32_t row = 0; row < 4; row++)
+        {
+            auto source = image.Row(std::min(y + row, image.Height - 1));
+            for (uint32_t column = 0; column < 4; column++)
+            {
+                auto sourceX = std::min(x + column, image.Width - 1);
+                memcpy(block.Pixels[row * 4 + column], source + sourceX * 4, 4);
+            }
+        }
+    }
+
+    void ComputeBounds(Block const& block, uint8_t (&minimum)[4], uint8_t (&maximum)[4])
+    {
+#ifdef IMAGE_DEMO_SSE2
+        if (SimdEnabled())
+        {
+        auto rows = reinterpret_cast<__m128i const*>(block.Pixels);
+        auto row0 = _mm_loadu_si128(rows + 0);
+        auto row1 = _mm_loadu_si128(rows + 1);
+        auto row2 = _mm_loadu_si128(rows + 2);
+        auto row3 = _mm_loadu_si128(rows + 3);
+        auto low = _mm_min_epu8(_mm_min_epu8(row0, row1), _mm_min_epu8(row2, row3));
+        auto high = _mm_max_epu8(_mm_max_epu8(row0, row1), _mm_max_epu8(row2, row3));
+        // Fold the four pixels in each register down to one.
+        low = _mm_min_epu8(low, _mm_srli_si128(low, 8));
+        low = _mm_min_epu8(low, _mm_srli_si128(low, 4));
+        high = _mm_max_epu8(high, _mm_srli_si128(high, 8));
+        high = _mm_max_epu8(high, _mm_srli_si128(high, 4));
+        auto packedLow = static_cast<uint32_t>(_mm_cvtsi128_si32(low));
+        auto packedHigh = static_cast<uint32_t>(_mm_cvtsi128_si32(high));
+        memcpy(minimum, &packedLow, 4);
+        memcpy(maximum, &packedHigh, 4);
+        return;
+        }
+#endif
+        for (int channel = 0; channel < 4; channel++)
+        {
+            minimum[channel] = 255;
+            maximum[channel] = 0;
+        }
+        for (auto&& pixel : block.Pixels)
+        {
+            for (int channel = 0; channel < 4; channel++)
+            {
+                minimum[channel] = std::min(minimum[channel], pixel[channel]);
+                maximum[channel] = std::max(maximum[channel], pixel[channel]);
+            }
+        }
+    }
+
+    // Picks two endpoints (low and high) that the block's colors can be
+    // interpolated between. Only the first 'Channels' channels are considered.
+    template <int Channels>
+    void FitEndpoints(Block const& block, CompressionQuality quality, float (&low)[4], float (&high)[4])
+    {
+        uint8_t minimum[4];
+        uint8_t maximum[4];
+        ComputeBounds(block, minimum, maximum);
+
+        if (quality == CompressionQuality::Fast)
+        {
+            // Inset the bounding box slightly, the extremes are rarely worth
+            // spending an endpoint on.
+            for (int channel = 0; channel < 4; channel++)
+            {
+                auto inset = (maximum[channel] - minimum[channel]) / 16.0f;
+                low[channel] = minimum[channel] + inset;
+                high[channel] = maximum[channel] - inset;
+            }
+            return;
+        }
+
+        float mean[Channels] = {};
+        for (auto&& pixel : block.Pixels)
+        {
+            for (int channel = 0; channel < Channels; channel++)
+            {
+                mean[channel] += pixel[channel];
+            }
+        }
+        for (auto& value : mean)
+        {
+            value /= 16.0f;
+        }
+
+        float covariance[Channels][Channels] = {};
+        for (auto&& pixel : block.Pixels)
+        {
+            float delta[Channels];
+            for (int channel = 0; channel < Channels; channel++)
+            {
+                delta[channel] = pixel[channel] - mean[channel];
+            }
+            for (int i = 0; i < Channels; i++)
+            {
+                for (int j = 0; j < Channels; j++)
+                {
+                    covariance[i][j] += delta[i] * delta[j];
+                }
+            }
+        }
+
+        // Power iteration for the principal axis, starting from the diagonal
+        // of the bounding box.
+        float axis[Channels];
+        for (int channel = 0; channel < Channels; channel++)
+        {
+            axis[channel] = static_cast<float>(maximum[channel] - minimum[channel]) + 1.0f;
+        }
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[Channels] = {};
+            for (int i = 0; i < Channels; i++)
+            {
+                for (int j = 0; j < Channels; j++)
+                {
+                    next[i] += covariance[i][j] * axis[j];
+                }
+            }
+            float length = 0.0f;
+            for (auto value : next)
+            {
+                length = std::max(length, std::abs(value));
+            }
+            if (length < 1e-6f)
+            {
+                // Every pixel is the same color.
+                break;
+            }
+            for (int channel = 0; channel < Channels; channel++)
+            {
+                axis[channel] = next[channel] / length;
+            }
+        }
+        float axisLengthSquared = 0.0f;
+        for (auto value : axis)
+        {
+            axisLengthSquared += value * value;
+        }
+
+        auto minimumProjection = 0.0f;
+        auto maximumProjection = 0.0f;
+        for (auto&& pixel : block.Pixels)
+        {
+            float projection = 0.0f;
+            for (int channel = 0; channel < Channels; channel++)
+            {
+                projection += (pixel[channel] - mean[channel]) * axis[channel];
+            }
+            projection /= axisLengthSquared;
+            minimumProjection = std::min(minimumProjection, projection);
+            maximumProjection = std::max(maximumProjection, projection);
+        }
+
+        for (int channel = 0; channel < 4; channel++)
+        {
+            if (channel < Channels)
+            {
+                low[channel] = std::clamp(mean[channel] + axis[channel] * minimumProjection, 0.0f, 255.0f);
+                high[channel] = std::clamp(mean[channel] + axis[channel] * maximumProjection, 0.0f, 255.0f);
+            }
+            else
+            {
+                low[channel] = minimum[channel];
+                high[channel] = maximum[channel];
+            }
+        }
+    }
+
+    // Given where each pixel landed between the two endpoints (0 is 'first',
+    // 1 is 'second'), solve for the endpoints that minimize the squared error.
+    template <int Channels>
+    void RefineEndpoints(Block const& block, float const (&weights)[16], float (&first)[4], float (&second)[4])
+    {
+        float alpha2 = 0.0f;
+        float beta2 = 0.0f;
+        float alphaBeta = 0.0f;
+        float alphaX[Channels] = {};
+        float betaX[Channels] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            auto beta = weights[i];
+            auto alpha = 1.0f - beta;
+            alpha2 += alpha * alpha;
+            beta2 += beta * beta;
+            alphaBeta += alpha * beta;
+            for (int channel = 0; channel < Channels; channel++)
+            {
+                alphaX[channel] += alpha * block.Pixels[i][channel];
+                betaX[channel] += beta * block.Pixels[i][channel];
+            }
+        }
+
+        auto determinant = alpha2 * beta2 - alphaBeta * alphaBeta;
+        if (std::abs(determinant) < 1e-6f)
+        {
+            return;
+        }
+        for (int channel = 0; channel < Channels; channel++)
+        {
+            first[channel] = std::clamp((alphaX[channel] * beta2 - betaX[channel] * alphaBeta) / determinant, 0.0f, 255.0f);
+            second[channel] = std::clamp((betaX[channel] * alpha2 - alphaX[channel] * alphaBeta) / determinant, 0.0f, 255.0f);
+        }
+    }
+
+    uint16_t QuantizeTo565(float const (&color)[4])
+    {
+        auto b = static_cast<uint16_t>(std::lround(color[0] * 31.0f / 255.0f));
+        auto g = static_cast<uint16_t>(std::lround(color[1] * 63.0f / 255.0f));
+        auto r = static_cast<uint16_t>(std::lround(color[2] * 31.0f / 255.0f));
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    void Expand565(uint16_t color, int (&bgr)[3])
+    {
+        auto r = (color >> 11) & 0x1f;
+        auto g = (color >> 5) & 0x3f;
+        auto b = color & 0x1f;
+        bgr[0] = (b << 3) | (b >> 2);
+        bgr[1] = (g << 2) | (g >> 4);
+        bgr[2] = (r << 3) | (r >> 2);
+    }
+
+    void BuildBc1Palette(uint16_t color0, uint16_t color1, bool fourColor, int (&palette)[4][4])
+    {
+        int first[3];
+        int second[3];
+        Expand565(color0, first);
+        Expand565(color1, second);
+        for (int channel = 0; channel < 3; channel++)
+        {
+            palette[0][channel] = first[channel];
+            palette[1][channel] = second[channel];
+            if (fourColor)
+            {
+                palette[2][channel] = (2 * first[channel] + second[channel]) / 3;
+                palette[3][channel] = (first[channel] + 2 * second[channel]) / 3;
+            }
+            else
+            {
+                palette[2][channel] = (first[channel] + second[channel]) / 2;
+                palette[3][channel] = 0;
+            }
+        }
+        palette[0][3] = palette[1][3] = palette[2][3] = 255;
+        palette[3][3] = fourColor ? 255 : 0;
+    }
+
+    void WriteLittleEndian16(uint8_t* output, uint16_t value)
+    {
+        output[0] = static_cast<uint8_t>(value);
+        output[1] = static_cast<uint8_t>(value >> 8);
+    }
+
+    // Picks the nearest palette color for each pixel, by squared distance over
+    // the color channels, and returns the total distance. Ties go to the lower
+    // index, so when both endpoints are the same every pixel gets index 0.
+    uint32_t SelectBc1Indices(Block const& block, int const (&palette)[4][4], uint32_t (&indices)[16])
+    {
+#ifdef IMAGE_DEMO_SSE2
+        if (SimdEnabled())
+        {
+            // Four pixels at a time, each as two lanes of 16 bit BGRA, with
+            // alpha masked out of the differences.
+            auto zero = _mm_setzero_si128();
+            auto colorMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+            __m128i colors[4];
+            for (int index = 0; index < 4; index++)
+            {
+                auto& color = palette[index];
+                colors[index] = _mm_set_epi16(0, static_cast<short>(color[2]), static_cast<short>(color[1]), static_cast<short>(color[0]),
+                    0, static_cast<short>(color[2]), static_cast<short>(color[1]), static_cast<short>(color[0]));
+            }
+            auto total = _mm_setzero_si128();
+            for (int group = 0; group < 4; group++)
+            {
+                auto pixels = _mm_loadu_si128(reinterpret_cast<__m128i const*>(block.Pixels[group * 4]));
+                auto low = _mm_unpacklo_epi8(pixels, zero);
+                auto high = _mm_unpackhi_epi8(pixels, zero);
+                auto best = _mm_set1_epi32(-1);
+                auto bestIndex = zero;
+                for (int index = 0; index < 4; index++)
+                {
+                    auto deltaLow = _mm_and_si128(_mm_sub_epi16(low, colors[index]), colorMask);
+                    auto deltaHigh = _mm_and_si128(_mm_sub_epi16(high, colors[index]), colorMask);
+                    // madd leaves each pixel's distance split over two lanes.
+                    auto sumsLow = _mm_castsi128_ps(_mm_madd_epi16(deltaLow, deltaLow));
+                    auto sumsHigh = _mm_castsi128_ps(_mm_madd_epi16(deltaHigh, deltaHigh));
+                    auto distance = _mm_add_epi32(
+                        _mm_castps_si128(_mm_shuffle_ps(sumsLow, sumsHigh, _MM_SHUFFLE(2, 0, 2, 0))),
+                        _mm_castps_si128(_mm_shuffle_ps(sumsLow, sumsHigh, _MM_SHUFFLE(3, 1, 3, 1))));
+                    // Distances are under 2^18, so a signed compare works and
+                    // the first candidate always beats the -1 start.
+                    auto closer = index == 0 ? _mm_set1_epi32(-1) : _mm_cmplt_epi32(distance, best);
+                    best = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best));
+                    bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(index)), _mm_andnot_si128(closer, bestIndex));
+                }
+                total = _mm_add_epi32(total, best);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(indices + group * 4), bestIndex);
+            }
+            total = _mm_add_epi32(total, _mm_srli_si128(total, 8));
+            total = _mm_add_epi32(total, _mm_srli_si128(total, 4));
+            return static_cast<uint32_t>(_mm_cvtsi128_si32(total));
+        }
+#endif
+        uint32_t error = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            auto pixel = block.Pixels[i];
+            uint32_t bestDistance = UINT32_MAX;
+            uint32_t bestIndex = 0;
+            for (uint32_t index = 0; index < 4; index++)
+            {
+                uint32_t distance = 0;
+                for (int channel = 0; channel < 3; channel++)
+                {
+                    auto delta = palette[index][channel] - pixel[channel];
+                    distance += delta * delta;
+                }
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    bestIndex = index;
+                }
+            }
+            indices[i] = bestIndex;
+            error += bestDistance;
+        }
+        return error;
+    }
+
+    // Writes the 8 byte color half of a BC1/BC3 block. The block is always
+    // encoded in four color mode.
+    void EncodeColorBlock(Block const& block, CompressionQuality quality, uint8_t* output)
+    {
+        float low[4];
+        float high[4];
+        FitEndpoints<3>(block, quality, low, high);
+
+        // Refinement needs a set of indices to work from, so the best quality
+        // setting takes a few passes.
+        auto passes = quality == CompressionQuality::Best ? 3 : 1;
+        auto bestError = UINT32_MAX;
+        for (int pass = 0; pass < passes; pass++)
+        {
+            auto color0 = QuantizeTo565(high);
+            auto color1 = QuantizeTo565(low);
+            if (color0 < color1)
+            {
+                std::swap(color0, color1);
+            }
+
+            int palette[4][4];
+            BuildBc1Palette(color0, color1, true, palette);
+
+            uint32_t indices[16];
+            auto error = SelectBc1Indices(block, palette, indices);
+            uint32_t selectors = 0;
+            float weights[16];
+            for (int i = 0; i < 16; i++)
+            {
+                selectors |= indices[i] << (2 * i);
+                weights[i] = Bc1Weights[indices[i]];
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                WriteLittleEndian16(output, color0);
+                WriteLittleEndian16(output + 2, color1);
+                for (int i = 0; i < 4; i++)
+                {
+                    output[4 + i] = static_cast<uint8_t>(selectors >> (8 * i));
+                }
+            }
+
+            if (error == 0 || color0 == color1)
+            {
+                break;
+            }
+            // color0 is the 'first' endpoint of the weights, color1 the second.
+            RefineEndpoints<3>(block, weights, high, low);
+        }
+    }
+
+    // Writes the 8 byte alpha half of a BC3 block.
+    void EncodeAlphaBlock(Block const& block, uint8_t* output)
+    {
+        uint8_t minimum[4];
+        uint8_t maximum[4];
+        ComputeBounds(block, minimum, maximum);
+        auto alpha0 = maximum[3];
+        auto alpha1 = minimum[3];
+        output[0] = alpha0;
+        output[1] = alpha1;
+        if (alpha0 == alpha1)
+        {
+            memset(output + 2, 0, 6);
+            return;
+        }
+
+        // Eight value mode: the endpoints plus six interpolated values.
+        int palette[8] = { alpha0, alpha1 };
+        for (int index = 2; index < 8; index++)
+        {
+            palette[index] = ((8 - index) * alpha0 + (index - 1) * alpha1) / 7;
+        }
+
+        uint64_t bits = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int alpha = block.Pixels[i][3];
+            uint64_t bestIndex = 0;
+            auto bestDistance = std::numeric_limits<int>::max();
+            for (int index = 0; index < 8; index++)
+            {
+                auto distance = std::abs(palette[index] - alpha);
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    bestIndex = index;
+                }
+            }
+            bits |= bestIndex << (3 * i);
+        }
+        for (int i = 0; i < 6; i++)
+        {
+            output[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+    }
+
+    struct BitWriter
+    {
+        uint8_t* Output;
+        uint32_t Position = 0;
+
+        void Write(uint32_t value, uint32_t bitCount)
+        {
+            for (uint32_t i = 0; i < bitCount; i++, Position++)
+            {
+                if (value & (1u << i))
+                {
+                    Output[Position / 8] |= static_cast<uint8_t>(1u << (Position % 8));
+                }
+            }
+        }
+    };
+
+    struct BitReader
+    {
+        uint8_t const* Input;
+        uint32_t Position = 0;
+
+        uint32_t Read(uint32_t bitCount)
+        {
+            uint32_t value = 0;
+            for (uint32_t i = 0; i < bitCount; i++, Position++)
+            {
+                value |= ((Input[Position / 8] >> (Position % 8)) & 1u) << i;
+            }
+            return value;
+        }
+    };
+
+    // Mode 6 endpoints are 7 bits per channel plus a shared low bit (the
+    // p-bit). Picks the p-bit that best represents the endpoint.
+    void QuantizeBc7Endpoint(float const (&endpoint)[4], int (&quantized)[4], int& pbit)
+    {
+        auto bestError = std::numeric_limits<float>::max();
+        for (int candidate = 0; candidate < 2; candidate++)
+        {
+            int values[4];
+            auto error = 0.0f;
+            for (int channel = 0; channel < 4; channel++)
+            {
+                values[channel] = std::clamp(static_cast<int>(std::lround((endpoint[channel] - candidate) / 2.0f)), 0, 127);
+                auto delta = (values[channel] * 2 + candidate) - endpoint[channel];
+                error += delta * delta;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pbit = candidate;
+                std::copy(std::begin(values), std::end(values), std::begin(quantized));
+            }
+        }
+    }
+
+    void EncodeBc7Block(Block const& block, CompressionQuality quality, uint8_t* output)
+    {
+        float low[4];
+        float high[4];
+        FitEndpoints<4>(block, quality, low, high);
+
+        auto passes = quality == CompressionQuality::Best ? 3 : 1;
+        auto bestError = UINT32_MAX;
+        for (int pass = 0; pass < passes; pass++)
+        {
+            int quantized[2][4];
+            int pbits[2];
+            QuantizeBc7Endpoint(low, quantized[0], pbits[0]);
+            QuantizeBc7Endpoint(high, quantized[1], pbits[1]);
+
+            int endpoints[2][4];
+            int direction[4];
+            auto directionLengthSquared = 0;
+            for (int channel = 0; channel < 4; channel++)
+            {
+                endpoints[0][channel] = quantized[0][channel] * 2 + pbits[0];
+                endpoints[1][channel] = quantized[1][channel] * 2 + pbits[1];
+                direction[channel] = endpoints[1][channel] - endpoints[0][channel];
+                directionLengthSquared += direction[channel] * direction[channel];
+            }
+
+            int palette[16][4];
+            for (int index = 0; index < 16; index++)
+            {
+                auto weight = Bc7Weights[index];
+                for (int channel = 0; channel < 4; channel++)
+                {
+                    palette[index][channel] = ((64 - weight) * endpoints[0][channel] + weight * endpoints[1][channel] + 32) >> 6;
+                }
+            }
+
+            int indices[16];
+            float weights[16];
+            uint32_t error = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                auto pixel = block.Pixels[i];
+                // Project onto the line between the endpoints to get close, then
+                // check the neighbouring indices since the weights aren't evenly spaced.
+                auto guess = 0;
+                if (directionLengthSquared > 0)
+                {
+                    auto dot = 0;
+                    for (int channel = 0; channel < 4; channel++)
+                    {
+                        dot += (pixel[channel] - endpoints[0][channel]) * direction[channel];
+                    }
+                    guess = std::clamp(static_cast<int>(std::lround(dot * 15.0f / directionLengthSquared)), 0, 15);
+                }
+                auto bestDistance = UINT32_MAX;
+                auto bestIndex = guess;
+                for (auto index = std::max(guess - 1, 0); index <= std::min(guess + 1, 15); index++)
+                {
+                    uint32_t distance = 0;
+                    for (int channel = 0; channel < 4; channel++)
+                    {
+                        auto delta = palette[index][channel] - pixel[channel];
+                        distance += delta * delta;
+                    }
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        bestIndex = index;
+                    }
+                }
+                indices[i] = bestIndex;
+                weights[i] = Bc7Weights[bestIndex] / 64.0f;
+                error += bestDistance;
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+
+                // The first index is stored with an implicit high bit of zero. If it
+                // doesn't fit, swap the endpoints and flip every index. The weights
+                // are symmetric, so this doesn't change the decoded colors.
+                auto swapped = indices[0] >= 8;
+                auto& first = swapped ? quantized[1] : quantized[0];
+                auto& second = swapped ? quantized[0] : quantized[1];
+                auto firstPbit = swapped ? pbits[1] : pbits[0];
+                auto secondPbit = swapped ? pbits[0] : pbits[1];
+
+                memset(output, 0, 16);
+                BitWriter writer{ output };
+                writer.Write(1u << 6, 7); // Mode 6
+                // Endpoints are stored R, G, B, A. Our channels are B, G, R, A.
+                for (auto channel : { 2, 1, 0, 3 })
+                {
+                    writer.Write(first[channel], 7);
+                    writer.Write(second[channel], 7);
+                }
+                writer.Write(firstPbit, 1);
+                writer.Write(secondPbit, 1);
+                for (int i = 0; i < 16; i++)
+                {
+                    auto index = swapped ? 15 - indices[i] : indices[i];
+                    writer.Write(index, i == 0 ? 3 : 4);
+                }
+            }
+
+            if (error == 0)
+            {
+                break;
+            }
+            RefineEndpoints<4>(block, weights, low, high);
+        }
+    }
+
+    void DecodeColorBlock(uint8_t const* input, bool allowThreeColor, uint8_t (&pixels)[16][4])
+    {
+        auto color0 = static_cast<uint16_t>(input[0] | (input[1] << 8));
+        auto color1 = static_cast<uint16_t>(input[2] | (input[3] << 8));
+        int palette[4][4];
+        BuildBc1Palette(color0, color1, !allowThreeColor || color0 > color1, palette);
+        for (int i = 0; i < 16; i++)
+        {
+            auto index = (input[4 + i / 4] >> (2 * (i % 4))) & 0x3;
+            for (int channel = 0; channel < 4; channel++)
+            {
+                pixels[i][channel] = static_cast<uint8_t>(palette[index][channel]);
+            }
+        }
+    }
+
+    void DecodeAlphaBlock(uint8_t const* input, uint8_t (&pixels)[16][4])
+    {
+        int alpha0 = input[0];
+        int alpha1 = input[1];
+        int palette[8] = { alpha0, alpha1 };
+        if (alpha0 > alpha1)
+        {
+            for (int index = 2; index < 8; index++)
+            {
+                palette[index] = ((8 - index) * alpha0 + (index - 1) * alpha1) / 7;
+            }
+        }
+        else
+        {
+            for (int index = 2; index < 6; index++)
+            {
+                palette[index] = ((6 - index) * alpha0 + (index - 1) * alpha1) / 5;
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        uint64_t bits = 0;
+        for (int i = 0; i < 6; i++)
+        {
+            bits |= static_cast<uint64_t>(input[2 + i]) << (8 * i);
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            pixels[i][3] = static_cast<uint8_t>(palette[(bits >> (3 * i)) & 0x7]);
+        }
+    }
+
+    void DecodeBc7Block(uint8_t const* input, uint8_t (&pixels)[16][4])
+    {
+        if ((input[0] & 0x7f) != 0x40)
+        {
+            // Not mode 6.
+            memset(pixels, 0, sizeof(pixels));
+            return;
+        }
+
+        BitReader reader{ input, 7 };
+        int endpoints[2][4];
+        for (auto channel : { 2, 1, 0, 3 })
+        {
+            endpoints[0][channel] = static_cast<int>(reader.Read(7));
+            endpoints[1][channel] = static_cast<int>(reader.Read(7));
+        }
+        auto pbit0 = static_cast<int>(reader.Read(1));
+        auto pbit1 = static_cast<int>(reader.Read(1));
+        for (int channel = 0; channel < 4; channel++)
+        {
+            endpoints[0][channel] = endpoints[0][channel] * 2 + pbit0;
+            endpoints[1][channel] = endpoints[1][channel] * 2 + pbit1;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            auto weight = Bc7Weights[reader.Read(i == 0 ? 3 : 4)];
+            for (int channel = 0; channel < 4; channel++)
+            {
+                pixels[i][channel] = static_cast<uint8_t>(((64 - weight) * endpoints[0][channel] + weight * endpoints[1][channel] + 32) >> 6);
+            }
+        }
+    }
+
+    // The parts of the DDS file format that we need.
+    constexpr uint32_t DdsMagic = 0x20534444; // "DDS "
+    constexpr uint32_t DdsHeaderSize = 124;
+    constexpr uint32_t DdsPixelFormatSize = 32;
+    constexpr uint32_t DdsFlags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x80000; // CAPS | HEIGHT | WIDTH | PIXELFORMAT | LINEARSIZE
+    constexpr uint32_t DdsPixelFormatFourCC = 0x4;
+    constexpr uint32_t DdsFourCCDX10 = 0x30315844; // "DX10"
+    constexpr uint32_t DdsCapsTexture = 0x1000;
+    constexpr uint32_t DdsDimensionTexture2D = 3;
+    constexpr uint32_t DdsAlphaModePremultiplied = 2;
+    constexpr uint32_t DdsAlphaModeOpaque = 3;
+    // The largest 2D texture D3D11 will make (D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION).
+    constexpr uint32_t MaxTextureDimension = 16384;
+    // Magic, the DDS header, and the DX10 header, as 32-bit words.
+    constexpr size_t DdsHeaderWords = 1 + DdsHeaderSize / 4 + 5;
+}
+
+uint32_t BlockSizeInBytes(BlockFormat format)
+{
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+uint32_t BlockFormatToDxgiFormat(BlockFormat format)
+{
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        return 71; // DXGI_FORMAT_BC1_UNORM
+    case BlockFormat::BC3:
+        return 77; // DXGI_FORMAT_BC3_UNORM
+    case BlockFormat::BC7:
+        return 98; // DXGI_FORMAT_BC7_UNORM
+    }
+    throw std::invalid_argument("Unknown block format");
+}
+
+bool HasTransparentPixels(PixelBuffer const& image)
+{
+    auto data = image.Bytes.data();
+    auto size = image.Bytes.size();
+    size_t i = 0;
+#ifdef IMAGE_DEMO_SSE2
+    // AND every pixel together, if the alpha bytes are still 0xFF at the end
+    // everything was opaque. Check each chunk so we can bail out early.
+    auto alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    constexpr size_t chunkSize = 4096;
+    while (SimdEnabled() && i + 16 <= size)
+    {
+        auto accumulator = _mm_set1_epi8(-1);
+        auto chunkEnd = std::min(size & ~static_cast<size_t>(15), i + chunkSize);
+        for (; i < chunkEnd; i += 16)
+        {
+            accumulator = _mm_and_si128(accumulator, _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + i)));
+        }
+        auto alpha = _mm_and_si128(accumulator, alphaMask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alphaMask)) != 0xFFFF)
+        {
+            return true;
+        }
+    }
+#endif
+    for (; i < size; i += 4)
+    {
+        if (data[i + 3] != 255)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+BlockFormat ChooseBlockFormat(PixelBuffer const& image, CompressionQuality quality)
+{
+    if (!HasTransparentPixels(image))
+    {
+        return BlockFormat::BC1;
+    }
+    return quality == CompressionQuality::Fast ? BlockFormat::BC3 : BlockFormat::BC7;
+}
+
+CompressedImage CompressImage(PixelBuffer const& image, BlockFormat format, CompressionQuality quality)
+{
+    if (image.Width == 0 || image.Height == 0)
+    {
+        throw std::invalid_argument("Can't compress an empty image");
+    }
+
+    CompressedImage result;
+    result.Format = format;
+    result.Width = image.Width;
+    result.Height = image.Height;
+    auto blockSize = BlockSizeInBytes(format);
+    auto blocksWide = result.BlocksWide();
+    result.Blocks.resize(static_cast<size_t>(blocksWide) * result.BlocksHigh() * blockSize);
+
+    ParallelFor(result.BlocksHigh(), [&](uint32_t blockY)
+        {
+            auto output = result.Blocks.data() + static_cast<size_t>(blockY) * blocksWide * blockSize;
+            Block block;
+            for (uint32_t blockX = 0; blockX < blocksWide; blockX++, output += blockSize)
+            {
+                LoadBlock(image, blockX, blockY, block);
+                switch (format)
+                {
+                case BlockFormat::BC1:
+                    EncodeColorBlock(block, quality, output);
+                    break;
+                case BlockFormat::BC3:
+                    EncodeAlphaBlock(block, output);
+                    EncodeColorBlock(block, quality, output + 8);
+                    break;
+                case BlockFormat::BC7:
+                    EncodeBc7Block(block, quality, output);
+                    break;
+                }
+            }
+        }, static_cast<uint64_t>(image.Width) * image.Height);
+
+    return result;
+}
+
+PixelBuffer DecompressImage(CompressedImage const& image)
+{
+    PixelBuffer result(image.Width, image.Height);
+    auto blockSize = BlockSizeInBytes(image.Format);
+    auto blocksWide = image.BlocksWide();
+    if (image.Blocks.size() < static_cast<size_t>(blocksWide) * image.BlocksHigh() * blockSize)
+    {
+        throw std::invalid_argument("Compressed image is truncated");
+    }
+
+    ParallelFor(image.BlocksHigh(), [&](uint32_t blockY)
+        {
+            auto input = image.Blocks.data() + static_cast<size_t>(blockY) * blocksWide * blockSize;
+            uint8_t pixels[16][4];
+            for (uint32_t blockX = 0; blockX < blocksWide; blockX++, input += blockSize)
+            {
+                switch (image.Format)
+                {
+                case BlockFormat::BC1:
+                    DecodeColorBlock(input, true, pixels);
+                    break;
+                case BlockFormat::BC3:
+                    DecodeColorBlock(input + 8, false, pixels);
+                    DecodeAlphaBlock(input, pixels);
+                    break;
+                case BlockFormat::BC7:
+                    DecodeBc7Block(input, pixels);
+                    break;
+                }
+
+                // Copy out whatever part of the block falls inside the image.
+                auto x = blockX * 4;
+                auto columns = std::min(4u, image.Width - x);
+                for (uint32_t row = 0; row < 4 && blockY * 4 + row < image.Height; row++)
+                {
+                    memcpy(result.Row(blockY * 4 + row) + x * 4, pixels[row * 4], columns * 4);
+                }
+            }
+        }, static_cast<uint64_t>(image.Width) * image.Height);
+
+    return result;
+}
+
+double ComputePsnr(PixelBuffer const& first, PixelBuffer const& second)
+{
+    if (first.Width != second.Width || first.Height != second.Height)
+    {
+        throw std::invalid_argument("Images must be the same size");
+    }
+
+    uint64_t sumOfSquares = 0;
+    for (size_t i = 0; i < first.Bytes.size(); i++)
+    {
+        auto delta = static_cast<int>(first.Bytes[i]) - static_cast<int>(second.Bytes[i]);
+        sumOfSquares += static_cast<uint64_t>(delta * delta);
+    }
+    if (sumOfSquares == 0)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    auto meanSquaredError = static_cast<double>(sumOfSquares) / static_cast<double>(first.Bytes.size());
+    return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+}
+
+void SaveCompressedImage(std::filesystem::path const& path, CompressedImage const& image)
+{
+    std::array<uint32_t, DdsHeaderWords> header = {};
+    header[0] = DdsMagic;
+    header[1] = DdsHeaderSize;
+    header[2] = DdsFlags;
+    header[3] = image.Height;
+    header[4] = image.Width;
+    header[5] = static_cast<uint32_t>(image.Blocks.size()); // pitchOrLinearSize
+    // Pixel format (starts at header[19])
+    header[19] = DdsPixelFormatSize;
+    header[20] = DdsPixelFormatFourCC;
+    header[21] = DdsFourCCDX10;
+    header[27] = DdsCapsTexture;
+    // DX10 header (starts at header[32])
+    header[32] = BlockFormatToDxgiFormat(image.Format);
+    header[33] = DdsDimensionTexture2D;
+    header[35] = 1; // arraySize
+    header[36] = image.Format == BlockFormat::BC1 ? DdsAlphaModeOpaque : DdsAlphaModePremultiplied;
+
+    // Write to a temporary file first so that a crash never leaves a
+    // half written file in the cache.
+    auto temporaryPath = path;
+    temporaryPath += L".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<char const*>(header.data()), sizeof(header));
+        file.write(reinterpret_cast<char const*>(image.Blocks.data()), image.Blocks.size());
+        if (!file)
+        {
+            throw std::runtime_error("Failed to write compressed image");
+        }
+    }
+    std::filesystem::rename(temporaryPath, path);
+}
+
+std::optional<CompressedImage> LoadCompressedImage(std::filesystem::path const& path)
+{
+    std::error_code error;
+    auto fileSize = std::filesystem::file_size(path, error);
+    std::ifstream file(path, std::ios::binary);
+    if (error || !file)
+    {
+        return std::nullopt;
+    }
+
+    std::array<uint32_t, DdsHeaderWords> header = {};
+    if (!file.read(reinterpret_cast<char*>(header.data()), sizeof(header)) ||
+        header[0] != DdsMagic ||
+        header[1] != DdsHeaderSize ||
+        header[21] != DdsFourCCDX10)
+    {
+        return std::nullopt;
+    }
+
+    CompressedImage image;
+    switch (header[32])
+    {
+    case 71:
+        image.Format = BlockFormat::BC1;
+        break;
+    case 77:
+        image.Format = BlockFormat::BC3;
+        break;
+    case 98:
+        image.Format = BlockFormat::BC7;
+        break;
+    default:
+        return std::nullopt;
+    }
+    image.Height = header[3];
+    image.Width = header[4];
+    // The size comes from the file, so check it's something we could make a
+    // texture from, and that the blocks are actually there before allocating
+    // room for them.
+    auto blocks = static_cast<uint64_t>(image.BlocksWide()) * image.BlocksHigh();
+    auto blockSize = BlockSizeInBytes(image.Format);
+    if (image.Width == 0 || image.Height == 0 ||
+        image.Width > MaxTextureDimension || image.Height > MaxTextureDimension ||
+        blocks > (fileSize - sizeof(header)) / blockSize)
+    {
+        return std::nullopt;
+    }
+    image.Blocks.resize(static_cast<size_t>(blocks * blockSize));
+    if (!file.read(reinterpret_cast<char*>(image.Blocks.data()), image.Blocks.size()))
+    {
+        return std::nullopt;
+    }
+    return image;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "PixelBuffer.h"
+
+// Block compressed formats we know how to produce. These map to
+// DXGI_FORMAT_BC1_UNORM, DXGI_FORMAT_BC3_UNORM, and DXGI_FORMAT_BC7_UNORM.
+//  BC1 - 8 bytes per 4x4 block (0.5 bytes per pixel). Opaque content only.
+//  BC3 - 16 bytes per block. BC1 color plus an interpolated alpha block.
+//  BC7 - 16 bytes per block. We only emit mode 6 (single subset RGBA), which
+//        handles alpha well and is simple enough to encode quickly.
+enum class BlockFormat
+{
+    BC1,
+    BC3,
+    BC7,
+};
+
+// Trades encode speed for quality.
+//  Fast     - bounding box endpoints.
+//  Balanced - endpoints along the principal axis of the block's colors.
+//  Best     - principal axis plus least squares refinement of the endpoints.
+enum class CompressionQuality
+{
+    Fast,
+    Balanced,
+    Best,
+};
+
+struct CompressedImage
+{
+    BlockFormat Format = BlockFormat::BC1;
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    std::vector<uint8_t> Blocks;
+
+    // Written so sizes near 4 GB don't wrap around to 0 blocks.
+    uint32_t BlocksWide() const { return Width / 4 + (Width % 4 != 0); }
+    uint32_t BlocksHigh() const { return Height / 4 + (Height % 4 != 0); }
+};
+
+uint32_t BlockSizeInBytes(BlockFormat format);
+// The DXGI_FORMAT value to use when creating a texture for the format.
+uint32_t BlockFormatToDxgiFormat(BlockFormat format);
+
+// Returns true if any pixel in the image isn't fully opaque.
+bool HasTransparentPixels(PixelBuffer const& image);
+// Opaque images go to BC1. Everything else goes to BC3, or BC7 when quality
+// matters more than encode time.
+BlockFormat ChooseBlockFormat(PixelBuffer const& image, CompressionQuality quality);
+
+// Block rows are encoded in parallel.
+CompressedImage CompressImage(PixelBuffer const& image, BlockFormat format, CompressionQuality quality);
+// CPU decoder, mostly useful for checking the quality of the encoder. BC7
+// blocks that don't use mode 6 decode to transparent black.
+PixelBuffer DecompressImage(CompressedImage const& image);
+// Peak signal-to-noise ratio across all four channels, in dB. Identical
+// images return infinity.
+double ComputePsnr(PixelBuffer const& first, PixelBuffer const& second);
+
+// Compressed images are cached on disk as DDS files (with the DX10 header), so
+// they can also be inspected with the usual texture tools.
+void SaveCompressedImage(std::filesystem::path const& path, CompressedImage const& image);
+// Returns std::nullopt if the file doesn't exist or isn't something we wrote.
+std::optional<CompressedImage> LoadCompressedImage(std::filesystem::path const& path);
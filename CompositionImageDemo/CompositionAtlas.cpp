@@ -0,0 +1,86 @@
+#include "pch.h"
+#include "CompositionAtlas.h"
+#include "CompositionSurfaceBackend.h"
+
+namespace winrt
+{
+    using namespace Windows::Graphics::DirectX;
+    using namespace Windows::UI::Composition;
+}
+
+CompositionAtlas::CompositionAtlas(
+    winrt::CompositionGraphicsDevice const& compositionGraphics,
+    uint32_t pageSize) : m_atlas(pageSize, pageSize)
+{
+    m_compositor = compositionGraphics.Compositor();
+    m_compositionGraphics = compositionGraphics;
+}
+
+AtlasImageId CompositionAtlas::Add(PixelBuffer image)
+{
+    auto id = m_atlas.Insert(image.Width, image.Height);
+    EnsurePages();
+
+    Image entry;
+    entry.Pixels = std::move(image);
+    // Line the top-left corner of the page up with the top-left corner of the
+    // visual, then slide the page over so our image is what lands there.
+    entry.Brush = m_compositor.CreateSurfaceBrush();
+    entry.Brush.Stretch(winrt::CompositionStretch::None);
+    entry.Brush.HorizontalAlignmentRatio(0.0f);
+    entry.Brush.VerticalAlignmentRatio(0.0f);
+    auto& stored = m_images.emplace(id, std::move(entry)).first->second;
+    Upload(id, stored);
+    return id;
+}
+
+void CompositionAtlas::Remove(AtlasImageId id)
+{
+    m_atlas.Remove(id);
+    m_images.erase(id);
+
+    if (m_atlas.NeedsDefragment())
+    {
+        for (auto&& move : m_atlas.Defragment())
+        {
+            Upload(move.Id, m_images.at(move.Id));
+        }
+        // Pages past the end are empty now.
+        m_pages.resize(m_atlas.PageCount(), nullptr);
+    }
+}
+
+winrt::CompositionSurfaceBrush CompositionAtlas::Brush(AtlasImageId id) const
+{
+    return m_images.at(id).Brush;
+}
+
+void CompositionAtlas::Redraw()
+{
+    for (auto&& [id, image] : m_images)
+    {
+        Upload(id, image);
+    }
+}
+
+void CompositionAtlas::EnsurePages()
+{
+    while (m_pages.size() < m_atlas.PageCount())
+    {
+        m_pages.push_back(m_compositionGraphics.CreateDrawingSurface(
+            { static_cast<float>(m_atlas.PageWidth()), static_cast<float>(m_atlas.PageHeight()) },
+            winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized,
+            winrt::DirectXAlphaMode::Premultiplied));
+    }
+}
+
+void CompositionAtlas::Upload(AtlasImageId id, Image& image)
+{
+    auto entry = m_atlas.Find(id).value();
+    auto& page = m_pages[entry.Page];
+    CompositionSurfaceBackend backend(page);
+    UploadRegion(backend, entry.Rect, image.Pixels.Bytes.data(), image.Pixels.Stride());
+
+    image.Brush.Surface(page);
+    image.Brush.Offset({ -static_cast<float>(entry.Rect.X), -static_cast<float>(entry.Rect.Y) });
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "AtlasPacker.h"
+
+// Backs an ImageAtlas with composition surfaces, one per page, and gives each
+// image a brush that only shows its part of the page. Use the brush on a
+// visual the size of the image.
+//
+// A CPU copy of every image is kept so that pixels can be uploaded again when
+// the atlas is defragmented or the device is lost.
+class CompositionAtlas
+{
+public:
+    CompositionAtlas(
+        winrt::Windows::UI::Composition::CompositionGraphicsDevice const& compositionGraphics,
+        uint32_t pageSize = 2048);
+
+    AtlasImageId Add(PixelBuffer image);
+    // Defragments the atlas once enough of it has been freed.
+    void Remove(AtlasImageId id);
+    winrt::Windows::UI::Composition::CompositionSurfaceBrush Brush(AtlasImageId id) const;
+    // Uploads every image again, e.g. after the rendering device was replaced.
+    void Redraw();
+
+    ImageAtlas const& Atlas() const { return m_atlas; }
+
+private:
+    struct Image
+    {
+        PixelBuffer Pixels;
+        winrt::Windows::UI::Composition::CompositionSurfaceBrush Brush{ nullptr };
+    };
+
+    void EnsurePages();
+    void Upload(AtlasImageId id, Image& image);
+
+    winrt::Windows::UI::Composition::Compositor m_compositor{ nullptr };
+    winrt::Windows::UI::Composition::CompositionGraphicsDevice m_compositionGraphics{ nullptr };
+    ImageAtlas m_atlas;
+    std::vector<winrt::Windows::UI::Composition::CompositionDrawingSurface> m_pages;
+    std::map<AtlasImageId, Image> m_images;
+};
@@ -0,0 +1,129 @@
+#include "pch.h"
+#include "CompositionRenderDevice.h"
+#include "D3D11UploadFence.h"
+#include "D3D11UploadPage.h"
+
+namespace winrt
+{
+    using namespace Windows::Graphics::DirectX;
+    using namespace Windows::UI::Composition;
+}
+
+namespace
+{
+    winrt::DirectXPixelFormat ToDirectXPixelFormat(SurfaceFormat format)
+    {
+        switch (format)
+        {
+        case SurfaceFormat::B8G8R8A8:
+            return winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized;
+        case SurfaceFormat::B5G6R5:
+            return winrt::DirectXPixelFormat::B5G6R5UIntNormalized;
+        case SurfaceFormat::B4G4R4A4:
+            return winrt::DirectXPixelFormat::B4G4R4A4UIntNormalized;
+        }
+        throw std::invalid_argument("Unknown surface format");
+    }
+}
+
+CompositionRenderDevice::CompositionRenderDevice(winrt::CompositionGraphicsDevice const& compositionGraphics)
+{
+    m_compositionGraphics = compositionGraphics;
+    UseRenderingDevice();
+    m_deviceReplaced = m_compositionGraphics.RenderingDeviceReplaced(winrt::auto_revoke, [this](auto&&, auto&&)
+        {
+            UseRenderingDevice();
+            RaiseDeviceReplaced();
+        });
+}
+
+void CompositionRenderDevice::UseRenderingDevice()
+{
+    auto graphicsDeviceInterop = m_compositionGraphics.as<ABI::Windows::UI::Composition::ICompositionGraphicsDeviceInterop>();
+    winrt::com_ptr<IUnknown> unknown;
+    winrt::check_hresult(graphicsDeviceInterop->GetRenderingDevice(unknown.put()));
+    auto d3dDevice = unknown.as<ID3D11Device>();
+    winrt::com_ptr<ID3D11DeviceContext> d3dContext;
+    d3dDevice->GetImmediateContext(d3dContext.put());
+    // Decodes finish on the thread pool and stage their pixels from there, so the
+    // context needs to be safe to use from more than one thread.
+    d3dContext.as<ID3D11Multithread>()->SetMultithreadProtected(TRUE);
+
+    std::lock_guard lock(m_lock);
+    m_d3dDevice = std::move(d3dDevice);
+    m_d3dContext = std::move(d3dContext);
+}
+
+std::shared_ptr<SurfaceBackend> CompositionRenderDevice::CreateSurface(SurfaceFormat format)
+{
+    return CreateCompositionSurface(format);
+}
+
+std::shared_ptr<CompositionSurfaceBackend> CompositionRenderDevice::CreateCompositionSurface(SurfaceFormat format, bool virtualSurface)
+{
+    auto pixelFormat = ToDirectXPixelFormat(format);
+    // B5G6R5 has no alpha channel, so those surfaces are opaque.
+    auto alphaMode = format == SurfaceFormat::B5G6R5 ? winrt::DirectXAlphaMode::Ignore : winrt::DirectXAlphaMode::Premultiplied;
+    // Surfaces are created with the minimum size and resized once we know how big the image is.
+    winrt::CompositionDrawingSurface surface{ nullptr };
+    if (virtualSurface)
+    {
+        surface = m_compositionGraphics.CreateVirtualDrawingSurface({ 1, 1 }, pixelFormat, alphaMode);
+    }
+    else
+    {
+        surface = m_compositionGraphics.CreateDrawingSurface({ 1, 1 }, pixelFormat, alphaMode);
+    }
+    return std::make_shared<CompositionSurfaceBackend>(surface);
+}
+
+winrt::CompositionSurfaceBrush CompositionRenderDevice::CreatePooledSurfaceBrush(
+    winrt::Compositor const& compositor,
+    PooledSurface const& surface)
+{
+    auto backend = std::dynamic_pointer_cast<CompositionSurfaceBackend>(surface.Surface);
+    if (!backend)
+    {
+        throw std::invalid_argument("Not a composition surface");
+    }
+    // The image is in the top-left corner. Drawing it unstretched from that corner
+    // on a visual the size of the image leaves the padding outside the visual.
+    auto brush = compositor.CreateSurfaceBrush(backend->Surface());
+    brush.Stretch(winrt::CompositionStretch::None);
+    brush.HorizontalAlignmentRatio(0.0f);
+    brush.VerticalAlignmentRatio(0.0f);
+    return brush;
+}
+
+std::unique_ptr<UploadPage> CompositionRenderDevice::CreateUploadPage(SurfaceFormat format, uint32_t width, uint32_t height)
+{
+    std::lock_guard lock(m_lock);
+    return std::make_unique<D3D11UploadPage>(m_d3dDevice, format, width, height);
+}
+
+std::shared_ptr<UploadFence> CompositionRenderDevice::CreateUploadFence()
+{
+    std::lock_guard lock(m_lock);
+    return std::make_shared<D3D11UploadFence>(m_d3dContext);
+}
+
+void CompositionRenderDevice::BeginUploads()
+{
+    winrt::com_ptr<ID3D11DeviceContext> d3dContext;
+    {
+        std::lock_guard lock(m_lock);
+        d3dContext = m_d3dContext;
+    }
+    // Hold the context for the whole batch.
+    d3dContext.as<ID3D11Multithread>()->Enter();
+    m_batchContext = std::move(d3dContext);
+}
+
+void CompositionRenderDevice::EndUploads()
+{
+    auto d3dContext = std::move(m_batchContext);
+    WINRT_ASSERT(d3dContext);
+    // Flush once at the end, rather than once per upload.
+    d3dContext->Flush();
+    d3dContext.as<ID3D11Multithread>()->Leave();
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "RenderDevice.h"
+#include "CompositionSurfaceBackend.h"
+#include "SurfacePool.h"
+
+// A RenderDevice for a CompositionGraphicsDevice and the D3D device behind it.
+// Uploads happen from more than one thread, so the context is made
+// multithread protected, and every batch holds its lock and flushes it once at
+// the end. The DeviceReplaced handlers are called from the graphics device's
+// RenderingDeviceReplaced event, once we've switched over to the new D3D device.
+class CompositionRenderDevice : public RenderDevice
+{
+public:
+    CompositionRenderDevice(winrt::Windows::UI::Composition::CompositionGraphicsDevice const& compositionGraphics);
+
+    std::shared_ptr<SurfaceBackend> CreateSurface(SurfaceFormat format) override;
+    std::unique_ptr<UploadPage> CreateUploadPage(SurfaceFormat format, uint32_t width, uint32_t height) override;
+    std::shared_ptr<UploadFence> CreateUploadFence() override;
+    void BeginUploads() override;
+    void EndUploads() override;
+
+    // Virtual surfaces can hold images bigger than the largest texture the GPU
+    // supports, and let go of the memory behind parts of them with Trim.
+    std::shared_ptr<CompositionSurfaceBackend> CreateCompositionSurface(SurfaceFormat format, bool virtualSurface = false);
+    // A brush that only shows the part of a pooled surface the image is in. Use
+    // it on a visual the size of the image.
+    winrt::Windows::UI::Composition::CompositionSurfaceBrush CreatePooledSurfaceBrush(
+        winrt::Windows::UI::Composition::Compositor const& compositor,
+        PooledSurface const& surface);
+
+    winrt::Windows::UI::Composition::CompositionGraphicsDevice const& CompositionGraphics() const { return m_compositionGraphics; }
+
+private:
+    void UseRenderingDevice();
+
+    winrt::Windows::UI::Composition::CompositionGraphicsDevice m_compositionGraphics{ nullptr };
+    winrt::Windows::UI::Composition::CompositionGraphicsDevice::RenderingDeviceReplaced_revoker m_deviceReplaced;
+
+    std::mutex m_lock;
+    winrt::com_ptr<ID3D11Device> m_d3dDevice;
+    winrt::com_ptr<ID3D11DeviceContext> m_d3dContext;
+    // The context the current batch started on, in case the device is replaced mid-batch.
+    winrt::com_ptr<ID3D11DeviceContext> m_batchContext;
+};
@@ -0,0 +1,150 @@
+#include "pch.h"
+#include "CompositionSurfaceBackend.h"
+#include "D3D11UploadPage.h"
+
+namespace winrt
+{
+    using namespace Windows::Graphics::DirectX;
+    using namespace Windows::UI::Composition;
+}
+
+namespace
+{
+    // Surface calls fail with these once the device is gone. The pipeline
+    // treats them like any other lost device.
+    void CheckSurfaceResult(HRESULT result)
+    {
+        if (result == DXGI_ERROR_DEVICE_REMOVED || result == DXGI_ERROR_DEVICE_RESET)
+        {
+            throw DeviceLostError();
+        }
+        winrt::check_hresult(result);
+    }
+}
+
+CompositionSurfaceBackend::CompositionSurfaceBackend(winrt::CompositionDrawingSurface const& surface)
+{
+    m_surface = surface;
+    // Since we're going to interop with D3D, we'll need the inteorp COM interface from the surface.
+    m_surfaceInterop = surface.as<ABI::Windows::UI::Composition::ICompositionDrawingSurfaceInterop>();
+}
+
+uint32_t CompositionSurfaceBackend::Width() const
+{
+    return static_cast<uint32_t>(m_surface.SizeInt32().Width);
+}
+
+uint32_t CompositionSurfaceBackend::Height() const
+{
+    return static_cast<uint32_t>(m_surface.SizeInt32().Height);
+}
+
+SurfaceFormat CompositionSurfaceBackend::Format() const
+{
+    switch (m_surface.PixelFormat())
+    {
+    case winrt::DirectXPixelFormat::B5G6R5UIntNormalized:
+        return SurfaceFormat::B5G6R5;
+    case winrt::DirectXPixelFormat::B4G4R4A4UIntNormalized:
+        return SurfaceFormat::B4G4R4A4;
+    default:
+        WINRT_ASSERT(m_surface.PixelFormat() == winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized);
+        return SurfaceFormat::B8G8R8A8;
+    }
+}
+
+void CompositionSurfaceBackend::Resize(uint32_t width, uint32_t height)
+{
+    CheckSurfaceResult(m_surfaceInterop->Resize({ static_cast<LONG>(width), static_cast<LONG>(height) }));
+}
+
+SurfacePoint CompositionSurfaceBackend::BeginDraw(SurfaceRect const* updateRect)
+{
+    RECT rect = {};
+    if (updateRect != nullptr)
+    {
+        rect.left = updateRect->X;
+        rect.top = updateRect->Y;
+        rect.right = updateRect->X + static_cast<LONG>(updateRect->Width);
+        rect.bottom = updateRect->Y + static_cast<LONG>(updateRect->Height);
+    }
+
+    // Here we get the underlying D3D texture for our surface. Because composition surfaces come from an
+    // atlas, we need to write our data at an offset. 
+    POINT offset = {};
+    CheckSurfaceResult(m_surfaceInterop->BeginDraw(updateRect != nullptr ? &rect : nullptr, winrt::guid_of<ID3D11Texture2D>(), m_surfaceTexture.put_void(), &offset));
+    // Whatever device the surface is on right now is the one we need to write with.
+    winrt::com_ptr<ID3D11Device> d3dDevice;
+    m_surfaceTexture->GetDevice(d3dDevice.put());
+    d3dDevice->GetImmediateContext(m_d3dContext.put());
+    return { offset.x, offset.y };
+}
+
+void CompositionSurfaceBackend::WritePixels(SurfacePoint atlasPosition, uint32_t width, uint32_t height, uint8_t const* pixels, uint32_t rowPitch)
+{
+    WINRT_ASSERT(m_surfaceTexture);
+    D3D11_BOX box = {};
+    box.left = static_cast<UINT>(atlasPosition.X);
+    box.top = static_cast<UINT>(atlasPosition.Y);
+    box.front = 0;
+    box.right = box.left + width;
+    box.bottom = box.top + height;
+    box.back = 1;
+    m_d3dContext->UpdateSubresource(
+        m_surfaceTexture.get(),
+        0, // We only have one subresource
+        &box,
+        pixels,
+        rowPitch,
+        0); // Only used for 3D textures
+}
+
+void CompositionSurfaceBackend::CopyPixels(SurfacePoint atlasPosition, UploadAllocation const& source)
+{
+    WINRT_ASSERT(m_surfaceTexture);
+    auto page = dynamic_cast<D3D11UploadPage const*>(source.Page);
+    if (page == nullptr)
+    {
+        throw std::invalid_argument("Composition surfaces can only copy from D3D11UploadPages");
+    }
+    // If the surface has moved to a new device, the page is from the old one.
+    winrt::com_ptr<ID3D11Device> d3dDevice;
+    m_surfaceTexture->GetDevice(d3dDevice.put());
+    if (d3dDevice.get() != page->Device())
+    {
+        throw DeviceLostError();
+    }
+    D3D11_BOX box = {};
+    box.left = source.X;
+    box.top = source.Y;
+    box.front = 0;
+    box.right = source.X + source.Width;
+    box.bottom = source.Y + source.Height;
+    box.back = 1;
+    m_d3dContext->CopySubresourceRegion(
+        m_surfaceTexture.get(),
+        0,
+        static_cast<UINT>(atlasPosition.X),
+        static_cast<UINT>(atlasPosition.Y),
+        0,
+        page->Texture(),
+        0,
+        &box);
+}
+
+void CompositionSurfaceBackend::EndDraw()
+{
+    m_surfaceTexture = nullptr;
+    m_d3dContext = nullptr;
+    CheckSurfaceResult(m_surfaceInterop->EndDraw());
+}
+
+void CompositionSurfaceBackend::Trim(SurfaceRect const& rect)
+{
+    // Regular drawing surfaces are backed by a single allocation, there's nothing to give back.
+    if (auto virtualSurface = m_surface.try_as<winrt::CompositionVirtualDrawingSurface>())
+    {
+        std::array<winrt::Windows::Graphics::RectInt32, 1> rects = { { { rect.X, rect.Y, static_cast<int32_t>(rect.Width), static_cast<int32_t>(rect.Height) } } };
+        virtualSurface.Trim(rects);
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "SurfaceBackend.h"
+
+// A SurfaceBackend for a CompositionDrawingSurface. Pixels are written
+// straight into the surface's atlas texture with UpdateSubresource, instead of
+// creating a texture for the image and then copying it over. The context comes
+// from the texture BeginDraw hands back, so the backend keeps working after the
+// rendering device has been replaced.
+class CompositionSurfaceBackend : public SurfaceBackend
+{
+public:
+    CompositionSurfaceBackend(winrt::Windows::UI::Composition::CompositionDrawingSurface const& surface);
+
+    uint32_t Width() const override;
+    uint32_t Height() const override;
+    SurfaceFormat Format() const override;
+
+    void Resize(uint32_t width, uint32_t height) override;
+    SurfacePoint BeginDraw(SurfaceRect const* updateRect) override;
+    void WritePixels(SurfacePoint atlasPosition, uint32_t width, uint32_t height, uint8_t const* pixels, uint32_t rowPitch) override;
+    // A GPU copy out of a D3D11UploadPage, rather than UpdateSubresource.
+    void CopyPixels(SurfacePoint atlasPosition, UploadAllocation const& source) override;
+    void EndDraw() override;
+    void Trim(SurfaceRect const& rect) override;
+
+    winrt::Windows::UI::Composition::CompositionDrawingSurface const& Surface() const { return m_surface; }
+
+private:
+    winrt::Windows::UI::Composition::CompositionDrawingSurface m_surface{ nullptr };
+    winrt::com_ptr<ABI::Windows::UI::Composition::ICompositionDrawingSurfaceInterop> m_surfaceInterop;
+    // Only valid between BeginDraw and EndDraw.
+    winrt::com_ptr<ID3D11Texture2D> m_surfaceTexture;
+    winrt::com_ptr<ID3D11DeviceContext> m_d3dContext;
+};
@@ -0,0 +1,145 @@
+#include "pch.h"
+#include "CompositionTileLoader.h"
+
+namespace winrt
+{
+    using namespace Windows::Graphics;
+    using namespace Windows::Graphics::Imaging;
+    using namespace Windows::System;
+}
+
+CompositionTileLoader::CompositionTileLoader(
+    winrt::DispatcherQueue const& dispatcherQueue,
+    std::shared_ptr<ImagePipeline> pipeline,
+    winrt::SizeInt32 const& viewSize)
+{
+    m_dispatcherQueue = dispatcherQueue;
+    m_pipeline = std::move(pipeline);
+    m_viewSize = viewSize;
+}
+
+winrt::SizeInt32 CompositionTileLoader::ViewSize()
+{
+    std::lock_guard lock(m_lock);
+    return m_viewSize;
+}
+
+void CompositionTileLoader::SetViewSize(winrt::SizeInt32 const& viewSize)
+{
+    {
+        std::lock_guard lock(m_lock);
+        m_viewSize = viewSize;
+    }
+    if (m_tiles)
+    {
+        m_tiles->SetViewport(Viewport());
+        LoadVisibleTilesAsync();
+    }
+}
+
+SurfaceRect CompositionTileLoader::Viewport()
+{
+    auto size = ViewSize();
+    auto width = static_cast<int32_t>(m_surface->Width());
+    auto height = static_cast<int32_t>(m_surface->Height());
+    SurfaceRect viewport = {};
+    viewport.X = (width - size.Width) / 2;
+    viewport.Y = (height - size.Height) / 2;
+    viewport.Width = static_cast<uint32_t>(std::max(size.Width, 0));
+    viewport.Height = static_cast<uint32_t>(std::max(size.Height, 0));
+    return viewport;
+}
+
+std::future<void> CompositionTileLoader::ShowAsync(
+    std::shared_ptr<SurfaceBackend> surface,
+    winrt::BitmapDecoder decoder)
+{
+    auto self = shared_from_this();
+    co_await winrt::resume_foreground(m_dispatcherQueue);
+
+    // Awaiting WinRT operations brings us back to this thread.
+    auto frame = co_await decoder.GetFrameAsync(0);
+    auto width = frame.PixelWidth();
+    auto height = frame.PixelHeight();
+    surface->Resize(width, height);
+
+    m_generation++;
+    m_surface = std::move(surface);
+    m_frame = frame;
+    m_tiles = std::make_unique<TileManager>(width, height);
+    m_tiles->SetViewport(Viewport());
+    co_await LoadVisibleTilesAsync();
+}
+
+std::future<void> CompositionTileLoader::LoadVisibleTilesAsync()
+{
+    auto self = shared_from_this();
+    // Only one load runs at a time. Whatever it's doing, it picks up the
+    // latest viewport each time it asks for a tile.
+    if (m_loading)
+    {
+        co_return;
+    }
+    m_loading = true;
+    auto generation = m_generation;
+    auto surface = m_surface;
+    auto frame = m_frame;
+
+    while (generation == m_generation)
+    {
+        auto tile = m_tiles->NextTileToLoad();
+        if (!tile)
+        {
+            break;
+        }
+
+        // Only decode the part of the image this tile covers. Orientation isn't
+        // applied to tiled images, the bounds are in stored pixel coordinates.
+        auto rect = m_tiles->TileRect(*tile);
+        winrt::BitmapTransform transform;
+        transform.Bounds({ static_cast<uint32_t>(rect.X), static_cast<uint32_t>(rect.Y), rect.Width, rect.Height });
+        winrt::PixelDataProvider pixelData{ nullptr };
+        try
+        {
+            pixelData = co_await frame.GetPixelDataAsync(
+                winrt::BitmapPixelFormat::Bgra8,
+                winrt::BitmapAlphaMode::Premultiplied,
+                transform,
+                winrt::ExifOrientationMode::IgnoreExifOrientation,
+                winrt::ColorManagementMode::DoNotColorManage);
+        }
+        catch (winrt::hresult_error const&)
+        {
+        }
+        if (generation != m_generation)
+        {
+            break;
+        }
+        if (!pixelData)
+        {
+            // It's queued again, and gets another go the next time the view changes.
+            m_tiles->TileFailed(*tile);
+            break;
+        }
+        auto bytes = pixelData.DetachPixelData();
+        auto tileImage = std::make_shared<PixelBuffer>(rect.Width, rect.Height);
+        tileImage->Bytes.assign(bytes.begin(), bytes.end());
+
+        // Neighbouring tiles that land in the same batch are written with a
+        // single BeginDraw.
+        m_pipeline->Upload(surface, std::move(tileImage), rect);
+
+        // Give back the memory behind tiles that haven't been on screen for a while.
+        for (auto&& evicted : m_tiles->TileLoaded(*tile))
+        {
+            surface->Trim(m_tiles->TileRect(evicted));
+        }
+    }
+    m_loading = false;
+
+    // A new image came along while we were loading the old one.
+    if (generation != m_generation)
+    {
+        co_await LoadVisibleTilesAsync();
+    }
+}
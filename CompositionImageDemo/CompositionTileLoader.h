@@ -0,0 +1,50 @@
+#pragma once
+#include "ImagePipeline.h"
+#include "TileManager.h"
+
+// Loads an image that's too big for a single texture into a virtual surface,
+// a tile at a time, and keeps up with the part of it that's on screen as the
+// window changes size. The brush centers the image, so the middle of the image
+// is what's visible.
+//
+// The surface is only resized and trimmed on the dispatcher queue's thread,
+// which is the thread the compositor runs on, and the TileManager lives there
+// too. Only the tile decodes themselves run elsewhere, inside WIC.
+class CompositionTileLoader : public std::enable_shared_from_this<CompositionTileLoader>
+{
+public:
+    CompositionTileLoader(
+        winrt::Windows::System::DispatcherQueue const& dispatcherQueue,
+        std::shared_ptr<ImagePipeline> pipeline,
+        winrt::Windows::Graphics::SizeInt32 const& viewSize);
+
+    // Can be called from any thread.
+    winrt::Windows::Graphics::SizeInt32 ViewSize();
+    // Call on the dispatcher queue's thread. Loads whatever tiles just came
+    // into view.
+    void SetViewSize(winrt::Windows::Graphics::SizeInt32 const& viewSize);
+
+    // Can be called from any thread. Replaces whatever image was being shown
+    // and starts loading the tiles that are visible.
+    std::future<void> ShowAsync(
+        std::shared_ptr<SurfaceBackend> surface,
+        winrt::Windows::Graphics::Imaging::BitmapDecoder decoder);
+
+private:
+    SurfaceRect Viewport();
+    std::future<void> LoadVisibleTilesAsync();
+
+    winrt::Windows::System::DispatcherQueue m_dispatcherQueue{ nullptr };
+    std::shared_ptr<ImagePipeline> m_pipeline;
+
+    std::mutex m_lock;
+    winrt::Windows::Graphics::SizeInt32 m_viewSize = {};
+
+    // Everything below is only touched on the dispatcher queue's thread.
+    std::shared_ptr<SurfaceBackend> m_surface;
+    winrt::Windows::Graphics::Imaging::BitmapFrame m_frame{ nullptr };
+    std::unique_ptr<TileManager> m_tiles;
+    // Bumped for every image, so a load that's still going for the last one stops.
+    uint64_t m_generation = 0;
+    bool m_loading = false;
+};
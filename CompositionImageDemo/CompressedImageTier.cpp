@@ -0,0 +1,146 @@
+#include "pch.h"
+#include "CompressedImageTier.h"
+
+CompressedImageTier::CompressedImageTier(CompressedTierOptions const& options)
+{
+    if (options.PromoteAfterHits == 0)
+    {
+        throw std::invalid_argument("Images need at least one hit to be promoted");
+    }
+    if (options.BandHeight == 0)
+    {
+        throw std::invalid_argument("Bands need at least one row");
+    }
+    m_options = options;
+}
+
+void CompressedImageTier::Demote(ImageKey const& key, PixelBuffer const& image)
+{
+    {
+        std::lock_guard lock(m_lock);
+        if (m_index.find(key) != m_index.end())
+        {
+            return;
+        }
+    }
+
+    if (!SampleCompresses(image))
+    {
+        std::lock_guard lock(m_lock);
+        m_stats.Incompressible++;
+        m_stats.RejectedBySample++;
+        return;
+    }
+
+    auto compressed = std::make_shared<QoiImage const>(EncodeQoi(image, m_options.BandHeight));
+    uint64_t bytes = compressed->Bytes();
+    uint64_t rawBytes = image.Bytes.size();
+
+    std::lock_guard lock(m_lock);
+    if (bytes > rawBytes * m_options.MaxCompressedRatio || bytes > m_options.BudgetBytes)
+    {
+        m_stats.Incompressible++;
+        return;
+    }
+    // Someone else demoted the same image while we were compressing it.
+    if (m_index.find(key) != m_index.end())
+    {
+        return;
+    }
+    while (m_stats.BytesUsed + bytes > m_options.BudgetBytes)
+    {
+        EraseLocked(std::prev(m_entries.end()));
+        m_stats.Evictions++;
+    }
+    m_entries.push_front({ key, std::move(compressed), bytes, rawBytes, 0 });
+    m_index.emplace(key, m_entries.begin());
+    m_stats.BytesUsed += bytes;
+    m_stats.RawBytes += rawBytes;
+    m_stats.Demotions++;
+}
+
+bool CompressedImageTier::SampleCompresses(PixelBuffer const& image) const
+{
+    // Only worth it when the sample is a small part of the image.
+    auto bands = (image.Height + m_options.BandHeight - 1) / m_options.BandHeight;
+    if (m_options.SampleBands == 0 || bands < m_options.SampleBands * 4)
+    {
+        return true;
+    }
+
+    uint64_t sampledBytes = 0;
+    uint64_t compressedBytes = 0;
+    PixelBuffer band(image.Width, m_options.BandHeight);
+    for (uint32_t i = 0; i < m_options.SampleBands; i++)
+    {
+        // The middle of each of SampleBands equal stretches of the image.
+        auto index = static_cast<uint32_t>((2 * i + 1) * static_cast<uint64_t>(bands - 1) / (2 * m_options.SampleBands));
+        std::memcpy(band.Bytes.data(), image.Row(index * m_options.BandHeight), band.Bytes.size());
+        sampledBytes += band.Bytes.size();
+        compressedBytes += EncodeQoi(band, m_options.BandHeight).Bytes();
+    }
+    return compressedBytes <= sampledBytes * m_options.MaxCompressedRatio;
+}
+
+std::optional<CompressedTierHit> CompressedImageTier::Find(ImageKey const& key, uint64_t maxPromoteBytes)
+{
+    std::shared_ptr<QoiImage const> image;
+    CompressedTierHit hit;
+    {
+        std::lock_guard lock(m_lock);
+        auto found = m_index.find(key);
+        if (found == m_index.end())
+        {
+            m_stats.Misses++;
+            return std::nullopt;
+        }
+        m_stats.Hits++;
+        auto entry = found->second;
+        image = entry->Image;
+        if (++entry->Hits >= m_options.PromoteAfterHits && entry->RawBytes <= maxPromoteBytes)
+        {
+            hit.Promote = true;
+            m_stats.Promotions++;
+            EraseLocked(entry);
+        }
+        else
+        {
+            m_entries.splice(m_entries.begin(), m_entries, entry);
+        }
+    }
+    hit.Pixels = DecodeQoi(*image);
+    return hit;
+}
+
+void CompressedImageTier::EraseLocked(std::list<Entry>::iterator entry)
+{
+    m_stats.BytesUsed -= entry->Bytes;
+    m_stats.RawBytes -= entry->RawBytes;
+    m_index.erase(entry->Key);
+    m_entries.erase(entry);
+}
+
+void CompressedImageTier::Erase(ImageKey const& key)
+{
+    std::lock_guard lock(m_lock);
+    auto found = m_index.find(key);
+    if (found != m_index.end())
+    {
+        EraseLocked(found->second);
+    }
+}
+
+void CompressedImageTier::Clear()
+{
+    std::lock_guard lock(m_lock);
+    m_entries.clear();
+    m_index.clear();
+    m_stats.BytesUsed = 0;
+    m_stats.RawBytes = 0;
+}
+
+CompressedTierStats CompressedImageTier::Stats()
+{
+    std::lock_guard lock(m_lock);
+    return m_stats;
+}
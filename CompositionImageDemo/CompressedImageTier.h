@@ -0,0 +1,95 @@
+#pragma once
+#include "DecodedImageCache.h"
+#include "QoiCodec.h"
+
+struct CompressedTierOptions
+{
+    uint64_t BudgetBytes = 128 * 1024 * 1024;
+    // An image goes back up to the raw cache on its Nth hit here. Until then,
+    // each hit decodes a copy for the caller and the compressed one stays put.
+    uint32_t PromoteAfterHits = 2;
+    // Images that don't compress to at most this fraction of their raw size
+    // aren't kept. Noisy photos often don't, and for those a decode from disk
+    // isn't much slower than decompressing would be.
+    double MaxCompressedRatio = 0.6;
+    uint32_t BandHeight = 64;
+    // Before compressing a large image, this many bands spread over it are
+    // compressed on their own. If they don't get under MaxCompressedRatio the
+    // image is dropped without compressing the rest. 0 always compresses the
+    // whole image.
+    uint32_t SampleBands = 4;
+};
+
+struct CompressedTierStats
+{
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+    uint64_t Demotions = 0;
+    uint64_t Promotions = 0;
+    uint64_t Evictions = 0;
+    // Demoted images that were dropped for not compressing well enough.
+    uint64_t Incompressible = 0;
+    // How many of those were caught by the sample, without a full compress.
+    uint64_t RejectedBySample = 0;
+    uint64_t BytesUsed = 0;
+    // What the images held would take up decoded.
+    uint64_t RawBytes = 0;
+
+    double CompressionRatio() const { return RawBytes > 0 ? static_cast<double>(BytesUsed) / RawBytes : 0.0; }
+};
+
+struct CompressedTierHit
+{
+    PixelBuffer Pixels;
+    // The image has been hit often enough to go back in the raw cache, and has
+    // been removed from this tier. The caller should insert it there.
+    bool Promote = false;
+};
+
+// The tier below DecodedImageCache. Images the raw cache evicts are kept here
+// losslessly compressed (see QoiCodec.h), so many more fit in the same memory.
+// A hit costs a decompress, which is slower than a raw cache hit but a lot
+// faster than decoding the file again. Least recently used goes first.
+//
+//  auto tier = std::make_shared<CompressedImageTier>();
+//  cache->OnEvicted([tier](auto&& key, auto&& image) { tier->Demote(key, *image); });
+class CompressedImageTier
+{
+public:
+    CompressedImageTier(CompressedTierOptions const& options = {});
+
+    // Compresses the image and keeps it, unless it's already here, doesn't
+    // compress well enough, or is bigger than the whole budget. The compression
+    // is done on the calling thread.
+    void Demote(ImageKey const& key, PixelBuffer const& image);
+    // Returns std::nullopt on a miss. The pixels are decompressed outside the
+    // lock. Images bigger than maxPromoteBytes are never promoted (pass the raw
+    // cache's budget, so nothing is promoted that it would turn away).
+    std::optional<CompressedTierHit> Find(ImageKey const& key, uint64_t maxPromoteBytes = std::numeric_limits<uint64_t>::max());
+    void Erase(ImageKey const& key);
+    void Clear();
+
+    CompressedTierOptions const& Options() const { return m_options; }
+    CompressedTierStats Stats();
+
+private:
+    struct Entry
+    {
+        ImageKey Key;
+        std::shared_ptr<QoiImage const> Image;
+        uint64_t Bytes;
+        uint64_t RawBytes;
+        uint32_t Hits;
+    };
+
+    bool SampleCompresses(PixelBuffer const& image) const;
+    void EraseLocked(std::list<Entry>::iterator entry);
+
+    CompressedTierOptions m_options;
+
+    std::mutex m_lock;
+    // Most recently used at the front.
+    std::list<Entry> m_entries;
+    std::unordered_map<ImageKey, std::list<Entry>::iterator, ImageKeyHash> m_index;
+    CompressedTierStats m_stats;
+};
@@ -0,0 +1,215 @@
+#include "pch.h"
+#include "ContentHash.h"
+#include "Simd.h"
+
+namespace
+{
+    constexpr uint64_t Prime32_1 = 0x9E3779B1ull;
+    constexpr uint64_t Prime32_2 = 0x85EBCA77ull;
+    constexpr uint64_t Prime32_3 = 0xC2B2AE3Dull;
+    constexpr uint64_t Prime64_1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t Prime64_2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t Prime64_3 = 0x165667B19E3779F9ull;
+    constexpr uint64_t Prime64_4 = 0x85EBCA77C2B2AE63ull;
+    constexpr uint64_t Prime64_5 = 0x27D4EB2F165667C5ull;
+
+    // Keys 0-23 are mixed into the stripes (each stripe of a block starts one
+    // key further along), 24-31 scramble the lanes at the end of a block and
+    // 32-39 are used when the lanes are merged.
+    constexpr size_t StripeKeys = 0;
+    constexpr size_t ScrambleKeys = 24;
+    constexpr size_t MergeKeys = 32;
+
+    // splitmix64, so the secret doesn't need to be pasted in as a table.
+    constexpr std::array<uint64_t, 40> Secret = []()
+    {
+        std::array<uint64_t, 40> secret = {};
+        uint64_t state = Prime64_1;
+        for (size_t i = 0; i < secret.size(); i++)
+        {
+            state += 0x9E3779B97F4A7C15ull;
+            auto value = state;
+            value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+            value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+            secret[i] = value ^ (value >> 31);
+        }
+        return secret;
+    }();
+
+    inline uint64_t Read64(uint8_t const* data)
+    {
+        uint64_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    // The 128-bit product of two 64-bit values, with its halves xored together.
+    // Done in 32-bit pieces so it's the same everywhere.
+    uint64_t Mul128Fold64(uint64_t a, uint64_t b)
+    {
+        uint64_t lowLow = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+        uint64_t highLow = (a >> 32) * (b & 0xFFFFFFFF);
+        uint64_t lowHigh = (a & 0xFFFFFFFF) * (b >> 32);
+        uint64_t highHigh = (a >> 32) * (b >> 32);
+        uint64_t cross = (lowLow >> 32) + (highLow & 0xFFFFFFFF) + lowHigh;
+        uint64_t upper = (highLow >> 32) + (cross >> 32) + highHigh;
+        uint64_t lower = (cross << 32) | (lowLow & 0xFFFFFFFF);
+        return lower ^ upper;
+    }
+
+    uint64_t Avalanche(uint64_t hash)
+    {
+        hash ^= hash >> 37;
+        hash *= 0x165667919E3779F9ull;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    void AccumulateStripe(std::array<uint64_t, 8>& lanes, uint8_t const* stripe, uint64_t const* keys)
+    {
+#ifdef IMAGE_DEMO_SSE2
+        if (SimdEnabled())
+        {
+        for (size_t i = 0; i < 8; i += 2)
+        {
+            auto lane = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&lanes[i]));
+            auto data = _mm_loadu_si128(reinterpret_cast<__m128i const*>(stripe + i * 8));
+            auto key = _mm_xor_si128(data, _mm_loadu_si128(reinterpret_cast<__m128i const*>(keys + i)));
+            // The low 32 bits of each key times its high 32 bits.
+            auto product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+            // Each lane also gets its neighbour's data, so none of the input is
+            // lost to a multiply by zero.
+            auto swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            lane = _mm_add_epi64(lane, _mm_add_epi64(product, swapped));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&lanes[i]), lane);
+        }
+        return;
+        }
+#endif
+        for (size_t i = 0; i < 8; i++)
+        {
+            auto data = Read64(stripe + i * 8);
+            auto key = data ^ keys[i];
+            lanes[i ^ 1] += data;
+            lanes[i] += (key & 0xFFFFFFFF) * (key >> 32);
+        }
+    }
+
+    void ScrambleLanes(std::array<uint64_t, 8>& lanes)
+    {
+        for (size_t i = 0; i < 8; i++)
+        {
+            auto lane = lanes[i];
+            lane ^= lane >> 47;
+            lane ^= Secret[ScrambleKeys + i];
+            lanes[i] = lane * Prime32_1;
+        }
+    }
+}
+
+ContentHasher::ContentHasher() :
+    m_lanes({ Prime32_3, Prime64_1, Prime64_2, Prime64_3, Prime64_4, Prime32_2, Prime64_5, Prime32_1 })
+{
+}
+
+void ContentHasher::ConsumeStripes(uint8_t const* data, size_t stripes)
+{
+    for (size_t i = 0; i < stripes; i++)
+    {
+        AccumulateStripe(m_lanes, data + i * StripeSize, &Secret[StripeKeys + m_stripe]);
+        if (++m_stripe == StripesPerBlock)
+        {
+            ScrambleLanes(m_lanes);
+            m_stripe = 0;
+        }
+    }
+}
+
+void ContentHasher::Update(uint8_t const* data, size_t size)
+{
+    m_length += size;
+    // Finish off a stripe left over from last time.
+    if (m_buffered > 0)
+    {
+        auto count = std::min(size, StripeSize - m_buffered);
+        memcpy(m_buffer.data() + m_buffered, data, count);
+        m_buffered += count;
+        data += count;
+        size -= count;
+        if (m_buffered < StripeSize)
+        {
+            return;
+        }
+        ConsumeStripes(m_buffer.data(), 1);
+        m_buffered = 0;
+    }
+
+    auto stripes = size / StripeSize;
+    ConsumeStripes(data, stripes);
+    data += stripes * StripeSize;
+    size -= stripes * StripeSize;
+
+    if (size > 0)
+    {
+        memcpy(m_buffer.data(), data, size);
+        m_buffered = size;
+    }
+}
+
+uint64_t ContentHasher::Digest() const
+{
+    auto lanes = m_lanes;
+    if (m_buffered > 0)
+    {
+        // The tail is zero padded to a whole stripe. The length is mixed in
+        // below, so that doesn't collide with input that really ends in zeros.
+        std::array<uint8_t, StripeSize> last = {};
+        memcpy(last.data(), m_buffer.data(), m_buffered);
+        AccumulateStripe(lanes, last.data(), &Secret[StripeKeys + m_stripe]);
+    }
+
+    auto hash = m_length * Prime64_1;
+    for (size_t i = 0; i < 8; i += 2)
+    {
+        hash += Mul128Fold64(lanes[i] ^ Secret[MergeKeys + i], lanes[i + 1] ^ Secret[MergeKeys + i + 1]);
+    }
+    return Avalanche(hash);
+}
+
+uint64_t ContentHasher::Hash(uint8_t const* data, size_t size)
+{
+    ContentHasher hasher;
+    hasher.Update(data, size);
+    return hasher.Digest();
+}
+
+HashedFile ReadFileWithHash(std::filesystem::path const& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Couldn't open the file to hash");
+    }
+    file.seekg(0, std::ios::end);
+    auto size = static_cast<size_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+
+    // Each chunk is hashed straight after it's read, while it's still in cache.
+    const size_t chunkSize = 256 * 1024;
+    HashedFile result;
+    result.Bytes.resize(size);
+    ContentHasher hasher;
+    size_t offset = 0;
+    while (offset < size)
+    {
+        auto count = std::min(chunkSize, size - offset);
+        if (!file.read(reinterpret_cast<char*>(result.Bytes.data() + offset), count))
+        {
+            throw std::runtime_error("Couldn't read the file to hash");
+        }
+        hasher.Update(result.Bytes.data() + offset, count);
+        offset += count;
+    }
+    result.Hash = hasher.Digest();
+    return result;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// A fast 64-bit hash of a file's contents, used to spot the same image showing
+// up under different paths. It's built like XXH3's long input loop: eight
+// 64-bit lanes, each stripe of 64 bytes is mixed in with a 32x32->64 multiply
+// against a rotating secret, and the lanes are scrambled every 1 KB. With SSE2
+// that's four vector multiplies a stripe, so it runs at memory speed.
+//
+// It is NOT bit compatible with XXH3, the values only mean something to this
+// code. They are the same on every platform, with or without SSE2, so they
+// can be stored (e.g. in the disk cache). It isn't a cryptographic hash, don't
+// use it on anything an attacker picks.
+class ContentHasher
+{
+public:
+    ContentHasher();
+
+    // Can be called as many times as needed, with any split of the input.
+    void Update(uint8_t const* data, size_t size);
+    void Update(std::vector<uint8_t> const& data) { Update(data.data(), data.size()); }
+    // Doesn't change the state, more data can still be added afterwards.
+    uint64_t Digest() const;
+
+    uint64_t Length() const { return m_length; }
+
+    static uint64_t Hash(uint8_t const* data, size_t size);
+
+private:
+    static constexpr size_t StripeSize = 64;
+    static constexpr size_t StripesPerBlock = 16;
+
+    void ConsumeStripes(uint8_t const* data, size_t stripes);
+
+    std::array<uint64_t, 8> m_lanes;
+    std::array<uint8_t, StripeSize> m_buffer = {};
+    size_t m_buffered = 0;
+    // How far into the current block we are, which picks the secret.
+    size_t m_stripe = 0;
+    uint64_t m_length = 0;
+};
+
+// The contents of a file along with their hash, which is worked out as each
+// chunk is read rather than in a second pass.
+struct HashedFile
+{
+    std::vector<uint8_t> Bytes;
+    uint64_t Hash = 0;
+};
+
+// Throws std::runtime_error if the file can't be read.
+HashedFile ReadFileWithHash(std::filesystem::path const& path);
@@ -0,0 +1,79 @@
+#include "pch.h"
+#include "D3D11UploadFence.h"
+
+D3D11UploadFence::D3D11UploadFence(winrt::com_ptr<ID3D11DeviceContext> const& d3dContext)
+{
+    m_d3dContext = d3dContext;
+    d3dContext->GetDevice(m_d3dDevice.put());
+}
+
+uint64_t D3D11UploadFence::Signal()
+{
+    std::lock_guard lock(m_lock);
+    winrt::com_ptr<ID3D11Query> query;
+    if (!m_freeQueries.empty())
+    {
+        query = std::move(m_freeQueries.back());
+        m_freeQueries.pop_back();
+    }
+    else
+    {
+        D3D11_QUERY_DESC desc = {};
+        desc.Query = D3D11_QUERY_EVENT;
+        winrt::check_hresult(m_d3dDevice->CreateQuery(&desc, query.put()));
+    }
+    // The query completes once the GPU has gotten through everything issued
+    // before it.
+    m_d3dContext->End(query.get());
+    m_signaled++;
+    m_pending.push_back({ m_signaled, std::move(query) });
+    return m_signaled;
+}
+
+uint64_t D3D11UploadFence::CompletedValue()
+{
+    std::lock_guard lock(m_lock);
+    Poll(false);
+    return m_completed;
+}
+
+void D3D11UploadFence::Wait(uint64_t value)
+{
+    std::unique_lock lock(m_lock);
+    value = std::min(value, m_signaled);
+    auto flush = true;
+    while (m_completed < value)
+    {
+        // Only flush the first time around, after that the work is on its way.
+        Poll(flush);
+        flush = false;
+        if (m_completed < value)
+        {
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+        }
+    }
+}
+
+void D3D11UploadFence::Poll(bool flush)
+{
+    while (!m_pending.empty())
+    {
+        auto& front = m_pending.front();
+        BOOL done = FALSE;
+        auto hr = m_d3dContext->GetData(front.Query.get(), &done, sizeof(done), flush ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH);
+        if (hr == S_FALSE)
+        {
+            break;
+        }
+        // If the device was removed, nothing we submitted is still in flight.
+        if (FAILED(hr) && hr != DXGI_ERROR_DEVICE_REMOVED)
+        {
+            winrt::throw_hresult(hr);
+        }
+        m_completed = front.Value;
+        m_freeQueries.push_back(std::move(front.Query));
+        m_pending.pop_front();
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "UploadRing.h"
+
+// An UploadFence built on D3D11 event queries, since ID3D11Fence needs a
+// newer runtime and device than we require. Each signal issues an event query
+// on the context, and a value is complete once its query (and every one
+// before it) has returned data.
+class D3D11UploadFence : public UploadFence
+{
+public:
+    D3D11UploadFence(winrt::com_ptr<ID3D11DeviceContext> const& d3dContext);
+
+    uint64_t Signal() override;
+    uint64_t CompletedValue() override;
+    void Wait(uint64_t value) override;
+
+private:
+    struct PendingQuery
+    {
+        uint64_t Value;
+        winrt::com_ptr<ID3D11Query> Query;
+    };
+
+    void Poll(bool flush);
+
+    std::mutex m_lock;
+    winrt::com_ptr<ID3D11Device> m_d3dDevice;
+    winrt::com_ptr<ID3D11DeviceContext> m_d3dContext;
+    uint64_t m_signaled = 0;
+    uint64_t m_completed = 0;
+    std::deque<PendingQuery> m_pending;
+    // Queries are reused once they've completed.
+    std::vector<winrt::com_ptr<ID3D11Query>> m_freeQueries;
+};
@@ -0,0 +1,62 @@
+#include "pch.h"
+#include "D3D11UploadPage.h"
+
+namespace
+{
+    DXGI_FORMAT ToDxgiFormat(SurfaceFormat format)
+    {
+        switch (format)
+        {
+        case SurfaceFormat::B8G8R8A8:
+            return DXGI_FORMAT_B8G8R8A8_UNORM;
+        case SurfaceFormat::B5G6R5:
+            return DXGI_FORMAT_B5G6R5_UNORM;
+        case SurfaceFormat::B4G4R4A4:
+            return DXGI_FORMAT_B4G4R4A4_UNORM;
+        }
+        throw std::invalid_argument("Unknown surface format");
+    }
+
+    // Same as CompositionSurfaceBackend, a removed device is a lost device.
+    void CheckPageResult(HRESULT result)
+    {
+        if (result == DXGI_ERROR_DEVICE_REMOVED || result == DXGI_ERROR_DEVICE_RESET)
+        {
+            throw DeviceLostError();
+        }
+        winrt::check_hresult(result);
+    }
+}
+
+D3D11UploadPage::D3D11UploadPage(winrt::com_ptr<ID3D11Device> const& d3dDevice, SurfaceFormat format, uint32_t width, uint32_t height)
+{
+    m_d3dDevice = d3dDevice;
+    d3dDevice->GetImmediateContext(m_d3dContext.put());
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = ToDxgiFormat(format);
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_STAGING;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    CheckPageResult(d3dDevice->CreateTexture2D(&desc, nullptr, m_texture.put()));
+}
+
+uint8_t* D3D11UploadPage::Map(uint32_t& rowPitch)
+{
+    // The ring only maps a page once its fence has completed, so this doesn't
+    // wait on the GPU. D3D11_MAP_WRITE keeps the parts of the page we don't
+    // write, which don't matter, but there's no discard for staging textures.
+    D3D11_MAPPED_SUBRESOURCE mapped = {};
+    CheckPageResult(m_d3dContext->Map(m_texture.get(), 0, D3D11_MAP_WRITE, 0, &mapped));
+    rowPitch = mapped.RowPitch;
+    return static_cast<uint8_t*>(mapped.pData);
+}
+
+void D3D11UploadPage::Unmap()
+{
+    m_d3dContext->Unmap(m_texture.get(), 0);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "UploadRing.h"
+
+// An UploadPage backed by a staging texture (CPU write, no GPU binding) in
+// the same format as the surfaces it feeds, so CopySubresourceRegion can move
+// pixels out of it without any conversion. Surfaces check the page came from
+// their device before copying, since a page from a lost device is no use.
+class D3D11UploadPage : public UploadPage
+{
+public:
+    D3D11UploadPage(winrt::com_ptr<ID3D11Device> const& d3dDevice, SurfaceFormat format, uint32_t width, uint32_t height);
+
+    uint8_t* Map(uint32_t& rowPitch) override;
+    void Unmap() override;
+
+    ID3D11Texture2D* Texture() const { return m_texture.get(); }
+    ID3D11Device* Device() const { return m_d3dDevice.get(); }
+
+private:
+    winrt::com_ptr<ID3D11Device> m_d3dDevice;
+    winrt::com_ptr<ID3D11DeviceContext> m_d3dContext;
+    winrt::com_ptr<ID3D11Texture2D> m_texture;
+};
@@ -0,0 +1,275 @@
+#include "pch.h"
+#include "DecodedImageCache.h"
+
+size_t ImageKeyHash::operator()(ImageKey const& key) const
+{
+    // boost::hash_combine's mixing step.
+    size_t hash = std::filesystem::hash_value(key.Path);
+    auto combine = [&hash](uint64_t value)
+    {
+        hash ^= std::hash<uint64_t>()(value) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    };
+    combine(key.FileSize);
+    combine(static_cast<uint64_t>(key.ModifiedTime));
+    combine(key.ContentHash);
+    combine((static_cast<uint64_t>(key.TargetWidth) << 32) | key.TargetHeight);
+    return hash;
+}
+
+ImageKey ImageKeyForFile(std::filesystem::path const& path, uint32_t targetWidth, uint32_t targetHeight)
+{
+    ImageKey key;
+    key.Path = path;
+    key.FileSize = std::filesystem::file_size(path);
+    key.ModifiedTime = std::filesystem::last_write_time(path).time_since_epoch().count();
+    key.TargetWidth = targetWidth;
+    key.TargetHeight = targetHeight;
+    return key;
+}
+
+ImageKey ImageKeyForContent(uint64_t contentHash, uint64_t size, uint32_t targetWidth, uint32_t targetHeight)
+{
+    ImageKey key;
+    key.FileSize = size;
+    key.ContentHash = contentHash;
+    key.TargetWidth = targetWidth;
+    key.TargetHeight = targetHeight;
+    return key;
+}
+
+DecodedImageCache::DecodedImageCache(uint64_t budgetBytes, uint32_t shardCount)
+{
+    if (shardCount == 0)
+    {
+        throw std::invalid_argument("A cache needs at least one shard");
+    }
+    m_budget = budgetBytes;
+    m_shards.reserve(shardCount);
+    for (uint32_t i = 0; i < shardCount; i++)
+    {
+        m_shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+DecodedImageCache::Shard& DecodedImageCache::ShardFor(ImageKey const& key)
+{
+    return *m_shards[ImageKeyHash()(key) % m_shards.size()];
+}
+
+void DecodedImageCache::PublishOldest(Shard& shard)
+{
+    shard.Oldest.store(shard.Entries.empty() ? std::numeric_limits<uint64_t>::max() : shard.Entries.back().LastUsed, std::memory_order_relaxed);
+}
+
+DecodedImageCache::Image DecodedImageCache::Find(ImageKey const& key)
+{
+    auto& shard = ShardFor(key);
+    std::lock_guard lock(shard.Lock);
+    auto image = FindLocked(shard, key);
+    (image ? m_hits : m_misses)++;
+    return image;
+}
+
+DecodedImageCache::Image DecodedImageCache::FindLocked(Shard& shard, ImageKey const& key)
+{
+    auto found = shard.Index.find(key);
+    if (found == shard.Index.end())
+    {
+        return nullptr;
+    }
+    // Move it to the front of the LRU list.
+    shard.Entries.splice(shard.Entries.begin(), shard.Entries, found->second);
+    found->second->LastUsed = ++m_clock;
+    PublishOldest(shard);
+    return found->second->Pixels;
+}
+
+DecodedImageCache::Image DecodedImageCache::Insert(ImageKey const& key, PixelBuffer image)
+{
+    auto& shard = ShardFor(key);
+    auto pixels = std::make_shared<PixelBuffer const>(std::move(image));
+    {
+        std::lock_guard lock(shard.Lock);
+        InsertLocked(shard, key, pixels);
+    }
+    EvictToBudget();
+    return pixels;
+}
+
+DecodedImageCache::Image DecodedImageCache::InsertLocked(Shard& shard, ImageKey const& key, std::shared_ptr<PixelBuffer const> pixels)
+{
+    uint64_t bytes = pixels->Bytes.size();
+    if (bytes > m_budget)
+    {
+        // It would push everything else out and still not fit.
+        m_rejections++;
+        return pixels;
+    }
+
+    auto existing = shard.Index.find(key);
+    if (existing != shard.Index.end())
+    {
+        shard.Bytes -= existing->second->Bytes;
+        m_bytes -= existing->second->Bytes;
+        shard.Entries.erase(existing->second);
+        shard.Index.erase(existing);
+    }
+    shard.Entries.push_front({ key, pixels, bytes, ++m_clock });
+    shard.Index.emplace(key, shard.Entries.begin());
+    shard.Bytes += bytes;
+    m_bytes += bytes;
+    m_insertions++;
+    PublishOldest(shard);
+    return pixels;
+}
+
+void DecodedImageCache::EvictToBudget()
+{
+    std::vector<Entry> evicted;
+    while (m_bytes > m_budget)
+    {
+        // Find the shard with the oldest entry, and the runner up, from what
+        // they've published. No locks are needed for that.
+        Shard* oldestShard = nullptr;
+        uint64_t oldest = std::numeric_limits<uint64_t>::max();
+        uint64_t runnerUp = std::numeric_limits<uint64_t>::max();
+        for (auto& shard : m_shards)
+        {
+            auto shardOldest = shard->Oldest.load(std::memory_order_relaxed);
+            if (shardOldest < oldest)
+            {
+                runnerUp = oldest;
+                oldest = shardOldest;
+                oldestShard = shard.get();
+            }
+            else if (shardOldest < runnerUp)
+            {
+                runnerUp = shardOldest;
+            }
+        }
+        if (!oldestShard)
+        {
+            break;
+        }
+
+        // Evict from it until it's no longer the oldest. The first entry goes
+        // even if another thread has used it since we looked, so every time
+        // around frees something or finds the shard empty.
+        std::lock_guard lock(oldestShard->Lock);
+        auto first = true;
+        while (!oldestShard->Entries.empty() && m_bytes > m_budget && (first || oldestShard->Entries.back().LastUsed <= runnerUp))
+        {
+            auto& entry = oldestShard->Entries.back();
+            oldestShard->Bytes -= entry.Bytes;
+            m_bytes -= entry.Bytes;
+            oldestShard->Index.erase(entry.Key);
+            evicted.push_back(std::move(entry));
+            oldestShard->Entries.pop_back();
+            m_evictions++;
+            first = false;
+        }
+        PublishOldest(*oldestShard);
+    }
+
+    if (m_onEvicted)
+    {
+        for (auto& entry : evicted)
+        {
+            m_onEvicted(entry.Key, entry.Pixels);
+        }
+    }
+}
+
+DecodedImageCache::Image DecodedImageCache::FindOrLoad(ImageKey const& key, Loader const& loader)
+{
+    auto& shard = ShardFor(key);
+    std::promise<Image> promise;
+    std::shared_future<Image> loading;
+    {
+        std::lock_guard lock(shard.Lock);
+        if (auto image = FindLocked(shard, key))
+        {
+            m_hits++;
+            return image;
+        }
+        auto found = shard.Loading.find(key);
+        if (found != shard.Loading.end())
+        {
+            m_sharedLoads++;
+            loading = found->second;
+        }
+        else
+        {
+            m_misses++;
+            shard.Loading.emplace(key, promise.get_future().share());
+        }
+    }
+    if (loading.valid())
+    {
+        return loading.get();
+    }
+
+    // We're the one loading it. The lock isn't held while we do.
+    try
+    {
+        auto image = std::make_shared<PixelBuffer const>(loader());
+        {
+            std::lock_guard lock(shard.Lock);
+            InsertLocked(shard, key, image);
+            shard.Loading.erase(key);
+        }
+        promise.set_value(image);
+        EvictToBudget();
+        return image;
+    }
+    catch (...)
+    {
+        {
+            std::lock_guard lock(shard.Lock);
+            shard.Loading.erase(key);
+        }
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
+
+void DecodedImageCache::Erase(ImageKey const& key)
+{
+    auto& shard = ShardFor(key);
+    std::lock_guard lock(shard.Lock);
+    auto found = shard.Index.find(key);
+    if (found != shard.Index.end())
+    {
+        shard.Bytes -= found->second->Bytes;
+        m_bytes -= found->second->Bytes;
+        shard.Entries.erase(found->second);
+        shard.Index.erase(found);
+        PublishOldest(shard);
+    }
+}
+
+void DecodedImageCache::Clear()
+{
+    for (auto& shard : m_shards)
+    {
+        std::lock_guard lock(shard->Lock);
+        m_bytes -= shard->Bytes;
+        shard->Entries.clear();
+        shard->Index.clear();
+        shard->Bytes = 0;
+        PublishOldest(*shard);
+    }
+}
+
+DecodedImageCacheStats DecodedImageCache::Stats()
+{
+    DecodedImageCacheStats stats;
+    stats.Hits = m_hits;
+    stats.Misses = m_misses;
+    stats.Insertions = m_insertions;
+    stats.Evictions = m_evictions;
+    stats.Rejections = m_rejections;
+    stats.SharedLoads = m_sharedLoads;
+    stats.BytesUsed = m_bytes;
+    return stats;
+}
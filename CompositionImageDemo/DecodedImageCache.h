@@ -0,0 +1,139 @@
+#pragma once
+#include "PixelBuffer.h"
+
+// Identifies a decoded image: where it came from, and what it was decoded to.
+// The file's size and modification time stand in for its contents, so an
+// edited file gets a new key. ContentHash can be used instead (or as well)
+// for sources that don't have a path. A target size of 0 means full size.
+struct ImageKey
+{
+    std::filesystem::path Path;
+    uint64_t FileSize = 0;
+    int64_t ModifiedTime = 0;
+    uint64_t ContentHash = 0;
+    uint32_t TargetWidth = 0;
+    uint32_t TargetHeight = 0;
+
+    bool operator==(ImageKey const& other) const
+    {
+        return Path == other.Path && FileSize == other.FileSize && ModifiedTime == other.ModifiedTime &&
+            ContentHash == other.ContentHash && TargetWidth == other.TargetWidth && TargetHeight == other.TargetHeight;
+    }
+};
+
+struct ImageKeyHash
+{
+    size_t operator()(ImageKey const& key) const;
+};
+
+// Fills in the size and modification time from the file system. Throws
+// std::filesystem::filesystem_error if the file can't be found.
+ImageKey ImageKeyForFile(std::filesystem::path const& path, uint32_t targetWidth = 0, uint32_t targetHeight = 0);
+// Identifies the image by its encoded bytes (see ContentHasher) instead of
+// its path, so the same image under two paths gets the same key.
+ImageKey ImageKeyForContent(uint64_t contentHash, uint64_t size, uint32_t targetWidth = 0, uint32_t targetHeight = 0);
+
+struct DecodedImageCacheStats
+{
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+    uint64_t Insertions = 0;
+    uint64_t Evictions = 0;
+    // Images too big to ever fit, which were handed back without being cached.
+    uint64_t Rejections = 0;
+    // Loads that waited on another thread's load of the same image instead of
+    // decoding it again.
+    uint64_t SharedLoads = 0;
+    uint64_t BytesUsed = 0;
+};
+
+// Keeps recently decoded images around so loading the same image again (for
+// another visual, or to redraw after the device was replaced) doesn't mean
+// reading and decoding the file again. The pixels are the decoded BGRA, they're
+// converted to each surface's format when uploaded.
+//
+// The cache is split into shards, each with its own lock, so concurrent
+// loaders rarely wait on each other. The byte budget is shared by all of them,
+// and whatever was used least recently across the whole cache is evicted
+// first. Each shard publishes when its oldest entry was last used, so finding
+// the oldest only locks the shard it's in. With other threads busy that's an
+// approximation (a shard can change between the look and the lock), but on
+// its own the cache evicts in exact LRU order. The cache only goes over
+// budget for the moment between an insert and the evictions it causes, and
+// images that are still in use stay alive through their shared_ptrs.
+class DecodedImageCache
+{
+public:
+    using Image = std::shared_ptr<PixelBuffer const>;
+    using Loader = std::function<PixelBuffer()>;
+    // Called (outside the cache's locks) with images that were evicted to make
+    // room. Images too big to be cached at all aren't passed on.
+    using EvictionHandler = std::function<void(ImageKey const& key, Image const& image)>;
+
+    DecodedImageCache(uint64_t budgetBytes, uint32_t shardCount = 16);
+
+    // Returns nullptr on a miss.
+    Image Find(ImageKey const& key);
+    // Replaces any image already cached for the key. Returns the cached image,
+    // or an uncached one if it's too big for the cache.
+    Image Insert(ImageKey const& key, PixelBuffer image);
+    // Returns the cached image, calling loader on a miss. If another thread is
+    // already loading the same key, waits for it rather than loading it twice.
+    // Exceptions from the loader are passed on to everyone waiting.
+    Image FindOrLoad(ImageKey const& key, Loader const& loader);
+    void Erase(ImageKey const& key);
+    void Clear();
+    // Lets the next tier down (e.g. CompressedImageTier) pick up what this one
+    // lets go of. Set it before the cache is used.
+    void OnEvicted(EvictionHandler handler) { m_onEvicted = std::move(handler); }
+
+    uint64_t Budget() const { return m_budget; }
+    DecodedImageCacheStats Stats();
+
+private:
+    struct Entry
+    {
+        ImageKey Key;
+        Image Pixels;
+        uint64_t Bytes;
+        // When it was last found or inserted, from m_clock.
+        uint64_t LastUsed;
+    };
+
+    struct Shard
+    {
+        std::mutex Lock;
+        // Most recently used at the front.
+        std::list<Entry> Entries;
+        std::unordered_map<ImageKey, std::list<Entry>::iterator, ImageKeyHash> Index;
+        std::unordered_map<ImageKey, std::shared_future<Image>, ImageKeyHash> Loading;
+        uint64_t Bytes = 0;
+        // LastUsed of the entry at the back of the list, or the largest value
+        // when there isn't one. Written under Lock, read without it.
+        std::atomic<uint64_t> Oldest = std::numeric_limits<uint64_t>::max();
+    };
+
+    Shard& ShardFor(ImageKey const& key);
+    // Call with the shard locked, after anything that changes its list.
+    static void PublishOldest(Shard& shard);
+    Image FindLocked(Shard& shard, ImageKey const& key);
+    // Doesn't evict anything, so call EvictToBudget once the lock is released.
+    Image InsertLocked(Shard& shard, ImageKey const& key, std::shared_ptr<PixelBuffer const> pixels);
+    // Evicts the least recently used entries, from whichever shards they're
+    // in, until the cache is within its budget. Then passes them on to the
+    // eviction handler. Call without holding any of the shard locks.
+    void EvictToBudget();
+
+    uint64_t m_budget = 0;
+    std::atomic<uint64_t> m_bytes = 0;
+    std::atomic<uint64_t> m_clock = 0;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    EvictionHandler m_onEvicted;
+
+    std::atomic<uint64_t> m_hits = 0;
+    std::atomic<uint64_t> m_misses = 0;
+    std::atomic<uint64_t> m_insertions = 0;
+    std::atomic<uint64_t> m_evictions = 0;
+    std::atomic<uint64_t> m_rejections = 0;
+    std::atomic<uint64_t> m_sharedLoads = 0;
+};
@@ -0,0 +1,96 @@
+#include "pch.h"
+#include "DedupRegistry.h"
+
+namespace
+{
+    uint64_t ImageBytes(SharedImage const& image)
+    {
+        uint64_t bytes = 0;
+        if (image.Pixels)
+        {
+            bytes += image.Pixels->Bytes.size();
+        }
+        if (image.Surface)
+        {
+            bytes += static_cast<uint64_t>(image.Surface->Width()) * image.Surface->Height() * image.Surface->BytesPerPixel();
+        }
+        return bytes;
+    }
+}
+
+std::optional<SharedImage> DedupRegistry::Acquire(ImageKey const& key)
+{
+    std::lock_guard lock(m_lock);
+    auto found = m_entries.find(key);
+    if (found == m_entries.end())
+    {
+        // Not a load yet, the caller goes on to Add it.
+        return std::nullopt;
+    }
+    auto& entry = found->second;
+    entry.References++;
+    m_stats.Loads++;
+    m_stats.DeduplicatedLoads++;
+    m_stats.References++;
+    return entry.Image;
+}
+
+SharedImage DedupRegistry::Add(ImageKey const& key, SharedImage image)
+{
+    std::lock_guard lock(m_lock);
+    m_stats.Loads++;
+    auto found = m_entries.find(key);
+    if (found != m_entries.end())
+    {
+        // Someone else got there first, so this load was a duplicate after all.
+        auto& entry = found->second;
+        entry.References++;
+        m_stats.DeduplicatedLoads++;
+        m_stats.References++;
+        return entry.Image;
+    }
+
+    m_entries.emplace(key, Entry{ image, 1 });
+    m_stats.UniqueImages++;
+    m_stats.References++;
+    return image;
+}
+
+bool DedupRegistry::Release(ImageKey const& key)
+{
+    std::lock_guard lock(m_lock);
+    auto found = m_entries.find(key);
+    if (found == m_entries.end())
+    {
+        throw std::invalid_argument("Released an image that wasn't acquired");
+    }
+    auto& entry = found->second;
+    m_stats.References--;
+    if (--entry.References > 0)
+    {
+        return false;
+    }
+    m_stats.UniqueImages--;
+    m_entries.erase(found);
+    return true;
+}
+
+size_t DedupRegistry::References(ImageKey const& key)
+{
+    std::lock_guard lock(m_lock);
+    auto found = m_entries.find(key);
+    return found != m_entries.end() ? found->second.References : 0;
+}
+
+DedupStats DedupRegistry::Stats()
+{
+    std::lock_guard lock(m_lock);
+    auto stats = m_stats;
+    for (auto const& [key, entry] : m_entries)
+    {
+        auto bytes = ImageBytes(entry.Image);
+        stats.UniqueBytes += bytes;
+        stats.ReferencedBytes += bytes * entry.References;
+    }
+    return stats;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "SurfaceBackend.h"
+#include "DecodedImageCache.h"
+
+// An image that may be shown in more than one place.
+struct SharedImage
+{
+    std::shared_ptr<PixelBuffer const> Pixels;
+    std::shared_ptr<SurfaceBackend> Surface;
+};
+
+struct DedupStats
+{
+    // Every Add, and every Acquire that found the content.
+    uint64_t Loads = 0;
+    // Loads that got content that was already loaded, under this or another path.
+    uint64_t DeduplicatedLoads = 0;
+    // Right now: the distinct images held, and the references to them.
+    uint64_t UniqueImages = 0;
+    uint64_t References = 0;
+    // Pixel and surface memory actually held, and what it would be if every
+    // reference had its own copy. Measured when Stats is called, so surfaces
+    // that have been resized since they were added count at their new size.
+    uint64_t UniqueBytes = 0;
+    uint64_t ReferencedBytes = 0;
+
+    double DeduplicationRatio() const { return UniqueBytes > 0 ? static_cast<double>(ReferencedBytes) / UniqueBytes : 1.0; }
+    uint64_t BytesSaved() const { return ReferencedBytes - UniqueBytes; }
+};
+
+// Lets everything showing the same content share one decoded buffer and one
+// surface. Galleries and feeds often show one image under several paths or
+// URLs, and without this each copy is decoded and uploaded separately.
+//
+// Keys should come from ImageKeyForContent, so they identify the bytes rather
+// than where they came from. Images are reference counted: each Acquire or Add
+// needs a matching Release, and the registry lets go of an image with its last
+// reference (anything still holding the SharedImage keeps it alive).
+class DedupRegistry
+{
+public:
+    // Adds a reference to content that's already loaded. Returns std::nullopt
+    // if it isn't, in which case the caller should load it and Add it.
+    std::optional<SharedImage> Acquire(ImageKey const& key);
+    // Registers freshly loaded content with one reference. If the same content
+    // was added while this copy was loading, that one wins: it gets the
+    // reference and is returned, and the caller should drop its own copy.
+    SharedImage Add(ImageKey const& key, SharedImage image);
+    // Returns true if that was the last reference.
+    bool Release(ImageKey const& key);
+
+    size_t References(ImageKey const& key);
+    DedupStats Stats();
+
+private:
+    struct Entry
+    {
+        SharedImage Image;
+        size_t References;
+    };
+
+    std::mutex m_lock;
+    std::unordered_map<ImageKey, Entry, ImageKeyHash> m_entries;
+    DedupStats m_stats;
+};
@@ -0,0 +1,136 @@
+#include "pch.h"
+#include "DirtyRects.h"
+
+namespace
+{
+    // Roughly what a BeginDraw/EndDraw pair costs, expressed in pixels we could
+    // have uploaded instead. Merging two rects is worth it as long as the
+    // overdraw is smaller than this.
+    constexpr uint64_t DrawOverheadInPixels = 64 * 64;
+    // Past this many rects we stop being clever and upload their bounds.
+    constexpr size_t MaxRects = 32;
+
+    uint64_t Area(SurfaceRect const& rect)
+    {
+        return static_cast<uint64_t>(rect.Width) * rect.Height;
+    }
+
+    SurfaceRect Union(SurfaceRect const& first, SurfaceRect const& second)
+    {
+        auto left = std::min(first.X, second.X);
+        auto top = std::min(first.Y, second.Y);
+        auto right = std::max(first.X + static_cast<int64_t>(first.Width), second.X + static_cast<int64_t>(second.Width));
+        auto bottom = std::max(first.Y + static_cast<int64_t>(first.Height), second.Y + static_cast<int64_t>(second.Height));
+        return { left, top, static_cast<uint32_t>(right - left), static_cast<uint32_t>(bottom - top) };
+    }
+
+    uint64_t IntersectionArea(SurfaceRect const& first, SurfaceRect const& second)
+    {
+        auto left = std::max<int64_t>(first.X, second.X);
+        auto top = std::max<int64_t>(first.Y, second.Y);
+        auto right = std::min(first.X + static_cast<int64_t>(first.Width), second.X + static_cast<int64_t>(second.Width));
+        auto bottom = std::min(first.Y + static_cast<int64_t>(first.Height), second.Y + static_cast<int64_t>(second.Height));
+        if (right <= left || bottom <= top)
+        {
+            return 0;
+        }
+        return static_cast<uint64_t>(right - left) * static_cast<uint64_t>(bottom - top);
+    }
+
+    std::optional<SurfaceRect> Clip(SurfaceRect const& rect, uint32_t width, uint32_t height)
+    {
+        auto left = std::max<int64_t>(rect.X, 0);
+        auto top = std::max<int64_t>(rect.Y, 0);
+        auto right = std::min<int64_t>(rect.X + static_cast<int64_t>(rect.Width), width);
+        auto bottom = std::min<int64_t>(rect.Y + static_cast<int64_t>(rect.Height), height);
+        if (right <= left || bottom <= top)
+        {
+            return std::nullopt;
+        }
+        return SurfaceRect{ static_cast<int32_t>(left), static_cast<int32_t>(top), static_cast<uint32_t>(right - left), static_cast<uint32_t>(bottom - top) };
+    }
+}
+
+std::vector<SurfaceRect> CoalesceDirtyRects(std::vector<SurfaceRect> rects, uint32_t width, uint32_t height)
+{
+    std::vector<SurfaceRect> result;
+    result.reserve(rects.size());
+    for (auto const& rect : rects)
+    {
+        if (auto clipped = Clip(rect, width, height))
+        {
+            result.push_back(*clipped);
+        }
+    }
+
+    // Keep merging pairs until nothing changes. Overlapping rects are always
+    // merged, otherwise the overlap would be uploaded twice.
+    auto merged = true;
+    while (merged && result.size() > 1)
+    {
+        merged = false;
+        for (size_t i = 0; i < result.size() && !merged; i++)
+        {
+            for (size_t j = i + 1; j < result.size(); j++)
+            {
+                auto combined = Union(result[i], result[j]);
+                auto separate = Area(result[i]) + Area(result[j]) - IntersectionArea(result[i], result[j]);
+                if (IntersectionArea(result[i], result[j]) > 0 || Area(combined) <= separate + DrawOverheadInPixels)
+                {
+                    result[i] = combined;
+                    result.erase(result.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (result.size() > MaxRects)
+    {
+        auto bounds = result.front();
+        for (auto const& rect : result)
+        {
+            bounds = Union(bounds, rect);
+        }
+        result = { bounds };
+    }
+    return result;
+}
+
+void UpdateDirtyRects(SurfaceBackend& surface, uint8_t const* pixels, uint32_t rowPitch, uint32_t width, uint32_t height, std::vector<SurfaceRect> const& dirtyRects, DirtyRectStats& stats)
+{
+    auto bytesPerPixel = surface.BytesPerPixel();
+    auto fullSize = static_cast<uint64_t>(width) * height * bytesPerPixel;
+    stats.Updates++;
+    stats.RectsRequested += dirtyRects.size();
+
+    if (surface.Width() != width || surface.Height() != height)
+    {
+        UploadImage(surface, pixels, rowPitch, width, height);
+        stats.RectsUploaded++;
+        stats.BytesUploaded += fullSize;
+        return;
+    }
+
+    uint64_t uploaded = 0;
+    for (auto const& rect : CoalesceDirtyRects(dirtyRects, width, height))
+    {
+        auto source = pixels + static_cast<size_t>(rect.Y) * rowPitch + static_cast<size_t>(rect.X) * bytesPerPixel;
+        UploadRegion(surface, rect, source, rowPitch);
+        uploaded += Area(rect) * bytesPerPixel;
+        stats.RectsUploaded++;
+    }
+    stats.BytesUploaded += uploaded;
+    stats.BytesSaved += fullSize - std::min(uploaded, fullSize);
+}
+
+void UpdateDirtyRects(SurfaceBackend& surface, PixelBuffer const& image, std::vector<SurfaceRect> const& dirtyRects, DirtyRectStats& stats)
+{
+    UpdateDirtyRects(surface, image.Bytes.data(), image.Stride(), image.Width, image.Height, dirtyRects, stats);
+}
+
+void UpdateDirtyRects(SurfaceBackend& surface, PackedPixelBuffer const& image, std::vector<SurfaceRect> const& dirtyRects, DirtyRectStats& stats)
+{
+    UpdateDirtyRects(surface, reinterpret_cast<uint8_t const*>(image.Pixels.data()), image.Stride(), image.Width, image.Height, dirtyRects, stats);
+}
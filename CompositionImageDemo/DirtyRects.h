@@ -0,0 +1,28 @@
+#pragma once
+#include "SurfaceBackend.h"
+
+struct DirtyRectStats
+{
+    uint64_t Updates = 0;
+    uint64_t RectsRequested = 0;
+    // Rects left after coalescing. Each one is a BeginDraw/EndDraw pair.
+    uint64_t RectsUploaded = 0;
+    uint64_t BytesUploaded = 0;
+    // What a full upload would have cost, minus what we actually sent.
+    uint64_t BytesSaved = 0;
+};
+
+// Clips the rects to the surface, drops empty ones, and merges rects whose
+// union doesn't cost much more to upload than the rects on their own. Every
+// separate rect costs a BeginDraw/EndDraw pair, so a little overdraw is
+// cheaper than lots of tiny draws.
+std::vector<SurfaceRect> CoalesceDirtyRects(std::vector<SurfaceRect> rects, uint32_t width, uint32_t height);
+
+// Uploads only the parts of the image that changed. The image is the complete
+// new contents of the surface, and the rects say which parts of it differ from
+// what was uploaded last time. If the surface isn't already the size of the
+// image, it is resized and the whole image is uploaded, since resizing throws
+// away the old contents.
+void UpdateDirtyRects(SurfaceBackend& surface, uint8_t const* pixels, uint32_t rowPitch, uint32_t width, uint32_t height, std::vector<SurfaceRect> const& dirtyRects, DirtyRectStats& stats);
+void UpdateDirtyRects(SurfaceBackend& surface, PixelBuffer const& image, std::vector<SurfaceRect> const& dirtyRects, DirtyRectStats& stats);
+void UpdateDirtyRects(SurfaceBackend& surface, PackedPixelBuffer const& image, std::vector<SurfaceRect> const& dirtyRects, DirtyRectStats& stats);
@@ -0,0 +1,737 @@
+#include "pch.h"
+#include "DiskPixelCache.h"
+
+namespace
+{
+    constexpr uint32_t RecordMagic = 0x31525850; // "PXR1"
+    constexpr uint32_t IndexMagic = 0x31495850; // "PXI1"
+    constexpr uint64_t RecordAlignment = 16;
+
+    // Every field is naturally aligned, so there's no padding for compilers to
+    // disagree on.
+    struct RecordHeader
+    {
+        uint32_t Magic;
+        uint32_t ContentVersion;
+        uint32_t PathBytes;
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t TargetWidth;
+        uint32_t TargetHeight;
+        uint32_t Reserved;
+        uint64_t KeyHash;
+        uint64_t FileSize;
+        int64_t ModifiedTime;
+        uint64_t ContentHash;
+        uint64_t PayloadBytes;
+        uint64_t PayloadChecksum;
+        // Covers everything above and the path.
+        uint64_t HeaderChecksum;
+    };
+    static_assert(sizeof(RecordHeader) == 88);
+
+    struct IndexHeader
+    {
+        uint32_t Magic;
+        uint32_t ContentVersion;
+        uint32_t SegmentCount;
+        uint32_t Reserved;
+        uint64_t EntryCount;
+    };
+
+    struct IndexSegment
+    {
+        uint32_t Id;
+        uint32_t Reserved;
+        uint64_t Length;
+    };
+
+    struct IndexEntry
+    {
+        uint64_t KeyHash;
+        uint32_t Segment;
+        uint32_t Reserved;
+        uint64_t Offset;
+    };
+
+    uint64_t Align(uint64_t value)
+    {
+        return (value + RecordAlignment - 1) & ~(RecordAlignment - 1);
+    }
+
+    uint64_t RotateLeft(uint64_t value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    // Not cryptographic, just quick and good at catching torn writes. Four
+    // independent lanes let the multiplies overlap.
+    uint64_t Checksum(uint8_t const* data, size_t size, uint64_t seed = 0)
+    {
+        const uint64_t prime1 = 0x9e3779b185ebca87ull;
+        const uint64_t prime2 = 0xc2b2ae3d27d4eb4full;
+        uint64_t lanes[4] = { seed + prime1, seed + prime2, seed, seed - prime1 };
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            for (int lane = 0; lane < 4; lane++)
+            {
+                uint64_t value;
+                std::memcpy(&value, data + i + lane * 8, 8);
+                lanes[lane] = RotateLeft(lanes[lane] + value * prime2, 31) * prime1;
+            }
+        }
+        auto hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18) + size;
+        for (; i < size; i++)
+        {
+            hash = RotateLeft(hash ^ (data[i] * prime1), 11) * prime2;
+        }
+        hash ^= hash >> 33;
+        hash *= prime2;
+        hash ^= hash >> 29;
+        return hash;
+    }
+
+    std::string PathBytes(std::filesystem::path const& path)
+    {
+        auto utf8 = path.generic_u8string();
+        return { reinterpret_cast<char const*>(utf8.data()), utf8.size() };
+    }
+
+    // std::hash isn't guaranteed to give the same answer from one run to the
+    // next, and this one ends up on disk.
+    uint64_t StableKeyHash(ImageKey const& key, std::string const& path)
+    {
+        uint64_t fields[] =
+        {
+            key.FileSize,
+            static_cast<uint64_t>(key.ModifiedTime),
+            key.ContentHash,
+            (static_cast<uint64_t>(key.TargetWidth) << 32) | key.TargetHeight,
+        };
+        auto hash = Checksum(reinterpret_cast<uint8_t const*>(path.data()), path.size());
+        return Checksum(reinterpret_cast<uint8_t const*>(fields), sizeof(fields), hash);
+    }
+
+    uint64_t HeaderChecksum(RecordHeader const& header, uint8_t const* path)
+    {
+        auto hash = Checksum(reinterpret_cast<uint8_t const*>(&header), offsetof(RecordHeader, HeaderChecksum));
+        return Checksum(path, header.PathBytes, hash);
+    }
+
+    uint64_t PayloadOffset(RecordHeader const& header)
+    {
+        return Align(sizeof(RecordHeader) + header.PathBytes);
+    }
+
+    uint64_t RecordSize(RecordHeader const& header)
+    {
+        return Align(PayloadOffset(header) + header.PayloadBytes);
+    }
+
+    bool RecordMatches(uint8_t const* record, ImageKey const& key, std::string const& path)
+    {
+        RecordHeader header;
+        std::memcpy(&header, record, sizeof(header));
+        return header.FileSize == key.FileSize && header.ModifiedTime == key.ModifiedTime && header.ContentHash == key.ContentHash &&
+            header.TargetWidth == key.TargetWidth && header.TargetHeight == key.TargetHeight &&
+            header.PathBytes == path.size() && std::memcmp(record + sizeof(header), path.data(), path.size()) == 0;
+    }
+
+    // Segment files are named after their id, e.g. "0000002a.seg". Anything
+    // else in the directory is left alone.
+    std::optional<uint32_t> ParseSegmentName(std::string const& name)
+    {
+        if (name.size() != 12 || name.compare(8, 4, ".seg") != 0)
+        {
+            return std::nullopt;
+        }
+        uint32_t id = 0;
+        auto [end, error] = std::from_chars(name.data(), name.data() + 8, id, 16);
+        if (error != std::errc() || end != name.data() + 8)
+        {
+            return std::nullopt;
+        }
+        return id;
+    }
+
+    // Writes the file and waits for it to reach the disk, so that renaming it
+    // over another file can't leave an empty or partial file behind after a
+    // power cut.
+    void WriteFileDurably(std::filesystem::path const& path, std::vector<uint8_t> const& bytes)
+    {
+#ifdef _WIN32
+        wil::unique_hfile file(CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+        if (!file)
+        {
+            winrt::throw_last_error();
+        }
+        size_t written = 0;
+        while (written < bytes.size())
+        {
+            auto chunk = static_cast<DWORD>(std::min<size_t>(bytes.size() - written, 1u << 30));
+            DWORD count = 0;
+            winrt::check_bool(WriteFile(file.get(), bytes.data() + written, chunk, &count, nullptr));
+            written += count;
+        }
+        winrt::check_bool(FlushFileBuffers(file.get()));
+#else
+        auto file = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (file < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "Couldn't create the cache index");
+        }
+        size_t written = 0;
+        while (written < bytes.size())
+        {
+            auto count = write(file, bytes.data() + written, bytes.size() - written);
+            if (count < 0 && errno != EINTR)
+            {
+                auto error = errno;
+                close(file);
+                throw std::system_error(error, std::generic_category(), "Couldn't write the cache index");
+            }
+            written += count > 0 ? static_cast<size_t>(count) : 0;
+        }
+        auto synced = fsync(file);
+        auto error = errno;
+        close(file);
+        if (synced != 0)
+        {
+            throw std::system_error(error, std::generic_category(), "Couldn't write the cache index");
+        }
+#endif
+    }
+
+    // Waits for everything written to the file so far to reach the disk.
+    void SyncFile(std::filesystem::path const& path)
+    {
+#ifdef _WIN32
+        wil::unique_hfile file(CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+        if (!file)
+        {
+            winrt::throw_last_error();
+        }
+        winrt::check_bool(FlushFileBuffers(file.get()));
+#else
+        auto file = open(path.c_str(), O_WRONLY);
+        if (file < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "Couldn't open a cache segment");
+        }
+        auto synced = fsync(file);
+        auto error = errno;
+        close(file);
+        if (synced != 0)
+        {
+            throw std::system_error(error, std::generic_category(), "Couldn't sync a cache segment");
+        }
+#endif
+    }
+}
+
+DiskPixelCache::DiskPixelCache(std::filesystem::path const& directory, DiskPixelCacheOptions const& options)
+{
+    if (options.SegmentBytes == 0 || options.MaxBytes < options.SegmentBytes)
+    {
+        throw std::invalid_argument("The cache must be able to hold at least one segment");
+    }
+    m_directory = directory;
+    m_options = options;
+    Open();
+}
+
+DiskPixelCache::~DiskPixelCache()
+{
+    try
+    {
+        Flush();
+    }
+    catch (...)
+    {
+        // The records are safe without the index, it will be rebuilt on the next open.
+    }
+}
+
+std::filesystem::path DiskPixelCache::SegmentPath(uint32_t id) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%08x.seg", id);
+    return m_directory / name;
+}
+
+void DiskPixelCache::Open()
+{
+    std::filesystem::create_directories(m_directory);
+    LoadIndex();
+
+    // Pick up every segment on disk, not just the ones in the index.
+    std::vector<uint32_t> ids;
+    for (auto&& item : std::filesystem::directory_iterator(m_directory))
+    {
+        if (!item.is_regular_file())
+        {
+            continue;
+        }
+        if (auto id = ParseSegmentName(item.path().filename().string()))
+        {
+            ids.push_back(*id);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    // The index told us how far each segment had been indexed.
+    std::map<uint32_t, uint64_t> indexedLengths;
+    for (auto&& segment : m_segments)
+    {
+        indexedLengths[segment.Id] = segment.Length;
+    }
+    m_segments.clear();
+    for (auto id : ids)
+    {
+        Segment segment;
+        segment.Id = id;
+        segment.Length = std::filesystem::file_size(SegmentPath(id));
+        auto indexed = indexedLengths.find(id);
+        m_segments.push_back(std::move(segment));
+        Recover(m_segments.back(), indexed != indexedLengths.end() ? indexed->second : 0);
+    }
+
+    // Drop anything the index has for segments that are gone.
+    std::erase_if(m_index, [this](auto const& entry) { return FindSegment(entry.second.Segment) == nullptr; });
+    EvictSegments();
+}
+
+void DiskPixelCache::Invalidate()
+{
+    for (auto&& item : std::filesystem::directory_iterator(m_directory))
+    {
+        auto extension = item.path().extension();
+        if (item.is_regular_file() && (extension == ".seg" || item.path().filename() == "index.bin"))
+        {
+            std::filesystem::remove(item.path());
+        }
+    }
+    m_segments.clear();
+    m_index.clear();
+    m_stats.Invalidations++;
+}
+
+bool DiskPixelCache::LoadIndex()
+{
+    std::ifstream file(m_directory / "index.bin", std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (bytes.size() < sizeof(IndexHeader) + sizeof(uint64_t))
+    {
+        return false;
+    }
+    IndexHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (header.Magic != IndexMagic || header.ContentVersion != m_options.ContentVersion)
+    {
+        // Written by a different version. Nothing in the cache can be trusted.
+        Invalidate();
+        return false;
+    }
+    // Check the counts against the size of the file before multiplying them,
+    // so a corrupt count can't wrap around to the right size.
+    auto available = bytes.size() - sizeof(IndexHeader) - sizeof(uint64_t);
+    if (header.SegmentCount > available / sizeof(IndexSegment))
+    {
+        return false;
+    }
+    available -= header.SegmentCount * sizeof(IndexSegment);
+    if (header.EntryCount > available / sizeof(IndexEntry))
+    {
+        return false;
+    }
+    auto expected = sizeof(IndexHeader) + header.SegmentCount * sizeof(IndexSegment) + header.EntryCount * sizeof(IndexEntry) + sizeof(uint64_t);
+    uint64_t checksum = 0;
+    if (bytes.size() != expected)
+    {
+        return false;
+    }
+    std::memcpy(&checksum, bytes.data() + bytes.size() - sizeof(checksum), sizeof(checksum));
+    if (checksum != Checksum(bytes.data(), bytes.size() - sizeof(checksum)))
+    {
+        return false;
+    }
+
+    auto position = bytes.data() + sizeof(IndexHeader);
+    for (uint32_t i = 0; i < header.SegmentCount; i++, position += sizeof(IndexSegment))
+    {
+        IndexSegment segment;
+        std::memcpy(&segment, position, sizeof(segment));
+        m_segments.push_back({ segment.Id, segment.Length, nullptr, false });
+    }
+    for (uint64_t i = 0; i < header.EntryCount; i++, position += sizeof(IndexEntry))
+    {
+        IndexEntry entry;
+        std::memcpy(&entry, position, sizeof(entry));
+        m_index.emplace(entry.KeyHash, Location{ entry.Segment, entry.Offset });
+    }
+    return true;
+}
+
+void DiskPixelCache::WriteIndex()
+{
+    // The records the index points at have to be on disk before it is.
+    // Otherwise a power cut can leave an index that covers records that were
+    // never written, and the next open trusts it without scanning them.
+    m_writer.flush();
+    for (auto& segment : m_segments)
+    {
+        if (segment.Unsynced)
+        {
+            SyncFile(SegmentPath(segment.Id));
+            segment.Unsynced = false;
+        }
+    }
+
+    std::vector<uint8_t> bytes(sizeof(IndexHeader) + m_segments.size() * sizeof(IndexSegment) + m_index.size() * sizeof(IndexEntry));
+    IndexHeader header = { IndexMagic, m_options.ContentVersion, static_cast<uint32_t>(m_segments.size()), 0, m_index.size() };
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    auto position = bytes.data() + sizeof(IndexHeader);
+    for (auto&& segment : m_segments)
+    {
+        IndexSegment entry = { segment.Id, 0, segment.Length };
+        std::memcpy(position, &entry, sizeof(entry));
+        position += sizeof(entry);
+    }
+    for (auto&& [keyHash, location] : m_index)
+    {
+        IndexEntry entry = { keyHash, location.Segment, 0, location.Offset };
+        std::memcpy(position, &entry, sizeof(entry));
+        position += sizeof(entry);
+    }
+    auto checksum = Checksum(bytes.data(), bytes.size());
+    bytes.resize(bytes.size() + sizeof(checksum));
+    std::memcpy(bytes.data() + bytes.size() - sizeof(checksum), &checksum, sizeof(checksum));
+
+    // Write it next to the old one and swap them, so a crash leaves one or the
+    // other. It has to be on disk before the rename, or a power cut can leave
+    // an empty index.bin in place of the old one.
+    auto temporaryPath = m_directory / "index.tmp";
+    WriteFileDurably(temporaryPath, bytes);
+    std::filesystem::rename(temporaryPath, m_directory / "index.bin");
+    m_lastIndexWrite = std::chrono::steady_clock::now();
+    m_stats.IndexWrites++;
+}
+
+void DiskPixelCache::Recover(Segment& segment, uint64_t indexedLength)
+{
+    if (indexedLength > segment.Length)
+    {
+        // The file is shorter than the index says, so we can't trust what the
+        // index has for it. Start over.
+        std::erase_if(m_index, [&segment](auto const& entry) { return entry.second.Segment == segment.Id; });
+        indexedLength = 0;
+    }
+    if (indexedLength == segment.Length)
+    {
+        return;
+    }
+
+    auto data = Map(segment, segment.Length);
+    auto offset = indexedLength;
+    while (offset + sizeof(RecordHeader) <= segment.Length)
+    {
+        RecordHeader header;
+        std::memcpy(&header, data + offset, sizeof(header));
+        auto remaining = segment.Length - offset;
+        if (header.Magic != RecordMagic || header.ContentVersion != m_options.ContentVersion ||
+            header.PathBytes > remaining || header.PayloadBytes > remaining || RecordSize(header) > remaining ||
+            header.HeaderChecksum != HeaderChecksum(header, data + offset + sizeof(header)) ||
+            header.PayloadChecksum != Checksum(data + offset + PayloadOffset(header), header.PayloadBytes))
+        {
+            break;
+        }
+
+        ImageKey key;
+        std::string path(reinterpret_cast<char const*>(data + offset + sizeof(header)), header.PathBytes);
+        key.Path = std::filesystem::path(std::u8string(path.begin(), path.end()));
+        key.FileSize = header.FileSize;
+        key.ModifiedTime = header.ModifiedTime;
+        key.ContentHash = header.ContentHash;
+        key.TargetWidth = header.TargetWidth;
+        key.TargetHeight = header.TargetHeight;
+        // Later records replace earlier ones.
+        auto existing = FindEntry(key, header.KeyHash);
+        if (existing != m_index.end())
+        {
+            m_index.erase(existing);
+        }
+        m_index.emplace(header.KeyHash, Location{ segment.Id, offset });
+        m_stats.RecordsRecovered++;
+        offset += RecordSize(header);
+    }
+
+    if (offset < segment.Length)
+    {
+        // A torn write (or garbage) at the end. Cut it off so appends start
+        // from a good record.
+        segment.Mapped = nullptr;
+        std::filesystem::resize_file(SegmentPath(segment.Id), offset);
+        segment.Length = offset;
+        segment.Unsynced = true;
+        m_stats.RecordsDiscarded++;
+    }
+    m_indexDirty = true;
+}
+
+uint8_t const* DiskPixelCache::Map(Segment& segment, uint64_t end)
+{
+    if (end > segment.Length)
+    {
+        throw std::out_of_range("Record is past the end of its segment");
+    }
+    if (!segment.Mapped || segment.Mapped->Size < end)
+    {
+        // The segment we're writing to grows, so map whatever it holds now.
+        segment.Mapped = std::make_shared<MappedFile>(SegmentPath(segment.Id), segment.Length);
+    }
+    return segment.Mapped->Data;
+}
+
+DiskPixelCache::Segment* DiskPixelCache::FindSegment(uint32_t id)
+{
+    for (auto& segment : m_segments)
+    {
+        if (segment.Id == id)
+        {
+            return &segment;
+        }
+    }
+    return nullptr;
+}
+
+std::unordered_multimap<uint64_t, DiskPixelCache::Location>::iterator DiskPixelCache::FindEntry(ImageKey const& key, uint64_t keyHash)
+{
+    auto path = PathBytes(key.Path);
+    auto [begin, end] = m_index.equal_range(keyHash);
+    for (auto it = begin; it != end; it++)
+    {
+        auto segment = FindSegment(it->second.Segment);
+        if (segment == nullptr || it->second.Offset + sizeof(RecordHeader) > segment->Length)
+        {
+            continue;
+        }
+        auto data = Map(*segment, std::min(segment->Length, it->second.Offset + sizeof(RecordHeader) + path.size()));
+        if (RecordMatches(data + it->second.Offset, key, path))
+        {
+            return it;
+        }
+    }
+    return m_index.end();
+}
+
+std::optional<PixelBuffer> DiskPixelCache::Load(ImageKey const& key)
+{
+    auto keyHash = StableKeyHash(key, PathBytes(key.Path));
+    RecordHeader header;
+    Location location;
+    std::shared_ptr<MappedFile> mapping;
+    uint8_t const* payload = nullptr;
+    {
+        std::lock_guard lock(m_lock);
+        auto entry = FindEntry(key, keyHash);
+        if (entry == m_index.end())
+        {
+            m_stats.Misses++;
+            return std::nullopt;
+        }
+
+        auto& segment = *FindSegment(entry->second.Segment);
+        location = entry->second;
+        std::memcpy(&header, Map(segment, location.Offset + sizeof(header)) + location.Offset, sizeof(header));
+        auto end = location.Offset + RecordSize(header);
+        if (end > segment.Length || header.PayloadBytes != static_cast<uint64_t>(header.Width) * header.Height * 4)
+        {
+            m_index.erase(entry);
+            m_indexDirty = true;
+            m_stats.RecordsDiscarded++;
+            m_stats.Misses++;
+            return std::nullopt;
+        }
+        payload = Map(segment, end) + location.Offset + PayloadOffset(header);
+        // Holding on to the mapping keeps the pixels readable even if the
+        // segment is evicted while we copy.
+        mapping = segment.Mapped;
+    }
+
+    // Straight out of the mapping, no decode, and without the lock, so big
+    // images don't hold up other loads and stores.
+    if (m_options.VerifyOnRead && header.PayloadChecksum != Checksum(payload, header.PayloadBytes))
+    {
+        std::lock_guard lock(m_lock);
+        // Only drop the entry if it's still the record we read.
+        auto entry = FindEntry(key, keyHash);
+        if (entry != m_index.end() && entry->second.Segment == location.Segment && entry->second.Offset == location.Offset)
+        {
+            m_index.erase(entry);
+            m_indexDirty = true;
+        }
+        m_stats.RecordsDiscarded++;
+        m_stats.Misses++;
+        return std::nullopt;
+    }
+    PixelBuffer image;
+    image.Width = header.Width;
+    image.Height = header.Height;
+    image.Bytes.assign(payload, payload + header.PayloadBytes);
+
+    std::lock_guard lock(m_lock);
+    m_stats.Hits++;
+    return image;
+}
+
+void DiskPixelCache::Store(ImageKey const& key, PixelBuffer const& image)
+{
+    // Build the record before taking the lock.
+    auto path = PathBytes(key.Path);
+    RecordHeader header = {};
+    header.Magic = RecordMagic;
+    header.ContentVersion = m_options.ContentVersion;
+    header.PathBytes = static_cast<uint32_t>(path.size());
+    header.Width = image.Width;
+    header.Height = image.Height;
+    header.TargetWidth = key.TargetWidth;
+    header.TargetHeight = key.TargetHeight;
+    header.KeyHash = StableKeyHash(key, path);
+    header.FileSize = key.FileSize;
+    header.ModifiedTime = key.ModifiedTime;
+    header.ContentHash = key.ContentHash;
+    header.PayloadBytes = image.Bytes.size();
+    header.PayloadChecksum = Checksum(image.Bytes.data(), image.Bytes.size());
+    header.HeaderChecksum = HeaderChecksum(header, reinterpret_cast<uint8_t const*>(path.data()));
+
+    std::vector<char> prefix(PayloadOffset(header), 0);
+    std::memcpy(prefix.data(), &header, sizeof(header));
+    std::memcpy(prefix.data() + sizeof(header), path.data(), path.size());
+    std::vector<char> suffix(RecordSize(header) - PayloadOffset(header) - header.PayloadBytes, 0);
+    auto recordSize = RecordSize(header);
+
+    std::lock_guard lock(m_lock);
+    OpenWriter(recordSize);
+    auto& segment = m_segments.back();
+    m_writer.write(prefix.data(), prefix.size());
+    m_writer.write(reinterpret_cast<char const*>(image.Bytes.data()), image.Bytes.size());
+    m_writer.write(suffix.data(), suffix.size());
+    if (!m_writer.flush())
+    {
+        // We don't know how much made it out. Carry on in a new segment, the
+        // next open will cut this one back to its last good record.
+        m_writer.close();
+        m_segments.push_back({ segment.Id + 1, 0, nullptr, false });
+        throw std::runtime_error("Couldn't write to the disk cache");
+    }
+
+    auto existing = FindEntry(key, header.KeyHash);
+    if (existing != m_index.end())
+    {
+        m_index.erase(existing);
+    }
+    m_index.emplace(header.KeyHash, Location{ segment.Id, segment.Length });
+    segment.Length += recordSize;
+    segment.Unsynced = true;
+    m_indexDirty = true;
+    m_stats.Writes++;
+    m_stats.BytesWritten += recordSize;
+    EvictSegments();
+}
+
+void DiskPixelCache::OpenWriter(uint64_t recordSize)
+{
+    // Keep appending to the last segment while the record fits (or the segment
+    // is empty), including the one that was last being written before we opened.
+    auto full = m_segments.empty() || (m_segments.back().Length > 0 && m_segments.back().Length + recordSize > m_options.SegmentBytes);
+    if (m_writer.is_open() && !full)
+    {
+        return;
+    }
+    m_writer.close();
+    m_writer.clear();
+    if (full)
+    {
+        auto id = m_segments.empty() ? 1 : m_segments.back().Id + 1;
+        m_segments.push_back({ id, 0, nullptr, false });
+    }
+    m_writer.open(SegmentPath(m_segments.back().Id), std::ios::binary | std::ios::app);
+    if (!m_writer)
+    {
+        throw std::runtime_error("Couldn't open a cache segment for writing");
+    }
+}
+
+void DiskPixelCache::EvictSegments()
+{
+    auto total = SizeBytesLocked();
+    // The last segment is the one being written to, it always stays.
+    while (total > m_options.MaxBytes && m_segments.size() > 1)
+    {
+        auto& oldest = m_segments.front();
+        auto id = oldest.Id;
+        auto before = m_index.size();
+        std::erase_if(m_index, [id](auto const& entry) { return entry.second.Segment == id; });
+        m_stats.EntriesEvicted += before - m_index.size();
+        m_stats.SegmentsEvicted++;
+        total -= oldest.Length;
+        oldest.Mapped = nullptr;
+        std::filesystem::remove(SegmentPath(id));
+        m_segments.pop_front();
+        m_indexDirty = true;
+    }
+}
+
+uint64_t DiskPixelCache::SizeBytesLocked()
+{
+    uint64_t total = 0;
+    for (auto&& segment : m_segments)
+    {
+        total += segment.Length;
+    }
+    return total;
+}
+
+void DiskPixelCache::Flush()
+{
+    std::lock_guard lock(m_lock);
+    if (m_indexDirty)
+    {
+        WriteIndex();
+        m_indexDirty = false;
+    }
+}
+
+void DiskPixelCache::FlushIfDue()
+{
+    std::lock_guard lock(m_lock);
+    if (m_indexDirty && std::chrono::steady_clock::now() - m_lastIndexWrite >= m_options.FlushInterval)
+    {
+        WriteIndex();
+        m_indexDirty = false;
+    }
+}
+
+uint64_t DiskPixelCache::SizeBytes()
+{
+    std::lock_guard lock(m_lock);
+    return SizeBytesLocked();
+}
+
+size_t DiskPixelCache::EntryCount()
+{
+    std::lock_guard lock(m_lock);
+    return m_index.size();
+}
+
+DiskPixelCacheStats DiskPixelCache::Stats()
+{
+    std::lock_guard lock(m_lock);
+    return m_stats;
+}
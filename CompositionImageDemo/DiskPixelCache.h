@@ -0,0 +1,117 @@
+#pragma once
+#include "DecodedImageCache.h"
+#include "MappedFile.h"
+
+struct DiskPixelCacheOptions
+{
+    // Once the segments add up to more than this, the oldest ones are deleted.
+    uint64_t MaxBytes = 1024ull * 1024 * 1024;
+    // A new segment is started once the current one reaches this size.
+    uint64_t SegmentBytes = 64 * 1024 * 1024;
+    // Bump this whenever what goes into the cache changes (a different decoder,
+    // color management, ...). A cache written with another version is thrown away.
+    uint32_t ContentVersion = 1;
+    // Check every record's checksum when it's read, not just when recovering.
+    bool VerifyOnRead = false;
+    // FlushIfDue writes the index at most this often.
+    std::chrono::milliseconds FlushInterval = std::chrono::seconds(5);
+};
+
+struct DiskPixelCacheStats
+{
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+    uint64_t Writes = 0;
+    uint64_t BytesWritten = 0;
+    uint64_t SegmentsEvicted = 0;
+    uint64_t EntriesEvicted = 0;
+    // Records found past the end of the saved index on open, e.g. because the
+    // process exited before the index was written.
+    uint64_t RecordsRecovered = 0;
+    // Torn or corrupt records that were cut off on open, or failed verification.
+    uint64_t RecordsDiscarded = 0;
+    // Times the whole cache was thrown away because of a version mismatch.
+    uint64_t Invalidations = 0;
+    uint64_t IndexWrites = 0;
+};
+
+// Decoded pixels on disk, so images don't have to go through the decoder again
+// after a restart. The pixels are stored exactly the way they're uploaded (BGRA,
+// premultiplied, already oriented), and are read straight out of a mapping of
+// the file. Different display sizes of the same image are different keys.
+//
+// Records are only ever appended to segment files. Each record carries its own
+// checksums, so a write that was cut short by a crash is found and cut off the
+// next time the cache is opened. The index (which record is where) is small
+// and written to a temporary file and renamed over the old one, so it's never
+// half written. The segments it points into are synced to disk first, so it
+// never covers records a power cut could lose. Anything appended after the
+// index was last written is found again by scanning the end of the segments.
+// Space is reclaimed by deleting whole segments, oldest first.
+//
+// All methods can be called from any thread. Loads only hold the lock to find
+// the record, the pixels are copied out of the mapping without it.
+class DiskPixelCache
+{
+public:
+    DiskPixelCache(std::filesystem::path const& directory, DiskPixelCacheOptions const& options = {});
+    // Writes the index.
+    ~DiskPixelCache();
+    DiskPixelCache(DiskPixelCache const&) = delete;
+    DiskPixelCache& operator=(DiskPixelCache const&) = delete;
+
+    std::optional<PixelBuffer> Load(ImageKey const& key);
+    // A later Store for the same key replaces the earlier one.
+    void Store(ImageKey const& key, PixelBuffer const& image);
+    // Writes the index. Records are safe on disk without it, but it saves
+    // scanning them on the next open.
+    void Flush();
+    // Flushes if the index hasn't been written for FlushInterval. Cheap enough
+    // to call after every Store, so a burst of stores writes the index once
+    // rather than once each.
+    void FlushIfDue();
+
+    uint64_t SizeBytes();
+    size_t EntryCount();
+    DiskPixelCacheStats Stats();
+
+private:
+    struct Segment
+    {
+        uint32_t Id = 0;
+        uint64_t Length = 0;
+        std::shared_ptr<MappedFile> Mapped;
+        // Written to (or cut back) since it was last synced to disk.
+        bool Unsynced = false;
+    };
+
+    struct Location
+    {
+        uint32_t Segment;
+        uint64_t Offset;
+    };
+
+    void Open();
+    void Invalidate();
+    bool LoadIndex();
+    void WriteIndex();
+    void Recover(Segment& segment, uint64_t indexedLength);
+    uint8_t const* Map(Segment& segment, uint64_t end);
+    Segment* FindSegment(uint32_t id);
+    std::unordered_multimap<uint64_t, Location>::iterator FindEntry(ImageKey const& key, uint64_t keyHash);
+    void OpenWriter(uint64_t recordSize);
+    void EvictSegments();
+    uint64_t SizeBytesLocked();
+    std::filesystem::path SegmentPath(uint32_t id) const;
+
+    std::filesystem::path m_directory;
+    DiskPixelCacheOptions m_options;
+
+    std::mutex m_lock;
+    std::deque<Segment> m_segments;
+    std::unordered_multimap<uint64_t, Location> m_index;
+    std::ofstream m_writer;
+    bool m_indexDirty = false;
+    std::chrono::steady_clock::time_point m_lastIndexWrite;
+    DiskPixelCacheStats m_stats;
+};
@@ -0,0 +1,450 @@
+#include "pch.h"
+#include "FilterGraph.h"
+#include "Parallel.h"
+
+namespace
+{
+    // Edge length of the output tiles. With a few pixels of border, the working
+    // buffers for a tile come to a few hundred KB, which fits in L2.
+    constexpr uint32_t TileSize = 64;
+    // Rows handed to each worker when running over the whole image.
+    constexpr uint32_t RowsPerBand = 32;
+
+    // Float RGBA pixels (0 to 1) covering a rectangle of the image. The
+    // rectangle can extend past the edges of the image.
+    struct FloatRegion
+    {
+        int32_t X = 0;
+        int32_t Y = 0;
+        uint32_t Width = 0;
+        uint32_t Height = 0;
+        std::vector<float> Pixels;
+
+        // Keeps the allocation around so tiles can reuse it.
+        void Reset(int32_t x, int32_t y, uint32_t width, uint32_t height)
+        {
+            X = x;
+            Y = y;
+            Width = width;
+            Height = height;
+            Pixels.resize(static_cast<size_t>(width) * height * 4);
+        }
+
+        float* Row(uint32_t y) { return Pixels.data() + static_cast<size_t>(y) * Width * 4; }
+        float const* Row(uint32_t y) const { return Pixels.data() + static_cast<size_t>(y) * Width * 4; }
+    };
+
+    // Working buffers for one run of the chain.
+    struct Scratch
+    {
+        FloatRegion Current;
+        FloatRegion Next;
+        FloatRegion Horizontal;
+        FloatRegion Blurred;
+        std::vector<float> ColumnSums;
+    };
+
+    // Both point filters boil down to color = clamp(Scale * color + Offset * alpha, 0, alpha).
+    struct Stage
+    {
+        FilterKind Kind;
+        float Scale = 1.0f;
+        float Offset = 0.0f;
+        float Amount = 0.0f;
+        uint32_t Radius = 0;
+
+        bool IsPoint() const { return Kind == FilterKind::Exposure || Kind == FilterKind::Contrast; }
+    };
+
+    std::vector<Stage> BuildStages(std::vector<Filter> const& filters)
+    {
+        std::vector<Stage> stages;
+        stages.reserve(filters.size());
+        for (auto&& filter : filters)
+        {
+            Stage stage{ filter.Kind };
+            switch (filter.Kind)
+            {
+            case FilterKind::Exposure:
+                stage.Scale = std::exp2(filter.Amount);
+                break;
+            case FilterKind::Contrast:
+                // Pivot around mid-grey, which is alpha / 2 when premultiplied.
+                stage.Scale = filter.Amount;
+                stage.Offset = 0.5f * (1.0f - filter.Amount);
+                break;
+            case FilterKind::BoxBlur:
+            case FilterKind::Sharpen:
+                stage.Amount = filter.Amount;
+                stage.Radius = filter.Radius;
+                break;
+            }
+            stages.push_back(stage);
+        }
+        return stages;
+    }
+
+    // How a chain is run. On a tile, everything runs on the calling thread and
+    // consecutive point filters are done in a single sweep. On the whole image,
+    // every filter is its own pass with rows split across cores.
+    enum class ChainMode
+    {
+        Tile,
+        WholeImage,
+    };
+
+    template <typename Func>
+    void ForRows(uint32_t rows, uint32_t width, ChainMode mode, Func&& func)
+    {
+        if (mode == ChainMode::Tile)
+        {
+            func(0u, rows);
+            return;
+        }
+        auto bands = (rows + RowsPerBand - 1) / RowsPerBand;
+        ParallelFor(bands, [&](uint32_t band)
+            {
+                func(band * RowsPerBand, std::min(rows, (band + 1) * RowsPerBand));
+            }, static_cast<uint64_t>(rows) * width);
+    }
+
+    void LoadRegion(PixelBuffer const& source, FloatRegion& region, ChainMode mode)
+    {
+        constexpr auto scale = 1.0f / 255.0f;
+        auto maxX = static_cast<int32_t>(source.Width) - 1;
+        auto maxY = static_cast<int32_t>(source.Height) - 1;
+        ForRows(region.Height, region.Width, mode, [&](uint32_t begin, uint32_t end)
+            {
+                for (auto y = begin; y < end; y++)
+                {
+                    auto sourceRow = source.Row(static_cast<uint32_t>(std::clamp(region.Y + static_cast<int32_t>(y), 0, maxY)));
+                    auto destination = region.Row(y);
+                    for (uint32_t x = 0; x < region.Width; x++, destination += 4)
+                    {
+                        auto sourcePixel = sourceRow + std::clamp(region.X + static_cast<int32_t>(x), 0, maxX) * 4;
+                        for (int channel = 0; channel < 4; channel++)
+                        {
+                            destination[channel] = sourcePixel[channel] * scale;
+                        }
+                    }
+                }
+            });
+    }
+
+    // The region must be entirely inside the destination.
+    void StoreRegion(FloatRegion const& region, PixelBuffer& destination, ChainMode mode)
+    {
+        ForRows(region.Height, region.Width, mode, [&](uint32_t begin, uint32_t end)
+            {
+                for (auto y = begin; y < end; y++)
+                {
+                    auto source = region.Row(y);
+                    auto destinationRow = destination.Row(region.Y + y) + region.X * 4;
+                    for (size_t i = 0; i < region.Width * 4; i++)
+                    {
+                        destinationRow[i] = static_cast<uint8_t>(std::clamp(source[i] * 255.0f + 0.5f, 0.0f, 255.0f));
+                    }
+                }
+            });
+    }
+
+    // After a neighbourhood filter, the pixels outside the image hold filtered
+    // copies of the old edge. Replace them with copies of the new edge, so the
+    // next filter sees what it would have seen running over the whole image.
+    void RefreshBorder(FloatRegion& region, uint32_t imageWidth, uint32_t imageHeight)
+    {
+        auto left = static_cast<uint32_t>(std::max(0, -region.X));
+        auto top = static_cast<uint32_t>(std::max(0, -region.Y));
+        auto right = static_cast<uint32_t>(std::max(0, region.X + static_cast<int32_t>(region.Width) - static_cast<int32_t>(imageWidth)));
+        auto bottom = static_cast<uint32_t>(std::max(0, region.Y + static_cast<int32_t>(region.Height) - static_cast<int32_t>(imageHeight)));
+        if (left == 0 && top == 0 && right == 0 && bottom == 0)
+        {
+            return;
+        }
+
+        auto rowSize = region.Width * 4 * sizeof(float);
+        for (auto y = top; y < region.Height - bottom; y++)
+        {
+            auto row = region.Row(y);
+            for (uint32_t x = 0; x < left; x++)
+            {
+                memcpy(row + x * 4, row + left * 4, 4 * sizeof(float));
+            }
+            for (auto x = region.Width - right; x < region.Width; x++)
+            {
+                memcpy(row + x * 4, row + (region.Width - right - 1) * 4, 4 * sizeof(float));
+            }
+        }
+        for (uint32_t y = 0; y < top; y++)
+        {
+            memcpy(region.Row(y), region.Row(top), rowSize);
+        }
+        for (auto y = region.Height - bottom; y < region.Height; y++)
+        {
+            memcpy(region.Row(y), region.Row(region.Height - bottom - 1), rowSize);
+        }
+    }
+
+    void ApplyPointStages(FloatRegion& region, Stage const* first, Stage const* last, ChainMode mode)
+    {
+        ForRows(region.Height, region.Width, mode, [&](uint32_t begin, uint32_t end)
+            {
+                for (auto y = begin; y < end; y++)
+                {
+                    auto pixel = region.Row(y);
+                    for (uint32_t x = 0; x < region.Width; x++, pixel += 4)
+                    {
+                        auto alpha = pixel[3];
+                        for (auto stage = first; stage != last; stage++)
+                        {
+                            for (int channel = 0; channel < 3; channel++)
+                            {
+                                pixel[channel] = std::clamp(stage->Scale * pixel[channel] + stage->Offset * alpha, 0.0f, alpha);
+                            }
+                        }
+                    }
+                }
+            });
+    }
+
+    // Horizontal half of a box blur. The output is 2 * radius narrower than the input.
+    void BlurRows(FloatRegion const& input, FloatRegion& output, uint32_t radius, uint32_t begin, uint32_t end)
+    {
+        auto window = 2 * radius + 1;
+        auto scale = 1.0f / window;
+        for (auto y = begin; y < end; y++)
+        {
+            auto source = input.Row(y);
+            auto destination = output.Row(y);
+            float sum[4] = {};
+            for (uint32_t i = 0; i < window; i++)
+            {
+                for (int channel = 0; channel < 4; channel++)
+                {
+                    sum[channel] += source[i * 4 + channel];
+                }
+            }
+            for (uint32_t x = 0; x < output.Width; x++)
+            {
+                for (int channel = 0; channel < 4; channel++)
+                {
+                    destination[x * 4 + channel] = sum[channel] * scale;
+                }
+                if (x + 1 < output.Width)
+                {
+                    for (int channel = 0; channel < 4; channel++)
+                    {
+                        sum[channel] += source[(x + window) * 4 + channel] - source[x * 4 + channel];
+                    }
+                }
+            }
+        }
+    }
+
+    // Vertical half of a box blur. Output rows [begin, end) are produced with a
+    // running sum per column, the output is 2 * radius shorter than the input.
+    void BlurColumns(FloatRegion const& input, FloatRegion& output, uint32_t radius, uint32_t begin, uint32_t end, std::vector<float>& sums)
+    {
+        auto window = 2 * radius + 1;
+        auto scale = 1.0f / window;
+        auto rowLength = static_cast<size_t>(input.Width) * 4;
+        sums.assign(rowLength, 0.0f);
+        for (uint32_t i = 0; i < window; i++)
+        {
+            auto source = input.Row(begin + i);
+            for (size_t j = 0; j < rowLength; j++)
+            {
+                sums[j] += source[j];
+            }
+        }
+        for (auto y = begin; y < end; y++)
+        {
+            auto destination = output.Row(y);
+            for (size_t j = 0; j < rowLength; j++)
+            {
+                destination[j] = sums[j] * scale;
+            }
+            if (y + 1 < end)
+            {
+                auto entering = input.Row(y + window);
+                auto leaving = input.Row(y);
+                for (size_t j = 0; j < rowLength; j++)
+                {
+                    sums[j] += entering[j] - leaving[j];
+                }
+            }
+        }
+    }
+
+    void SharpenRows(FloatRegion const& input, FloatRegion const& blurred, FloatRegion& output, float amount, uint32_t radius, uint32_t begin, uint32_t end)
+    {
+        for (auto y = begin; y < end; y++)
+        {
+            auto source = input.Row(y + radius) + radius * 4;
+            auto blur = blurred.Row(y);
+            auto destination = output.Row(y);
+            for (uint32_t x = 0; x < output.Width; x++, source += 4, blur += 4, destination += 4)
+            {
+                auto alpha = source[3];
+                for (int channel = 0; channel < 3; channel++)
+                {
+                    destination[channel] = std::clamp(source[channel] + amount * (source[channel] - blur[channel]), 0.0f, alpha);
+                }
+                destination[3] = alpha;
+            }
+        }
+    }
+
+    void ApplyNeighbourhoodStage(Stage const& stage, Scratch& scratch, ChainMode mode)
+    {
+        auto& current = scratch.Current;
+        auto radius = stage.Radius;
+        scratch.Horizontal.Reset(current.X + radius, current.Y, current.Width - 2 * radius, current.Height);
+        scratch.Next.Reset(current.X + radius, current.Y + radius, current.Width - 2 * radius, current.Height - 2 * radius);
+        auto& blurred = stage.Kind == FilterKind::BoxBlur ? scratch.Next : scratch.Blurred;
+        if (stage.Kind == FilterKind::Sharpen)
+        {
+            blurred.Reset(scratch.Next.X, scratch.Next.Y, scratch.Next.Width, scratch.Next.Height);
+        }
+
+        ForRows(current.Height, current.Width, mode, [&](uint32_t begin, uint32_t end)
+            {
+                BlurRows(current, scratch.Horizontal, radius, begin, end);
+            });
+        if (mode == ChainMode::Tile)
+        {
+            BlurColumns(scratch.Horizontal, blurred, radius, 0, blurred.Height, scratch.ColumnSums);
+        }
+        else
+        {
+            ForRows(blurred.Height, blurred.Width, mode, [&](uint32_t begin, uint32_t end)
+                {
+                    std::vector<float> sums;
+                    BlurColumns(scratch.Horizontal, blurred, radius, begin, end, sums);
+                });
+        }
+        if (stage.Kind == FilterKind::Sharpen)
+        {
+            ForRows(scratch.Next.Height, scratch.Next.Width, mode, [&](uint32_t begin, uint32_t end)
+                {
+                    SharpenRows(current, blurred, scratch.Next, stage.Amount, radius, begin, end);
+                });
+        }
+    }
+
+    // Runs the stages over scratch.Current. Each neighbourhood filter shrinks
+    // the region by its radius on every side.
+    void RunChain(std::vector<Stage> const& stages, Scratch& scratch, uint32_t imageWidth, uint32_t imageHeight, ChainMode mode)
+    {
+        size_t i = 0;
+        while (i < stages.size())
+        {
+            if (stages[i].IsPoint())
+            {
+                auto last = i + 1;
+                if (mode == ChainMode::Tile)
+                {
+                    while (last < stages.size() && stages[last].IsPoint())
+                    {
+                        last++;
+                    }
+                }
+                ApplyPointStages(scratch.Current, stages.data() + i, stages.data() + last, mode);
+                i = last;
+                continue;
+            }
+
+            if (stages[i].Radius > 0)
+            {
+                ApplyNeighbourhoodStage(stages[i], scratch, mode);
+                RefreshBorder(scratch.Next, imageWidth, imageHeight);
+                std::swap(scratch.Current, scratch.Next);
+            }
+            i++;
+        }
+    }
+}
+
+FilterGraph& FilterGraph::Exposure(float stops)
+{
+    m_filters.push_back({ FilterKind::Exposure, stops });
+    return *this;
+}
+
+FilterGraph& FilterGraph::Contrast(float amount)
+{
+    m_filters.push_back({ FilterKind::Contrast, amount });
+    return *this;
+}
+
+FilterGraph& FilterGraph::BoxBlur(uint32_t radius)
+{
+    m_filters.push_back({ FilterKind::BoxBlur, 0.0f, radius });
+    return *this;
+}
+
+FilterGraph& FilterGraph::Sharpen(float amount, uint32_t radius)
+{
+    m_filters.push_back({ FilterKind::Sharpen, amount, radius });
+    return *this;
+}
+
+uint32_t FilterGraph::BorderSize() const
+{
+    uint32_t border = 0;
+    for (auto&& filter : m_filters)
+    {
+        border += filter.Radius;
+    }
+    return border;
+}
+
+PixelBuffer FilterGraph::Apply(PixelBuffer const& source) const
+{
+    if (m_filters.empty())
+    {
+        return source;
+    }
+
+    auto stages = BuildStages(m_filters);
+    auto border = BorderSize();
+    PixelBuffer result(source.Width, source.Height);
+    auto tilesWide = (source.Width + TileSize - 1) / TileSize;
+    auto tilesHigh = (source.Height + TileSize - 1) / TileSize;
+    ParallelFor(tilesWide * tilesHigh, [&](uint32_t tile)
+        {
+            thread_local Scratch scratch;
+            auto x = (tile % tilesWide) * TileSize;
+            auto y = (tile / tilesWide) * TileSize;
+            auto width = std::min(TileSize, source.Width - x);
+            auto height = std::min(TileSize, source.Height - y);
+            scratch.Current.Reset(
+                static_cast<int32_t>(x) - static_cast<int32_t>(border),
+                static_cast<int32_t>(y) - static_cast<int32_t>(border),
+                width + 2 * border,
+                height + 2 * border);
+            LoadRegion(source, scratch.Current, ChainMode::Tile);
+            RunChain(stages, scratch, source.Width, source.Height, ChainMode::Tile);
+            StoreRegion(scratch.Current, result, ChainMode::Tile);
+        }, static_cast<uint64_t>(source.Width) * source.Height);
+    return result;
+}
+
+PixelBuffer FilterGraph::ApplyUnfused(PixelBuffer const& source) const
+{
+    if (m_filters.empty())
+    {
+        return source;
+    }
+
+    auto stages = BuildStages(m_filters);
+    auto border = BorderSize();
+    Scratch scratch;
+    scratch.Current.Reset(-static_cast<int32_t>(border), -static_cast<int32_t>(border), source.Width + 2 * border, source.Height + 2 * border);
+    LoadRegion(source, scratch.Current, ChainMode::WholeImage);
+    RunChain(stages, scratch, source.Width, source.Height, ChainMode::WholeImage);
+
+    PixelBuffer result(source.Width, source.Height);
+    StoreRegion(scratch.Current, result, ChainMode::WholeImage);
+    return result;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "PixelBuffer.h"
+
+enum class FilterKind
+{
+    // Point filters only look at the pixel they're writing.
+    Exposure,
+    Contrast,
+    // Neighbourhood filters read a square of pixels around the one they're writing.
+    BoxBlur,
+    Sharpen,
+};
+
+struct Filter
+{
+    FilterKind Kind;
+    float Amount = 0.0f;
+    uint32_t Radius = 0;
+};
+
+// A chain of filters to run on a decoded image before it is uploaded. Running
+// the filters one after the other over the whole image would read and write
+// every pixel once per filter. Instead, Apply runs the entire chain on one
+// tile at a time (plus enough border for the neighbourhood filters), so the
+// intermediate results stay in cache. Tiles are processed in parallel.
+//
+// Filters work in premultiplied space, and color is always clamped to alpha.
+// Pixels past the edge of the image repeat the edge.
+class FilterGraph
+{
+public:
+    // Scales the color by 2^stops.
+    FilterGraph& Exposure(float stops);
+    // Scales the distance from mid-grey. 1 leaves the image unchanged.
+    FilterGraph& Contrast(float amount);
+    // Averages the (2 * radius + 1)^2 square around each pixel. Chaining three
+    // of these is a decent approximation of a gaussian blur.
+    FilterGraph& BoxBlur(uint32_t radius);
+    // Unsharp mask: adds back 'amount' of the difference from a box blur.
+    FilterGraph& Sharpen(float amount, uint32_t radius);
+
+    bool Empty() const { return m_filters.empty(); }
+    std::vector<Filter> const& Filters() const { return m_filters; }
+
+    PixelBuffer Apply(PixelBuffer const& source) const;
+    // Runs each filter as a separate pass over the whole image. The results
+    // match Apply (give or take rounding), this exists to measure what the
+    // tiling buys us.
+    PixelBuffer ApplyUnfused(PixelBuffer const& source) const;
+
+private:
+    uint32_t BorderSize() const;
+
+    std::vector<Filter> m_filters;
+};
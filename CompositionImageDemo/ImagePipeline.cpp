@@ -0,0 +1,232 @@
+#include "pch.h"
+#include "ImagePipeline.h"
+
+namespace
+{
+    PackedPixelFormat ToPackedFormat(SurfaceFormat format)
+    {
+        switch (format)
+        {
+        case SurfaceFormat::B5G6R5:
+            return PackedPixelFormat::B5G6R5;
+        case SurfaceFormat::B4G4R4A4:
+            return PackedPixelFormat::B4G4R4A4;
+        default:
+            throw std::invalid_argument("Not a packed pixel format");
+        }
+    }
+}
+
+ImagePipeline::ImagePipeline(
+    std::shared_ptr<RenderDevice> device,
+    ImagePipelineOptions const& options,
+    UploadBatcher::ScheduleFlushHandler scheduleFlush,
+    UploadScheduler::Clock clock) :
+    m_uploadScheduler(options.Scheduling, [this]() { FlushBatch(); }, std::move(clock))
+{
+    if (!device)
+    {
+        throw std::invalid_argument("An image pipeline needs a device");
+    }
+    if (!scheduleFlush)
+    {
+        throw std::invalid_argument("An image pipeline needs a way to schedule flushes");
+    }
+    m_device = std::move(device);
+    m_options = options;
+    m_scheduleFlush = std::move(scheduleFlush);
+
+    // Uploads only reach the batcher from RunFrame, on the thread that owns
+    // the surfaces, and every frame ends with a flush. So the only flush it
+    // needs to ask for is for a batch that hit a size limit part way through
+    // a frame, and that can be done right away.
+    auto renderDevice = m_device;
+    m_uploadBatcher = std::make_unique<UploadBatcher>(
+        m_options.Batching,
+        [this](std::chrono::milliseconds delay)
+        {
+            if (delay.count() == 0)
+            {
+                FlushBatch();
+            }
+        },
+        [renderDevice]()
+        {
+            renderDevice->BeginUploads();
+        },
+        [renderDevice]()
+        {
+            renderDevice->EndUploads();
+        });
+
+    CreateUploadRings();
+
+    m_deviceReplacedToken = m_device->DeviceReplaced([this]()
+        {
+            // Whatever is still waiting, including a batch the old device was
+            // lost during, can go to the new one.
+            CreateUploadRings();
+            m_deviceReplacements++;
+            m_scheduleFlush(std::chrono::milliseconds(0));
+        });
+}
+
+ImagePipeline::~ImagePipeline()
+{
+    m_device->RevokeDeviceReplaced(m_deviceReplacedToken);
+}
+
+void ImagePipeline::CreateUploadRings()
+{
+    std::vector<std::shared_ptr<UploadRing>> uploadRings;
+    if (m_options.Ring.PageCount > 0)
+    {
+        for (auto format : { SurfaceFormat::B8G8R8A8, SurfaceFormat::B5G6R5, SurfaceFormat::B4G4R4A4 })
+        {
+            auto device = m_device;
+            auto width = m_options.Ring.PageWidth;
+            auto height = m_options.Ring.PageHeight;
+            uploadRings.push_back(std::make_shared<UploadRing>(format, m_options.Ring, m_device->CreateUploadFence(),
+                [device, format, width, height]()
+                {
+                    return device->CreateUploadPage(format, width, height);
+                }));
+        }
+    }
+    m_uploadBatcher->SetUploadRings(uploadRings);
+    std::lock_guard lock(m_ringLock);
+    m_uploadRings = std::move(uploadRings);
+}
+
+UploadRingStats ImagePipeline::RingStats()
+{
+    std::lock_guard lock(m_ringLock);
+    UploadRingStats total;
+    for (auto& ring : m_uploadRings)
+    {
+        auto stats = ring->Stats();
+        total.Allocations += stats.Allocations;
+        total.Splits += stats.Splits;
+        total.OversizeFallbacks += stats.OversizeFallbacks;
+        total.FullFallbacks += stats.FullFallbacks;
+        total.Stalls += stats.Stalls;
+        total.StallTime += stats.StallTime;
+        total.PagesSubmitted += stats.PagesSubmitted;
+        total.PagesCreated += stats.PagesCreated;
+        total.BytesAllocated += stats.BytesAllocated;
+        total.BytesUnused += stats.BytesUnused;
+        total.PeakPagesInUse = std::max(total.PeakPagesInUse, stats.PeakPagesInUse);
+    }
+    return total;
+}
+
+double ImagePipeline::RingUtilization()
+{
+    std::lock_guard lock(m_ringLock);
+    double utilization = 0.0;
+    for (auto& ring : m_uploadRings)
+    {
+        utilization = std::max(utilization, ring->Utilization());
+    }
+    return utilization;
+}
+
+void ImagePipeline::Upload(
+    std::shared_ptr<SurfaceBackend> const& surface,
+    std::shared_ptr<PixelBuffer const> image,
+    std::optional<SurfaceRect> const& rect,
+    std::function<void()> onUploaded,
+    int32_t priority)
+{
+    if (!rect && !m_options.Filters.Empty())
+    {
+        image = std::make_shared<PixelBuffer const>(m_options.Filters.Apply(*image));
+    }
+    Schedule(surface, std::move(image), rect, std::move(onUploaded), priority);
+}
+
+void ImagePipeline::Upload(
+    PooledSurface const& surface,
+    std::shared_ptr<PixelBuffer const> image,
+    std::function<void()> onUploaded,
+    int32_t priority)
+{
+    if (image->Width != surface.Width || image->Height != surface.Height)
+    {
+        throw std::invalid_argument("Image doesn't match the size of the pooled surface");
+    }
+    if (!m_options.Filters.Empty())
+    {
+        image = std::make_shared<PixelBuffer const>(m_options.Filters.Apply(*image));
+    }
+    SurfaceRect rect = { 0, 0, image->Width, image->Height };
+    Schedule(surface.Surface, std::move(image), rect, std::move(onUploaded), priority);
+}
+
+void ImagePipeline::Schedule(
+    std::shared_ptr<SurfaceBackend> const& surface,
+    std::shared_ptr<PixelBuffer const> source,
+    std::optional<SurfaceRect> const& rect,
+    std::function<void()> onUploaded,
+    int32_t priority)
+{
+    // When the batch is flushed, the surface is resized (for whole images),
+    // our rows are staged in the upload ring, BeginDraw tells us where the
+    // surface lives in its atlas, and the GPU copies them there. The pixels
+    // wait with the scheduler until their frame comes up, and then with the
+    // batcher until the batch is written, without a copy.
+    UploadScheduler::UploadHandler upload;
+    uint64_t bytes = 0;
+    auto format = surface->Format();
+    if (format == SurfaceFormat::B8G8R8A8)
+    {
+        bytes = source->Bytes.size();
+        upload = [this, surface, rect, pixels = std::move(source), onUploaded = std::move(onUploaded)]()
+        {
+            m_uploadBatcher->Enqueue(surface, rect, pixels, pixels->Bytes.data(), pixels->Stride(), pixels->Width, pixels->Height, onUploaded);
+        };
+    }
+    else
+    {
+        auto packed = std::make_shared<PackedPixelBuffer const>(ConvertPixels(*source, ToPackedFormat(format), m_options.Dither));
+        bytes = static_cast<uint64_t>(packed->Stride()) * packed->Height;
+        upload = [this, surface, rect, pixels = std::move(packed), onUploaded = std::move(onUploaded)]()
+        {
+            m_uploadBatcher->Enqueue(surface, rect, pixels, reinterpret_cast<uint8_t const*>(pixels->Pixels.data()), pixels->Stride(), pixels->Width, pixels->Height, onUploaded);
+        };
+    }
+
+    // The first upload to arrive gets a flush scheduled. Waiting a little lets
+    // other loads that finish around the same time join it.
+    if (m_uploadScheduler.Schedule(priority, bytes, std::move(upload)) == 1)
+    {
+        m_scheduleFlush(m_options.Batching.MaxLatency);
+    }
+}
+
+size_t ImagePipeline::Flush()
+{
+    auto count = m_uploadScheduler.RunFrame();
+    if (count == 0)
+    {
+        // There may still be a batch left over from a lost device.
+        FlushBatch();
+    }
+    if (m_uploadScheduler.QueueDepth() > 0)
+    {
+        m_scheduleFlush(m_options.FrameInterval);
+    }
+    return count;
+}
+
+void ImagePipeline::FlushBatch()
+{
+    try
+    {
+        m_uploadBatcher->Flush();
+    }
+    catch (DeviceLostError const&)
+    {
+        // The batcher keeps the batch until DeviceReplaced asks for a flush.
+    }
+}
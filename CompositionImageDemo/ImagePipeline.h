@@ -0,0 +1,110 @@
+#pragma once
+#include "RenderDevice.h"
+#include "UploadBatcher.h"
+#include "UploadScheduler.h"
+#include "SurfacePool.h"
+#include "FilterGraph.h"
+
+struct ImagePipelineOptions
+{
+    UploadBatcherOptions Batching;
+    // Where each batch is staged on its way to the surfaces. There's a ring for
+    // each surface format, and their pages are only created once they're used.
+    UploadRingOptions Ring;
+    // How much upload work each frame gets. Whatever doesn't fit waits for the
+    // next frame, which is FrameInterval later.
+    UploadSchedulerOptions Scheduling;
+    std::chrono::milliseconds FrameInterval = std::chrono::milliseconds(16);
+    // Used when converting to the 16-bit formats. Ordered dithering keeps
+    // gradients from banding without costing much more than a plain conversion.
+    DitherMode Dither = DitherMode::Ordered;
+    // Run on whole images before they're uploaded. Regions (like tiles of a
+    // large image) are uploaded as they are, since the neighbourhood filters
+    // would leave seams at their edges.
+    FilterGraph Filters;
+};
+
+// Everything between a decoded image and its surface: filtering, converting
+// to the surface's format, spreading the writes over frames, and batching each
+// frame's writes through rings of upload pages. It only talks to the device
+// through RenderDevice, so it runs the same on a CompositionRenderDevice as it
+// does headless on a SoftwareRenderDevice.
+//
+// Nothing that's been queued is dropped when the device is lost. A batch the
+// device was lost during stays with the batcher, and is written (and its
+// onUploaded called) along with everything else once the device has been
+// replaced. The DeviceReplaced handlers the app adds after creating the
+// pipeline are still the place to upload what was already on the surfaces.
+// The rings belong to the device, so they're created again when it's replaced.
+class ImagePipeline
+{
+public:
+    ImagePipeline(
+        std::shared_ptr<RenderDevice> device,
+        ImagePipelineOptions const& options,
+        UploadBatcher::ScheduleFlushHandler scheduleFlush,
+        UploadScheduler::Clock clock = nullptr);
+    ~ImagePipeline();
+    ImagePipeline(ImagePipeline const&) = delete;
+    ImagePipeline& operator=(ImagePipeline const&) = delete;
+
+    // Can be called from any thread. With no rect, the surface is resized to
+    // the image. onUploaded is called from Flush once the pixels are written.
+    // Higher priority uploads go first when there's more than fits in a frame.
+    // The image is shared rather than copied, and must not change until it has
+    // been uploaded. A new buffer is only made when the filters or a format
+    // conversion need one.
+    void Upload(
+        std::shared_ptr<SurfaceBackend> const& surface,
+        std::shared_ptr<PixelBuffer const> image,
+        std::optional<SurfaceRect> const& rect = std::nullopt,
+        std::function<void()> onUploaded = nullptr,
+        int32_t priority = 0);
+    // Writes a whole image into the top-left of a pooled surface, without
+    // resizing it. The image must be the size the surface was acquired with.
+    void Upload(
+        PooledSurface const& surface,
+        std::shared_ptr<PixelBuffer const> image,
+        std::function<void()> onUploaded = nullptr,
+        int32_t priority = 0);
+    // Call on the thread that owns the surfaces when the ScheduleFlush handler
+    // asks for it. Writes one frame's worth of uploads and returns how many
+    // there were. If there's more waiting, another flush is scheduled. If the
+    // device is lost part way through, the batch waits for the new device.
+    size_t Flush();
+
+    std::shared_ptr<RenderDevice> const& Device() const { return m_device; }
+    ImagePipelineOptions const& Options() const { return m_options; }
+    UploadBatcherStats BatcherStats() { return m_uploadBatcher->Stats(); }
+    UploadSchedulerStats SchedulerStats() { return m_uploadScheduler.Stats(); }
+    std::vector<UploadFrameStats> RecentFrames() { return m_uploadScheduler.RecentFrames(); }
+    size_t QueueDepth() { return m_uploadScheduler.QueueDepth(); }
+    // These describe the current device's rings only.
+    UploadRingStats RingStats();
+    // How full the fullest ring is, from 0 to 1.
+    double RingUtilization();
+    uint64_t DeviceReplacements() { return m_deviceReplacements; }
+    // Flushes the device was lost during.
+    uint64_t LostBatches() { return BatcherStats().LostBatches; }
+
+private:
+    void CreateUploadRings();
+    void FlushBatch();
+    void Schedule(
+        std::shared_ptr<SurfaceBackend> const& surface,
+        std::shared_ptr<PixelBuffer const> source,
+        std::optional<SurfaceRect> const& rect,
+        std::function<void()> onUploaded,
+        int32_t priority);
+
+    std::shared_ptr<RenderDevice> m_device;
+    ImagePipelineOptions m_options;
+    UploadBatcher::ScheduleFlushHandler m_scheduleFlush;
+    uint64_t m_deviceReplacedToken = 0;
+    std::unique_ptr<UploadBatcher> m_uploadBatcher;
+    UploadScheduler m_uploadScheduler;
+    std::atomic<uint64_t> m_deviceReplacements = 0;
+
+    std::mutex m_ringLock;
+    std::vector<std::shared_ptr<UploadRing>> m_uploadRings;
+};
@@ -0,0 +1,185 @@
+#include "pch.h"
+#include "ImagePyramid.h"
+#include "Parallel.h"
+
+PixelBuffer HalveImage(PixelBuffer const& source)
+{
+    PixelBuffer result((source.Width + 1) / 2, (source.Height + 1) / 2);
+    // The four taps for output pixel i sit at 2i - 1 to 2i + 2, clamped to the
+    // edge of the source.
+    auto tap = [](uint32_t output, int32_t offset, uint32_t size)
+    {
+        return static_cast<uint32_t>(std::clamp(static_cast<int32_t>(output * 2) + offset, 0, static_cast<int32_t>(size) - 1));
+    };
+
+    // Horizontal pass first, into 16-bit sums (at most 8 * 255).
+    std::vector<uint16_t> rows(static_cast<size_t>(result.Width) * 4 * source.Height);
+    ParallelFor(source.Height, [&](uint32_t y)
+        {
+            auto sourceRow = source.Row(y);
+            auto destination = rows.data() + static_cast<size_t>(y) * result.Width * 4;
+            for (uint32_t x = 0; x < result.Width; x++)
+            {
+                auto first = sourceRow + tap(x, -1, source.Width) * 4;
+                auto second = sourceRow + tap(x, 0, source.Width) * 4;
+                auto third = sourceRow + tap(x, 1, source.Width) * 4;
+                auto fourth = sourceRow + tap(x, 2, source.Width) * 4;
+                for (uint32_t channel = 0; channel < 4; channel++)
+                {
+                    destination[x * 4 + channel] = static_cast<uint16_t>(first[channel] + 3 * (second[channel] + third[channel]) + fourth[channel]);
+                }
+            }
+        }, static_cast<uint64_t>(source.Width) * source.Height);
+
+    // Then vertical, dividing by the total weight of 64 at the end.
+    ParallelFor(result.Height, [&](uint32_t y)
+        {
+            auto rowAt = [&](int32_t offset)
+            {
+                return rows.data() + static_cast<size_t>(tap(y, offset, source.Height)) * result.Width * 4;
+            };
+            auto first = rowAt(-1);
+            auto second = rowAt(0);
+            auto third = rowAt(1);
+            auto fourth = rowAt(2);
+            auto destination = result.Row(y);
+            for (uint32_t i = 0; i < result.Width * 4; i++)
+            {
+                uint32_t sum = first[i] + 3 * (second[i] + third[i]) + fourth[i];
+                destination[i] = static_cast<uint8_t>((sum + 32) / 64);
+            }
+        }, static_cast<uint64_t>(result.Width) * result.Height);
+    return result;
+}
+
+ImagePyramid::ImagePyramid(PixelBuffer image, uint32_t minimumSize)
+{
+    m_levels.push_back(std::move(image));
+    while (std::max(m_levels.back().Width, m_levels.back().Height) > minimumSize &&
+        (m_levels.back().Width > 1 || m_levels.back().Height > 1))
+    {
+        auto next = HalveImage(m_levels.back());
+        m_levels.push_back(std::move(next));
+    }
+}
+
+uint32_t ImagePyramid::SelectLevel(uint32_t width, uint32_t height) const
+{
+    // Levels only get smaller, so the last one that's big enough is the one we want.
+    uint32_t selected = 0;
+    for (uint32_t level = 1; level < m_levels.size(); level++)
+    {
+        if (m_levels[level].Width < width || m_levels[level].Height < height)
+        {
+            break;
+        }
+        selected = level;
+    }
+    return selected;
+}
+
+uint64_t ImagePyramid::Bytes() const
+{
+    uint64_t bytes = 0;
+    for (auto& level : m_levels)
+    {
+        bytes += level.Bytes.size();
+    }
+    return bytes;
+}
+
+PyramidCache::PyramidCache(uint64_t budgetBytes, uint32_t minimumSize)
+{
+    m_budget = budgetBytes;
+    m_minimumSize = minimumSize;
+}
+
+PyramidHit PyramidCache::HitFor(std::shared_ptr<ImagePyramid const> const& pyramid, uint32_t width, uint32_t height)
+{
+    PyramidHit hit;
+    hit.Level = pyramid->SelectLevel(width, height);
+    // Shares ownership with the pyramid, so the level can't go away while it's in use.
+    hit.Pixels = std::shared_ptr<PixelBuffer const>(pyramid, &pyramid->Level(hit.Level));
+    return hit;
+}
+
+std::optional<PyramidHit> PyramidCache::Find(ImageKey const& key, uint32_t width, uint32_t height)
+{
+    std::shared_ptr<ImagePyramid const> pyramid;
+    {
+        std::lock_guard lock(m_lock);
+        auto found = m_index.find(key);
+        if (found == m_index.end())
+        {
+            m_stats.Misses++;
+            return std::nullopt;
+        }
+        m_entries.splice(m_entries.begin(), m_entries, found->second);
+        pyramid = found->second->Pyramid;
+        m_stats.Hits++;
+        m_stats.DecodeTimeAvoided += found->second->DecodeTime;
+    }
+
+    auto hit = HitFor(pyramid, width, height);
+    std::lock_guard lock(m_lock);
+    if (m_stats.LevelHits.size() <= hit.Level)
+    {
+        m_stats.LevelHits.resize(hit.Level + 1);
+    }
+    m_stats.LevelHits[hit.Level]++;
+    return hit;
+}
+
+PyramidHit PyramidCache::Insert(ImageKey const& key, PixelBuffer image, std::chrono::microseconds decodeTime, uint32_t width, uint32_t height)
+{
+    auto pyramid = std::make_shared<ImagePyramid const>(std::move(image), m_minimumSize);
+    auto bytes = pyramid->Bytes();
+    auto hit = HitFor(pyramid, width, height);
+
+    std::lock_guard lock(m_lock);
+    // Too big to ever fit, it's handed back without being cached.
+    if (bytes > m_budget)
+    {
+        return hit;
+    }
+    auto existing = m_index.find(key);
+    if (existing != m_index.end())
+    {
+        m_bytes -= existing->second->Bytes;
+        m_entries.erase(existing->second);
+        m_index.erase(existing);
+    }
+    while (m_bytes + bytes > m_budget)
+    {
+        auto& oldest = m_entries.back();
+        m_bytes -= oldest.Bytes;
+        m_index.erase(oldest.Key);
+        m_entries.pop_back();
+        m_stats.Evictions++;
+    }
+    m_entries.push_front({ key, std::move(pyramid), decodeTime, bytes });
+    m_index.emplace(key, m_entries.begin());
+    m_bytes += bytes;
+    m_stats.Insertions++;
+    return hit;
+}
+
+void PyramidCache::Erase(ImageKey const& key)
+{
+    std::lock_guard lock(m_lock);
+    auto found = m_index.find(key);
+    if (found != m_index.end())
+    {
+        m_bytes -= found->second->Bytes;
+        m_entries.erase(found->second);
+        m_index.erase(found);
+    }
+}
+
+PyramidCacheStats PyramidCache::Stats()
+{
+    std::lock_guard lock(m_lock);
+    auto stats = m_stats;
+    stats.BytesUsed = m_bytes;
+    return stats;
+}
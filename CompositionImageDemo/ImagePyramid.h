@@ -0,0 +1,93 @@
+#pragma once
+#include "DecodedImageCache.h"
+
+// An image at a series of resolutions, each half the size of the one before
+// (rounded up), from the full image down to MinimumSize. Every level is made
+// from the one above it with a [1 3 3 1] filter in each direction, which
+// keeps detail better than a box filter without aliasing. The filter works on
+// premultiplied pixels, so color never ends up brighter than alpha.
+class ImagePyramid
+{
+public:
+    ImagePyramid(PixelBuffer image, uint32_t minimumSize = 64);
+
+    uint32_t LevelCount() const { return static_cast<uint32_t>(m_levels.size()); }
+    PixelBuffer const& Level(uint32_t level) const { return m_levels.at(level); }
+    // The smallest level that's at least width x height, or the full image if
+    // none are. That way the level is only ever scaled down for display.
+    uint32_t SelectLevel(uint32_t width, uint32_t height) const;
+    uint64_t Bytes() const;
+
+private:
+    std::vector<PixelBuffer> m_levels;
+};
+
+// Halves the image in each direction (rounding up) with the pyramid's filter.
+PixelBuffer HalveImage(PixelBuffer const& source);
+
+struct PyramidCacheStats
+{
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+    uint64_t Insertions = 0;
+    uint64_t Evictions = 0;
+    // Hits, by the level that served them.
+    std::vector<uint64_t> LevelHits;
+    // Each hit saves decoding the image again. This adds up how long the
+    // decodes took the first time.
+    std::chrono::microseconds DecodeTimeAvoided{};
+    uint64_t BytesUsed = 0;
+
+    double HitRate() const { return Hits + Misses > 0 ? static_cast<double>(Hits) / (Hits + Misses) : 0.0; }
+    double LevelHitRate(uint32_t level) const { return Hits > 0 && level < LevelHits.size() ? static_cast<double>(LevelHits[level]) / Hits : 0.0; }
+};
+
+struct PyramidHit
+{
+    // Keeps the whole pyramid alive.
+    std::shared_ptr<PixelBuffer const> Pixels;
+    uint32_t Level = 0;
+};
+
+// Caches a pyramid per image, so showing the same image as a grid thumbnail,
+// in a preview pane and fullscreen only decodes it once. A request for any
+// display size is served from the nearest level at or above it. Keys are for
+// the full image, so their target size should be 0. Least recently used
+// pyramids are evicted first.
+class PyramidCache
+{
+public:
+    PyramidCache(uint64_t budgetBytes, uint32_t minimumSize = 64);
+
+    // Returns std::nullopt on a miss.
+    std::optional<PyramidHit> Find(ImageKey const& key, uint32_t width, uint32_t height);
+    // Builds the pyramid (outside the lock) and caches it. decodeTime is how
+    // long decoding the image took, which is what later hits save. Returns the
+    // level for width x height.
+    PyramidHit Insert(ImageKey const& key, PixelBuffer image, std::chrono::microseconds decodeTime, uint32_t width, uint32_t height);
+    void Erase(ImageKey const& key);
+
+    uint64_t Budget() const { return m_budget; }
+    PyramidCacheStats Stats();
+
+private:
+    struct Entry
+    {
+        ImageKey Key;
+        std::shared_ptr<ImagePyramid const> Pyramid;
+        std::chrono::microseconds DecodeTime;
+        uint64_t Bytes;
+    };
+
+    PyramidHit HitFor(std::shared_ptr<ImagePyramid const> const& pyramid, uint32_t width, uint32_t height);
+
+    uint64_t m_budget = 0;
+    uint32_t m_minimumSize = 0;
+
+    std::mutex m_lock;
+    // Most recently used at the front.
+    std::list<Entry> m_entries;
+    std::unordered_map<ImageKey, std::list<Entry>::iterator, ImageKeyHash> m_index;
+    uint64_t m_bytes = 0;
+    PyramidCacheStats m_stats;
+};
@@ -0,0 +1,385 @@
+#include "pch.h"
+#include "ImageTransform.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+namespace
+{
+    // Edge length, in pixels, of the tiles used when transposing.
+    constexpr uint32_t TileSize = 16;
+    // Rows handed to each worker for the orientations that don't transpose.
+    constexpr uint32_t RowsPerBand = 64;
+
+    // Describes where each destination pixel comes from. Without a transpose,
+    // destination x walks across the source columns and y walks down the
+    // source rows. With a transpose, destination x walks down the source rows
+    // and y walks across the source columns. FlipX/FlipY reverse those walks.
+    struct Mapping
+    {
+        bool Transposed;
+        bool FlipX;
+        bool FlipY;
+    };
+
+    Mapping GetMapping(ImageOrientation orientation)
+    {
+        switch (orientation)
+        {
+        case ImageOrientation::Normal:
+            return { false, false, false };
+        case ImageOrientation::FlipHorizontal:
+            return { false, true, false };
+        case ImageOrientation::Rotate180:
+            return { false, true, true };
+        case ImageOrientation::FlipVertical:
+            return { false, false, true };
+        case ImageOrientation::Transpose:
+            return { true, false, false };
+        case ImageOrientation::Rotate90:
+            return { true, true, false };
+        case ImageOrientation::Transverse:
+            return { true, true, true };
+        case ImageOrientation::Rotate270:
+            return { true, false, true };
+        }
+        throw std::invalid_argument("Unknown image orientation");
+    }
+
+    uint32_t* PixelAt(PixelBuffer& image, uint32_t x, uint32_t y)
+    {
+        return reinterpret_cast<uint32_t*>(image.Row(y)) + x;
+    }
+
+    uint32_t const* PixelAt(PixelBuffer const& image, uint32_t x, uint32_t y)
+    {
+        return reinterpret_cast<uint32_t const*>(image.Row(y)) + x;
+    }
+
+    uint32_t SourcePixel(PixelBuffer const& source, Mapping mapping, uint32_t x, uint32_t y)
+    {
+        if (mapping.Transposed)
+        {
+            auto sourceX = mapping.FlipY ? source.Width - 1 - y : y;
+            auto sourceY = mapping.FlipX ? source.Height - 1 - x : x;
+            return *PixelAt(source, sourceX, sourceY);
+        }
+        auto sourceX = mapping.FlipX ? source.Width - 1 - x : x;
+        auto sourceY = mapping.FlipY ? source.Height - 1 - y : y;
+        return *PixelAt(source, sourceX, sourceY);
+    }
+
+#ifdef IMAGE_DEMO_SSE2
+    void Transpose4x4(__m128i& row0, __m128i& row1, __m128i& row2, __m128i& row3)
+    {
+        auto low01 = _mm_unpacklo_epi32(row0, row1);
+        auto low23 = _mm_unpacklo_epi32(row2, row3);
+        auto high01 = _mm_unpackhi_epi32(row0, row1);
+        auto high23 = _mm_unpackhi_epi32(row2, row3);
+        row0 = _mm_unpacklo_epi64(low01, low23);
+        row1 = _mm_unpackhi_epi64(low01, low23);
+        row2 = _mm_unpacklo_epi64(high01, high23);
+        row3 = _mm_unpackhi_epi64(high01, high23);
+    }
+
+    __m128i Load4(uint32_t const* pixels)
+    {
+        return _mm_loadu_si128(reinterpret_cast<__m128i const*>(pixels));
+    }
+
+    void Store4(uint32_t* pixels, __m128i value)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels), value);
+    }
+
+    __m128i Reverse4(__m128i value)
+    {
+        return _mm_shuffle_epi32(value, _MM_SHUFFLE(0, 1, 2, 3));
+    }
+#endif
+
+    // Fills one tile of the destination for the orientations that transpose.
+    void TransposeTile(PixelBuffer const& source, PixelBuffer& destination, Mapping mapping, uint32_t tileX, uint32_t tileY)
+    {
+        auto startX = tileX * TileSize;
+        auto startY = tileY * TileSize;
+        auto endX = std::min(startX + TileSize, destination.Width);
+        auto endY = std::min(startY + TileSize, destination.Height);
+
+        for (auto blockY = startY; blockY < endY; blockY += 4)
+        {
+            for (auto blockX = startX; blockX < endX; blockX += 4)
+            {
+#ifdef IMAGE_DEMO_SSE2
+                if (SimdEnabled() && blockX + 4 <= endX && blockY + 4 <= endY)
+                {
+                    // Destination columns come from source rows, and destination rows
+                    // come from source columns.
+                    uint32_t sourceRows[4];
+                    for (uint32_t i = 0; i < 4; i++)
+                    {
+                        sourceRows[i] = mapping.FlipX ? source.Height - 1 - (blockX + i) : blockX + i;
+                    }
+                    auto sourceX = mapping.FlipY ? source.Width - 4 - blockY : blockY;
+                    auto row0 = Load4(PixelAt(source, sourceX, sourceRows[0]));
+                    auto row1 = Load4(PixelAt(source, sourceX, sourceRows[1]));
+                    auto row2 = Load4(PixelAt(source, sourceX, sourceRows[2]));
+                    auto row3 = Load4(PixelAt(source, sourceX, sourceRows[3]));
+                    Transpose4x4(row0, row1, row2, row3);
+                    // When flipping in y we loaded the source columns right to left.
+                    if (mapping.FlipY)
+                    {
+                        std::swap(row0, row3);
+                        std::swap(row1, row2);
+                    }
+                    Store4(PixelAt(destination, blockX, blockY + 0), row0);
+                    Store4(PixelAt(destination, blockX, blockY + 1), row1);
+                    Store4(PixelAt(destination, blockX, blockY + 2), row2);
+                    Store4(PixelAt(destination, blockX, blockY + 3), row3);
+                    continue;
+                }
+#endif
+                for (auto y = blockY; y < std::min(blockY + 4, endY); y++)
+                {
+                    for (auto x = blockX; x < std::min(blockX + 4, endX); x++)
+                    {
+                        *PixelAt(destination, x, y) = SourcePixel(source, mapping, x, y);
+                    }
+                }
+            }
+        }
+    }
+
+    void CopyRowReversed(uint32_t const* source, uint32_t* destination, uint32_t width)
+    {
+        uint32_t x = 0;
+#ifdef IMAGE_DEMO_SSE2
+        for (; SimdEnabled() && x + 4 <= width; x += 4)
+        {
+            Store4(destination + x, Reverse4(Load4(source + width - 4 - x)));
+        }
+#endif
+        for (; x < width; x++)
+        {
+            destination[x] = source[width - 1 - x];
+        }
+    }
+
+    void ReverseRowInPlace(uint32_t* row, uint32_t width)
+    {
+        uint32_t left = 0;
+        auto right = width;
+#ifdef IMAGE_DEMO_SSE2
+        for (; SimdEnabled() && left + 8 <= right; left += 4, right -= 4)
+        {
+            auto leftPixels = Load4(row + left);
+            auto rightPixels = Load4(row + right - 4);
+            Store4(row + left, Reverse4(rightPixels));
+            Store4(row + right - 4, Reverse4(leftPixels));
+        }
+#endif
+        std::reverse(row + left, row + right);
+    }
+
+    // Handles the orientations that don't transpose. Every source row maps to
+    // exactly one destination row, so there's no need to tile.
+    void FlipImage(PixelBuffer const& source, PixelBuffer& destination, Mapping mapping)
+    {
+        auto bands = (destination.Height + RowsPerBand - 1) / RowsPerBand;
+        ParallelFor(bands, [&](uint32_t band)
+            {
+                auto end = std::min((band + 1) * RowsPerBand, destination.Height);
+                for (auto y = band * RowsPerBand; y < end; y++)
+                {
+                    auto sourceY = mapping.FlipY ? source.Height - 1 - y : y;
+                    if (mapping.FlipX)
+                    {
+                        CopyRowReversed(PixelAt(source, 0, sourceY), PixelAt(destination, 0, y), source.Width);
+                    }
+                    else
+                    {
+                        memcpy(destination.Row(y), source.Row(sourceY), source.Stride());
+                    }
+                }
+            }, static_cast<uint64_t>(destination.Width) * destination.Height);
+    }
+
+    void FlipImageInPlace(PixelBuffer& image, bool flipX, bool flipY)
+    {
+        if (!flipY)
+        {
+            if (flipX)
+            {
+                auto bands = (image.Height + RowsPerBand - 1) / RowsPerBand;
+                ParallelFor(bands, [&](uint32_t band)
+                    {
+                        auto end = std::min((band + 1) * RowsPerBand, image.Height);
+                        for (auto y = band * RowsPerBand; y < end; y++)
+                        {
+                            ReverseRowInPlace(PixelAt(image, 0, y), image.Width);
+                        }
+                    }, static_cast<uint64_t>(image.Width) * image.Height);
+            }
+            return;
+        }
+
+        // Swap each row in the top half with its partner in the bottom half.
+        auto pairs = image.Height / 2;
+        auto bands = (pairs + RowsPerBand - 1) / RowsPerBand;
+        ParallelFor(bands, [&](uint32_t band)
+            {
+                auto end = std::min((band + 1) * RowsPerBand, pairs);
+                for (auto y = band * RowsPerBand; y < end; y++)
+                {
+                    auto top = PixelAt(image, 0, y);
+                    auto bottom = PixelAt(image, 0, image.Height - 1 - y);
+                    std::swap_ranges(top, top + image.Width, bottom);
+                    if (flipX)
+                    {
+                        ReverseRowInPlace(top, image.Width);
+                        ReverseRowInPlace(bottom, image.Width);
+                    }
+                }
+            }, static_cast<uint64_t>(image.Width) * image.Height);
+        if (flipX && image.Height % 2 == 1)
+        {
+            ReverseRowInPlace(PixelAt(image, 0, pairs), image.Width);
+        }
+    }
+
+    // Swaps the 4x4 block at (column, row) with its mirror across the diagonal,
+    // transposing both. Blocks on the diagonal are transposed in place.
+    void SwapTransposeBlock(PixelBuffer& image, uint32_t row, uint32_t column)
+    {
+        auto size = image.Width;
+#ifdef IMAGE_DEMO_SSE2
+        if (SimdEnabled() && row + 4 <= size && column + 4 <= size)
+        {
+            auto a0 = Load4(PixelAt(image, column, row + 0));
+            auto a1 = Load4(PixelAt(image, column, row + 1));
+            auto a2 = Load4(PixelAt(image, column, row + 2));
+            auto a3 = Load4(PixelAt(image, column, row + 3));
+            Transpose4x4(a0, a1, a2, a3);
+            if (row == column)
+            {
+                Store4(PixelAt(image, column, row + 0), a0);
+                Store4(PixelAt(image, column, row + 1), a1);
+                Store4(PixelAt(image, column, row + 2), a2);
+                Store4(PixelAt(image, column, row + 3), a3);
+                return;
+            }
+            auto b0 = Load4(PixelAt(image, row, column + 0));
+            auto b1 = Load4(PixelAt(image, row, column + 1));
+            auto b2 = Load4(PixelAt(image, row, column + 2));
+            auto b3 = Load4(PixelAt(image, row, column + 3));
+            Transpose4x4(b0, b1, b2, b3);
+            Store4(PixelAt(image, row, column + 0), a0);
+            Store4(PixelAt(image, row, column + 1), a1);
+            Store4(PixelAt(image, row, column + 2), a2);
+            Store4(PixelAt(image, row, column + 3), a3);
+            Store4(PixelAt(image, column, row + 0), b0);
+            Store4(PixelAt(image, column, row + 1), b1);
+            Store4(PixelAt(image, column, row + 2), b2);
+            Store4(PixelAt(image, column, row + 3), b3);
+            return;
+        }
+#endif
+        for (auto y = row; y < std::min(row + 4, size); y++)
+        {
+            for (auto x = column; x < std::min(column + 4, size); x++)
+            {
+                // On the diagonal, only swap the upper triangle.
+                if (row != column || x > y)
+                {
+                    std::swap(*PixelAt(image, x, y), *PixelAt(image, y, x));
+                }
+            }
+        }
+    }
+
+    void TransposeSquareInPlace(PixelBuffer& image)
+    {
+        auto size = image.Width;
+        auto tiles = (size + TileSize - 1) / TileSize;
+        // Each worker takes a row of tiles and swaps everything to the right of
+        // the diagonal with its mirror below the diagonal.
+        ParallelFor(tiles, [&](uint32_t tileY)
+            {
+                for (auto tileX = tileY; tileX < tiles; tileX++)
+                {
+                    auto startY = tileY * TileSize;
+                    auto endY = std::min(startY + TileSize, size);
+                    for (auto row = startY; row < endY; row += 4)
+                    {
+                        auto startX = tileX == tileY ? row : tileX * TileSize;
+                        auto endX = std::min(tileX * TileSize + TileSize, size);
+                        for (auto column = startX; column < endX; column += 4)
+                        {
+                            SwapTransposeBlock(image, row, column);
+                        }
+                    }
+                }
+            }, static_cast<uint64_t>(size) * size);
+    }
+}
+
+bool SwapsDimensions(ImageOrientation orientation)
+{
+    return GetMapping(orientation).Transposed;
+}
+
+PixelBuffer TransformImage(PixelBuffer const& source, ImageOrientation orientation)
+{
+    auto mapping = GetMapping(orientation);
+    if (!mapping.Transposed)
+    {
+        PixelBuffer destination(source.Width, source.Height);
+        FlipImage(source, destination, mapping);
+        return destination;
+    }
+
+    PixelBuffer destination(source.Height, source.Width);
+    auto tilesWide = (destination.Width + TileSize - 1) / TileSize;
+    auto tilesHigh = (destination.Height + TileSize - 1) / TileSize;
+    ParallelFor(tilesHigh, [&](uint32_t tileY)
+        {
+            for (uint32_t tileX = 0; tileX < tilesWide; tileX++)
+            {
+                TransposeTile(source, destination, mapping, tileX, tileY);
+            }
+        }, static_cast<uint64_t>(destination.Width) * destination.Height);
+    return destination;
+}
+
+void TransformImageInPlace(PixelBuffer& image, ImageOrientation orientation)
+{
+    auto mapping = GetMapping(orientation);
+    if (!mapping.Transposed)
+    {
+        FlipImageInPlace(image, mapping.FlipX, mapping.FlipY);
+        return;
+    }
+    if (image.Width != image.Height)
+    {
+        image = TransformImage(image, orientation);
+        return;
+    }
+
+    // For square images, every transposing orientation is a transpose
+    // followed by a flip.
+    TransposeSquareInPlace(image);
+    FlipImageInPlace(image, mapping.FlipX, mapping.FlipY);
+}
+
+PixelBuffer TransformImageNaive(PixelBuffer const& source, ImageOrientation orientation)
+{
+    auto mapping = GetMapping(orientation);
+    auto destination = mapping.Transposed ? PixelBuffer(source.Height, source.Width) : PixelBuffer(source.Width, source.Height);
+    for (uint32_t y = 0; y < destination.Height; y++)
+    {
+        for (uint32_t x = 0; x < destination.Width; x++)
+        {
+            *PixelAt(destination, x, y) = SourcePixel(source, mapping, x, y);
+        }
+    }
+    return destination;
+}
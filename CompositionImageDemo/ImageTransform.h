@@ -0,0 +1,32 @@
+#pragma once
+#include "PixelBuffer.h"
+
+// The values match the EXIF orientation tag (System.Photo.Orientation), which
+// describes what needs to happen to the stored pixels for them to display
+// upright. Rotations are clockwise.
+enum class ImageOrientation : uint16_t
+{
+    Normal = 1,
+    FlipHorizontal = 2,
+    Rotate180 = 3,
+    FlipVertical = 4,
+    Transpose = 5, // Mirror across the top-left to bottom-right diagonal
+    Rotate90 = 6,
+    Transverse = 7, // Mirror across the top-right to bottom-left diagonal
+    Rotate270 = 8,
+};
+
+// True for the orientations that swap the width and height of the image.
+bool SwapsDimensions(ImageOrientation orientation);
+
+// Applies the orientation to the image, returning a new buffer. Orientations
+// that swap the dimensions are done in 16x16 pixel tiles (4x4 SSE2 transposes
+// within each tile) so that both the source and destination stay in cache.
+// Tile rows are processed in parallel.
+PixelBuffer TransformImage(PixelBuffer const& source, ImageOrientation orientation);
+// Applies the orientation without allocating a second image. This works for any
+// flip, and for rotations/transposes of square images. Other images fall back
+// to TransformImage.
+void TransformImageInPlace(PixelBuffer& image, ImageOrientation orientation);
+// A simple pixel-by-pixel version to compare the tiled kernels against.
+PixelBuffer TransformImageNaive(PixelBuffer const& source, ImageOrientation orientation);
@@ -42,5 +42,10 @@ MainWindow::MainWindow(std::wstring const& titleString, int width, int height)
 
 LRESULT MainWindow::MessageHandler(UINT const message, WPARAM const wparam, LPARAM const lparam)
 {
+    // Minimizing reports a zero size, which isn't a view worth loading for.
+    if (message == WM_SIZE && wparam != SIZE_MINIMIZED && m_sizeChanged)
+    {
+        m_sizeChanged({ LOWORD(lparam), HIWORD(lparam) });
+    }
     return base_type::MessageHandler(message, wparam, lparam);
 }
@@ -7,6 +7,11 @@ struct MainWindow : robmikh::common::desktop::DesktopWindow<MainWindow>
 	MainWindow(std::wstring const& titleString, int width, int height);
 	LRESULT MessageHandler(UINT const message, WPARAM const wparam, LPARAM const lparam);
 
+	// Called with the new size of the client area.
+	void SizeChanged(std::function<void(winrt::Windows::Graphics::SizeInt32 const&)> handler) { m_sizeChanged = std::move(handler); }
+
 private:
 	static void RegisterWindowClass();
+
+	std::function<void(winrt::Windows::Graphics::SizeInt32 const&)> m_sizeChanged;
 };
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include "pch.h"
+#include "MappedFile.h"
+
+#ifdef _WIN32
+MappedFile::MappedFile(std::filesystem::path const& path, uint64_t size)
+{
+    Size = size;
+    m_file.reset(CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!m_file)
+    {
+        winrt::throw_last_error();
+    }
+    m_section.reset(CreateFileMappingW(m_file.get(), nullptr, PAGE_READONLY, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr));
+    if (!m_section)
+    {
+        winrt::throw_last_error();
+    }
+    Data = static_cast<uint8_t const*>(MapViewOfFile(m_section.get(), FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(size)));
+    if (Data == nullptr)
+    {
+        winrt::throw_last_error();
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    UnmapViewOfFile(Data);
+}
+#else
+MappedFile::MappedFile(std::filesystem::path const& path, uint64_t size)
+{
+    Size = size;
+    m_file = open(path.c_str(), O_RDONLY);
+    if (m_file < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "Couldn't open mapped file");
+    }
+    auto view = mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_SHARED, m_file, 0);
+    if (view == MAP_FAILED)
+    {
+        auto error = errno;
+        close(m_file);
+        throw std::system_error(error, std::generic_category(), "Couldn't map file");
+    }
+    Data = static_cast<uint8_t const*>(view);
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(const_cast<uint8_t*>(Data), static_cast<size_t>(Size));
+    close(m_file);
+}
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+// A read-only view of the first Size bytes of a file. The file is opened with
+// sharing for writes and deletes, so it can still be appended to (the view
+// doesn't grow with it) or replaced while it's mapped. Throws if the file
+// can't be opened or mapped. Size must not be 0.
+struct MappedFile
+{
+    uint8_t const* Data = nullptr;
+    uint64_t Size = 0;
+
+    MappedFile(std::filesystem::path const& path, uint64_t size);
+    ~MappedFile();
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+private:
+#ifdef _WIN32
+    wil::unique_hfile m_file;
+    wil::unique_handle m_section;
+#else
+    int m_file = -1;
+#endif
+};
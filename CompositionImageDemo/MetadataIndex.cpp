@@ -0,0 +1,736 @@
+#include "pch.h"
+#include "MetadataIndex.h"
+#include "ContentHash.h"
+
+namespace
+{
+    struct IndexHeader
+    {
+        char Magic[4];
+        uint32_t Version;
+        uint64_t Count;
+        uint64_t PathBytes;
+    };
+
+    constexpr char IndexMagic[4] = { 'M', 'I', 'D', 'X' };
+    constexpr uint32_t IndexVersion = 1;
+
+    std::string PathBytes(std::filesystem::path const& path)
+    {
+        auto utf8 = path.generic_u8string();
+        return std::string(utf8.begin(), utf8.end());
+    }
+
+    std::filesystem::path PathFromBytes(std::string const& bytes)
+    {
+        return std::filesystem::path(std::u8string(bytes.begin(), bytes.end()));
+    }
+
+    bool IsImageExtension(std::filesystem::path const& path)
+    {
+        auto extension = PathBytes(path.extension());
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+        return extension == ".jpg" || extension == ".jpeg" || extension == ".jfif" || extension == ".png";
+    }
+
+    // Days from 1970-01-01 to the given date, in the proleptic Gregorian
+    // calendar (Howard Hinnant's days_from_civil).
+    int64_t DaysFromCivil(int64_t year, uint32_t month, uint32_t day)
+    {
+        year -= month <= 2;
+        auto era = (year >= 0 ? year : year - 399) / 400;
+        auto yearOfEra = static_cast<uint32_t>(year - era * 400);
+        auto dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        auto dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+    }
+
+    // EXIF dates look like "2021:06:30 14:05:59".
+    int64_t ParseExifDate(char const* text, size_t size)
+    {
+        if (size < 19)
+        {
+            return 0;
+        }
+        bool valid = true;
+        auto number = [text, &valid](size_t offset, size_t digits)
+        {
+            int value = 0;
+            for (size_t i = offset; i < offset + digits; i++)
+            {
+                valid = valid && text[i] >= '0' && text[i] <= '9';
+                value = value * 10 + (text[i] - '0');
+            }
+            return value;
+        };
+        auto year = number(0, 4);
+        auto month = number(5, 2);
+        auto day = number(8, 2);
+        auto hour = number(11, 2);
+        auto minute = number(14, 2);
+        auto second = number(17, 2);
+        // Unknown dates are written as all spaces or zeros.
+        if (!valid || year < 1900 || month < 1 || month > 12 || day < 1 || day > 31)
+        {
+            return 0;
+        }
+        return DaysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    }
+
+    // 'tiff' is the APP1 payload after "Exif\0\0".
+    void ParseExif(uint8_t const* tiff, size_t size, ImageMetadata& metadata)
+    {
+        if (size < 8 || !(tiff[0] == tiff[1] && (tiff[0] == 'I' || tiff[0] == 'M')))
+        {
+            return;
+        }
+        // Every offset in the file is untrusted, so the bounds checks are done
+        // in 64 bits, where offset + length can't wrap around (size_t is only
+        // 32 bits in x86 builds).
+        bool littleEndian = tiff[0] == 'I';
+        auto inBounds = [size](uint64_t offset, uint64_t length)
+        {
+            return offset <= size && length <= size - offset;
+        };
+        auto read16 = [&](uint64_t offset) -> uint32_t
+        {
+            if (!inBounds(offset, 2))
+            {
+                return 0;
+            }
+            return littleEndian ? tiff[offset] | (tiff[offset + 1] << 8) : (tiff[offset] << 8) | tiff[offset + 1];
+        };
+        auto read32 = [&](uint64_t offset) -> uint32_t
+        {
+            if (!inBounds(offset, 4))
+            {
+                return 0;
+            }
+            return littleEndian ? (read16(offset) | (read16(offset + 2) << 16)) : ((read16(offset) << 16) | read16(offset + 2));
+        };
+        if (read16(2) != 42)
+        {
+            return;
+        }
+
+        const uint32_t OrientationTag = 0x0112;
+        const uint32_t DateTimeTag = 0x0132;
+        const uint32_t ExifPointerTag = 0x8769;
+        const uint32_t DateTimeOriginalTag = 0x9003;
+        auto readDate = [&](uint64_t entry) -> int64_t
+        {
+            auto count = read32(entry + 4);
+            auto offset = read32(entry + 8);
+            return count >= 19 && inBounds(offset, count) ? ParseExifDate(reinterpret_cast<char const*>(tiff + offset), count) : 0;
+        };
+
+        uint64_t exifOffset = 0;
+        int64_t dateTime = 0;
+        uint64_t ifd = read32(4);
+        auto entries = read16(ifd);
+        for (uint32_t i = 0; i < entries; i++)
+        {
+            auto entry = ifd + 2 + i * 12ull;
+            switch (read16(entry))
+            {
+            case OrientationTag:
+            {
+                auto orientation = read16(entry + 8);
+                if (orientation >= 1 && orientation <= 8)
+                {
+                    metadata.Orientation = static_cast<ImageOrientation>(orientation);
+                }
+                break;
+            }
+            case DateTimeTag:
+                dateTime = readDate(entry);
+                break;
+            case ExifPointerTag:
+                exifOffset = read32(entry + 8);
+                break;
+            }
+        }
+
+        // The capture time lives in the EXIF sub-IFD. DateTime (when the file
+        // was last changed by the camera or an editor) is the fallback.
+        metadata.CaptureTime = dateTime;
+        if (exifOffset != 0)
+        {
+            entries = read16(exifOffset);
+            for (uint32_t i = 0; i < entries; i++)
+            {
+                auto entry = exifOffset + 2 + i * 12ull;
+                if (read16(entry) == DateTimeOriginalTag)
+                {
+                    if (auto original = readDate(entry))
+                    {
+                        metadata.CaptureTime = original;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    bool ProbeJpeg(std::ifstream& file, ImageMetadata& metadata)
+    {
+        auto readByte = [&file]() -> int
+        {
+            char value;
+            return file.get(value) ? static_cast<uint8_t>(value) : -1;
+        };
+
+        while (file)
+        {
+            if (readByte() != 0xFF)
+            {
+                return false;
+            }
+            // Markers can be padded with any number of 0xFF bytes.
+            auto marker = readByte();
+            while (marker == 0xFF)
+            {
+                marker = readByte();
+            }
+            if (marker < 0 || marker == 0xD9 || marker == 0xDA)
+            {
+                // End of image, or the start of the compressed data. Either way
+                // there wasn't a frame header.
+                return false;
+            }
+            if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+            {
+                // These don't have a length.
+                continue;
+            }
+
+            auto high = readByte();
+            auto low = readByte();
+            if (low < 0 || ((high << 8) | low) < 2)
+            {
+                return false;
+            }
+            auto payload = ((high << 8) | low) - 2;
+
+            // Start of frame. C4 (DHT), C8 (JPG) and CC (DAC) share the range.
+            if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+            {
+                uint8_t frame[5];
+                if (payload < 5 || !file.read(reinterpret_cast<char*>(frame), sizeof(frame)))
+                {
+                    return false;
+                }
+                metadata.Height = (frame[1] << 8) | frame[2];
+                metadata.Width = (frame[3] << 8) | frame[4];
+                return true;
+            }
+            if (marker == 0xE1)
+            {
+                std::vector<uint8_t> segment(payload);
+                if (!file.read(reinterpret_cast<char*>(segment.data()), payload))
+                {
+                    return false;
+                }
+                if (payload > 6 && memcmp(segment.data(), "Exif\0\0", 6) == 0)
+                {
+                    ParseExif(segment.data() + 6, segment.size() - 6, metadata);
+                }
+                continue;
+            }
+            file.seekg(payload, std::ios::cur);
+        }
+        return false;
+    }
+
+    bool ProbePng(std::ifstream& file, ImageMetadata& metadata)
+    {
+        // The rest of the signature, then IHDR, which has to be the first chunk.
+        uint8_t header[22];
+        if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+            memcmp(header, "NG\r\n\x1a\n", 6) != 0 || memcmp(header + 10, "IHDR", 4) != 0)
+        {
+            return false;
+        }
+        auto read32 = [&header](size_t offset)
+        {
+            return (static_cast<uint32_t>(header[offset]) << 24) | (header[offset + 1] << 16) | (header[offset + 2] << 8) | header[offset + 3];
+        };
+        metadata.Width = read32(14);
+        metadata.Height = read32(18);
+        return true;
+    }
+
+    // Fills in everything but the path, size and modification time.
+    bool ProbeContents(std::filesystem::path const& path, ImageMetadata& metadata)
+    {
+        std::ifstream file(path, std::ios::binary);
+        uint8_t signature[2];
+        if (!file.read(reinterpret_cast<char*>(signature), sizeof(signature)))
+        {
+            return false;
+        }
+        if (signature[0] == 0xFF && signature[1] == 0xD8)
+        {
+            metadata.Format = ImageFileFormat::Jpeg;
+            return ProbeJpeg(file, metadata);
+        }
+        if (signature[0] == 0x89 && signature[1] == 'P')
+        {
+            metadata.Format = ImageFileFormat::Png;
+            return ProbePng(file, metadata);
+        }
+        return false;
+    }
+
+    template <typename T>
+    void WriteColumn(std::vector<uint8_t>& output, std::vector<T> const& column)
+    {
+        auto bytes = reinterpret_cast<uint8_t const*>(column.data());
+        output.insert(output.end(), bytes, bytes + column.size() * sizeof(T));
+    }
+
+    template <typename T>
+    bool ReadColumn(std::vector<uint8_t> const& input, size_t& offset, size_t count, std::vector<T>& column)
+    {
+        // Dividing rather than multiplying, so a huge count can't wrap around.
+        if (offset > input.size() || count > (input.size() - offset) / sizeof(T))
+        {
+            return false;
+        }
+        column.resize(count);
+        memcpy(column.data(), input.data() + offset, count * sizeof(T));
+        offset += count * sizeof(T);
+        return true;
+    }
+}
+
+std::optional<ImageMetadata> ProbeImage(std::filesystem::path const& path)
+{
+    std::error_code error;
+    ImageMetadata metadata;
+    metadata.Path = path;
+    metadata.FileSize = std::filesystem::file_size(path, error);
+    if (error)
+    {
+        return std::nullopt;
+    }
+    metadata.ModifiedTime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+    if (error || !ProbeContents(path, metadata))
+    {
+        return std::nullopt;
+    }
+    return metadata;
+}
+
+void MetadataIndex::Columns::Append(std::string path, ImageMetadata const& metadata)
+{
+    FileSizes.push_back(metadata.FileSize);
+    ModifiedTimes.push_back(metadata.ModifiedTime);
+    CaptureTimes.push_back(metadata.CaptureTime);
+    Widths.push_back(metadata.Width);
+    Heights.push_back(metadata.Height);
+    Orientations.push_back(static_cast<uint16_t>(metadata.Orientation));
+    Formats.push_back(static_cast<uint8_t>(metadata.Format));
+    Paths.push_back(std::move(path));
+}
+
+void MetadataIndex::Columns::AppendRow(Columns const& other, size_t row)
+{
+    FileSizes.push_back(other.FileSizes[row]);
+    ModifiedTimes.push_back(other.ModifiedTimes[row]);
+    CaptureTimes.push_back(other.CaptureTimes[row]);
+    Widths.push_back(other.Widths[row]);
+    Heights.push_back(other.Heights[row]);
+    Orientations.push_back(other.Orientations[row]);
+    Formats.push_back(other.Formats[row]);
+    Paths.push_back(other.Paths[row]);
+}
+
+MetadataIndex::MetadataIndex(std::filesystem::path indexPath)
+{
+    m_indexPath = std::move(indexPath);
+    if (!Load())
+    {
+        m_columns = {};
+    }
+    RebuildLookupLocked();
+}
+
+MetadataIndex::~MetadataIndex()
+{
+    try
+    {
+        Save();
+    }
+    catch (...)
+    {
+        // The index is only an optimization, we'll probe the files again next time.
+    }
+}
+
+bool MetadataIndex::Load()
+{
+    std::ifstream file(m_indexPath, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    auto size = static_cast<size_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+    if (size < sizeof(IndexHeader) + sizeof(uint64_t))
+    {
+        return false;
+    }
+    std::vector<uint8_t> bytes(size);
+    if (!file.read(reinterpret_cast<char*>(bytes.data()), size))
+    {
+        return false;
+    }
+
+    uint64_t checksum = 0;
+    memcpy(&checksum, bytes.data() + size - sizeof(checksum), sizeof(checksum));
+    if (checksum != ContentHasher::Hash(bytes.data(), size - sizeof(checksum)))
+    {
+        return false;
+    }
+    bytes.resize(size - sizeof(checksum));
+
+    IndexHeader header;
+    memcpy(&header, bytes.data(), sizeof(header));
+    if (memcmp(header.Magic, IndexMagic, sizeof(IndexMagic)) != 0 || header.Version != IndexVersion)
+    {
+        return false;
+    }
+
+    // Every row takes this many bytes, not counting its path, so the count
+    // can't be more than the file has room for. Checking before allocating
+    // anything means a bad count can't ask for terabytes.
+    constexpr size_t RowBytes = sizeof(uint64_t) + 2 * sizeof(int64_t) + sizeof(uint32_t) +
+        2 * sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint8_t);
+    if (header.Count > (bytes.size() - sizeof(header)) / RowBytes)
+    {
+        return false;
+    }
+    auto count = static_cast<size_t>(header.Count);
+    size_t offset = sizeof(header);
+    std::vector<uint32_t> pathOffsets;
+    Columns columns;
+    if (!ReadColumn(bytes, offset, count, columns.FileSizes) ||
+        !ReadColumn(bytes, offset, count, columns.ModifiedTimes) ||
+        !ReadColumn(bytes, offset, count, columns.CaptureTimes) ||
+        !ReadColumn(bytes, offset, count + 1, pathOffsets) ||
+        !ReadColumn(bytes, offset, count, columns.Widths) ||
+        !ReadColumn(bytes, offset, count, columns.Heights) ||
+        !ReadColumn(bytes, offset, count, columns.Orientations) ||
+        !ReadColumn(bytes, offset, count, columns.Formats) ||
+        bytes.size() - offset != header.PathBytes || pathOffsets.back() != header.PathBytes)
+    {
+        return false;
+    }
+    auto paths = reinterpret_cast<char const*>(bytes.data() + offset);
+    columns.Paths.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (pathOffsets[i] > pathOffsets[i + 1])
+        {
+            return false;
+        }
+        columns.Paths.emplace_back(paths + pathOffsets[i], pathOffsets[i + 1] - pathOffsets[i]);
+    }
+    m_columns = std::move(columns);
+    return true;
+}
+
+void MetadataIndex::Save()
+{
+    std::vector<uint8_t> bytes;
+    {
+        std::lock_guard lock(m_lock);
+        if (!m_dirty)
+        {
+            return;
+        }
+
+        std::vector<uint32_t> pathOffsets;
+        pathOffsets.reserve(m_columns.Count() + 1);
+        uint64_t pathBytes = 0;
+        for (auto& path : m_columns.Paths)
+        {
+            pathOffsets.push_back(static_cast<uint32_t>(pathBytes));
+            pathBytes += path.size();
+        }
+        pathOffsets.push_back(static_cast<uint32_t>(pathBytes));
+        if (pathBytes > std::numeric_limits<uint32_t>::max())
+        {
+            throw std::runtime_error("Too many paths for the metadata index");
+        }
+
+        IndexHeader header = {};
+        memcpy(header.Magic, IndexMagic, sizeof(IndexMagic));
+        header.Version = IndexVersion;
+        header.Count = m_columns.Count();
+        header.PathBytes = pathBytes;
+        bytes.reserve(sizeof(header) + m_columns.Count() * 40 + pathBytes + sizeof(uint64_t));
+        auto headerBytes = reinterpret_cast<uint8_t const*>(&header);
+        bytes.insert(bytes.end(), headerBytes, headerBytes + sizeof(header));
+        WriteColumn(bytes, m_columns.FileSizes);
+        WriteColumn(bytes, m_columns.ModifiedTimes);
+        WriteColumn(bytes, m_columns.CaptureTimes);
+        WriteColumn(bytes, pathOffsets);
+        WriteColumn(bytes, m_columns.Widths);
+        WriteColumn(bytes, m_columns.Heights);
+        WriteColumn(bytes, m_columns.Orientations);
+        WriteColumn(bytes, m_columns.Formats);
+        for (auto& path : m_columns.Paths)
+        {
+            bytes.insert(bytes.end(), path.begin(), path.end());
+        }
+        m_dirty = false;
+    }
+    auto checksum = ContentHasher::Hash(bytes.data(), bytes.size());
+    auto checksumBytes = reinterpret_cast<uint8_t const*>(&checksum);
+    bytes.insert(bytes.end(), checksumBytes, checksumBytes + sizeof(checksum));
+
+    // Written next to the real one and renamed over it, so a crash part way
+    // through leaves the old index in place.
+    if (m_indexPath.has_parent_path())
+    {
+        std::filesystem::create_directories(m_indexPath.parent_path());
+    }
+    auto temporaryPath = m_indexPath;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<char const*>(bytes.data()), bytes.size()))
+        {
+            throw std::runtime_error("Couldn't write the metadata index");
+        }
+    }
+    std::filesystem::rename(temporaryPath, m_indexPath);
+}
+
+MetadataRefreshStats MetadataIndex::Refresh(std::filesystem::path const& directory, bool recursive)
+{
+    struct Found
+    {
+        std::filesystem::path Path;
+        std::string Key;
+        uint64_t FileSize;
+        int64_t ModifiedTime;
+    };
+
+    // List the directory without holding the lock. On Windows the size and time
+    // come with the listing, elsewhere they cost a stat each.
+    std::vector<Found> found;
+    auto visit = [&found](std::filesystem::directory_entry const& entry)
+    {
+        std::error_code error;
+        if (!entry.is_regular_file(error) || !IsImageExtension(entry.path()))
+        {
+            return;
+        }
+        auto fileSize = entry.file_size(error);
+        auto modifiedTime = entry.last_write_time(error);
+        if (!error)
+        {
+            found.push_back({ entry.path(), PathBytes(entry.path()), fileSize, modifiedTime.time_since_epoch().count() });
+        }
+    };
+    auto options = std::filesystem::directory_options::skip_permission_denied;
+    if (recursive)
+    {
+        for (auto&& entry : std::filesystem::recursive_directory_iterator(directory, options))
+        {
+            visit(entry);
+        }
+    }
+    else
+    {
+        for (auto&& entry : std::filesystem::directory_iterator(directory, options))
+        {
+            visit(entry);
+        }
+    }
+
+    MetadataRefreshStats stats;
+    stats.Scanned = found.size();
+    std::vector<Found*> changed;
+    {
+        std::lock_guard lock(m_lock);
+        for (auto& file : found)
+        {
+            auto existing = m_lookup.find(file.Key);
+            if (existing != m_lookup.end() &&
+                m_columns.FileSizes[existing->second] == file.FileSize &&
+                m_columns.ModifiedTimes[existing->second] == file.ModifiedTime)
+            {
+                stats.Unchanged++;
+                continue;
+            }
+            changed.push_back(&file);
+        }
+    }
+
+    // Probing opens the files, so that's done outside the lock too.
+    std::vector<ImageMetadata> probed;
+    probed.reserve(changed.size());
+    for (auto file : changed)
+    {
+        ImageMetadata metadata;
+        metadata.FileSize = file->FileSize;
+        metadata.ModifiedTime = file->ModifiedTime;
+        if (!ProbeContents(file->Path, metadata))
+        {
+            metadata.Format = ImageFileFormat::Unknown;
+            metadata.Width = 0;
+            metadata.Height = 0;
+        }
+        probed.push_back(std::move(metadata));
+    }
+    stats.Probed = probed.size();
+
+    // Rows for this directory that aren't in the listing anymore (or were
+    // probed again) are left out of the new columns.
+    auto prefix = PathBytes(directory);
+    if (prefix.empty() || prefix.back() != '/')
+    {
+        prefix += '/';
+    }
+    std::unordered_map<std::string_view, bool> listed;
+    listed.reserve(found.size());
+    for (auto& file : found)
+    {
+        listed.emplace(file.Key, false);
+    }
+    for (auto file : changed)
+    {
+        listed[file->Key] = true;
+    }
+
+    std::lock_guard lock(m_lock);
+    Columns next;
+    for (size_t row = 0; row < m_columns.Count(); row++)
+    {
+        auto& path = m_columns.Paths[row];
+        bool inDirectory = path.compare(0, prefix.size(), prefix) == 0 &&
+            (recursive || path.find('/', prefix.size()) == std::string::npos);
+        if (inDirectory)
+        {
+            auto listing = listed.find(path);
+            if (listing == listed.end())
+            {
+                stats.Removed++;
+                continue;
+            }
+            if (listing->second)
+            {
+                continue;
+            }
+        }
+        next.AppendRow(m_columns, row);
+    }
+    for (size_t i = 0; i < changed.size(); i++)
+    {
+        next.Append(changed[i]->Key, probed[i]);
+    }
+    if (stats.Probed > 0 || stats.Removed > 0)
+    {
+        m_columns = std::move(next);
+        RebuildLookupLocked();
+        m_dirty = true;
+    }
+    return stats;
+}
+
+void MetadataIndex::RebuildLookupLocked()
+{
+    m_lookup.clear();
+    m_lookup.reserve(m_columns.Count());
+    for (size_t row = 0; row < m_columns.Count(); row++)
+    {
+        m_lookup.emplace(m_columns.Paths[row], row);
+    }
+}
+
+ImageMetadata MetadataIndex::RowLocked(size_t row) const
+{
+    ImageMetadata metadata;
+    metadata.Path = PathFromBytes(m_columns.Paths[row]);
+    metadata.FileSize = m_columns.FileSizes[row];
+    metadata.ModifiedTime = m_columns.ModifiedTimes[row];
+    metadata.Format = static_cast<ImageFileFormat>(m_columns.Formats[row]);
+    metadata.Width = m_columns.Widths[row];
+    metadata.Height = m_columns.Heights[row];
+    metadata.Orientation = static_cast<ImageOrientation>(m_columns.Orientations[row]);
+    metadata.CaptureTime = m_columns.CaptureTimes[row];
+    return metadata;
+}
+
+std::optional<ImageMetadata> MetadataIndex::Find(std::filesystem::path const& path)
+{
+    std::lock_guard lock(m_lock);
+    auto found = m_lookup.find(PathBytes(path));
+    if (found == m_lookup.end())
+    {
+        return std::nullopt;
+    }
+    return RowLocked(found->second);
+}
+
+std::vector<ImageMetadata> MetadataIndex::List(MetadataOrder order)
+{
+    std::lock_guard lock(m_lock);
+    // Sort row numbers using the columns, and only build the results at the end.
+    std::vector<size_t> rows(m_columns.Count());
+    for (size_t row = 0; row < rows.size(); row++)
+    {
+        rows[row] = row;
+    }
+    auto& columns = m_columns;
+    switch (order)
+    {
+    case MetadataOrder::Path:
+        std::sort(rows.begin(), rows.end(), [&columns](size_t a, size_t b) { return columns.Paths[a] < columns.Paths[b]; });
+        break;
+    case MetadataOrder::CaptureTime:
+    {
+        auto time = [&columns](size_t row)
+        {
+            // Modification times are in file clock ticks, so compare in seconds.
+            auto captured = columns.CaptureTimes[row];
+            if (captured != 0)
+            {
+                return captured;
+            }
+            auto modified = std::filesystem::file_time_type(std::filesystem::file_time_type::duration(columns.ModifiedTimes[row]));
+            return std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::file_clock::to_sys(modified).time_since_epoch()).count();
+        };
+        std::vector<int64_t> times(rows.size());
+        for (size_t row = 0; row < rows.size(); row++)
+        {
+            times[row] = time(row);
+        }
+        std::stable_sort(rows.begin(), rows.end(), [&times](size_t a, size_t b) { return times[a] < times[b]; });
+        break;
+    }
+    case MetadataOrder::FileSize:
+        std::stable_sort(rows.begin(), rows.end(), [&columns](size_t a, size_t b) { return columns.FileSizes[a] < columns.FileSizes[b]; });
+        break;
+    }
+
+    std::vector<ImageMetadata> result;
+    result.reserve(rows.size());
+    for (auto row : rows)
+    {
+        result.push_back(RowLocked(row));
+    }
+    return result;
+}
+
+size_t MetadataIndex::Count()
+{
+    std::lock_guard lock(m_lock);
+    return m_columns.Count();
+}
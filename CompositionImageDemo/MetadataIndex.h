@@ -0,0 +1,117 @@
+#pragma once
+#include "ImageTransform.h"
+
+enum class ImageFileFormat : uint8_t
+{
+    // Couldn't be probed. It's still indexed, so it isn't probed again until
+    // it changes.
+    Unknown,
+    Jpeg,
+    Png,
+};
+
+// What a directory listing needs to lay out and sort images.
+struct ImageMetadata
+{
+    std::filesystem::path Path;
+    uint64_t FileSize = 0;
+    // The same units as ImageKey::ModifiedTime.
+    int64_t ModifiedTime = 0;
+    ImageFileFormat Format = ImageFileFormat::Unknown;
+    // As stored, before orientation.
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    ImageOrientation Orientation = ImageOrientation::Normal;
+    // Seconds since 1970 from EXIF DateTimeOriginal (or DateTime), as the
+    // camera recorded it, which usually means local time. 0 if there isn't one.
+    int64_t CaptureTime = 0;
+
+    uint32_t DisplayWidth() const { return SwapsDimensions(Orientation) ? Height : Width; }
+    uint32_t DisplayHeight() const { return SwapsDimensions(Orientation) ? Width : Height; }
+};
+
+// Reads just enough of a JPEG or PNG to fill in the metadata: the JPEG
+// segment headers up to the frame header (plus the EXIF block), or the PNG
+// IHDR chunk. Nothing is decoded. Returns std::nullopt if the file can't be
+// opened or isn't a format we know.
+std::optional<ImageMetadata> ProbeImage(std::filesystem::path const& path);
+
+enum class MetadataOrder
+{
+    Path,
+    // Falls back to the modification time for images without one.
+    CaptureTime,
+    FileSize,
+};
+
+struct MetadataRefreshStats
+{
+    uint64_t Scanned = 0;
+    uint64_t Unchanged = 0;
+    uint64_t Probed = 0;
+    uint64_t Removed = 0;
+};
+
+// A persistent index of image metadata, so opening a folder doesn't mean
+// opening (let alone decoding) every file in it. Entries are keyed by path,
+// and are only probed again when the file's size or modification time
+// changes. Refresh only needs the directory listing for unchanged files, and
+// on Windows the listing already carries both, so a cold refresh costs about
+// what enumerating the directory does.
+//
+// The file is columnar: every row's sizes, then every row's times, and so
+// on, with the paths in one block at the end. The offsets of the paths in
+// that block are a column too, between the capture times and the widths.
+// Loading it is a few big reads and copies rather than parsing 100k records.
+// It's written to a temporary file and renamed into place, and a checksum at
+// the end catches anything that was cut short, in which case the index starts
+// out empty.
+class MetadataIndex
+{
+public:
+    MetadataIndex(std::filesystem::path indexPath);
+    // Saves any changes.
+    ~MetadataIndex();
+    MetadataIndex(MetadataIndex const&) = delete;
+    MetadataIndex& operator=(MetadataIndex const&) = delete;
+
+    // Brings the entries for the images in the directory up to date, and drops
+    // the ones whose files are gone. Entries for other directories are left alone.
+    MetadataRefreshStats Refresh(std::filesystem::path const& directory, bool recursive = false);
+    void Save();
+
+    // These never touch the image files.
+    std::optional<ImageMetadata> Find(std::filesystem::path const& path);
+    std::vector<ImageMetadata> List(MetadataOrder order = MetadataOrder::Path);
+    size_t Count();
+
+private:
+    // One vector per field, in the same order as the file, except that the
+    // file has a column of path offsets between CaptureTimes and Widths.
+    struct Columns
+    {
+        std::vector<uint64_t> FileSizes;
+        std::vector<int64_t> ModifiedTimes;
+        std::vector<int64_t> CaptureTimes;
+        std::vector<uint32_t> Widths;
+        std::vector<uint32_t> Heights;
+        std::vector<uint16_t> Orientations;
+        std::vector<uint8_t> Formats;
+        std::vector<std::string> Paths;
+
+        size_t Count() const { return Paths.size(); }
+        void Append(std::string path, ImageMetadata const& metadata);
+        void AppendRow(Columns const& other, size_t row);
+    };
+
+    bool Load();
+    ImageMetadata RowLocked(size_t row) const;
+    void RebuildLookupLocked();
+
+    std::filesystem::path m_indexPath;
+
+    std::mutex m_lock;
+    Columns m_columns;
+    std::unordered_map<std::string, size_t> m_lookup;
+    bool m_dirty = false;
+};
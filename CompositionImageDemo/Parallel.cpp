@@ -0,0 +1,120 @@
+#include "pch.h"
+#include "Parallel.h"
+
+ParallelPool& ParallelPool::Instance()
+{
+    // One thread per core, less the one that calls Run.
+    static ParallelPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+ParallelPool::ParallelPool(uint32_t threadCount)
+{
+    m_threads.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++)
+    {
+        m_threads.emplace_back([this]() { ThreadLoop(); });
+    }
+}
+
+ParallelPool::~ParallelPool()
+{
+    {
+        std::lock_guard lock(m_lock);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void ParallelPool::Run(uint32_t count, uint32_t helpers, std::function<void(uint32_t)> const& func)
+{
+    Job job;
+    job.Func = &func;
+    job.Count = count;
+    job.OpenSlots = std::min(helpers, ThreadCount());
+    if (job.OpenSlots > 0)
+    {
+        {
+            std::lock_guard lock(m_lock);
+            m_jobs.push_back(&job);
+        }
+        if (job.OpenSlots == 1)
+        {
+            m_wake.notify_one();
+        }
+        else
+        {
+            m_wake.notify_all();
+        }
+    }
+
+    // The calling thread does its share too, so the job finishes even if
+    // every thread in the pool is busy with someone else's.
+    Work(job);
+
+    std::unique_lock lock(m_lock);
+    // Nobody else can join once we're done, the job lives on our stack.
+    auto queued = std::find(m_jobs.begin(), m_jobs.end(), &job);
+    if (queued != m_jobs.end())
+    {
+        m_jobs.erase(queued);
+    }
+    m_done.wait(lock, [&job]() { return job.Active == 0; });
+    if (job.Error)
+    {
+        std::rethrow_exception(job.Error);
+    }
+}
+
+void ParallelPool::Work(Job& job)
+{
+    try
+    {
+        for (auto i = job.Next.fetch_add(1); i < job.Count; i = job.Next.fetch_add(1))
+        {
+            (*job.Func)(i);
+        }
+    }
+    catch (...)
+    {
+        // Stop handing out work and remember what went wrong.
+        job.Next = job.Count;
+        std::lock_guard lock(m_lock);
+        if (!job.Error)
+        {
+            job.Error = std::current_exception();
+        }
+    }
+}
+
+void ParallelPool::ThreadLoop()
+{
+    std::unique_lock lock(m_lock);
+    while (true)
+    {
+        m_wake.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+        if (m_stopping)
+        {
+            return;
+        }
+        auto job = m_jobs.front();
+        if (--job->OpenSlots == 0)
+        {
+            m_jobs.pop_front();
+        }
+        job->Active++;
+
+        lock.unlock();
+        Work(*job);
+        lock.lock();
+
+        if (--job->Active == 0)
+        {
+            m_done.notify_all();
+        }
+    }
+}
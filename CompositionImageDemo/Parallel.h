@@ -0,0 +1,73 @@
+#pragma once
+
+// The threads behind ParallelFor. They're started once, the first time they're
+// needed, and shared by everything. Each ParallelFor runs on the calling thread
+// plus however many of these are free, so concurrent loads split the cores
+// between them instead of each starting a thread per core.
+class ParallelPool
+{
+public:
+    static ParallelPool& Instance();
+
+    ParallelPool(uint32_t threadCount);
+    ~ParallelPool();
+    ParallelPool(ParallelPool const&) = delete;
+    ParallelPool& operator=(ParallelPool const&) = delete;
+
+    uint32_t ThreadCount() const { return static_cast<uint32_t>(m_threads.size()); }
+    // Calls func(index) for every index in [0, count), on the calling thread
+    // and at most 'helpers' of the pool's threads. Returns once every index
+    // is done, rethrowing the first exception any of them threw.
+    void Run(uint32_t count, uint32_t helpers, std::function<void(uint32_t)> const& func);
+
+private:
+    struct Job
+    {
+        std::function<void(uint32_t)> const* Func = nullptr;
+        uint32_t Count = 0;
+        // Helpers that can still join, and helpers that are working on it.
+        uint32_t OpenSlots = 0;
+        uint32_t Active = 0;
+        std::atomic<uint32_t> Next = 0;
+        std::exception_ptr Error;
+    };
+
+    void Work(Job& job);
+    void ThreadLoop();
+
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::deque<Job*> m_jobs;
+    bool m_stopping = false;
+    std::vector<std::thread> m_threads;
+};
+
+// Below this many pixels for each thread, waking another thread costs more
+// than it saves.
+constexpr uint64_t MinimumPixelsPerThread = 64 * 1024;
+
+// Calls func(index) for every index in [0, count), spreading the work over
+// the available cores. Indices are handed out one at a time, so callers should
+// make each index a reasonably sized chunk of work (a row of tiles, a band of
+// rows, etc). 'pixels' is roughly how much work there is in total, and small
+// jobs run on fewer threads, or just the calling one. Blocks until all of the
+// work is done and rethrows the first exception thrown by any of the workers.
+template <typename Func>
+void ParallelFor(uint32_t count, Func&& func, uint64_t pixels = std::numeric_limits<uint64_t>::max())
+{
+    auto& pool = ParallelPool::Instance();
+    uint64_t threads = std::min<uint64_t>(count, pool.ThreadCount() + 1);
+    threads = std::min<uint64_t>(threads, std::max<uint64_t>(1, pixels / MinimumPixelsPerThread));
+    if (threads <= 1)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            func(i);
+        }
+        return;
+    }
+
+    std::function<void(uint32_t)> const work = std::ref(func);
+    pool.Run(count, static_cast<uint32_t>(threads - 1), work);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// Decoded pixels that live in system memory. The layout matches what we get
+// back from BitmapFrame::GetPixelDataAsync: BGRA with 8 bits per channel,
+// premultiplied alpha, and rows that are tightly packed (Width * 4 bytes).
+struct PixelBuffer
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    std::vector<uint8_t> Bytes;
+
+    PixelBuffer() = default;
+    PixelBuffer(uint32_t width, uint32_t height) :
+        Width(width),
+        Height(height),
+        Bytes(static_cast<size_t>(width) * height * 4) {}
+
+    uint32_t Stride() const { return Width * 4; }
+    uint8_t* Row(uint32_t y) { return Bytes.data() + static_cast<size_t>(y) * Stride(); }
+    uint8_t const* Row(uint32_t y) const { return Bytes.data() + static_cast<size_t>(y) * Stride(); }
+};
@@ -0,0 +1,270 @@
+#include "pch.h"
+#include "PixelFormatConversion.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+namespace
+{
+    constexpr uint32_t RowsPerBand = 64;
+    // Error diffusion bands start this many rows early (without writing any
+    // output) so the error has settled by the time we reach the band. This
+    // hides the seams between bands.
+    constexpr uint32_t WarmupRows = 4;
+
+    // Per channel (B, G, R, A) quantization levels and bit positions.
+    struct FormatTraits
+    {
+        int Levels[4];
+        int Shifts[4];
+
+        bool HasAlpha() const { return Levels[3] > 0; }
+    };
+
+    FormatTraits GetTraits(PackedPixelFormat format)
+    {
+        switch (format)
+        {
+        case PackedPixelFormat::B5G6R5:
+            return { { 31, 63, 31, 0 }, { 0, 5, 11, 0 } };
+        case PackedPixelFormat::B4G4R4A4:
+            return { { 15, 15, 15, 15 }, { 0, 4, 8, 12 } };
+        }
+        throw std::invalid_argument("Unknown pixel format");
+    }
+
+    constexpr int BayerMatrix[4][4] =
+    {
+        {  0,  8,  2, 10 },
+        { 12,  4, 14,  6 },
+        {  3, 11,  1,  9 },
+        { 15,  7, 13,  5 },
+    };
+
+    // Threshold added before dividing by 255, so each value rounds up with a
+    // probability that matches its distance from the level below.
+    int BayerThreshold(uint32_t x, uint32_t y)
+    {
+        return ((2 * BayerMatrix[y % 4][x % 4] + 1) * 255) / 32;
+    }
+
+    uint16_t Pack(int (&levels)[4], FormatTraits const& traits)
+    {
+        if (traits.HasAlpha())
+        {
+            // Keep the result premultiplied.
+            for (int channel = 0; channel < 3; channel++)
+            {
+                levels[channel] = std::min(levels[channel], levels[3]);
+            }
+        }
+        uint32_t result = 0;
+        for (int channel = 0; channel < 4; channel++)
+        {
+            if (traits.Levels[channel] > 0)
+            {
+                result |= static_cast<uint32_t>(levels[channel]) << traits.Shifts[channel];
+            }
+        }
+        return static_cast<uint16_t>(result);
+    }
+
+    uint16_t QuantizePixel(uint8_t const* pixel, FormatTraits const& traits, int threshold)
+    {
+        int levels[4];
+        for (int channel = 0; channel < 4; channel++)
+        {
+            levels[channel] = (pixel[channel] * traits.Levels[channel] + threshold) / 255;
+        }
+        return Pack(levels, traits);
+    }
+
+#ifdef IMAGE_DEMO_SSE2
+    // Exact floor(x / 255) for the range we use (x < 2^16).
+    __m128i DivideBy255(__m128i value)
+    {
+        auto one = _mm_set1_epi16(1);
+        return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(value, one), _mm_srli_epi16(value, 8)), 8);
+    }
+
+    // Quantizes two pixels (eight 16-bit channels) and packs each one into the
+    // low 16 bits of 32-bit lanes 0 and 1.
+    __m128i QuantizeTwoPixels(__m128i pixels, __m128i threshold, __m128i levels, __m128i multipliers, bool premultiplied)
+    {
+        auto quantized = DivideBy255(_mm_add_epi16(_mm_mullo_epi16(pixels, levels), threshold));
+        if (premultiplied)
+        {
+            auto alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(quantized, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            quantized = _mm_min_epi16(quantized, alpha);
+        }
+        // Shift each channel into place and sum (B + G) and (R + A)...
+        auto halves = _mm_madd_epi16(quantized, multipliers);
+        // ...then sum the halves of each pixel.
+        auto packed = _mm_add_epi32(halves, _mm_srli_epi64(halves, 32));
+        return _mm_shuffle_epi32(packed, _MM_SHUFFLE(3, 1, 2, 0));
+    }
+
+    // Narrows four 32-bit lanes holding 16-bit values, keeping the bit patterns.
+    __m128i SignExtend16(__m128i value)
+    {
+        return _mm_srai_epi32(_mm_slli_epi32(value, 16), 16);
+    }
+#endif
+
+    // Handles both plain rounding (no dither) and ordered dithering, the only
+    // difference being the threshold.
+    void ConvertRowOrdered(uint8_t const* source, uint16_t* destination, uint32_t width, uint32_t y, FormatTraits const& traits, bool dither)
+    {
+        int thresholds[4];
+        for (uint32_t x = 0; x < 4; x++)
+        {
+            thresholds[x] = dither ? BayerThreshold(x, y) : 127;
+        }
+
+        uint32_t x = 0;
+#ifdef IMAGE_DEMO_SSE2
+        auto zero = _mm_setzero_si128();
+        auto levels = _mm_setr_epi16(
+            static_cast<short>(traits.Levels[0]), static_cast<short>(traits.Levels[1]), static_cast<short>(traits.Levels[2]), static_cast<short>(traits.Levels[3]),
+            static_cast<short>(traits.Levels[0]), static_cast<short>(traits.Levels[1]), static_cast<short>(traits.Levels[2]), static_cast<short>(traits.Levels[3]));
+        short multiplierValues[4];
+        for (int channel = 0; channel < 4; channel++)
+        {
+            multiplierValues[channel] = traits.Levels[channel] > 0 ? static_cast<short>(1 << traits.Shifts[channel]) : 0;
+        }
+        auto multipliers = _mm_setr_epi16(
+            multiplierValues[0], multiplierValues[1], multiplierValues[2], multiplierValues[3],
+            multiplierValues[0], multiplierValues[1], multiplierValues[2], multiplierValues[3]);
+        // Pixels 0 and 1 of every group of four share one set of thresholds,
+        // pixels 2 and 3 the other.
+        auto threshold01 = _mm_setr_epi16(
+            static_cast<short>(thresholds[0]), static_cast<short>(thresholds[0]), static_cast<short>(thresholds[0]), static_cast<short>(thresholds[0]),
+            static_cast<short>(thresholds[1]), static_cast<short>(thresholds[1]), static_cast<short>(thresholds[1]), static_cast<short>(thresholds[1]));
+        auto threshold23 = _mm_setr_epi16(
+            static_cast<short>(thresholds[2]), static_cast<short>(thresholds[2]), static_cast<short>(thresholds[2]), static_cast<short>(thresholds[2]),
+            static_cast<short>(thresholds[3]), static_cast<short>(thresholds[3]), static_cast<short>(thresholds[3]), static_cast<short>(thresholds[3]));
+        auto premultiplied = traits.HasAlpha();
+
+        for (; SimdEnabled() && x + 8 <= width; x += 8)
+        {
+            auto first = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + x * 4));
+            auto second = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + x * 4 + 16));
+            auto pixels01 = QuantizeTwoPixels(_mm_unpacklo_epi8(first, zero), threshold01, levels, multipliers, premultiplied);
+            auto pixels23 = QuantizeTwoPixels(_mm_unpackhi_epi8(first, zero), threshold23, levels, multipliers, premultiplied);
+            auto pixels45 = QuantizeTwoPixels(_mm_unpacklo_epi8(second, zero), threshold01, levels, multipliers, premultiplied);
+            auto pixels67 = QuantizeTwoPixels(_mm_unpackhi_epi8(second, zero), threshold23, levels, multipliers, premultiplied);
+            auto pixels0123 = SignExtend16(_mm_unpacklo_epi64(pixels01, pixels23));
+            auto pixels4567 = SignExtend16(_mm_unpacklo_epi64(pixels45, pixels67));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x), _mm_packs_epi32(pixels0123, pixels4567));
+        }
+#endif
+        for (; x < width; x++)
+        {
+            destination[x] = QuantizePixel(source + x * 4, traits, thresholds[x % 4]);
+        }
+    }
+
+    // Floyd-Steinberg over rows [startY, endY), alternating direction every
+    // row. Errors are kept in 1/16ths of an 8-bit step.
+    void DiffuseBand(PixelBuffer const& source, PackedPixelBuffer& destination, FormatTraits const& traits, uint32_t startY, uint32_t endY)
+    {
+        auto width = source.Width;
+        // One pixel of padding on either side so we don't need edge checks.
+        std::vector<int> current((width + 2) * 4, 0);
+        std::vector<int> next((width + 2) * 4, 0);
+
+        auto firstY = startY >= WarmupRows ? startY - WarmupRows : 0;
+        for (auto y = firstY; y < endY; y++)
+        {
+            auto leftToRight = y % 2 == 0;
+            auto direction = leftToRight ? 1 : -1;
+            auto sourceRow = source.Row(y);
+            std::fill(next.begin(), next.end(), 0);
+
+            for (uint32_t i = 0; i < width; i++)
+            {
+                auto x = leftToRight ? i : width - 1 - i;
+                auto pixel = sourceRow + x * 4;
+                auto here = (x + 1) * 4;
+                auto ahead = here + direction * 4;
+                auto behind = here - direction * 4;
+
+                int levels[4] = {};
+                for (int channel = 0; channel < 4; channel++)
+                {
+                    auto levelCount = traits.Levels[channel];
+                    if (levelCount == 0)
+                    {
+                        continue;
+                    }
+                    auto wanted = std::clamp(pixel[channel] * 16 + current[here + channel], 0, 255 * 16);
+                    levels[channel] = (wanted * levelCount + 255 * 8) / (255 * 16);
+                    auto error = wanted - levels[channel] * 255 * 16 / levelCount;
+                    current[ahead + channel] += error * 7 / 16;
+                    next[behind + channel] += error * 3 / 16;
+                    next[here + channel] += error * 5 / 16;
+                    next[ahead + channel] += error / 16;
+                }
+
+                if (y >= startY)
+                {
+                    destination.Row(y)[x] = Pack(levels, traits);
+                }
+            }
+            std::swap(current, next);
+        }
+    }
+
+    int ExpandChannel(uint32_t value, int levels)
+    {
+        return levels == 0 ? 255 : static_cast<int>(value * 255 + levels / 2) / levels;
+    }
+}
+
+PackedPixelBuffer ConvertPixels(PixelBuffer const& source, PackedPixelFormat format, DitherMode dither)
+{
+    auto traits = GetTraits(format);
+    PackedPixelBuffer result;
+    result.Format = format;
+    result.Width = source.Width;
+    result.Height = source.Height;
+    result.Pixels.resize(static_cast<size_t>(source.Width) * source.Height);
+
+    auto bands = (source.Height + RowsPerBand - 1) / RowsPerBand;
+    ParallelFor(bands, [&](uint32_t band)
+        {
+            auto startY = band * RowsPerBand;
+            auto endY = std::min(startY + RowsPerBand, source.Height);
+            if (dither == DitherMode::ErrorDiffusion)
+            {
+                DiffuseBand(source, result, traits, startY, endY);
+                return;
+            }
+            for (auto y = startY; y < endY; y++)
+            {
+                ConvertRowOrdered(source.Row(y), result.Row(y), source.Width, y, traits, dither == DitherMode::Ordered);
+            }
+        }, static_cast<uint64_t>(source.Width) * source.Height);
+
+    return result;
+}
+
+PixelBuffer ExpandPixels(PackedPixelBuffer const& source)
+{
+    auto traits = GetTraits(source.Format);
+    PixelBuffer result(source.Width, source.Height);
+    for (uint32_t y = 0; y < source.Height; y++)
+    {
+        auto sourceRow = source.Row(y);
+        auto destination = result.Row(y);
+        for (uint32_t x = 0; x < source.Width; x++, destination += 4)
+        {
+            for (int channel = 0; channel < 4; channel++)
+            {
+                auto levels = traits.Levels[channel];
+                auto value = (sourceRow[x] >> traits.Shifts[channel]) & static_cast<uint32_t>(levels);
+                destination[channel] = static_cast<uint8_t>(ExpandChannel(value, levels));
+            }
+        }
+    }
+    return result;
+}
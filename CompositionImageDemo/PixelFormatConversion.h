@@ -0,0 +1,42 @@
+#pragma once
+#include "PixelBuffer.h"
+
+// The 16-bit formats we can convert to. Channels are listed from the least
+// significant bits up, the same way DXGI names them.
+//  B5G6R5   - Opaque content. Alpha is dropped.
+//  B4G4R4A4 - Premultiplied alpha with 4 bits per channel.
+enum class PackedPixelFormat
+{
+    B5G6R5,
+    B4G4R4A4,
+};
+
+//  None           - Round to the nearest value. Fastest, but gradients band.
+//  Ordered        - 4x4 Bayer matrix. Vectorized, runs at close to copy speed.
+//  ErrorDiffusion - Floyd-Steinberg with serpentine scanning. Best looking.
+enum class DitherMode
+{
+    None,
+    Ordered,
+    ErrorDiffusion,
+};
+
+// Pixels in one of the 16-bit formats. Rows are tightly packed (Width * 2 bytes).
+struct PackedPixelBuffer
+{
+    PackedPixelFormat Format = PackedPixelFormat::B5G6R5;
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    std::vector<uint16_t> Pixels;
+
+    uint32_t Stride() const { return Width * 2; }
+    uint16_t* Row(uint32_t y) { return Pixels.data() + static_cast<size_t>(y) * Width; }
+    uint16_t const* Row(uint32_t y) const { return Pixels.data() + static_cast<size_t>(y) * Width; }
+};
+
+// Converts premultiplied BGRA8 pixels to a 16-bit format. Ordered dithering
+// is done with SSE2 where available, and error diffusion runs in parallel
+// bands of rows.
+PackedPixelBuffer ConvertPixels(PixelBuffer const& source, PackedPixelFormat format, DitherMode dither);
+// Expands 16-bit pixels back to BGRA8, useful for checking the conversion.
+PixelBuffer ExpandPixels(PackedPixelBuffer const& source);
@@ -0,0 +1,254 @@
+#include "pch.h"
+#include "PixelRetention.h"
+#include "Parallel.h"
+
+namespace
+{
+    // Averages each factor x factor block. Blocks at the right and bottom
+    // edges can be smaller.
+    PixelBuffer Downscale(PixelBuffer const& source, uint32_t factor)
+    {
+        PixelBuffer result((source.Width + factor - 1) / factor, (source.Height + factor - 1) / factor);
+        ParallelFor(result.Height, [&](uint32_t y)
+            {
+                auto top = y * factor;
+                auto bottom = std::min(top + factor, source.Height);
+                auto destination = result.Row(y);
+                for (uint32_t x = 0; x < result.Width; x++)
+                {
+                    auto left = x * factor;
+                    auto right = std::min(left + factor, source.Width);
+                    uint32_t sums[4] = {};
+                    for (auto sourceY = top; sourceY < bottom; sourceY++)
+                    {
+                        auto row = source.Row(sourceY);
+                        for (auto sourceX = left; sourceX < right; sourceX++)
+                        {
+                            for (uint32_t channel = 0; channel < 4; channel++)
+                            {
+                                sums[channel] += row[sourceX * 4 + channel];
+                            }
+                        }
+                    }
+                    auto count = (bottom - top) * (right - left);
+                    for (uint32_t channel = 0; channel < 4; channel++)
+                    {
+                        destination[x * 4 + channel] = static_cast<uint8_t>((sums[channel] + count / 2) / count);
+                    }
+                }
+            }, static_cast<uint64_t>(source.Width) * source.Height);
+        return result;
+    }
+
+    // Bilinear, with pixel centers lined up the way the GPU would. The weights
+    // are 8-bit fixed point, and the columns' are worked out once up front.
+    PixelBuffer Upscale(PixelBuffer const& source, uint32_t width, uint32_t height)
+    {
+        struct Sample
+        {
+            uint32_t First;
+            uint32_t Second;
+            uint32_t Weight;
+        };
+        auto sample = [](uint32_t index, uint32_t size, uint32_t sourceSize)
+        {
+            auto position = std::clamp((index + 0.5f) * sourceSize / size - 0.5f, 0.0f, static_cast<float>(sourceSize - 1));
+            auto first = static_cast<uint32_t>(position);
+            return Sample{ first, std::min(first + 1, sourceSize - 1), static_cast<uint32_t>((position - first) * 256.0f + 0.5f) };
+        };
+        std::vector<Sample> columns(width);
+        for (uint32_t x = 0; x < width; x++)
+        {
+            columns[x] = sample(x, width, source.Width);
+        }
+
+        PixelBuffer result(width, height);
+        ParallelFor(height, [&](uint32_t y)
+            {
+                auto rows = sample(y, height, source.Height);
+                auto row0 = source.Row(rows.First);
+                auto row1 = source.Row(rows.Second);
+                auto destination = result.Row(y);
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    auto& column = columns[x];
+                    auto first = column.First * 4;
+                    auto second = column.Second * 4;
+                    for (uint32_t channel = 0; channel < 4; channel++)
+                    {
+                        auto top = row0[first + channel] * (256 - column.Weight) + row0[second + channel] * column.Weight;
+                        auto bottom = row1[first + channel] * (256 - column.Weight) + row1[second + channel] * column.Weight;
+                        destination[x * 4 + channel] = static_cast<uint8_t>((top * (256 - rows.Weight) + bottom * rows.Weight + 32768) >> 16);
+                    }
+                }
+            }, static_cast<uint64_t>(width) * height);
+        return result;
+    }
+}
+
+PixelRetention::PixelRetention(std::shared_ptr<ImagePipeline> pipeline, RetentionOptions const& options, Clock clock)
+{
+    if (options.DownscaleFactor == 0)
+    {
+        throw std::invalid_argument("The downscale factor must be at least 1");
+    }
+    m_pipeline = std::move(pipeline);
+    m_options = options;
+    m_clock = clock ? std::move(clock) : []() { return std::chrono::steady_clock::now(); };
+}
+
+bool PixelRetention::Retain(std::shared_ptr<SurfaceBackend> const& surface, std::shared_ptr<PixelBuffer const> image)
+{
+    if (m_options.Mode == RetentionMode::None)
+    {
+        Forget(surface);
+        return false;
+    }
+
+    // Shrinking or compressing is done before taking the lock.
+    Entry entry;
+    entry.Surface = surface;
+    entry.Width = image->Width;
+    entry.Height = image->Height;
+    switch (m_options.Mode)
+    {
+    case RetentionMode::Full:
+        entry.Bytes = image->Bytes.size();
+        entry.Pixels = std::move(image);
+        break;
+    case RetentionMode::Downscaled:
+        entry.Pixels = std::make_shared<PixelBuffer const>(Downscale(*image, m_options.DownscaleFactor));
+        entry.Bytes = entry.Pixels->Bytes.size();
+        break;
+    case RetentionMode::Compressed:
+        entry.Blocks = std::make_shared<CompressedImage const>(
+            CompressImage(*image, HasTransparentPixels(*image) ? BlockFormat::BC3 : BlockFormat::BC1, m_options.Quality));
+        entry.Bytes = entry.Blocks->Blocks.size();
+        break;
+    default:
+        throw std::invalid_argument("Unknown retention mode");
+    }
+
+    // Whatever was retained for the surface before goes in the same critical
+    // section, so the totals never count both, or neither.
+    std::lock_guard lock(m_lock);
+    auto existing = m_entries.find(surface.get());
+    if (existing != m_entries.end())
+    {
+        m_bytes -= existing->second.Bytes;
+        m_stats.FullSizeBytes -= static_cast<uint64_t>(existing->second.Width) * existing->second.Height * 4;
+    }
+    if (m_bytes + entry.Bytes > m_options.BudgetBytes)
+    {
+        // The old contents are gone from the surface, so they go from here too.
+        if (existing != m_entries.end())
+        {
+            m_entries.erase(existing);
+        }
+        m_stats.Rejected++;
+        return false;
+    }
+    m_bytes += entry.Bytes;
+    m_stats.FullSizeBytes += static_cast<uint64_t>(entry.Width) * entry.Height * 4;
+    m_entries.insert_or_assign(surface.get(), std::move(entry));
+    return true;
+}
+
+void PixelRetention::Forget(std::shared_ptr<SurfaceBackend> const& surface)
+{
+    std::lock_guard lock(m_lock);
+    auto found = m_entries.find(surface.get());
+    if (found != m_entries.end())
+    {
+        m_bytes -= found->second.Bytes;
+        m_stats.FullSizeBytes -= static_cast<uint64_t>(found->second.Width) * found->second.Height * 4;
+        m_entries.erase(found);
+    }
+}
+
+bool PixelRetention::IsRetained(std::shared_ptr<SurfaceBackend> const& surface)
+{
+    std::lock_guard lock(m_lock);
+    return m_entries.find(surface.get()) != m_entries.end();
+}
+
+std::shared_ptr<PixelBuffer const> PixelRetention::Prepare(Entry const& entry) const
+{
+    if (entry.Pixels)
+    {
+        if (entry.Pixels->Width == entry.Width && entry.Pixels->Height == entry.Height)
+        {
+            return entry.Pixels;
+        }
+        return std::make_shared<PixelBuffer const>(Upscale(*entry.Pixels, entry.Width, entry.Height));
+    }
+    return std::make_shared<PixelBuffer const>(DecompressImage(*entry.Blocks));
+}
+
+size_t PixelRetention::RestoreAll(std::function<void()> onRestored)
+{
+    auto start = m_clock();
+    std::vector<std::pair<std::shared_ptr<SurfaceBackend>, std::shared_ptr<PixelBuffer const>>> restores;
+    {
+        // Entries are never changed in place, so copies of them (which only
+        // copy the shared_ptrs) are safe to prepare outside the lock.
+        std::vector<Entry> entries;
+        {
+            std::lock_guard lock(m_lock);
+            m_stats.Restores++;
+            entries.reserve(m_entries.size());
+            for (auto&& [key, entry] : m_entries)
+            {
+                entries.push_back(entry);
+            }
+        }
+        for (auto& entry : entries)
+        {
+            restores.emplace_back(entry.Surface, Prepare(entry));
+        }
+    }
+    auto prepareTime = std::chrono::duration_cast<std::chrono::microseconds>(m_clock() - start);
+
+    if (restores.empty())
+    {
+        if (onRestored)
+        {
+            onRestored();
+        }
+        return 0;
+    }
+
+    // The last upload to be written finishes the restore.
+    auto remaining = std::make_shared<std::atomic<size_t>>(restores.size());
+    for (auto&& [surface, pixels] : restores)
+    {
+        m_pipeline->Upload(surface, pixels, std::nullopt, [this, remaining, start, prepareTime, onRestored]()
+            {
+                if (--*remaining > 0)
+                {
+                    return;
+                }
+                {
+                    std::lock_guard lock(m_lock);
+                    m_stats.LastPrepareTime = prepareTime;
+                    m_stats.LastRestoreTime = std::chrono::duration_cast<std::chrono::microseconds>(m_clock() - start);
+                }
+                if (onRestored)
+                {
+                    onRestored();
+                }
+            });
+    }
+    std::lock_guard lock(m_lock);
+    m_stats.ImagesRestored += restores.size();
+    return restores.size();
+}
+
+RetentionStats PixelRetention::Stats()
+{
+    std::lock_guard lock(m_lock);
+    auto stats = m_stats;
+    stats.RetainedImages = m_entries.size();
+    stats.RetainedBytes = m_bytes;
+    return stats;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "ImagePipeline.h"
+#include "BlockCompression.h"
+
+//  None       - Nothing is kept, surfaces are reloaded from their source.
+//  Full       - The decoded pixels are kept as they are. Restoring is just an
+//               upload. Shares the buffer with the decoded image cache.
+//  Downscaled - A copy with each side divided by DownscaleFactor (box filtered),
+//               stretched back up when restored. Blurry until the app reloads
+//               the real thing, but the screen isn't empty in the meantime.
+//  Compressed - BC1 (or BC3 with alpha) blocks, 4-8x smaller than the pixels.
+//               Lossy, and restoring has to decompress them first.
+enum class RetentionMode
+{
+    None,
+    Full,
+    Downscaled,
+    Compressed,
+};
+
+struct RetentionOptions
+{
+    RetentionMode Mode = RetentionMode::Full;
+    uint32_t DownscaleFactor = 2;
+    CompressionQuality Quality = CompressionQuality::Fast;
+    // Images that would take the total over this aren't retained, and have to
+    // be reloaded from their source like before.
+    uint64_t BudgetBytes = 256 * 1024 * 1024;
+};
+
+struct RetentionStats
+{
+    uint64_t RetainedImages = 0;
+    uint64_t RetainedBytes = 0;
+    // What the retained images would take up decoded at full size.
+    uint64_t FullSizeBytes = 0;
+    // Images that didn't fit in the budget.
+    uint64_t Rejected = 0;
+    uint64_t Restores = 0;
+    uint64_t ImagesRestored = 0;
+    // For the last restore that finished. Preparing is decompressing and
+    // scaling the pixels, the restore time runs from the call to RestoreAll
+    // until the last of its uploads was written.
+    std::chrono::microseconds LastPrepareTime{};
+    std::chrono::microseconds LastRestoreTime{};
+};
+
+// Keeps a copy of what's on each surface in system memory, so when the device
+// is replaced the surfaces can be put back with an upload instead of opening
+// and decoding every file again. Without it, recovery time grows with the
+// number and size of the images on screen.
+//
+// RestoreAll should be called from a DeviceReplaced handler added after the
+// pipeline was created, so the pipeline is already set up for the new device.
+class PixelRetention
+{
+public:
+    using Clock = std::function<std::chrono::steady_clock::time_point()>;
+
+    PixelRetention(std::shared_ptr<ImagePipeline> pipeline, RetentionOptions const& options = {}, Clock clock = nullptr);
+
+    // Remembers the image as the contents of the surface, replacing whatever
+    // was retained for it before. Returns false if it wasn't retained (the mode
+    // is None, or it doesn't fit in the budget).
+    bool Retain(std::shared_ptr<SurfaceBackend> const& surface, std::shared_ptr<PixelBuffer const> image);
+    void Forget(std::shared_ptr<SurfaceBackend> const& surface);
+    bool IsRetained(std::shared_ptr<SurfaceBackend> const& surface);
+
+    // Queues every retained image to be uploaded to its surface again.
+    // onRestored is called from the pipeline's Flush once the last one has been
+    // written. Returns the number of surfaces queued.
+    size_t RestoreAll(std::function<void()> onRestored = nullptr);
+
+    RetentionOptions const& Options() const { return m_options; }
+    RetentionStats Stats();
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<SurfaceBackend> Surface;
+        uint32_t Width = 0;
+        uint32_t Height = 0;
+        // Full and Downscaled keep pixels, Compressed keeps blocks. Both are
+        // shared, so copying an entry is cheap.
+        std::shared_ptr<PixelBuffer const> Pixels;
+        std::shared_ptr<CompressedImage const> Blocks;
+        uint64_t Bytes = 0;
+    };
+
+    std::shared_ptr<PixelBuffer const> Prepare(Entry const& entry) const;
+
+    std::shared_ptr<ImagePipeline> m_pipeline;
+    RetentionOptions m_options;
+    Clock m_clock;
+
+    std::mutex m_lock;
+    std::map<SurfaceBackend*, Entry> m_entries;
+    uint64_t m_bytes = 0;
+    RetentionStats m_stats;
+};
@@ -0,0 +1,381 @@
+#include "pch.h"
+#include "Placeholder.h"
+
+namespace
+{
+    // Four floats (one pixel) that can be added and scaled together.
+    struct Float4
+    {
+#ifdef IMAGE_DEMO_SSE2
+        __m128 Value = _mm_setzero_ps();
+
+        static Float4 Load(uint8_t const* pixel)
+        {
+            int packed;
+            memcpy(&packed, pixel, 4);
+            auto bytes = _mm_cvtsi32_si128(packed);
+            auto zero = _mm_setzero_si128();
+            auto words = _mm_unpacklo_epi8(bytes, zero);
+            return { _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero)) };
+        }
+
+        void Store(uint8_t* pixel) const
+        {
+            auto rounded = _mm_cvtps_epi32(Value);
+            auto words = _mm_packs_epi32(rounded, rounded);
+            auto bytes = _mm_packus_epi16(words, words);
+            auto packed = _mm_cvtsi128_si32(bytes);
+            memcpy(pixel, &packed, 4);
+        }
+
+        Float4& operator+=(Float4 other) { Value = _mm_add_ps(Value, other.Value); return *this; }
+        Float4 operator*(float scale) const { return { _mm_mul_ps(Value, _mm_set1_ps(scale)) }; }
+#else
+        float Value[4] = {};
+
+        static Float4 Load(uint8_t const* pixel)
+        {
+            return { { static_cast<float>(pixel[0]), static_cast<float>(pixel[1]), static_cast<float>(pixel[2]), static_cast<float>(pixel[3]) } };
+        }
+
+        void Store(uint8_t* pixel) const
+        {
+            for (int channel = 0; channel < 4; channel++)
+            {
+                pixel[channel] = static_cast<uint8_t>(std::clamp(std::lround(Value[channel]), 0l, 255l));
+            }
+        }
+
+        Float4& operator+=(Float4 other)
+        {
+            for (int channel = 0; channel < 4; channel++)
+            {
+                Value[channel] += other.Value[channel];
+            }
+            return *this;
+        }
+
+        Float4 operator*(float scale) const
+        {
+            return { { Value[0] * scale, Value[1] * scale, Value[2] * scale, Value[3] * scale } };
+        }
+#endif
+    };
+
+    // Picks the pixel at the center of each cell of a grid laid over the
+    // source. The grid is at most maxSize on its longest side.
+    PixelBuffer Subsample(PixelBuffer const& source, uint32_t maxSize)
+    {
+        auto width = source.Width;
+        auto height = source.Height;
+        if (width >= height && width > maxSize)
+        {
+            height = std::max(1u, static_cast<uint32_t>(static_cast<uint64_t>(height) * maxSize / width));
+            width = maxSize;
+        }
+        else if (height > width && height > maxSize)
+        {
+            width = std::max(1u, static_cast<uint32_t>(static_cast<uint64_t>(width) * maxSize / height));
+            height = maxSize;
+        }
+
+        PixelBuffer result(width, height);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            auto sourceY = static_cast<uint32_t>((2 * static_cast<uint64_t>(y) + 1) * source.Height / (2 * height));
+            auto sourceRow = source.Row(sourceY);
+            auto destination = result.Row(y);
+            for (uint32_t x = 0; x < width; x++)
+            {
+                auto sourceX = static_cast<uint32_t>((2 * static_cast<uint64_t>(x) + 1) * source.Width / (2 * width));
+                memcpy(destination + x * 4, sourceRow + sourceX * 4, 4);
+            }
+        }
+        return result;
+    }
+
+    // One box blur pass along a line of pixels, repeating the end pixels.
+    void BlurLine(Float4 const* input, Float4* output, uint32_t count, size_t step, int radius)
+    {
+        auto scale = 1.0f / (2 * radius + 1);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            Float4 sum;
+            for (auto offset = -radius; offset <= radius; offset++)
+            {
+                auto index = std::clamp(static_cast<int>(i) + offset, 0, static_cast<int>(count) - 1);
+                sum += input[index * step];
+            }
+            output[i * step] = sum * scale;
+        }
+    }
+
+    constexpr std::string_view Base83Characters = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz#$%*+,-.:;=?@[]^_{|}~";
+
+    void EncodeBase83(uint32_t value, uint32_t length, std::string& output)
+    {
+        for (uint32_t i = 1; i <= length; i++)
+        {
+            uint32_t divisor = 1;
+            for (auto j = i; j < length; j++)
+            {
+                divisor *= 83;
+            }
+            output.push_back(Base83Characters[(value / divisor) % 83]);
+        }
+    }
+
+    std::optional<uint32_t> DecodeBase83(std::string_view text)
+    {
+        uint32_t value = 0;
+        for (auto character : text)
+        {
+            auto digit = Base83Characters.find(character);
+            if (digit == std::string_view::npos)
+            {
+                return std::nullopt;
+            }
+            value = value * 83 + static_cast<uint32_t>(digit);
+        }
+        return value;
+    }
+
+    float SrgbToLinear(uint8_t value)
+    {
+        auto normalized = value / 255.0f;
+        return normalized <= 0.04045f ? normalized / 12.92f : std::pow((normalized + 0.055f) / 1.055f, 2.4f);
+    }
+
+    uint8_t LinearToSrgb(float value)
+    {
+        auto clamped = std::clamp(value, 0.0f, 1.0f);
+        auto srgb = clamped <= 0.0031308f ? clamped * 12.92f : 1.055f * std::pow(clamped, 1.0f / 2.4f) - 0.055f;
+        return static_cast<uint8_t>(std::clamp(static_cast<int>(srgb * 255.0f + 0.5f), 0, 255));
+    }
+
+    float SignedPow(float value, float exponent)
+    {
+        return std::copysign(std::pow(std::abs(value), exponent), value);
+    }
+
+    constexpr float Pi = 3.14159265358979f;
+}
+
+PixelBuffer CreatePlaceholder(PixelBuffer const& source, uint32_t maxSize)
+{
+    if (source.Width == 0 || source.Height == 0 || maxSize == 0)
+    {
+        throw std::invalid_argument("Can't create a placeholder for an empty image");
+    }
+
+    auto result = Subsample(source, maxSize);
+    auto width = result.Width;
+    auto height = result.Height;
+    auto radius = static_cast<int>(std::max(1u, std::max(width, height) / 16));
+
+    std::vector<Float4> pixels(static_cast<size_t>(width) * height);
+    std::vector<Float4> temporary(pixels.size());
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+        pixels[i] = Float4::Load(result.Bytes.data() + i * 4);
+    }
+    // Three box blurs in a row come close to a gaussian.
+    for (int pass = 0; pass < 3; pass++)
+    {
+        for (uint32_t y = 0; y < height; y++)
+        {
+            BlurLine(pixels.data() + static_cast<size_t>(y) * width, temporary.data() + static_cast<size_t>(y) * width, width, 1, radius);
+        }
+        for (uint32_t x = 0; x < width; x++)
+        {
+            BlurLine(temporary.data() + x, pixels.data() + x, height, width, radius);
+        }
+    }
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+        pixels[i].Store(result.Bytes.data() + i * 4);
+    }
+    return result;
+}
+
+std::string EncodeBlurHash(PixelBuffer const& source, uint32_t componentsX, uint32_t componentsY)
+{
+    if (componentsX < 1 || componentsX > 9 || componentsY < 1 || componentsY > 9)
+    {
+        throw std::invalid_argument("BlurHash components must be between 1 and 9");
+    }
+    if (source.Width == 0 || source.Height == 0)
+    {
+        throw std::invalid_argument("Can't hash an empty image");
+    }
+
+    auto samples = Subsample(source, 32);
+    auto width = samples.Width;
+    auto height = samples.Height;
+
+    // Convert once up front, this is the expensive part.
+    std::vector<std::array<float, 3>> linear(static_cast<size_t>(width) * height);
+    for (size_t i = 0; i < linear.size(); i++)
+    {
+        auto pixel = samples.Bytes.data() + i * 4;
+        // Stored as B, G, R. BlurHash wants R, G, B.
+        linear[i] = { SrgbToLinear(pixel[2]), SrgbToLinear(pixel[1]), SrgbToLinear(pixel[0]) };
+    }
+
+    std::vector<std::array<float, 3>> factors;
+    for (uint32_t j = 0; j < componentsY; j++)
+    {
+        for (uint32_t i = 0; i < componentsX; i++)
+        {
+            auto normalization = (i == 0 && j == 0) ? 1.0f : 2.0f;
+            std::array<float, 3> factor = {};
+            for (uint32_t y = 0; y < height; y++)
+            {
+                auto basisY = std::cos(Pi * j * y / height);
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    auto basis = normalization * std::cos(Pi * i * x / width) * basisY;
+                    auto& color = linear[static_cast<size_t>(y) * width + x];
+                    for (int channel = 0; channel < 3; channel++)
+                    {
+                        factor[channel] += basis * color[channel];
+                    }
+                }
+            }
+            auto scale = 1.0f / (width * height);
+            for (auto& value : factor)
+            {
+                value *= scale;
+            }
+            factors.push_back(factor);
+        }
+    }
+
+    std::string hash;
+    EncodeBase83((componentsX - 1) + (componentsY - 1) * 9, 1, hash);
+
+    auto maximumValue = 1.0f;
+    if (factors.size() > 1)
+    {
+        auto actualMaximum = 0.0f;
+        for (size_t i = 1; i < factors.size(); i++)
+        {
+            for (auto value : factors[i])
+            {
+                actualMaximum = std::max(actualMaximum, std::abs(value));
+            }
+        }
+        auto quantizedMaximum = std::clamp(static_cast<int>(std::floor(actualMaximum * 166.0f - 0.5f)), 0, 82);
+        maximumValue = (quantizedMaximum + 1) / 166.0f;
+        EncodeBase83(static_cast<uint32_t>(quantizedMaximum), 1, hash);
+    }
+    else
+    {
+        EncodeBase83(0, 1, hash);
+    }
+
+    auto& dc = factors[0];
+    EncodeBase83((LinearToSrgb(dc[0]) << 16) | (LinearToSrgb(dc[1]) << 8) | LinearToSrgb(dc[2]), 4, hash);
+
+    for (size_t i = 1; i < factors.size(); i++)
+    {
+        uint32_t value = 0;
+        for (auto component : factors[i])
+        {
+            auto quantized = std::clamp(static_cast<int>(std::floor(SignedPow(component / maximumValue, 0.5f) * 9.0f + 9.5f)), 0, 18);
+            value = value * 19 + static_cast<uint32_t>(quantized);
+        }
+        EncodeBase83(value, 2, hash);
+    }
+    return hash;
+}
+
+std::optional<PixelBuffer> DecodeBlurHash(std::string_view hash, uint32_t width, uint32_t height, float punch)
+{
+    if (hash.size() < 6 || width == 0 || height == 0)
+    {
+        return std::nullopt;
+    }
+    auto sizeFlag = DecodeBase83(hash.substr(0, 1));
+    if (!sizeFlag)
+    {
+        return std::nullopt;
+    }
+    auto componentsX = *sizeFlag % 9 + 1;
+    auto componentsY = *sizeFlag / 9 + 1;
+    if (hash.size() != 4 + 2 * static_cast<size_t>(componentsX) * componentsY)
+    {
+        return std::nullopt;
+    }
+
+    auto quantizedMaximum = DecodeBase83(hash.substr(1, 1));
+    auto dcValue = DecodeBase83(hash.substr(2, 4));
+    if (!quantizedMaximum || !dcValue)
+    {
+        return std::nullopt;
+    }
+    auto maximumValue = (*quantizedMaximum + 1) / 166.0f * punch;
+
+    std::vector<std::array<float, 3>> colors;
+    colors.push_back({
+        SrgbToLinear(static_cast<uint8_t>(*dcValue >> 16)),
+        SrgbToLinear(static_cast<uint8_t>(*dcValue >> 8)),
+        SrgbToLinear(static_cast<uint8_t>(*dcValue)) });
+    for (uint32_t i = 1; i < componentsX * componentsY; i++)
+    {
+        auto value = DecodeBase83(hash.substr(4 + 2 * static_cast<size_t>(i), 2));
+        if (!value)
+        {
+            return std::nullopt;
+        }
+        colors.push_back({
+            SignedPow((static_cast<float>(*value / (19 * 19)) - 9.0f) / 9.0f, 2.0f) * maximumValue,
+            SignedPow((static_cast<float>((*value / 19) % 19) - 9.0f) / 9.0f, 2.0f) * maximumValue,
+            SignedPow((static_cast<float>(*value % 19) - 9.0f) / 9.0f, 2.0f) * maximumValue });
+    }
+
+    // The cosines only depend on one coordinate each, so compute them once.
+    std::vector<float> cosinesX(static_cast<size_t>(width) * componentsX);
+    std::vector<float> cosinesY(static_cast<size_t>(height) * componentsY);
+    for (uint32_t x = 0; x < width; x++)
+    {
+        for (uint32_t i = 0; i < componentsX; i++)
+        {
+            cosinesX[static_cast<size_t>(x) * componentsX + i] = std::cos(Pi * x * i / width);
+        }
+    }
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t j = 0; j < componentsY; j++)
+        {
+            cosinesY[static_cast<size_t>(y) * componentsY + j] = std::cos(Pi * y * j / height);
+        }
+    }
+
+    PixelBuffer result(width, height);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        auto destination = result.Row(y);
+        for (uint32_t x = 0; x < width; x++, destination += 4)
+        {
+            float color[3] = {};
+            for (uint32_t j = 0; j < componentsY; j++)
+            {
+                for (uint32_t i = 0; i < componentsX; i++)
+                {
+                    auto basis = cosinesX[static_cast<size_t>(x) * componentsX + i] * cosinesY[static_cast<size_t>(y) * componentsY + j];
+                    auto& factor = colors[static_cast<size_t>(j) * componentsX + i];
+                    for (int channel = 0; channel < 3; channel++)
+                    {
+                        color[channel] += factor[channel] * basis;
+                    }
+                }
+            }
+            destination[0] = LinearToSrgb(color[2]);
+            destination[1] = LinearToSrgb(color[1]);
+            destination[2] = LinearToSrgb(color[0]);
+            destination[3] = 255;
+        }
+    }
+    return result;
+}
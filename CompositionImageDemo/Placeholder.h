@@ -0,0 +1,20 @@
+#pragma once
+#include "PixelBuffer.h"
+
+// Builds a small, blurry stand-in for an image that can be shown while the
+// real thing decodes. The source is sampled on a fixed grid (at most
+// maxSize x maxSize samples), so the cost doesn't depend on the size of the
+// source. The samples are then softened with three box blur passes, which
+// approximates a gaussian. The result should be stretched to the size of the
+// real image with linear filtering.
+PixelBuffer CreatePlaceholder(PixelBuffer const& source, uint32_t maxSize = 32);
+
+// BlurHash (https://blurha.sh) lets a placeholder be stored as a short string,
+// e.g. alongside the image's metadata, so it can be shown before the file is
+// even opened. Components are the number of cosine terms in each direction
+// (1 to 9). Encoding samples the image the same way CreatePlaceholder does.
+// Alpha is ignored, transparent areas encode as black.
+std::string EncodeBlurHash(PixelBuffer const& source, uint32_t componentsX = 4, uint32_t componentsY = 3);
+// Returns std::nullopt if the hash is malformed. 'punch' scales the contrast
+// of the result.
+std::optional<PixelBuffer> DecodeBlurHash(std::string_view hash, uint32_t width, uint32_t height, float punch = 1.0f);
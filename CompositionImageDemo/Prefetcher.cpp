@@ -0,0 +1,302 @@
+#include "pch.h"
+#include "Prefetcher.h"
+
+Prefetcher::Prefetcher(size_t itemCount, Loader loader, PrefetchOptions const& options)
+{
+    if (!loader)
+    {
+        throw std::invalid_argument("A prefetcher needs a loader");
+    }
+    m_loader = std::move(loader);
+    m_options = options;
+    m_itemCount = itemCount;
+    auto workerCount = std::max(1u, options.MaxConcurrent);
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        m_workers.emplace_back([this]() { Worker(); });
+    }
+}
+
+Prefetcher::~Prefetcher()
+{
+    {
+        std::lock_guard lock(m_lock);
+        m_stopping = true;
+        for (auto&& [item, task] : m_tasks)
+        {
+            *task.Cancelled = true;
+        }
+    }
+    m_workAvailable.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void Prefetcher::SetItemCount(size_t itemCount)
+{
+    std::vector<size_t> predicted;
+    {
+        std::lock_guard lock(m_lock);
+        m_itemCount = itemCount;
+        predicted = m_predicted;
+    }
+    // Items past the new end fall out of the prediction.
+    Predict(predicted);
+}
+
+void Prefetcher::HintSequence(size_t current, int32_t step)
+{
+    std::vector<size_t> items;
+    auto add = [&items, current, step](int64_t distance)
+    {
+        auto item = static_cast<int64_t>(current) + distance * step;
+        if (item >= 0)
+        {
+            items.push_back(static_cast<size_t>(item));
+        }
+    };
+    for (uint32_t i = 1; i <= m_options.LookAhead; i++)
+    {
+        add(i);
+    }
+    for (uint32_t i = 1; i <= m_options.LookBehind; i++)
+    {
+        add(-static_cast<int64_t>(i));
+    }
+    Predict(items);
+}
+
+void Prefetcher::HintScroll(size_t firstVisible, size_t visibleCount, double itemsPerSecond)
+{
+    // Whatever will scroll into view within the horizon, plus the usual look ahead.
+    auto horizon = std::chrono::duration<double>(m_options.ScrollHorizon).count();
+    auto ahead = m_options.LookAhead + static_cast<size_t>(std::ceil(std::abs(itemsPerSecond) * horizon));
+    auto first = static_cast<int64_t>(firstVisible);
+    auto last = first + static_cast<int64_t>(visibleCount) - 1;
+
+    std::vector<size_t> items;
+    auto add = [&items](int64_t item)
+    {
+        if (item >= 0)
+        {
+            items.push_back(static_cast<size_t>(item));
+        }
+    };
+    bool forward = itemsPerSecond >= 0.0;
+    for (size_t i = 1; i <= ahead; i++)
+    {
+        add(forward ? last + i : first - i);
+    }
+    for (size_t i = 1; i <= m_options.LookBehind; i++)
+    {
+        add(forward ? first - i : last + i);
+    }
+    Predict(items);
+}
+
+void Prefetcher::HintItems(std::vector<size_t> const& items)
+{
+    Predict(items);
+}
+
+void Prefetcher::Predict(std::vector<size_t> const& items)
+{
+    {
+        std::lock_guard lock(m_lock);
+        m_predicted.clear();
+        for (auto item : items)
+        {
+            if (item < m_itemCount && std::find(m_predicted.begin(), m_predicted.end(), item) == m_predicted.end())
+            {
+                m_predicted.push_back(item);
+            }
+        }
+
+        // Let go of everything that's no longer wanted.
+        for (auto it = m_tasks.begin(); it != m_tasks.end();)
+        {
+            auto& [item, task] = *it;
+            if (std::find(m_predicted.begin(), m_predicted.end(), item) != m_predicted.end())
+            {
+                ++it;
+                continue;
+            }
+            switch (task.State)
+            {
+            case TaskState::Queued:
+                m_stats.Dropped++;
+                break;
+            case TaskState::Loading:
+                // The worker sees this and throws the result away.
+                *task.Cancelled = true;
+                break;
+            case TaskState::Done:
+                m_stats.Unused++;
+                m_stats.UnusedBytes += task.Bytes;
+                m_stats.WastedTime += task.LoadTime;
+                m_doneBytes -= task.Bytes;
+                break;
+            }
+            it = m_tasks.erase(it);
+        }
+
+        for (auto item : m_predicted)
+        {
+            if (m_tasks.find(item) == m_tasks.end())
+            {
+                Task task;
+                task.Promise = std::make_shared<std::promise<std::shared_ptr<PixelBuffer const>>>();
+                task.Result = task.Promise->get_future().share();
+                m_tasks.emplace(item, std::move(task));
+            }
+        }
+    }
+    m_workAvailable.notify_all();
+}
+
+std::optional<size_t> Prefetcher::NextQueuedLocked()
+{
+    if (m_doneBytes >= m_options.BudgetBytes)
+    {
+        return std::nullopt;
+    }
+    // Most likely first.
+    for (auto item : m_predicted)
+    {
+        auto found = m_tasks.find(item);
+        if (found != m_tasks.end() && found->second.State == TaskState::Queued)
+        {
+            return item;
+        }
+    }
+    return std::nullopt;
+}
+
+void Prefetcher::Worker()
+{
+#ifdef _WIN32
+    // Lowers the thread's I/O and memory priority as well as its CPU priority.
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#endif
+
+    std::unique_lock lock(m_lock);
+    while (true)
+    {
+        std::optional<size_t> next;
+        m_workAvailable.wait(lock, [&]()
+            {
+                next = m_stopping ? std::nullopt : NextQueuedLocked();
+                return m_stopping || next.has_value();
+            });
+        if (m_stopping)
+        {
+            return;
+        }
+
+        auto item = *next;
+        auto& task = m_tasks.at(item);
+        task.State = TaskState::Loading;
+        auto cancelled = task.Cancelled;
+        auto promise = task.Promise;
+        m_stats.Started++;
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<PixelBuffer const> image;
+        std::exception_ptr error;
+        try
+        {
+            image = m_loader(item, *cancelled);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        auto loadTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+        lock.lock();
+        m_stats.BusyTime += loadTime;
+        if (*cancelled)
+        {
+            m_stats.Cancelled++;
+            m_stats.WastedTime += loadTime;
+            promise->set_value(nullptr);
+            continue;
+        }
+
+        m_stats.Completed++;
+        // If the task is gone without being cancelled, Take got to it while it
+        // was loading and is waiting on the promise.
+        auto found = m_tasks.find(item);
+        if (found == m_tasks.end() || found->second.Cancelled != cancelled)
+        {
+            m_stats.LateHits++;
+        }
+        else
+        {
+            found->second.State = TaskState::Done;
+            found->second.LoadTime = loadTime;
+            if (image)
+            {
+                found->second.Bytes = image->Bytes.size();
+                m_doneBytes += found->second.Bytes;
+            }
+        }
+        if (error)
+        {
+            promise->set_exception(error);
+        }
+        else
+        {
+            promise->set_value(std::move(image));
+        }
+    }
+}
+
+std::shared_ptr<PixelBuffer const> Prefetcher::Take(size_t item)
+{
+    std::shared_future<std::shared_ptr<PixelBuffer const>> result;
+    {
+        std::lock_guard lock(m_lock);
+        auto found = m_tasks.find(item);
+        if (found == m_tasks.end() || found->second.State == TaskState::Queued)
+        {
+            m_stats.Misses++;
+            if (found != m_tasks.end())
+            {
+                m_tasks.erase(found);
+            }
+            return nullptr;
+        }
+        auto& task = found->second;
+        if (task.State == TaskState::Done)
+        {
+            m_stats.Hits++;
+            m_doneBytes -= task.Bytes;
+        }
+        // Otherwise it's still loading, and the worker counts it as a late hit
+        // when it's done.
+        result = task.Result;
+        m_tasks.erase(found);
+        // The item stays out of the prediction until the next hint, so it isn't
+        // loaded again.
+        m_predicted.erase(std::remove(m_predicted.begin(), m_predicted.end(), item), m_predicted.end());
+    }
+    // Taking a finished item frees up budget.
+    m_workAvailable.notify_all();
+    return result.get();
+}
+
+std::vector<size_t> Prefetcher::Predicted()
+{
+    std::lock_guard lock(m_lock);
+    return m_predicted;
+}
+
+PrefetchStats Prefetcher::Stats()
+{
+    std::lock_guard lock(m_lock);
+    return m_stats;
+}
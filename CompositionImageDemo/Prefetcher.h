@@ -0,0 +1,133 @@
+#pragma once
+#include "PixelBuffer.h"
+
+struct PrefetchOptions
+{
+    // The CPU budget: prefetches never use more than this many threads. On
+    // Windows the threads run in background mode, which lowers their CPU and
+    // I/O priority below anything the user is waiting on.
+    uint32_t MaxConcurrent = 2;
+    // Finished prefetches that haven't been taken yet can hold at most this
+    // much. Nothing new is started while it's full, though loads that were
+    // already running still finish, so it can go over by a few images.
+    uint64_t BudgetBytes = 128 * 1024 * 1024;
+    // How many items to load in the direction of travel, and behind it. The
+    // item just left behind has usually only just been shown, so behind is
+    // only worth it if the app doesn't keep hold of what it showed.
+    uint32_t LookAhead = 3;
+    uint32_t LookBehind = 0;
+    // When scrolling, items that will be on screen within this long are loaded
+    // as well, on top of LookAhead.
+    std::chrono::milliseconds ScrollHorizon = std::chrono::milliseconds(500);
+};
+
+struct PrefetchStats
+{
+    uint64_t Started = 0;
+    uint64_t Completed = 0;
+    // Stopped part way because the prediction changed.
+    uint64_t Cancelled = 0;
+    // Queued, but dropped before they started.
+    uint64_t Dropped = 0;
+    // Finished, then dropped without being taken.
+    uint64_t Unused = 0;
+    uint64_t UnusedBytes = 0;
+    // Takes that found the item ready, found it still loading (and waited),
+    // or found nothing. A late hit is counted when its load finishes, so each
+    // finished prefetch is counted as used at most once.
+    uint64_t Hits = 0;
+    uint64_t LateHits = 0;
+    uint64_t Misses = 0;
+    // Time spent in the loader, and how much of it went on loads that were
+    // cancelled or never used.
+    std::chrono::microseconds BusyTime{};
+    std::chrono::microseconds WastedTime{};
+
+    // The fraction of finished prefetches that got used.
+    double Accuracy() const { return Completed > 0 ? static_cast<double>(Hits + LateHits) / Completed : 0.0; }
+    // The fraction of navigations a prefetch had (at least partly) covered.
+    double Coverage() const
+    {
+        auto takes = Hits + LateHits + Misses;
+        return takes > 0 ? static_cast<double>(Hits + LateHits) / takes : 0.0;
+    }
+    double WastedFraction() const { return BusyTime.count() > 0 ? static_cast<double>(WastedTime.count()) / BusyTime.count() : 0.0; }
+};
+
+// Loads the images the user is likely to want next, before they ask for them.
+// Items are indices into whatever the app is showing (a slideshow, a grid, a
+// feed). The app passes navigation hints, the prefetcher turns them into a
+// ranked list of items, and works through it on a few low priority threads.
+// Loads for items that drop off the list are cancelled. When the user gets to
+// an item, Take hands over the prefetched image.
+//
+// Loaders should check 'cancelled' between steps (after reading the file,
+// between decode passes) and give up early when it's set. Results of
+// cancelled loads are thrown away.
+class Prefetcher
+{
+public:
+    using Loader = std::function<std::shared_ptr<PixelBuffer const>(size_t item, std::atomic<bool> const& cancelled)>;
+
+    Prefetcher(size_t itemCount, Loader loader, PrefetchOptions const& options = {});
+    ~Prefetcher();
+    Prefetcher(Prefetcher const&) = delete;
+    Prefetcher& operator=(Prefetcher const&) = delete;
+
+    void SetItemCount(size_t itemCount);
+
+    // Hints. Each one replaces the prediction from the last.
+    // Slideshow style: we're on 'current', and moving by 'step' (usually 1 or -1).
+    void HintSequence(size_t current, int32_t step = 1);
+    // Scrolling a list or grid, with items flowing by at itemsPerSecond
+    // (negative when scrolling back).
+    void HintScroll(size_t firstVisible, size_t visibleCount, double itemsPerSecond);
+    // The app knows best, most likely first.
+    void HintItems(std::vector<size_t> const& items);
+
+    // Returns the prefetched image for the item, waiting for it if it's still
+    // loading, or nullptr if it wasn't prefetched. Either way the item is done
+    // with as far as the prefetcher is concerned. If the loader threw for the
+    // item, Take rethrows it, so callers that fall back to loading the item
+    // themselves on nullptr should do the same on an exception.
+    std::shared_ptr<PixelBuffer const> Take(size_t item);
+
+    // The items currently predicted, most likely first.
+    std::vector<size_t> Predicted();
+    PrefetchStats Stats();
+
+private:
+    enum class TaskState
+    {
+        Queued,
+        Loading,
+        Done,
+    };
+
+    struct Task
+    {
+        TaskState State = TaskState::Queued;
+        std::shared_ptr<std::atomic<bool>> Cancelled = std::make_shared<std::atomic<bool>>(false);
+        std::shared_ptr<std::promise<std::shared_ptr<PixelBuffer const>>> Promise;
+        std::shared_future<std::shared_ptr<PixelBuffer const>> Result;
+        uint64_t Bytes = 0;
+        std::chrono::microseconds LoadTime{};
+    };
+
+    void Predict(std::vector<size_t> const& items);
+    std::optional<size_t> NextQueuedLocked();
+    void Worker();
+
+    Loader m_loader;
+    PrefetchOptions m_options;
+
+    std::mutex m_lock;
+    std::condition_variable m_workAvailable;
+    size_t m_itemCount = 0;
+    std::vector<size_t> m_predicted;
+    std::map<size_t, Task> m_tasks;
+    uint64_t m_doneBytes = 0;
+    bool m_stopping = false;
+    PrefetchStats m_stats;
+    std::vector<std::thread> m_workers;
+};
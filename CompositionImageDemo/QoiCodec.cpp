@@ -0,0 +1,234 @@
+#include "pch.h"
+#include "QoiCodec.h"
+#include "Parallel.h"
+
+namespace
+{
+    constexpr uint8_t OpIndex = 0x00;
+    constexpr uint8_t OpDiff = 0x40;
+    constexpr uint8_t OpLuma = 0x80;
+    constexpr uint8_t OpRun = 0xC0;
+    constexpr uint8_t OpRgb = 0xFE;
+    constexpr uint8_t OpRgba = 0xFF;
+    constexpr uint8_t TagMask = 0xC0;
+    // Runs can't be 63 or 64 long, those would look like OpRgb and OpRgba.
+    constexpr uint32_t MaxRun = 62;
+
+    // Pixels are handled as the four bytes in memory order, B G R A. QOI's "r"
+    // and "b" are our B and R, which doesn't matter to any of the ops.
+    inline uint32_t Slot(uint8_t const* pixel)
+    {
+        return (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64;
+    }
+
+    inline uint32_t Read32(uint8_t const* pixel)
+    {
+        uint32_t value;
+        memcpy(&value, pixel, sizeof(value));
+        return value;
+    }
+
+    void EncodeBand(uint8_t const* pixels, size_t count, std::vector<uint8_t>& output)
+    {
+        // Most images come out well under the raw size. The worst case is 5 bytes
+        // a pixel, which the vector grows into if it has to.
+        output.reserve(count * 2);
+        std::array<uint32_t, 64> index = {};
+        uint8_t const opaqueBlack[4] = { 0, 0, 0, 255 };
+        uint8_t const* previous = opaqueBlack;
+        uint32_t run = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            auto pixel = pixels + i * 4;
+            auto value = Read32(pixel);
+            if (value == Read32(previous))
+            {
+                if (++run == MaxRun)
+                {
+                    output.push_back(static_cast<uint8_t>(OpRun | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0)
+            {
+                output.push_back(static_cast<uint8_t>(OpRun | (run - 1)));
+                run = 0;
+            }
+
+            auto slot = Slot(pixel);
+            if (index[slot] == value)
+            {
+                output.push_back(static_cast<uint8_t>(OpIndex | slot));
+            }
+            else
+            {
+                index[slot] = value;
+                if (pixel[3] == previous[3])
+                {
+                    int first = static_cast<int8_t>(pixel[0] - previous[0]);
+                    int green = static_cast<int8_t>(pixel[1] - previous[1]);
+                    int third = static_cast<int8_t>(pixel[2] - previous[2]);
+                    auto firstFromGreen = first - green;
+                    auto thirdFromGreen = third - green;
+                    if (first >= -2 && first <= 1 && green >= -2 && green <= 1 && third >= -2 && third <= 1)
+                    {
+                        output.push_back(static_cast<uint8_t>(OpDiff | ((first + 2) << 4) | ((green + 2) << 2) | (third + 2)));
+                    }
+                    else if (green >= -32 && green <= 31 &&
+                        firstFromGreen >= -8 && firstFromGreen <= 7 &&
+                        thirdFromGreen >= -8 && thirdFromGreen <= 7)
+                    {
+                        output.push_back(static_cast<uint8_t>(OpLuma | (green + 32)));
+                        output.push_back(static_cast<uint8_t>(((firstFromGreen + 8) << 4) | (thirdFromGreen + 8)));
+                    }
+                    else
+                    {
+                        output.insert(output.end(), { OpRgb, pixel[0], pixel[1], pixel[2] });
+                    }
+                }
+                else
+                {
+                    output.insert(output.end(), { OpRgba, pixel[0], pixel[1], pixel[2], pixel[3] });
+                }
+            }
+            previous = pixel;
+        }
+        if (run > 0)
+        {
+            output.push_back(static_cast<uint8_t>(OpRun | (run - 1)));
+        }
+    }
+
+    void DecodeBand(uint8_t const* data, size_t size, uint8_t* destination, uint32_t rowPitch, uint32_t width, uint32_t rows)
+    {
+        std::array<uint32_t, 64> index = {};
+        uint8_t pixel[4] = { 0, 0, 0, 255 };
+        uint32_t run = 0;
+        size_t position = 0;
+        auto need = [&](size_t bytes)
+        {
+            if (size - position < bytes)
+            {
+                throw std::runtime_error("QOI data ended early");
+            }
+        };
+
+        for (uint32_t y = 0; y < rows; y++)
+        {
+            auto row = destination + static_cast<size_t>(y) * rowPitch;
+            for (uint32_t x = 0; x < width; x++)
+            {
+                if (run > 0)
+                {
+                    run--;
+                }
+                else
+                {
+                    need(1);
+                    auto op = data[position++];
+                    if (op == OpRgb)
+                    {
+                        need(3);
+                        memcpy(pixel, data + position, 3);
+                        position += 3;
+                    }
+                    else if (op == OpRgba)
+                    {
+                        need(4);
+                        memcpy(pixel, data + position, 4);
+                        position += 4;
+                    }
+                    else if ((op & TagMask) == OpIndex)
+                    {
+                        memcpy(pixel, &index[op], 4);
+                    }
+                    else if ((op & TagMask) == OpDiff)
+                    {
+                        pixel[0] += ((op >> 4) & 0x03) - 2;
+                        pixel[1] += ((op >> 2) & 0x03) - 2;
+                        pixel[2] += (op & 0x03) - 2;
+                    }
+                    else if ((op & TagMask) == OpLuma)
+                    {
+                        need(1);
+                        auto second = data[position++];
+                        int green = (op & 0x3F) - 32;
+                        pixel[0] += green - 8 + ((second >> 4) & 0x0F);
+                        pixel[1] += green;
+                        pixel[2] += green - 8 + (second & 0x0F);
+                    }
+                    else
+                    {
+                        run = op & 0x3F;
+                    }
+                    index[Slot(pixel)] = Read32(pixel);
+                }
+                memcpy(row + x * 4, pixel, 4);
+            }
+        }
+    }
+}
+
+QoiImage EncodeQoi(PixelBuffer const& image, uint32_t bandHeight)
+{
+    if (bandHeight == 0)
+    {
+        throw std::invalid_argument("Bands need at least one row");
+    }
+    QoiImage result;
+    result.Width = image.Width;
+    result.Height = image.Height;
+    result.BandHeight = bandHeight;
+
+    auto bandCount = (image.Height + bandHeight - 1) / bandHeight;
+    std::vector<std::vector<uint8_t>> bands(bandCount);
+    ParallelFor(bandCount, [&](uint32_t band)
+        {
+            auto top = band * bandHeight;
+            auto rows = std::min(bandHeight, image.Height - top);
+            // The rows of a PixelBuffer are tightly packed, so a band is one run of pixels.
+            EncodeBand(image.Row(top), static_cast<size_t>(rows) * image.Width, bands[band]);
+        }, static_cast<uint64_t>(image.Width) * image.Height);
+
+    size_t total = 0;
+    for (auto& band : bands)
+    {
+        result.BandOffsets.push_back(total);
+        total += band.size();
+    }
+    result.Data.reserve(total);
+    for (auto& band : bands)
+    {
+        result.Data.insert(result.Data.end(), band.begin(), band.end());
+    }
+    return result;
+}
+
+void DecodeQoi(QoiImage const& image, uint8_t* destination, uint32_t rowPitch)
+{
+    auto bandCount = static_cast<uint32_t>(image.BandOffsets.size());
+    if (image.BandHeight == 0 || bandCount != (image.Height + image.BandHeight - 1) / image.BandHeight)
+    {
+        throw std::runtime_error("QOI bands don't cover the image");
+    }
+    ParallelFor(bandCount, [&](uint32_t band)
+        {
+            auto begin = image.BandOffsets[band];
+            auto end = band + 1 < bandCount ? image.BandOffsets[band + 1] : image.Data.size();
+            if (begin > end || end > image.Data.size())
+            {
+                throw std::runtime_error("QOI band is out of range");
+            }
+            auto top = band * image.BandHeight;
+            auto rows = std::min(image.BandHeight, image.Height - top);
+            DecodeBand(image.Data.data() + begin, end - begin, destination + static_cast<size_t>(top) * rowPitch, rowPitch, image.Width, rows);
+        }, static_cast<uint64_t>(image.Width) * image.Height);
+}
+
+PixelBuffer DecodeQoi(QoiImage const& image)
+{
+    PixelBuffer result(image.Width, image.Height);
+    DecodeQoi(image, result.Bytes.data(), result.Stride());
+    return result;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "PixelBuffer.h"
+
+// Lossless compression of decoded pixels using the QOI ops (https://qoiformat.org):
+// runs, a 64 entry table of recently seen pixels, and small deltas from the
+// previous pixel. It's nowhere near as small as the JPEG the pixels came from,
+// but it decodes many times faster, and screenshots, UI and artwork often come
+// out at a fraction of their raw size.
+//
+// QOI is serial within a stream, so the image is split into bands of rows
+// that are each a stream of their own, and bands are encoded and decoded in
+// parallel. The bytes are coded in BGRA order as they are, so while the ops
+// are QOI's, this isn't a .qoi file.
+struct QoiImage
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint32_t BandHeight = 0;
+    // Where each band starts in Data. Band i ends where band i + 1 starts.
+    std::vector<uint64_t> BandOffsets;
+    std::vector<uint8_t> Data;
+
+    size_t Bytes() const { return Data.size() + BandOffsets.size() * sizeof(uint64_t); }
+};
+
+QoiImage EncodeQoi(PixelBuffer const& image, uint32_t bandHeight = 64);
+// Decodes straight into the destination, e.g. memory that's about to be
+// uploaded. Rows are rowPitch bytes apart. Throws std::runtime_error if the
+// data is malformed.
+void DecodeQoi(QoiImage const& image, uint8_t* destination, uint32_t rowPitch);
+PixelBuffer DecodeQoi(QoiImage const& image);
@@ -0,0 +1,37 @@
+#include "pch.h"
+#include "RenderDevice.h"
+
+uint64_t RenderDevice::DeviceReplaced(DeviceReplacedHandler handler)
+{
+    if (!handler)
+    {
+        throw std::invalid_argument("Handler can't be empty");
+    }
+    std::lock_guard lock(m_lock);
+    auto token = m_nextToken++;
+    m_handlers.emplace_back(token, std::move(handler));
+    return token;
+}
+
+void RenderDevice::RevokeDeviceReplaced(uint64_t token)
+{
+    std::lock_guard lock(m_lock);
+    std::erase_if(m_handlers, [token](auto const& entry) { return entry.first == token; });
+}
+
+void RenderDevice::RaiseDeviceReplaced()
+{
+    // Call the handlers outside the lock, so they're free to add or revoke handlers.
+    std::vector<DeviceReplacedHandler> handlers;
+    {
+        std::lock_guard lock(m_lock);
+        for (auto&& [token, handler] : m_handlers)
+        {
+            handlers.push_back(handler);
+        }
+    }
+    for (auto& handler : handlers)
+    {
+        handler();
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "SurfaceBackend.h"
+#include "UploadRing.h"
+
+// The device side of the load pipeline: where surfaces and upload memory come
+// from, how we know the GPU is done with that memory, and the bracket around a
+// batch of uploads. CompositionRenderDevice implements it on top of a
+// CompositionGraphicsDevice. SoftwareRenderDevice keeps everything in memory,
+// so the pipeline can run headless and device loss can be forced on demand.
+//
+// When the device is replaced, every surface it created has lost its contents
+// (but keeps its size), and anything created from the old device, like upload
+// pages and fences, has to be created again. The DeviceReplaced handlers are
+// where that happens. They're called in the order they were added.
+class RenderDevice
+{
+public:
+    using DeviceReplacedHandler = std::function<void()>;
+
+    virtual ~RenderDevice() = default;
+
+    // Surfaces start out 1x1.
+    virtual std::shared_ptr<SurfaceBackend> CreateSurface(SurfaceFormat format) = 0;
+    // Pages the surfaces from this device can copy from, for an UploadRing.
+    virtual std::unique_ptr<UploadPage> CreateUploadPage(SurfaceFormat format, uint32_t width, uint32_t height) = 0;
+    virtual std::shared_ptr<UploadFence> CreateUploadFence() = 0;
+    // Called around every batch of uploads.
+    virtual void BeginUploads() = 0;
+    virtual void EndUploads() = 0;
+
+    // Returns a token that can be passed to RevokeDeviceReplaced.
+    uint64_t DeviceReplaced(DeviceReplacedHandler handler);
+    void RevokeDeviceReplaced(uint64_t token);
+
+protected:
+    void RaiseDeviceReplaced();
+
+private:
+    std::mutex m_lock;
+    uint64_t m_nextToken = 1;
+    std::vector<std::pair<uint64_t, DeviceReplacedHandler>> m_handlers;
+};
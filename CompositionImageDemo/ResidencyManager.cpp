@@ -0,0 +1,182 @@
+#include "pch.h"
+#include "ResidencyManager.h"
+
+namespace
+{
+    uint64_t SurfaceBytes(SurfaceBackend const& surface)
+    {
+        return static_cast<uint64_t>(surface.Width()) * surface.Height() * surface.BytesPerPixel();
+    }
+}
+
+ResidencyManager::ResidencyManager(ResidencyOptions const& options, Clock clock)
+{
+    m_options = options;
+    m_clock = clock ? std::move(clock) : []() { return std::chrono::steady_clock::now(); };
+}
+
+ResidencyId ResidencyManager::Register(std::shared_ptr<SurfaceBackend> surface, bool cheapToReload, RestoreHandler restore)
+{
+    if (!surface || !restore)
+    {
+        throw std::invalid_argument("A surface needs a way to be restored");
+    }
+    Entry entry;
+    entry.Surface = std::move(surface);
+    entry.CheapToReload = cheapToReload;
+    entry.Restore = std::move(restore);
+    entry.LastVisible = m_clock();
+
+    std::lock_guard lock(m_lock);
+    auto id = m_nextId++;
+    m_entries.emplace(id, std::move(entry));
+    return id;
+}
+
+void ResidencyManager::Unregister(ResidencyId id)
+{
+    std::lock_guard lock(m_lock);
+    m_entries.erase(id);
+}
+
+void ResidencyManager::SetVisible(ResidencyId id, bool visible)
+{
+    std::shared_ptr<SurfaceBackend> surface;
+    RestoreHandler restore;
+    {
+        std::lock_guard lock(m_lock);
+        auto& entry = m_entries.at(id);
+        // Leaving the screen counts as the last time it was seen.
+        if (entry.Visible || visible)
+        {
+            entry.LastVisible = m_clock();
+        }
+        entry.Visible = visible;
+        if (!visible || entry.Resident)
+        {
+            return;
+        }
+        entry.Resident = true;
+        m_stats.Restores++;
+        surface = entry.Surface;
+        restore = entry.Restore;
+    }
+    // Outside the lock, the handler is likely to come back to us.
+    restore(surface);
+}
+
+size_t ResidencyManager::Enforce()
+{
+    std::lock_guard lock(m_lock);
+    auto resident = ResidentBytesLocked();
+    m_stats.PeakResidentBytes = std::max(m_stats.PeakResidentBytes, resident);
+    if (resident <= m_options.BudgetBytes)
+    {
+        return 0;
+    }
+
+    std::vector<std::pair<ResidencyId, Entry*>> candidates;
+    for (auto&& [id, entry] : m_entries)
+    {
+        if (entry.Resident && !entry.Visible)
+        {
+            candidates.emplace_back(id, &entry);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](auto const& first, auto const& second)
+        {
+            if (first.second->CheapToReload != second.second->CheapToReload)
+            {
+                return first.second->CheapToReload;
+            }
+            return first.second->LastVisible < second.second->LastVisible;
+        });
+
+    size_t evicted = 0;
+    for (auto&& [id, entry] : candidates)
+    {
+        if (resident <= m_options.BudgetBytes)
+        {
+            break;
+        }
+        auto bytes = EntryBytes(*entry);
+        // Shrinking the surface gives its space in the atlas back.
+        entry->Surface->Resize(1, 1);
+        entry->Resident = false;
+        entry->EvictedBytes = bytes;
+        resident -= std::min(resident, bytes);
+        m_stats.Evictions++;
+        m_stats.BytesEvicted += bytes;
+        if (!entry->CheapToReload)
+        {
+            m_stats.ExpensiveEvictions++;
+        }
+        evicted++;
+    }
+    if (resident > m_options.BudgetBytes)
+    {
+        m_stats.OverBudget++;
+    }
+    return evicted;
+}
+
+uint64_t ResidencyManager::EntryBytes(Entry& entry)
+{
+    auto bytes = SurfaceBytes(*entry.Surface);
+    if (entry.EvictedBytes > 0)
+    {
+        // Once the reload has resized the surface, its own size is the one to use.
+        if (entry.Surface->Width() > 1 || entry.Surface->Height() > 1)
+        {
+            entry.EvictedBytes = 0;
+        }
+        else
+        {
+            bytes = entry.EvictedBytes;
+        }
+    }
+    return bytes;
+}
+
+uint64_t ResidencyManager::ResidentBytesLocked()
+{
+    uint64_t total = 0;
+    for (auto&& [id, entry] : m_entries)
+    {
+        if (entry.Resident)
+        {
+            total += EntryBytes(entry);
+        }
+    }
+    return total;
+}
+
+bool ResidencyManager::IsResident(ResidencyId id)
+{
+    std::lock_guard lock(m_lock);
+    return m_entries.at(id).Resident;
+}
+
+uint64_t ResidencyManager::ResidentBytes()
+{
+    std::lock_guard lock(m_lock);
+    return ResidentBytesLocked();
+}
+
+void ResidencyManager::SetBudget(uint64_t budgetBytes)
+{
+    std::lock_guard lock(m_lock);
+    m_options.BudgetBytes = budgetBytes;
+}
+
+uint64_t ResidencyManager::Budget()
+{
+    std::lock_guard lock(m_lock);
+    return m_options.BudgetBytes;
+}
+
+ResidencyStats ResidencyManager::Stats()
+{
+    std::lock_guard lock(m_lock);
+    return m_stats;
+}
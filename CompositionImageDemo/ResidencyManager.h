@@ -0,0 +1,86 @@
+#pragma once
+#include "SurfaceBackend.h"
+
+struct ResidencyOptions
+{
+    // How much surface memory we try to stay under. Something like the local
+    // budget from IDXGIAdapter3::QueryVideoMemoryInfo, less a margin for
+    // everything that isn't an image, is a reasonable choice.
+    uint64_t BudgetBytes = 512 * 1024 * 1024;
+};
+
+struct ResidencyStats
+{
+    uint64_t Evictions = 0;
+    uint64_t Restores = 0;
+    uint64_t BytesEvicted = 0;
+    // Evictions of surfaces that weren't cheap to reload, because evicting the
+    // cheap ones wasn't enough.
+    uint64_t ExpensiveEvictions = 0;
+    // Times Enforce couldn't get under budget because everything left was visible.
+    uint64_t OverBudget = 0;
+    uint64_t PeakResidentBytes = 0;
+};
+
+using ResidencyId = uint64_t;
+
+// Keeps track of how much memory our surfaces use and shrinks the ones that
+// haven't been seen for a while to 1x1 once we go over budget, before the
+// driver starts paging. An evicted surface is restored as soon as it becomes
+// visible again, by handing it back to the app to reload through the normal
+// load path.
+//
+// Surfaces that are cheap to reload (e.g. the decoded pixels are still in a
+// cache) are evicted before the ones that aren't. Within each group, the
+// least recently visible go first. Visible surfaces are never evicted.
+//
+// Surface sizes are read from the surfaces themselves, so Enforce should be
+// called on the thread that draws to them, e.g. once a frame.
+class ResidencyManager
+{
+public:
+    using Clock = std::function<std::chrono::steady_clock::time_point()>;
+    // Reload the surface's contents. The surface is 1x1 at this point.
+    using RestoreHandler = std::function<void(std::shared_ptr<SurfaceBackend> const& surface)>;
+
+    ResidencyManager(ResidencyOptions const& options = {}, Clock clock = nullptr);
+
+    // Surfaces start out visible.
+    ResidencyId Register(std::shared_ptr<SurfaceBackend> surface, bool cheapToReload, RestoreHandler restore);
+    void Unregister(ResidencyId id);
+    // Restores the surface if it was evicted.
+    void SetVisible(ResidencyId id, bool visible);
+    // Evicts surfaces until we're under budget. Returns the number evicted.
+    size_t Enforce();
+
+    bool IsResident(ResidencyId id);
+    uint64_t ResidentBytes();
+    void SetBudget(uint64_t budgetBytes);
+    uint64_t Budget();
+    ResidencyStats Stats();
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<SurfaceBackend> Surface;
+        bool CheapToReload = false;
+        RestoreHandler Restore;
+        bool Visible = true;
+        bool Resident = true;
+        std::chrono::steady_clock::time_point LastVisible;
+        // The size the surface had when it was evicted. While a restore is in
+        // flight the surface is still 1x1, so this is what we count.
+        uint64_t EvictedBytes = 0;
+    };
+
+    uint64_t EntryBytes(Entry& entry);
+    uint64_t ResidentBytesLocked();
+
+    ResidencyOptions m_options;
+    Clock m_clock;
+
+    std::mutex m_lock;
+    std::map<ResidencyId, Entry> m_entries;
+    ResidencyId m_nextId = 1;
+    ResidencyStats m_stats;
+};
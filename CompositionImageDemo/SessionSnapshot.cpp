@@ -0,0 +1,343 @@
+#include "pch.h"
+#include "SessionSnapshot.h"
+#include "ContentHash.h"
+#include "MappedFile.h"
+
+namespace
+{
+    constexpr uint32_t SnapshotMagic = 0x314e5353; // "SSN1"
+    constexpr uint32_t SnapshotVersion = 1;
+    constexpr uint64_t PixelAlignment = 16;
+
+    struct SnapshotHeader
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t ItemCount;
+        uint32_t ViewWidth;
+        uint32_t ViewHeight;
+        uint32_t Reserved;
+        double ScrollOffset;
+        uint64_t PathBytes;
+    };
+    static_assert(sizeof(SnapshotHeader) == 40);
+
+    struct SnapshotRecord
+    {
+        uint64_t FileSize;
+        int64_t ModifiedTime;
+        uint64_t ContentHash;
+        uint32_t TargetWidth;
+        uint32_t TargetHeight;
+        int32_t X;
+        int32_t Y;
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t PathOffset;
+        uint32_t PathBytes;
+        uint64_t PixelOffset;
+    };
+    static_assert(sizeof(SnapshotRecord) == 64);
+
+    uint64_t Align(uint64_t value)
+    {
+        return (value + PixelAlignment - 1) & ~(PixelAlignment - 1);
+    }
+
+    std::string PathBytes(std::filesystem::path const& path)
+    {
+        auto utf8 = path.generic_u8string();
+        return { reinterpret_cast<char const*>(utf8.data()), utf8.size() };
+    }
+}
+
+uint64_t SessionSnapshot::PixelBytes() const
+{
+    uint64_t bytes = 0;
+    for (auto& item : Items)
+    {
+        bytes += item.Pixels ? item.Pixels->Bytes.size() : 0;
+    }
+    return bytes;
+}
+
+void SaveSessionSnapshot(std::filesystem::path const& path, SessionSnapshot const& snapshot)
+{
+    // Everything but the pixels goes in one buffer: the header, a record per
+    // item, then the paths.
+    std::vector<SnapshotRecord> records;
+    std::string paths;
+    std::vector<PixelBuffer const*> pixels;
+    for (auto& item : snapshot.Items)
+    {
+        if (!item.Pixels || item.Pixels->Width != item.Bounds.Width || item.Pixels->Height != item.Bounds.Height)
+        {
+            throw std::invalid_argument("Snapshot pixels must match the item's bounds");
+        }
+        auto path = PathBytes(item.Key.Path);
+        SnapshotRecord record = {};
+        record.FileSize = item.Key.FileSize;
+        record.ModifiedTime = item.Key.ModifiedTime;
+        record.ContentHash = item.Key.ContentHash;
+        record.TargetWidth = item.Key.TargetWidth;
+        record.TargetHeight = item.Key.TargetHeight;
+        record.X = item.Bounds.X;
+        record.Y = item.Bounds.Y;
+        record.Width = item.Bounds.Width;
+        record.Height = item.Bounds.Height;
+        record.PathOffset = static_cast<uint32_t>(paths.size());
+        record.PathBytes = static_cast<uint32_t>(path.size());
+        records.push_back(record);
+        paths += path;
+        pixels.push_back(item.Pixels.get());
+    }
+
+    SnapshotHeader header = {};
+    header.Magic = SnapshotMagic;
+    header.Version = SnapshotVersion;
+    header.ItemCount = static_cast<uint32_t>(records.size());
+    header.ViewWidth = snapshot.ViewWidth;
+    header.ViewHeight = snapshot.ViewHeight;
+    header.ScrollOffset = snapshot.ScrollOffset;
+    header.PathBytes = paths.size();
+
+    // The pixels follow, each starting on an aligned offset.
+    auto offset = Align(sizeof(header) + records.size() * sizeof(SnapshotRecord) + paths.size());
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        records[i].PixelOffset = offset;
+        offset = Align(offset + pixels[i]->Bytes.size());
+    }
+
+    std::vector<uint8_t> metadata(sizeof(header) + records.size() * sizeof(SnapshotRecord) + paths.size());
+    std::memcpy(metadata.data(), &header, sizeof(header));
+    std::memcpy(metadata.data() + sizeof(header), records.data(), records.size() * sizeof(SnapshotRecord));
+    std::memcpy(metadata.data() + sizeof(header) + records.size() * sizeof(SnapshotRecord), paths.data(), paths.size());
+
+    if (path.has_parent_path())
+    {
+        std::filesystem::create_directories(path.parent_path());
+    }
+    auto temporaryPath = path;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        ContentHasher hasher;
+        auto write = [&file, &hasher](uint8_t const* data, size_t size)
+        {
+            file.write(reinterpret_cast<char const*>(data), size);
+            hasher.Update(data, size);
+        };
+        const uint8_t padding[PixelAlignment] = {};
+        auto pad = [&write, &hasher, &padding]()
+        {
+            write(padding, static_cast<size_t>(Align(hasher.Length()) - hasher.Length()));
+        };
+        write(metadata.data(), metadata.size());
+        for (auto image : pixels)
+        {
+            pad();
+            write(image->Bytes.data(), image->Bytes.size());
+        }
+        pad();
+        auto checksum = hasher.Digest();
+        file.write(reinterpret_cast<char const*>(&checksum), sizeof(checksum));
+        if (!file)
+        {
+            throw std::runtime_error("Couldn't write the session snapshot");
+        }
+    }
+    std::filesystem::rename(temporaryPath, path);
+}
+
+std::optional<SessionSnapshot> LoadSessionSnapshot(std::filesystem::path const& path)
+{
+    std::error_code error;
+    auto size = std::filesystem::file_size(path, error);
+    if (error || size < sizeof(SnapshotHeader) + sizeof(uint64_t))
+    {
+        return std::nullopt;
+    }
+    std::unique_ptr<MappedFile> mapped;
+    try
+    {
+        mapped = std::make_unique<MappedFile>(path, size);
+    }
+    catch (...)
+    {
+        return std::nullopt;
+    }
+
+    auto data = mapped->Data;
+    auto contentSize = size - sizeof(uint64_t);
+    SnapshotHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.Magic != SnapshotMagic || header.Version != SnapshotVersion)
+    {
+        return std::nullopt;
+    }
+    uint64_t checksum;
+    std::memcpy(&checksum, data + contentSize, sizeof(checksum));
+    if (checksum != ContentHasher::Hash(data, static_cast<size_t>(contentSize)))
+    {
+        return std::nullopt;
+    }
+    auto pathsOffset = sizeof(header) + static_cast<uint64_t>(header.ItemCount) * sizeof(SnapshotRecord);
+    if (pathsOffset > contentSize || header.PathBytes > contentSize - pathsOffset)
+    {
+        return std::nullopt;
+    }
+
+    SessionSnapshot snapshot;
+    snapshot.ViewWidth = header.ViewWidth;
+    snapshot.ViewHeight = header.ViewHeight;
+    snapshot.ScrollOffset = header.ScrollOffset;
+    auto paths = reinterpret_cast<char const*>(data + pathsOffset);
+    for (uint32_t i = 0; i < header.ItemCount; i++)
+    {
+        SnapshotRecord record;
+        std::memcpy(&record, data + sizeof(header) + i * sizeof(SnapshotRecord), sizeof(record));
+        auto pixelBytes = static_cast<uint64_t>(record.Width) * record.Height * 4;
+        if (static_cast<uint64_t>(record.PathOffset) + record.PathBytes > header.PathBytes ||
+            record.PixelOffset > contentSize || contentSize - record.PixelOffset < pixelBytes)
+        {
+            return std::nullopt;
+        }
+
+        SnapshotItem item;
+        auto path = std::u8string(reinterpret_cast<char8_t const*>(paths + record.PathOffset), record.PathBytes);
+        item.Key.Path = std::filesystem::path(path);
+        item.Key.FileSize = record.FileSize;
+        item.Key.ModifiedTime = record.ModifiedTime;
+        item.Key.ContentHash = record.ContentHash;
+        item.Key.TargetWidth = record.TargetWidth;
+        item.Key.TargetHeight = record.TargetHeight;
+        item.Bounds = { record.X, record.Y, record.Width, record.Height };
+        auto pixels = std::make_shared<PixelBuffer>(record.Width, record.Height);
+        std::memcpy(pixels->Bytes.data(), data + record.PixelOffset, static_cast<size_t>(pixelBytes));
+        item.Pixels = std::move(pixels);
+        snapshot.Items.push_back(std::move(item));
+    }
+    return snapshot;
+}
+
+PixelBuffer CropImage(PixelBuffer const& image, SurfaceRect const& rect)
+{
+    auto left = std::clamp<int64_t>(rect.X, 0, image.Width);
+    auto top = std::clamp<int64_t>(rect.Y, 0, image.Height);
+    auto right = std::clamp<int64_t>(static_cast<int64_t>(rect.X) + rect.Width, left, image.Width);
+    auto bottom = std::clamp<int64_t>(static_cast<int64_t>(rect.Y) + rect.Height, top, image.Height);
+
+    PixelBuffer result(static_cast<uint32_t>(right - left), static_cast<uint32_t>(bottom - top));
+    for (uint32_t y = 0; y < result.Height; y++)
+    {
+        std::memcpy(result.Row(y), image.Row(static_cast<uint32_t>(top) + y) + left * 4, result.Stride());
+    }
+    return result;
+}
+
+void SessionRecorder::SetView(uint32_t width, uint32_t height, double scrollOffset)
+{
+    std::lock_guard lock(m_lock);
+    m_viewWidth = width;
+    m_viewHeight = height;
+    m_scrollOffset = scrollOffset;
+}
+
+void SessionRecorder::Show(ImageKey const& key, std::shared_ptr<PixelBuffer const> image, SurfaceRect const& visible, SurfacePoint const& position)
+{
+    std::lock_guard lock(m_lock);
+    std::erase_if(m_shown, [&position](Shown const& shown)
+        {
+            return shown.Position.X == position.X && shown.Position.Y == position.Y;
+        });
+    m_shown.push_back({ key, std::move(image), visible, position });
+}
+
+void SessionRecorder::Hide(ImageKey const& key)
+{
+    std::lock_guard lock(m_lock);
+    std::erase_if(m_shown, [&key](Shown const& shown) { return shown.Key == key; });
+}
+
+SessionSnapshot SessionRecorder::Capture()
+{
+    std::vector<Shown> shown;
+    SessionSnapshot snapshot;
+    {
+        std::lock_guard lock(m_lock);
+        shown = m_shown;
+        snapshot.ViewWidth = m_viewWidth;
+        snapshot.ViewHeight = m_viewHeight;
+        snapshot.ScrollOffset = m_scrollOffset;
+    }
+
+    // The images are shared, so cropping them doesn't need the lock.
+    for (auto& item : shown)
+    {
+        auto pixels = CropImage(*item.Image, item.Visible);
+        if (pixels.Width == 0 || pixels.Height == 0)
+        {
+            continue;
+        }
+        // Clipping the visible rect to the image moves where it starts.
+        auto clippedX = std::max(item.Visible.X, 0) - item.Visible.X;
+        auto clippedY = std::max(item.Visible.Y, 0) - item.Visible.Y;
+        SnapshotItem snapshotItem;
+        snapshotItem.Key = item.Key;
+        snapshotItem.Bounds = { item.Position.X + clippedX, item.Position.Y + clippedY, pixels.Width, pixels.Height };
+        snapshotItem.Pixels = std::make_shared<PixelBuffer const>(std::move(pixels));
+        snapshot.Items.push_back(std::move(snapshotItem));
+    }
+    return snapshot;
+}
+
+StartupTimer::StartupTimer(Clock clock)
+{
+    m_clock = clock ? std::move(clock) : []() { return std::chrono::steady_clock::now(); };
+    m_start = m_clock();
+}
+
+std::chrono::microseconds StartupTimer::Elapsed()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(m_clock() - m_start);
+}
+
+void StartupTimer::SnapshotLoaded(std::chrono::microseconds loadTime, bool found)
+{
+    std::lock_guard lock(m_lock);
+    m_times.SnapshotLoad = loadTime;
+    m_times.Warm = found;
+}
+
+void StartupTimer::FirstPixels()
+{
+    auto elapsed = Elapsed();
+    std::lock_guard lock(m_lock);
+    if (!m_times.FirstPixels)
+    {
+        m_times.FirstPixels = elapsed;
+    }
+}
+
+bool StartupTimer::ImageShown()
+{
+    auto elapsed = Elapsed();
+    std::lock_guard lock(m_lock);
+    if (!m_times.FirstPixels)
+    {
+        m_times.FirstPixels = elapsed;
+    }
+    if (m_times.ImageShown)
+    {
+        return false;
+    }
+    m_times.ImageShown = elapsed;
+    return true;
+}
+
+StartupTimes StartupTimer::Times()
+{
+    std::lock_guard lock(m_lock);
+    return m_times;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include "DecodedImageCache.h"
+#include "SurfaceBackend.h"
+
+// One visible item, as it was on screen.
+struct SnapshotItem
+{
+    // The image the item was showing, so the real thing can be loaded to
+    // replace it.
+    ImageKey Key;
+    // Where the pixels go, in view coordinates. Width and Height match the
+    // pixels.
+    SurfaceRect Bounds;
+    // What was on screen, already at display size.
+    std::shared_ptr<PixelBuffer const> Pixels;
+};
+
+// What was visible when the app last closed. Showing this on the next launch
+// gets pixels on screen before any source file has been opened (let alone
+// decoded), and the real images replace it as they load.
+struct SessionSnapshot
+{
+    uint32_t ViewWidth = 0;
+    uint32_t ViewHeight = 0;
+    double ScrollOffset = 0.0;
+    std::vector<SnapshotItem> Items;
+
+    uint64_t PixelBytes() const;
+};
+
+// Writes the snapshot to a temporary file and renames it over the old one, so
+// a crash part way through leaves the previous snapshot in place. Throws
+// std::runtime_error or std::filesystem::filesystem_error if it can't be written.
+void SaveSessionSnapshot(std::filesystem::path const& path, SessionSnapshot const& snapshot);
+// Maps the file and copies the pixels out of it. A checksum covers the whole
+// file. Returns std::nullopt if there's no snapshot, or it's from another
+// version or damaged.
+std::optional<SessionSnapshot> LoadSessionSnapshot(std::filesystem::path const& path);
+
+// Copies the part of the image inside rect. The rect is clipped to the image.
+PixelBuffer CropImage(PixelBuffer const& image, SurfaceRect const& rect);
+
+// Keeps track of what's on screen as images come and go, so a snapshot can
+// be taken at shutdown. Can be called from any thread.
+class SessionRecorder
+{
+public:
+    void SetView(uint32_t width, uint32_t height, double scrollOffset = 0.0);
+    // image is the whole image. visible is the part of it that's on screen,
+    // in image coordinates, and position is where that part is in the view.
+    // Showing another image at the same position replaces it.
+    void Show(ImageKey const& key, std::shared_ptr<PixelBuffer const> image, SurfaceRect const& visible, SurfacePoint const& position);
+    void Hide(ImageKey const& key);
+    // Crops out the visible parts of everything that's showing.
+    SessionSnapshot Capture();
+
+private:
+    struct Shown
+    {
+        ImageKey Key;
+        std::shared_ptr<PixelBuffer const> Image;
+        SurfaceRect Visible;
+        SurfacePoint Position;
+    };
+
+    std::mutex m_lock;
+    uint32_t m_viewWidth = 0;
+    uint32_t m_viewHeight = 0;
+    double m_scrollOffset = 0.0;
+    std::vector<Shown> m_shown;
+};
+
+struct StartupTimes
+{
+    // Warm if there was a snapshot to show.
+    bool Warm = false;
+    // How long finding, mapping and checking the snapshot took.
+    std::chrono::microseconds SnapshotLoad{};
+    // From launch to the first pixels being written, from the snapshot or the
+    // real image. Not set until it happens.
+    std::optional<std::chrono::microseconds> FirstPixels;
+    // From launch until the real image was up.
+    std::optional<std::chrono::microseconds> ImageShown;
+};
+
+// Times startup from when the timer is created.
+class StartupTimer
+{
+public:
+    using Clock = std::function<std::chrono::steady_clock::time_point()>;
+
+    StartupTimer(Clock clock = nullptr);
+
+    // Call after LoadSessionSnapshot. found says whether there was one.
+    void SnapshotLoaded(std::chrono::microseconds loadTime, bool found);
+    // Only the first call to each counts. ImageShown returns true for that one.
+    void FirstPixels();
+    bool ImageShown();
+
+    StartupTimes Times();
+
+private:
+    std::chrono::microseconds Elapsed();
+
+    Clock m_clock;
+    std::chrono::steady_clock::time_point m_start;
+
+    std::mutex m_lock;
+    StartupTimes m_times;
+};
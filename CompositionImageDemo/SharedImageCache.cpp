@@ -0,0 +1,828 @@
+#include "pch.h"
+#include "SharedImageCache.h"
+#include "ContentHash.h"
+
+namespace
+{
+    constexpr uint32_t SegmentMagic = 0x31434953; // "SIC1"
+    constexpr uint32_t SegmentVersion = 3;
+    constexpr uint64_t PixelAlignment = 64;
+    // Windows can only map views on 64 KB boundaries.
+    constexpr uint64_t ViewAlignment = 64 * 1024;
+    // How long to wait for another process to finish setting up the segment.
+    constexpr auto OpenTimeout = std::chrono::seconds(5);
+
+    // The atomics are shared between processes, so they have to work without a
+    // lock (which would be private to each process).
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+    static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+    enum SlotState : uint32_t
+    {
+        Empty = 0,
+        // Claimed by an insert that's still copying the pixels in.
+        Writing = 1,
+        Live = 2,
+        Dead = 3,
+    };
+
+    // The state is in the high half and the reference count in the low half,
+    // so both can be checked and changed together.
+    uint64_t MakeWord(uint32_t state, uint32_t references)
+    {
+        return (static_cast<uint64_t>(state) << 32) | references;
+    }
+
+    uint32_t StateOf(uint64_t word)
+    {
+        return static_cast<uint32_t>(word >> 32);
+    }
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    struct SegmentHeader
+    {
+        // Written last by the process that creates the segment.
+        std::atomic<uint32_t> Magic;
+        uint32_t Version;
+        uint32_t SlotCount;
+        uint32_t Ways;
+        uint64_t ArenaBytes;
+        uint64_t ArenaOffset;
+        // The id of the process holding the lock, or 0.
+        std::atomic<uint32_t> AllocatorLock;
+        // How many slots are in the position index. Only used under the
+        // allocator lock.
+        uint32_t PositionCount;
+        // Where the next allocation in the arena starts, as a running total.
+        std::atomic<uint64_t> Cursor;
+        // Ticks for least recently used.
+        std::atomic<uint64_t> Clock;
+        std::atomic<uint64_t> Hits;
+        std::atomic<uint64_t> CrossProcessHits;
+        std::atomic<uint64_t> Misses;
+        std::atomic<uint64_t> Insertions;
+        std::atomic<uint64_t> Rejections;
+        std::atomic<uint64_t> Evictions;
+        std::atomic<uint64_t> BytesUsed;
+        std::atomic<uint64_t> EntryCount;
+        std::atomic<uint64_t> LockTakeovers;
+    };
+
+    struct Slot
+    {
+        std::atomic<uint64_t> Word;
+        std::atomic<uint64_t> KeyHash;
+        std::atomic<uint64_t> KeyCheck;
+        std::atomic<uint64_t> LastUsed;
+        // Written by whoever claimed the slot, before it's published. The key
+        // hashes and the owner are set under the allocator lock when the slot
+        // is claimed. Offset and Bytes are set under the allocator lock, and
+        // read under it.
+        uint64_t Offset;
+        uint64_t Bytes;
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t Owner;
+        uint32_t Reserved;
+    };
+    static_assert(sizeof(Slot) == 64);
+
+    struct KeyHashes
+    {
+        uint64_t Hash;
+        uint64_t Check;
+    };
+
+    // std::hash isn't the same from one process to the next. Two keys would
+    // have to collide in both hashes to be mixed up.
+    KeyHashes HashKey(ImageKey const& key)
+    {
+        uint64_t fields[] =
+        {
+            key.FileSize,
+            static_cast<uint64_t>(key.ModifiedTime),
+            key.ContentHash,
+            (static_cast<uint64_t>(key.TargetWidth) << 32) | key.TargetHeight,
+        };
+        auto path = key.Path.generic_u8string();
+        ContentHasher hasher;
+        hasher.Update(reinterpret_cast<uint8_t const*>(fields), sizeof(fields));
+        hasher.Update(reinterpret_cast<uint8_t const*>(path.data()), path.size());
+        KeyHashes hashes;
+        hashes.Hash = hasher.Digest();
+        const uint8_t salt = 0x5a;
+        hasher.Update(&salt, 1);
+        hashes.Check = hasher.Digest();
+        return hashes;
+    }
+
+    uint32_t CurrentProcessId()
+    {
+#ifdef _WIN32
+        return GetCurrentProcessId();
+#else
+        return static_cast<uint32_t>(getpid());
+#endif
+    }
+
+    bool ProcessIsAlive(uint32_t id)
+    {
+#ifdef _WIN32
+        wil::unique_handle process(OpenProcess(SYNCHRONIZE, FALSE, id));
+        if (!process)
+        {
+            // It's there, we just aren't allowed to look at it.
+            return GetLastError() == ERROR_ACCESS_DENIED;
+        }
+        return WaitForSingleObject(process.get(), 0) == WAIT_TIMEOUT;
+#else
+        return kill(static_cast<pid_t>(id), 0) == 0 || errno == EPERM;
+#endif
+    }
+
+    uint32_t SlotCountFor(SharedImageCacheOptions const& options)
+    {
+        return static_cast<uint32_t>(AlignUp(std::max(options.SlotCount, options.Ways), options.Ways));
+    }
+
+    // The header, the slots, then the position index: a slot number for every
+    // slot.
+    uint64_t ArenaOffsetFor(SharedImageCacheOptions const& options)
+    {
+        auto slotCount = static_cast<uint64_t>(SlotCountFor(options));
+        return AlignUp(sizeof(SegmentHeader) + slotCount * sizeof(Slot) + slotCount * sizeof(uint32_t), ViewAlignment);
+    }
+}
+
+PixelBuffer SharedPixels::Copy() const
+{
+    PixelBuffer copy(Width, Height);
+    std::memcpy(copy.Bytes.data(), Data, copy.Bytes.size());
+    return copy;
+}
+
+// The mapped segment. The index is mapped read-write, and the arena twice: a
+// writable view for inserts, and a read-only one for handing out pixels.
+struct SharedImageCache::Segment
+{
+    SegmentHeader* Header = nullptr;
+    Slot* Slots = nullptr;
+    uint32_t* Positions = nullptr;
+    uint8_t* Arena = nullptr;
+    uint8_t const* ReadOnlyArena = nullptr;
+    uint32_t ProcessId = 0;
+    uint64_t TotalBytes = 0;
+
+    Segment(std::string const& name, SharedImageCacheOptions const& options)
+    {
+        ProcessId = CurrentProcessId();
+        auto indexBytes = ArenaOffsetFor(options);
+        auto arenaBytes = AlignUp(options.ArenaBytes, ViewAlignment);
+        TotalBytes = indexBytes + arenaBytes;
+        try
+        {
+            Initialize(Open(name, indexBytes, arenaBytes), options, indexBytes, arenaBytes);
+        }
+        catch (...)
+        {
+            Close();
+            throw;
+        }
+    }
+
+    ~Segment()
+    {
+        Close();
+    }
+
+    void Lock();
+
+    void Unlock()
+    {
+        Header->AllocatorLock.store(0, std::memory_order_release);
+    }
+
+private:
+    void RepairAfterTakeover(uint32_t deadProcess);
+    void Initialize(bool created, SharedImageCacheOptions const& options, uint64_t indexBytes, uint64_t arenaBytes)
+    {
+        Header = reinterpret_cast<SegmentHeader*>(m_indexView);
+        Slots = reinterpret_cast<Slot*>(static_cast<uint8_t*>(m_indexView) + sizeof(SegmentHeader));
+        Positions = reinterpret_cast<uint32_t*>(Slots + SlotCountFor(options));
+        Arena = static_cast<uint8_t*>(m_arenaView);
+        ReadOnlyArena = static_cast<uint8_t const*>(m_readOnlyView);
+
+        if (created)
+        {
+            // The memory starts out zeroed, which is every slot empty.
+            new (Header) SegmentHeader();
+            Header->Version = SegmentVersion;
+            Header->SlotCount = SlotCountFor(options);
+            Header->Ways = options.Ways;
+            Header->ArenaBytes = arenaBytes;
+            Header->ArenaOffset = indexBytes;
+            for (uint32_t i = 0; i < Header->SlotCount; i++)
+            {
+                new (&Slots[i]) Slot();
+            }
+            Header->Magic.store(SegmentMagic, std::memory_order_release);
+        }
+        else
+        {
+            auto deadline = std::chrono::steady_clock::now() + OpenTimeout;
+            while (Header->Magic.load(std::memory_order_acquire) != SegmentMagic)
+            {
+                if (std::chrono::steady_clock::now() > deadline)
+                {
+                    throw std::runtime_error("The shared image cache was never set up");
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (Header->Version != SegmentVersion || Header->SlotCount != SlotCountFor(options) || Header->Ways != options.Ways ||
+                Header->ArenaBytes != arenaBytes || Header->ArenaOffset != indexBytes)
+            {
+                throw std::runtime_error("The shared image cache was created with different options");
+            }
+        }
+    }
+
+#ifdef _WIN32
+    void Close()
+    {
+        for (auto view : { m_readOnlyView, m_arenaView, m_indexView })
+        {
+            if (view != nullptr)
+            {
+                UnmapViewOfFile(view);
+            }
+        }
+        m_section.reset();
+    }
+
+    bool Open(std::string const& name, uint64_t indexBytes, uint64_t arenaBytes)
+    {
+        auto sectionName = std::wstring(L"Local\\") + winrt::to_hstring(name).c_str();
+        m_section.reset(CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            static_cast<DWORD>(TotalBytes >> 32), static_cast<DWORD>(TotalBytes), sectionName.c_str()));
+        if (!m_section)
+        {
+            winrt::throw_last_error();
+        }
+        bool created = GetLastError() != ERROR_ALREADY_EXISTS;
+        auto map = [this](DWORD access, uint64_t offset, uint64_t size)
+        {
+            auto view = MapViewOfFile(m_section.get(), access, static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset), static_cast<SIZE_T>(size));
+            if (view == nullptr)
+            {
+                winrt::throw_last_error();
+            }
+            return view;
+        };
+        m_indexView = map(FILE_MAP_WRITE, 0, indexBytes);
+        m_arenaView = map(FILE_MAP_WRITE, indexBytes, arenaBytes);
+        m_readOnlyView = map(FILE_MAP_READ, indexBytes, arenaBytes);
+        return created;
+    }
+
+    wil::unique_handle m_section;
+#else
+    void Close()
+    {
+        if (m_readOnlyView != nullptr)
+        {
+            munmap(m_readOnlyView, m_arenaBytes);
+        }
+        if (m_arenaView != nullptr)
+        {
+            munmap(m_arenaView, m_arenaBytes);
+        }
+        if (m_indexView != nullptr)
+        {
+            munmap(m_indexView, m_indexBytes);
+        }
+        if (m_file >= 0)
+        {
+            close(m_file);
+        }
+    }
+
+    bool Open(std::string const& name, uint64_t indexBytes, uint64_t arenaBytes)
+    {
+        auto objectName = "/" + name;
+        bool created = true;
+        m_file = shm_open(objectName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (m_file < 0 && errno == EEXIST)
+        {
+            created = false;
+            m_file = shm_open(objectName.c_str(), O_RDWR, 0600);
+        }
+        if (m_file < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "Couldn't open the shared image cache");
+        }
+
+        if (created)
+        {
+            if (ftruncate(m_file, static_cast<off_t>(TotalBytes)) != 0)
+            {
+                auto error = errno;
+                shm_unlink(objectName.c_str());
+                throw std::system_error(error, std::generic_category(), "Couldn't size the shared image cache");
+            }
+        }
+        else
+        {
+            // The creator might not have sized it yet.
+            auto deadline = std::chrono::steady_clock::now() + OpenTimeout;
+            struct stat status = {};
+            while (fstat(m_file, &status) == 0 && status.st_size == 0 && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (static_cast<uint64_t>(status.st_size) != TotalBytes)
+            {
+                throw std::runtime_error("The shared image cache was created with different options");
+            }
+        }
+
+        m_indexBytes = static_cast<size_t>(indexBytes);
+        m_arenaBytes = static_cast<size_t>(arenaBytes);
+        auto map = [this](int protection, uint64_t offset, size_t size)
+        {
+            auto view = mmap(nullptr, size, protection, MAP_SHARED, m_file, static_cast<off_t>(offset));
+            if (view == MAP_FAILED)
+            {
+                throw std::system_error(errno, std::generic_category(), "Couldn't map the shared image cache");
+            }
+            return view;
+        };
+        m_indexView = map(PROT_READ | PROT_WRITE, 0, m_indexBytes);
+        m_arenaView = map(PROT_READ | PROT_WRITE, indexBytes, m_arenaBytes);
+        m_readOnlyView = map(PROT_READ, indexBytes, m_arenaBytes);
+        return created;
+    }
+
+    int m_file = -1;
+    size_t m_indexBytes = 0;
+    size_t m_arenaBytes = 0;
+#endif
+    void* m_indexView = nullptr;
+    void* m_arenaView = nullptr;
+    void* m_readOnlyView = nullptr;
+};
+
+namespace
+{
+    Slot* SetFor(SegmentHeader* header, Slot* slots, uint64_t hash)
+    {
+        auto sets = header->SlotCount / header->Ways;
+        return slots + (hash % sets) * header->Ways;
+    }
+
+    // Takes a reference to the live entry for the key, or returns nullptr.
+    Slot* AcquireSlot(SegmentHeader* header, Slot* slots, KeyHashes const& key)
+    {
+        auto set = SetFor(header, slots, key.Hash);
+        for (uint32_t way = 0; way < header->Ways; way++)
+        {
+            auto slot = set + way;
+            auto word = slot->Word.load(std::memory_order_acquire);
+            while (StateOf(word) == Live && slot->KeyHash.load(std::memory_order_relaxed) == key.Hash)
+            {
+                if (slot->Word.compare_exchange_weak(word, word + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+                {
+                    // The slot could have been reused for another key between
+                    // the check and the reference, but it can't change now.
+                    if (slot->KeyHash.load(std::memory_order_relaxed) == key.Hash &&
+                        slot->KeyCheck.load(std::memory_order_relaxed) == key.Check)
+                    {
+                        slot->LastUsed.store(header->Clock.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+                        return slot;
+                    }
+                    slot->Word.fetch_sub(1, std::memory_order_release);
+                    break;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    // Call with the allocator lock held. Looks for an insert of the same key
+    // that has claimed a slot but hasn't published it yet.
+    bool IsBeingWrittenLocked(SegmentHeader* header, Slot* slots, KeyHashes const& key)
+    {
+        auto set = SetFor(header, slots, key.Hash);
+        for (uint32_t way = 0; way < header->Ways; way++)
+        {
+            if (StateOf(set[way].Word.load(std::memory_order_acquire)) == Writing &&
+                set[way].KeyHash.load(std::memory_order_relaxed) == key.Hash &&
+                set[way].KeyCheck.load(std::memory_order_relaxed) == key.Check)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The slots that have space in the arena (live, or being written), sorted
+    // by where that space starts. Allocations don't overlap, so their ends are
+    // in the same order, and finding what's in the way of a new one is a
+    // binary search rather than a pass over every slot. Only used under the
+    // allocator lock.
+    struct PositionIndex
+    {
+        SegmentHeader* Header;
+        Slot* Slots;
+        uint32_t* Positions;
+
+        uint32_t* begin() const { return Positions; }
+        uint32_t* end() const { return Positions + Header->PositionCount; }
+
+        // The first slot whose space ends after offset.
+        uint32_t* FirstEndingAfter(uint64_t offset) const
+        {
+            return std::partition_point(begin(), end(), [this, offset](uint32_t i)
+                {
+                    return Slots[i].Offset + Slots[i].Bytes <= offset;
+                });
+        }
+
+        // Anything the slot's space overlapped must have been removed first.
+        void Add(Slot* slot)
+        {
+            auto at = FirstEndingAfter(slot->Offset);
+            std::move_backward(at, end(), end() + 1);
+            *at = static_cast<uint32_t>(slot - Slots);
+            Header->PositionCount++;
+        }
+
+        void Remove(Slot* slot)
+        {
+            auto at = FirstEndingAfter(slot->Offset);
+            if (slot->Bytes > 0 && at != end() && *at == static_cast<uint32_t>(slot - Slots))
+            {
+                std::move(at + 1, end(), at);
+                Header->PositionCount--;
+            }
+        }
+    };
+
+    // Call with the allocator lock held. Moves an unreferenced live slot to
+    // newState, and gives up its space. Fails if anyone holds a reference, or
+    // it isn't live anymore.
+    bool TryEvictLocked(PositionIndex& positions, Slot* slot, uint32_t newState)
+    {
+        auto expected = MakeWord(Live, 0);
+        if (!slot->Word.compare_exchange_strong(expected, MakeWord(newState, 0), std::memory_order_acq_rel))
+        {
+            return false;
+        }
+        auto header = positions.Header;
+        header->BytesUsed.fetch_sub(slot->Bytes, std::memory_order_relaxed);
+        header->EntryCount.fetch_sub(1, std::memory_order_relaxed);
+        header->Evictions.fetch_add(1, std::memory_order_relaxed);
+        positions.Remove(slot);
+        slot->Bytes = 0;
+        return true;
+    }
+
+    // Call with the allocator lock held. Returns a slot in the key's set that's
+    // now Writing, or nullptr if every slot in it is in use.
+    Slot* ClaimSlotLocked(PositionIndex& positions, uint64_t hash, uint64_t& evictions)
+    {
+        auto header = positions.Header;
+        auto set = SetFor(header, positions.Slots, hash);
+        for (uint32_t way = 0; way < header->Ways; way++)
+        {
+            auto word = set[way].Word.load(std::memory_order_acquire);
+            if ((StateOf(word) == Empty || StateOf(word) == Dead) &&
+                set[way].Word.compare_exchange_strong(word, MakeWord(Writing, 0), std::memory_order_acq_rel))
+            {
+                return set + way;
+            }
+        }
+
+        // The set is full, so the least recently used entry that nobody is
+        // holding makes way.
+        for (uint32_t attempt = 0; attempt < header->Ways; attempt++)
+        {
+            Slot* oldest = nullptr;
+            for (uint32_t way = 0; way < header->Ways; way++)
+            {
+                if (set[way].Word.load(std::memory_order_acquire) == MakeWord(Live, 0) &&
+                    (!oldest || set[way].LastUsed.load(std::memory_order_relaxed) < oldest->LastUsed.load(std::memory_order_relaxed)))
+                {
+                    oldest = set + way;
+                }
+            }
+            if (!oldest)
+            {
+                return nullptr;
+            }
+            if (TryEvictLocked(positions, oldest, Writing))
+            {
+                evictions++;
+                return oldest;
+            }
+        }
+        return nullptr;
+    }
+
+    // Call with the allocator lock held. Finds room for size bytes at the
+    // front of the ring, evicting whatever's there. Entries that are in use
+    // are stepped over. Returns the offset into the arena.
+    std::optional<uint64_t> AllocateLocked(PositionIndex& positions, uint64_t size, uint64_t& evictions)
+    {
+        auto header = positions.Header;
+        auto arenaBytes = header->ArenaBytes;
+        auto cursor = header->Cursor.load(std::memory_order_relaxed);
+        uint64_t skipped = 0;
+        while (skipped < arenaBytes)
+        {
+            auto offset = cursor % arenaBytes;
+            if (offset + size > arenaBytes)
+            {
+                // Entries don't wrap around the end.
+                skipped += arenaBytes - offset;
+                cursor += arenaBytes - offset;
+                continue;
+            }
+
+            // What overlaps the space is one run of the index. Evicting an
+            // entry removes it, which moves the next one down to the same place.
+            Slot* blocker = nullptr;
+            auto at = positions.FirstEndingAfter(offset);
+            while (at != positions.end() && positions.Slots[*at].Offset < offset + size)
+            {
+                auto slot = positions.Slots + *at;
+                if (!TryEvictLocked(positions, slot, Dead))
+                {
+                    blocker = slot;
+                    break;
+                }
+                evictions++;
+            }
+            if (!blocker)
+            {
+                header->Cursor.store(cursor + size, std::memory_order_relaxed);
+                return offset;
+            }
+            auto step = blocker->Offset + blocker->Bytes - offset;
+            skipped += step;
+            cursor += step;
+        }
+        return std::nullopt;
+    }
+
+    // Wraps a slot we hold a reference to. The reference goes with the last
+    // copy of the pointer, which keeps the mapping alive too.
+    template <typename SegmentPointer>
+    std::shared_ptr<SharedPixels const> PixelsFor(SegmentPointer const& segment, Slot* slot)
+    {
+        auto pixels = new SharedPixels();
+        pixels->Width = slot->Width;
+        pixels->Height = slot->Height;
+        pixels->Data = segment->ReadOnlyArena + slot->Offset;
+        return std::shared_ptr<SharedPixels const>(pixels, [segment, slot](SharedPixels const* pixels)
+            {
+                slot->Word.fetch_sub(1, std::memory_order_release);
+                delete pixels;
+            });
+    }
+}
+
+// Only held to claim space in the arena, so a spin is enough. The lock word
+// holds the id of the process that has it, so if that process dies the next
+// one to want the lock can tell and take it over.
+void SharedImageCache::Segment::Lock()
+{
+    uint32_t spins = 0;
+    uint32_t owner = 0;
+    while (!Header->AllocatorLock.compare_exchange_weak(owner, ProcessId, std::memory_order_acquire, std::memory_order_relaxed))
+    {
+        if (owner != 0 && ++spins % 1024 == 0 && !ProcessIsAlive(owner) &&
+            Header->AllocatorLock.compare_exchange_strong(owner, ProcessId, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            RepairAfterTakeover(owner);
+            return;
+        }
+        if (spins > 64)
+        {
+            std::this_thread::yield();
+        }
+        owner = 0;
+    }
+}
+
+// The process that died could have been anywhere in an insert, so the
+// position index is rebuilt from the slots. Its claimed slots are never going
+// to be published, so they're given up. The segment's stats can be off by the
+// eviction it was part way through.
+void SharedImageCache::Segment::RepairAfterTakeover(uint32_t deadProcess)
+{
+    Header->LockTakeovers.fetch_add(1, std::memory_order_relaxed);
+    uint32_t positionCount = 0;
+    for (uint32_t i = 0; i < Header->SlotCount; i++)
+    {
+        auto& slot = Slots[i];
+        auto word = slot.Word.load(std::memory_order_acquire);
+        if (StateOf(word) == Writing && slot.Owner == deadProcess &&
+            slot.Word.compare_exchange_strong(word, MakeWord(Dead, 0), std::memory_order_acq_rel))
+        {
+            slot.Bytes = 0;
+            continue;
+        }
+        if ((StateOf(word) == Live || StateOf(word) == Writing) && slot.Bytes > 0)
+        {
+            Positions[positionCount++] = i;
+        }
+    }
+    std::sort(Positions, Positions + positionCount, [this](uint32_t a, uint32_t b) { return Slots[a].Offset < Slots[b].Offset; });
+    Header->PositionCount = positionCount;
+}
+
+SharedImageCache::SharedImageCache(std::string const& name, SharedImageCacheOptions const& options)
+{
+    if (options.Ways == 0 || options.SlotCount == 0 || options.ArenaBytes == 0)
+    {
+        throw std::invalid_argument("The shared image cache needs slots and an arena");
+    }
+    m_segment = std::make_shared<Segment>(name, options);
+}
+
+SharedImageCache::~SharedImageCache()
+{
+}
+
+std::shared_ptr<SharedPixels const> SharedImageCache::Find(ImageKey const& key)
+{
+    auto header = m_segment->Header;
+    auto slot = AcquireSlot(header, m_segment->Slots, HashKey(key));
+    if (!slot)
+    {
+        m_misses++;
+        header->Misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    m_hits++;
+    header->Hits.fetch_add(1, std::memory_order_relaxed);
+    if (slot->Owner != m_segment->ProcessId)
+    {
+        m_crossProcessHits++;
+        header->CrossProcessHits.fetch_add(1, std::memory_order_relaxed);
+    }
+    return PixelsFor(m_segment, slot);
+}
+
+std::shared_ptr<SharedPixels const> SharedImageCache::Insert(ImageKey const& key, PixelBuffer const& image)
+{
+    auto header = m_segment->Header;
+    auto slots = m_segment->Slots;
+    auto hashes = HashKey(key);
+    // Another process may have decoded the same image while we were, in which
+    // case theirs is used and ours is thrown away.
+    if (auto existing = AcquireSlot(header, slots, hashes))
+    {
+        return PixelsFor(m_segment, existing);
+    }
+    auto size = AlignUp(image.Bytes.size(), PixelAlignment);
+
+    uint64_t evictions = 0;
+    Slot* existing = nullptr;
+    bool beingWritten = false;
+    Slot* slot = nullptr;
+    std::optional<uint64_t> offset;
+    if (size > 0 && size <= header->ArenaBytes)
+    {
+        m_segment->Lock();
+        PositionIndex positions = { header, slots, m_segment->Positions };
+        // Slots are claimed for a key under the lock, so checking again here
+        // means two processes can't both insert the same image.
+        existing = AcquireSlot(header, slots, hashes);
+        beingWritten = !existing && IsBeingWrittenLocked(header, slots, hashes);
+        if (!existing && !beingWritten)
+        {
+            slot = ClaimSlotLocked(positions, hashes.Hash, evictions);
+        }
+        if (slot)
+        {
+            // Whatever the slot held before has already given up its space.
+            slot->KeyHash.store(hashes.Hash, std::memory_order_relaxed);
+            slot->KeyCheck.store(hashes.Check, std::memory_order_relaxed);
+            slot->Owner = m_segment->ProcessId;
+            offset = AllocateLocked(positions, size, evictions);
+            if (offset)
+            {
+                slot->Offset = *offset;
+                slot->Bytes = size;
+                positions.Add(slot);
+            }
+            else
+            {
+                slot->Word.store(MakeWord(Dead, 0), std::memory_order_release);
+            }
+        }
+        m_segment->Unlock();
+    }
+    m_evictions += evictions;
+    if (existing)
+    {
+        return PixelsFor(m_segment, existing);
+    }
+    if (beingWritten)
+    {
+        // Rather than wait on the other insert, the caller keeps its own copy.
+        return nullptr;
+    }
+    if (!slot || !offset)
+    {
+        m_rejections++;
+        header->Rejections.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    // The slot is ours until it's published, so this doesn't need the lock.
+    std::memcpy(m_segment->Arena + *offset, image.Bytes.data(), image.Bytes.size());
+    slot->Width = image.Width;
+    slot->Height = image.Height;
+    slot->LastUsed.store(header->Clock.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+    header->BytesUsed.fetch_add(size, std::memory_order_relaxed);
+    header->EntryCount.fetch_add(1, std::memory_order_relaxed);
+    header->Insertions.fetch_add(1, std::memory_order_relaxed);
+    m_insertions++;
+    // Published with the caller's reference already taken.
+    slot->Word.store(MakeWord(Live, 1), std::memory_order_release);
+    return PixelsFor(m_segment, slot);
+}
+
+void SharedImageCache::SimulateCrashDuringInsert(ImageKey const& key)
+{
+    auto header = m_segment->Header;
+    auto hashes = HashKey(key);
+    m_segment->Lock();
+    PositionIndex positions = { header, m_segment->Slots, m_segment->Positions };
+    uint64_t evictions = 0;
+    auto slot = ClaimSlotLocked(positions, hashes.Hash, evictions);
+    if (!slot)
+    {
+        return;
+    }
+    slot->KeyHash.store(hashes.Hash, std::memory_order_relaxed);
+    slot->KeyCheck.store(hashes.Check, std::memory_order_relaxed);
+    slot->Owner = m_segment->ProcessId;
+    // As much as a 128x128 image.
+    auto size = std::min<uint64_t>(64 * 1024, header->ArenaBytes);
+    if (auto offset = AllocateLocked(positions, size, evictions))
+    {
+        slot->Offset = *offset;
+        slot->Bytes = size;
+        positions.Add(slot);
+    }
+    // And never unlocks.
+}
+
+SharedImageCacheStats SharedImageCache::Stats()
+{
+    SharedImageCacheStats stats;
+    stats.Hits = m_hits;
+    stats.CrossProcessHits = m_crossProcessHits;
+    stats.Misses = m_misses;
+    stats.Insertions = m_insertions;
+    stats.Rejections = m_rejections;
+    stats.Evictions = m_evictions;
+    return stats;
+}
+
+SharedImageCacheStats SharedImageCache::SegmentStats()
+{
+    auto header = m_segment->Header;
+    SharedImageCacheStats stats;
+    stats.Hits = header->Hits.load(std::memory_order_relaxed);
+    stats.CrossProcessHits = header->CrossProcessHits.load(std::memory_order_relaxed);
+    stats.Misses = header->Misses.load(std::memory_order_relaxed);
+    stats.Insertions = header->Insertions.load(std::memory_order_relaxed);
+    stats.Rejections = header->Rejections.load(std::memory_order_relaxed);
+    stats.Evictions = header->Evictions.load(std::memory_order_relaxed);
+    stats.BytesUsed = header->BytesUsed.load(std::memory_order_relaxed);
+    stats.EntryCount = header->EntryCount.load(std::memory_order_relaxed);
+    stats.LockTakeovers = header->LockTakeovers.load(std::memory_order_relaxed);
+    return stats;
+}
+
+uint64_t SharedImageCache::SegmentBytes() const
+{
+    return m_segment->TotalBytes;
+}
+
+void SharedImageCache::Remove(std::string const& name)
+{
+#ifndef _WIN32
+    shm_unlink(("/" + name).c_str());
+#else
+    (void)name;
+#endif
+}
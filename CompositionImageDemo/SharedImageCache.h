@@ -0,0 +1,125 @@
+#pragma once
+#include "DecodedImageCache.h"
+
+struct SharedImageCacheOptions
+{
+    // Room for pixels. The segment is this plus the index, rounded up.
+    uint64_t ArenaBytes = 256 * 1024 * 1024;
+    // How many images the index can hold. Rounded up to a multiple of Ways.
+    uint32_t SlotCount = 4096;
+    // A key can only go in one set of this many slots, so a lookup never
+    // looks at more than that.
+    uint32_t Ways = 8;
+};
+
+// Every process that opens the segment must use the same options. The stats
+// for the whole segment are kept in the segment, and a process's own are
+// kept in the process.
+struct SharedImageCacheStats
+{
+    uint64_t Hits = 0;
+    // Hits on images another process inserted.
+    uint64_t CrossProcessHits = 0;
+    uint64_t Misses = 0;
+    uint64_t Insertions = 0;
+    // Inserts that couldn't find room, because what was in the way is still
+    // in use (or still being written).
+    uint64_t Rejections = 0;
+    uint64_t Evictions = 0;
+    // These three are only in the segment's stats.
+    uint64_t BytesUsed = 0;
+    uint64_t EntryCount = 0;
+    // Times a process found the arena locked by one that had died, and took
+    // the lock over.
+    uint64_t LockTakeovers = 0;
+
+    double HitRate() const { return Hits + Misses > 0 ? static_cast<double>(Hits) / (Hits + Misses) : 0.0; }
+    double CrossProcessHitRate() const { return Hits + Misses > 0 ? static_cast<double>(CrossProcessHits) / (Hits + Misses) : 0.0; }
+};
+
+// Pixels in the shared segment, laid out like a PixelBuffer. They're mapped
+// read-only, and the entry can't be evicted while this is alive.
+struct SharedPixels
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint8_t const* Data = nullptr;
+
+    uint32_t Stride() const { return Width * 4; }
+    uint8_t const* Row(uint32_t y) const { return Data + static_cast<size_t>(y) * Stride(); }
+    uint64_t Bytes() const { return static_cast<uint64_t>(Stride()) * Height; }
+    PixelBuffer Copy() const;
+};
+
+// Decoded images in named shared memory, so several viewer processes over the
+// same library decode each image once and all map the same pixels. On Windows
+// the segment is a named section backed by the paging file, and goes away with
+// the last process that has it open. Elsewhere it's a POSIX shared memory
+// object, which stays until Remove is called.
+//
+// The index is a table of slots in the segment, split into sets of Ways
+// slots. Lookups are lock-free: each slot's state and reference count share
+// one atomic word, so taking a reference is a single compare-and-swap that
+// also checks the entry is still live, and an entry is only evicted by
+// swapping it from live with no references to dead. Pixels go in a ring
+// arena, oldest first. Inserts take a short spin lock in the segment to claim
+// a slot and space in the arena and evict what's in the way, and then write
+// the pixels without it. The segment also keeps the slots sorted by where
+// their pixels are, so finding what's in the way doesn't mean looking at
+// every slot.
+//
+// The lock records which process holds it. If that process dies with it, the
+// next insert that wants it takes it over and rebuilds the sorted slots.
+// That relies on process ids meaning the same thing to every process that
+// opens the segment, and on the dead one's id not having been reused yet. A
+// process that exits while holding references leaves those entries pinned
+// until the segment is recreated, and one that exits while copying pixels in
+// leaves that image out of the cache.
+//
+// All methods can be called from any thread.
+class SharedImageCache
+{
+public:
+    // Opens the segment with this name, creating it if it doesn't exist yet.
+    // Throws std::runtime_error if it can't be created or mapped, or if it was
+    // created with different options.
+    SharedImageCache(std::string const& name, SharedImageCacheOptions const& options = {});
+    ~SharedImageCache();
+    SharedImageCache(SharedImageCache const&) = delete;
+    SharedImageCache& operator=(SharedImageCache const&) = delete;
+
+    // Returns nullptr on a miss.
+    std::shared_ptr<SharedPixels const> Find(ImageKey const& key);
+    // Copies the image into the segment, unless another process got there
+    // first, in which case that copy is returned. Returns nullptr if there's
+    // no room for it, or another process is still copying the same image in,
+    // and the caller keeps using its own copy.
+    std::shared_ptr<SharedPixels const> Insert(ImageKey const& key, PixelBuffer const& image);
+
+    // This process's lookups and inserts.
+    SharedImageCacheStats Stats();
+    // Every process's.
+    SharedImageCacheStats SegmentStats();
+    uint64_t SegmentBytes() const;
+
+    // Leaves the segment the way a process that crashes part way through an
+    // insert would: a slot claimed for the key, space for its pixels taken,
+    // and the arena locked. For testing recovery from a process that's about
+    // to be killed, inserts from this process never finish after it.
+    void SimulateCrashDuringInsert(ImageKey const& key);
+
+    // Deletes the named segment. Processes that have it open keep their
+    // mapping. Does nothing on Windows, where that happens by itself.
+    static void Remove(std::string const& name);
+
+private:
+    struct Segment;
+
+    std::shared_ptr<Segment> m_segment;
+    std::atomic<uint64_t> m_hits = 0;
+    std::atomic<uint64_t> m_crossProcessHits = 0;
+    std::atomic<uint64_t> m_misses = 0;
+    std::atomic<uint64_t> m_insertions = 0;
+    std::atomic<uint64_t> m_rejections = 0;
+    std::atomic<uint64_t> m_evictions = 0;
+};
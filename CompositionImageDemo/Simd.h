@@ -0,0 +1,18 @@
+#pragma once
+
+// The SSE2 paths (see IMAGE_DEMO_SSE2 in pch.h) check this before they run, so
+// they can be switched off at run time. That's for the tests and benchmarks,
+// which check the vector and scalar code give the same answers on the same
+// machine, and how much faster the vector code is. Builds without SSE2 always
+// run the scalar code.
+inline std::atomic<bool> SimdSwitch = true;
+
+inline bool SimdEnabled()
+{
+    return SimdSwitch.load(std::memory_order_relaxed);
+}
+
+inline void SetSimdEnabled(bool enabled)
+{
+    SimdSwitch.store(enabled, std::memory_order_relaxed);
+}
@@ -0,0 +1,112 @@
+#include "pch.h"
+#include "SoftwareRenderDevice.h"
+
+std::shared_ptr<SurfaceBackend> SoftwareRenderDevice::CreateSurface(SurfaceFormat format)
+{
+    return CreateSoftwareSurface(format);
+}
+
+std::shared_ptr<SoftwareSurfaceBackend> SoftwareRenderDevice::CreateSoftwareSurface(SurfaceFormat format)
+{
+    std::lock_guard lock(m_lock);
+    // Spread the surfaces around so no two share an offset in a row.
+    auto index = m_surfacesCreated++;
+    SurfacePoint offset = { static_cast<int32_t>((index * 7) % 32), static_cast<int32_t>((index * 13) % 32) };
+    auto surface = std::make_shared<SoftwareSurfaceBackend>(format, offset);
+    if (m_lost)
+    {
+        surface->SetDeviceLost(true);
+    }
+    std::erase_if(m_surfaces, [](auto const& weak) { return weak.expired(); });
+    m_surfaces.push_back(surface);
+    return surface;
+}
+
+std::unique_ptr<UploadPage> SoftwareRenderDevice::CreateUploadPage(SurfaceFormat format, uint32_t width, uint32_t height)
+{
+    return std::make_unique<CpuUploadPage>(format, width, height);
+}
+
+std::shared_ptr<UploadFence> SoftwareRenderDevice::CreateUploadFence()
+{
+    return std::make_shared<CpuUploadFence>(m_fenceLatency);
+}
+
+void SoftwareRenderDevice::BeginUploads()
+{
+    std::lock_guard lock(m_lock);
+    if (m_uploading)
+    {
+        throw std::logic_error("BeginUploads called twice");
+    }
+    m_uploading = true;
+}
+
+void SoftwareRenderDevice::EndUploads()
+{
+    std::lock_guard lock(m_lock);
+    if (!m_uploading)
+    {
+        throw std::logic_error("EndUploads called without BeginUploads");
+    }
+    m_uploading = false;
+    m_uploadBatches++;
+}
+
+void SoftwareRenderDevice::SimulateDeviceLoss()
+{
+    std::lock_guard lock(m_lock);
+    if (m_lost)
+    {
+        return;
+    }
+    m_lost = true;
+    m_deviceLosses++;
+    for (auto&& weak : m_surfaces)
+    {
+        if (auto surface = weak.lock())
+        {
+            surface->SetDeviceLost(true);
+        }
+    }
+}
+
+void SoftwareRenderDevice::ReplaceDevice()
+{
+    {
+        std::lock_guard lock(m_lock);
+        m_lost = false;
+        for (auto&& weak : m_surfaces)
+        {
+            if (auto surface = weak.lock())
+            {
+                surface->SetDeviceLost(false);
+            }
+        }
+    }
+    RaiseDeviceReplaced();
+}
+
+bool SoftwareRenderDevice::IsLost()
+{
+    std::lock_guard lock(m_lock);
+    return m_lost;
+}
+
+uint64_t SoftwareRenderDevice::DeviceLosses()
+{
+    std::lock_guard lock(m_lock);
+    return m_deviceLosses;
+}
+
+uint64_t SoftwareRenderDevice::UploadBatches()
+{
+    std::lock_guard lock(m_lock);
+    return m_uploadBatches;
+}
+
+size_t SoftwareRenderDevice::LiveSurfaces()
+{
+    std::lock_guard lock(m_lock);
+    return std::count_if(m_surfaces.begin(), m_surfaces.end(), [](auto const& weak) { return !weak.expired(); });
+}
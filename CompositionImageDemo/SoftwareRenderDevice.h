@@ -0,0 +1,44 @@
+#pragma once
+#include "RenderDevice.h"
+#include "SoftwareSurfaceBackend.h"
+
+// A RenderDevice with no GPU behind it. Surfaces are SoftwareSurfaceBackends,
+// each placed at a different spot in its (pretend) atlas so offset bugs show
+// up, upload pages are CpuUploadPages and fences are CpuUploadFences.
+//
+// Device loss is simulated in two steps, the same way it plays out for real:
+// SimulateDeviceLoss drops the contents of every surface and makes them throw
+// DeviceLostError, then ReplaceDevice brings them back (empty) and calls the
+// DeviceReplaced handlers so everything can be redrawn.
+class SoftwareRenderDevice : public RenderDevice
+{
+public:
+    SoftwareRenderDevice(uint32_t fenceLatency = 2) : m_fenceLatency(fenceLatency) {}
+
+    std::shared_ptr<SurfaceBackend> CreateSurface(SurfaceFormat format) override;
+    std::unique_ptr<UploadPage> CreateUploadPage(SurfaceFormat format, uint32_t width, uint32_t height) override;
+    std::shared_ptr<UploadFence> CreateUploadFence() override;
+    void BeginUploads() override;
+    void EndUploads() override;
+
+    std::shared_ptr<SoftwareSurfaceBackend> CreateSoftwareSurface(SurfaceFormat format);
+
+    void SimulateDeviceLoss();
+    void ReplaceDevice();
+    bool IsLost();
+
+    uint64_t DeviceLosses();
+    // Completed BeginUploads/EndUploads pairs.
+    uint64_t UploadBatches();
+    size_t LiveSurfaces();
+
+private:
+    std::mutex m_lock;
+    uint32_t m_fenceLatency = 0;
+    std::vector<std::weak_ptr<SoftwareSurfaceBackend>> m_surfaces;
+    uint32_t m_surfacesCreated = 0;
+    bool m_lost = false;
+    bool m_uploading = false;
+    uint64_t m_deviceLosses = 0;
+    uint64_t m_uploadBatches = 0;
+};
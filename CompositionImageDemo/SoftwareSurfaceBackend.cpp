@@ -0,0 +1,156 @@
+#include "pch.h"
+#include "SoftwareSurfaceBackend.h"
+#include "UploadRing.h"
+
+SoftwareSurfaceBackend::SoftwareSurfaceBackend(SurfaceFormat format, SurfacePoint atlasOffset)
+{
+    if (atlasOffset.X < 0 || atlasOffset.Y < 0)
+    {
+        throw std::invalid_argument("Invalid surface layout");
+    }
+    m_format = format;
+    m_bytesPerPixel = ::BytesPerPixel(format);
+    m_offset = atlasOffset;
+    // Surfaces start out 1x1, just like the ones from CreateDrawingSurface.
+    Resize(1, 1);
+}
+
+void SoftwareSurfaceBackend::Resize(uint32_t width, uint32_t height)
+{
+    if (m_drawing)
+    {
+        throw std::logic_error("Can't resize a surface while drawing");
+    }
+    if (width == 0 || height == 0)
+    {
+        throw std::invalid_argument("Surface size must be non-zero");
+    }
+    CheckDevice();
+    m_width = width;
+    m_height = height;
+    // Like the real thing, the contents are lost when the surface is resized.
+    m_atlas.assign(static_cast<size_t>(AtlasStride()) * (m_offset.Y + height), 0);
+}
+
+SurfacePoint SoftwareSurfaceBackend::BeginDraw(SurfaceRect const* updateRect)
+{
+    if (m_drawing)
+    {
+        throw std::logic_error("BeginDraw called twice");
+    }
+    CheckDevice();
+    SurfaceRect rect = { 0, 0, m_width, m_height };
+    if (updateRect != nullptr)
+    {
+        rect = *updateRect;
+        if (rect.X < 0 || rect.Y < 0 || rect.Width == 0 || rect.Height == 0 ||
+            rect.X + rect.Width > m_width || rect.Y + rect.Height > m_height)
+        {
+            throw std::out_of_range("Update rect is outside of the surface");
+        }
+    }
+    m_drawing = true;
+    // Store the rect in atlas coordinates, since that's what writes use.
+    m_drawRect = { m_offset.X + rect.X, m_offset.Y + rect.Y, rect.Width, rect.Height };
+    m_drawCount++;
+    return { m_drawRect.X, m_drawRect.Y };
+}
+
+void SoftwareSurfaceBackend::WritePixels(SurfacePoint atlasPosition, uint32_t width, uint32_t height, uint8_t const* pixels, uint32_t rowPitch)
+{
+    if (!m_drawing)
+    {
+        throw std::logic_error("WritePixels called outside of BeginDraw/EndDraw");
+    }
+    CheckDevice();
+    if (atlasPosition.X < m_drawRect.X || atlasPosition.Y < m_drawRect.Y ||
+        atlasPosition.X + width > m_drawRect.X + m_drawRect.Width ||
+        atlasPosition.Y + height > m_drawRect.Y + m_drawRect.Height)
+    {
+        throw std::out_of_range("Write is outside of the area being drawn");
+    }
+
+    auto rowBytes = static_cast<size_t>(width) * m_bytesPerPixel;
+    auto stride = AtlasStride();
+    for (uint32_t y = 0; y < height; y++)
+    {
+        auto destination = m_atlas.data() + static_cast<size_t>(atlasPosition.Y + y) * stride + static_cast<size_t>(atlasPosition.X) * m_bytesPerPixel;
+        std::memcpy(destination, pixels + static_cast<size_t>(y) * rowPitch, rowBytes);
+    }
+    m_bytesWritten += rowBytes * height;
+    m_writeCount++;
+}
+
+void SoftwareSurfaceBackend::CopyPixels(SurfacePoint atlasPosition, UploadAllocation const& source)
+{
+    auto page = dynamic_cast<CpuUploadPage const*>(source.Page);
+    if (page == nullptr)
+    {
+        throw std::invalid_argument("Software surfaces can only copy from CpuUploadPages");
+    }
+    // A staging texture can't be copied from while it's mapped.
+    if (page->IsMapped())
+    {
+        throw std::logic_error("Upload page is still mapped");
+    }
+    auto pixels = page->Data() + static_cast<size_t>(source.Y) * page->RowPitch() + static_cast<size_t>(source.X) * m_bytesPerPixel;
+    WritePixels(atlasPosition, source.Width, source.Height, pixels, page->RowPitch());
+    m_copyCount++;
+}
+
+void SoftwareSurfaceBackend::EndDraw()
+{
+    if (!m_drawing)
+    {
+        throw std::logic_error("EndDraw called without BeginDraw");
+    }
+    m_drawing = false;
+    CheckDevice();
+}
+
+void SoftwareSurfaceBackend::Trim(SurfaceRect const& rect)
+{
+    if (rect.X < 0 || rect.Y < 0 || rect.X + rect.Width > m_width || rect.Y + rect.Height > m_height)
+    {
+        throw std::out_of_range("Trim rect is outside of the surface");
+    }
+    // Zero the memory so that reading trimmed pixels is obvious.
+    auto rowBytes = static_cast<size_t>(rect.Width) * m_bytesPerPixel;
+    auto stride = AtlasStride();
+    for (uint32_t y = 0; y < rect.Height; y++)
+    {
+        auto destination = m_atlas.data() + static_cast<size_t>(m_offset.Y + rect.Y + y) * stride + static_cast<size_t>(m_offset.X + rect.X) * m_bytesPerPixel;
+        std::memset(destination, 0, rowBytes);
+    }
+    m_bytesTrimmed += rowBytes * rect.Height;
+}
+
+void SoftwareSurfaceBackend::SetDeviceLost(bool lost)
+{
+    if (lost && !m_deviceLost)
+    {
+        std::fill(m_atlas.begin(), m_atlas.end(), static_cast<uint8_t>(0));
+    }
+    m_deviceLost = lost;
+}
+
+void SoftwareSurfaceBackend::CheckDevice() const
+{
+    if (m_deviceLost)
+    {
+        throw DeviceLostError();
+    }
+}
+
+std::vector<uint8_t> SoftwareSurfaceBackend::ReadPixels() const
+{
+    auto rowBytes = static_cast<size_t>(m_width) * m_bytesPerPixel;
+    std::vector<uint8_t> result(rowBytes * m_height);
+    auto stride = AtlasStride();
+    for (uint32_t y = 0; y < m_height; y++)
+    {
+        auto source = m_atlas.data() + static_cast<size_t>(m_offset.Y + y) * stride + static_cast<size_t>(m_offset.X) * m_bytesPerPixel;
+        std::memcpy(result.data() + y * rowBytes, source, rowBytes);
+    }
+    return result;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "SurfaceBackend.h"
+
+// A SurfaceBackend that keeps its atlas in system memory. It checks the same
+// rules the real thing does (no writes outside of BeginDraw/EndDraw or outside
+// the area being drawn) and counts the traffic, so the upload path can be
+// exercised without a GPU. SoftwareRenderDevice can also take the surface's
+// device away, after which it behaves like a surface on a lost device.
+class SoftwareSurfaceBackend : public SurfaceBackend
+{
+public:
+    SoftwareSurfaceBackend(SurfaceFormat format = SurfaceFormat::B8G8R8A8, SurfacePoint atlasOffset = { 16, 16 });
+
+    uint32_t Width() const override { return m_width; }
+    uint32_t Height() const override { return m_height; }
+    SurfaceFormat Format() const override { return m_format; }
+
+    void Resize(uint32_t width, uint32_t height) override;
+    SurfacePoint BeginDraw(SurfaceRect const* updateRect) override;
+    void WritePixels(SurfacePoint atlasPosition, uint32_t width, uint32_t height, uint8_t const* pixels, uint32_t rowPitch) override;
+    void CopyPixels(SurfacePoint atlasPosition, UploadAllocation const& source) override;
+    void EndDraw() override;
+    void Trim(SurfaceRect const& rect) override;
+
+    // Copies the surface's pixels out of the atlas, tightly packed.
+    std::vector<uint8_t> ReadPixels() const;
+
+    uint64_t BytesWritten() const { return m_bytesWritten; }
+    uint64_t WriteCount() const { return m_writeCount; }
+    // Writes that came from an upload page. They're in WriteCount too.
+    uint64_t CopyCount() const { return m_copyCount; }
+    uint64_t DrawCount() const { return m_drawCount; }
+    uint64_t BytesTrimmed() const { return m_bytesTrimmed; }
+
+    // Drops the contents of the surface. Until SetDeviceLost(false) is called,
+    // anything that needs the device throws DeviceLostError.
+    void SetDeviceLost(bool lost);
+    bool IsDeviceLost() const { return m_deviceLost; }
+
+private:
+    uint32_t AtlasStride() const { return (m_offset.X + m_width) * m_bytesPerPixel; }
+
+    void CheckDevice() const;
+
+    SurfaceFormat m_format = SurfaceFormat::B8G8R8A8;
+    uint32_t m_bytesPerPixel = 0;
+    SurfacePoint m_offset;
+    uint32_t m_width = 1;
+    uint32_t m_height = 1;
+    std::vector<uint8_t> m_atlas;
+
+    bool m_drawing = false;
+    bool m_deviceLost = false;
+    SurfaceRect m_drawRect;
+
+    uint64_t m_bytesWritten = 0;
+    uint64_t m_writeCount = 0;
+    uint64_t m_copyCount = 0;
+    uint64_t m_drawCount = 0;
+    uint64_t m_bytesTrimmed = 0;
+};
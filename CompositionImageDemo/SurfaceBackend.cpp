@@ -0,0 +1,64 @@
+#include "pch.h"
+#include "SurfaceBackend.h"
+
+uint32_t BytesPerPixel(SurfaceFormat format)
+{
+    switch (format)
+    {
+    case SurfaceFormat::B8G8R8A8:
+        return 4;
+    case SurfaceFormat::B5G6R5:
+    case SurfaceFormat::B4G4R4A4:
+        return 2;
+    }
+    throw std::invalid_argument("Unknown surface format");
+}
+
+void UploadImage(SurfaceBackend& surface, uint8_t const* pixels, uint32_t rowPitch, uint32_t width, uint32_t height)
+{
+    // Make sure our surface is the correct size for our image.
+    if (surface.Width() != width || surface.Height() != height)
+    {
+        surface.Resize(width, height);
+    }
+
+    auto offset = surface.BeginDraw(nullptr);
+    // Make sure that EndDraw gets called even if the write fails.
+    try
+    {
+        surface.WritePixels(offset, width, height, pixels, rowPitch);
+    }
+    catch (...)
+    {
+        surface.EndDraw();
+        throw;
+    }
+    surface.EndDraw();
+}
+
+void UploadRegion(SurfaceBackend& surface, SurfaceRect const& rect, uint8_t const* pixels, uint32_t rowPitch)
+{
+    // The offset we get back is where the top-left corner of the rect lives
+    // in the atlas, not the top-left corner of the surface.
+    auto offset = surface.BeginDraw(&rect);
+    try
+    {
+        surface.WritePixels(offset, rect.Width, rect.Height, pixels, rowPitch);
+    }
+    catch (...)
+    {
+        surface.EndDraw();
+        throw;
+    }
+    surface.EndDraw();
+}
+
+void UploadImage(SurfaceBackend& surface, PixelBuffer const& image)
+{
+    UploadImage(surface, image.Bytes.data(), image.Stride(), image.Width, image.Height);
+}
+
+void UploadImage(SurfaceBackend& surface, PackedPixelBuffer const& image)
+{
+    UploadImage(surface, reinterpret_cast<uint8_t const*>(image.Pixels.data()), image.Stride(), image.Width, image.Height);
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "PixelBuffer.h"
+#include "PixelFormatConversion.h"
+
+// The pixel formats a surface can have. These match the DirectXPixelFormat
+// values the sample creates surfaces with.
+enum class SurfaceFormat
+{
+    B8G8R8A8,
+    B5G6R5,
+    B4G4R4A4,
+};
+
+uint32_t BytesPerPixel(SurfaceFormat format);
+
+// Thrown by surfaces whose device has been lost. Their contents are gone, and
+// they need to be drawn again once the device has been replaced.
+class DeviceLostError : public std::runtime_error
+{
+public:
+    DeviceLostError() : std::runtime_error("The rendering device was lost") {}
+};
+
+struct SurfacePoint
+{
+    int32_t X = 0;
+    int32_t Y = 0;
+};
+
+struct UploadAllocation;
+
+struct SurfaceRect
+{
+    int32_t X = 0;
+    int32_t Y = 0;
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+};
+
+// The drawing surface operations the load pipeline needs. CompositionSurfaceBackend
+// implements them on top of a CompositionDrawingSurface, and SoftwareSurfaceBackend
+// models a surface in plain memory so the same code can run (and be checked)
+// without a GPU.
+//
+// Just like with ICompositionDrawingSurfaceInterop, a surface is a piece of a
+// larger atlas. BeginDraw returns the position in the atlas of the top-left
+// corner of the area being drawn, and WritePixels takes atlas positions.
+class SurfaceBackend
+{
+public:
+    virtual ~SurfaceBackend() = default;
+
+    virtual uint32_t Width() const = 0;
+    virtual uint32_t Height() const = 0;
+    virtual SurfaceFormat Format() const = 0;
+    uint32_t BytesPerPixel() const { return ::BytesPerPixel(Format()); }
+
+    virtual void Resize(uint32_t width, uint32_t height) = 0;
+    // Passing nullptr draws to the whole surface.
+    virtual SurfacePoint BeginDraw(SurfaceRect const* updateRect) = 0;
+    // Copies rows of pixels into the atlas. Only valid between BeginDraw and
+    // EndDraw, and only inside the area being drawn.
+    virtual void WritePixels(SurfacePoint atlasPosition, uint32_t width, uint32_t height, uint8_t const* pixels, uint32_t rowPitch) = 0;
+    // Same as WritePixels, but copies a block of an upload page that has been
+    // unmapped (see UploadRing). The page has to come from the surface's
+    // device, a page from a lost device throws DeviceLostError.
+    virtual void CopyPixels(SurfacePoint atlasPosition, UploadAllocation const& source) = 0;
+    virtual void EndDraw() = 0;
+    // Tells the surface it can let go of the memory behind part of it. Only
+    // virtual surfaces do anything with this, the contents of the rect are
+    // undefined afterwards.
+    virtual void Trim(SurfaceRect const& rect) = 0;
+};
+
+// Resizes the surface to fit the image and writes the rows straight into the
+// surface's atlas. There is no intermediate texture and no extra GPU copy.
+void UploadImage(SurfaceBackend& surface, uint8_t const* pixels, uint32_t rowPitch, uint32_t width, uint32_t height);
+void UploadImage(SurfaceBackend& surface, PixelBuffer const& image);
+void UploadImage(SurfaceBackend& surface, PackedPixelBuffer const& image);
+// Draws to one rect of the surface, which must already be big enough. The
+// pixels are the contents of the rect.
+void UploadRegion(SurfaceBackend& surface, SurfaceRect const& rect, uint8_t const* pixels, uint32_t rowPitch);
@@ -0,0 +1,143 @@
+#include "pch.h"
+#include "SurfacePool.h"
+
+SurfacePool::SurfacePool(std::shared_ptr<RenderDevice> device, SurfacePoolOptions const& options)
+{
+    if (!device)
+    {
+        throw std::invalid_argument("A surface pool needs a device");
+    }
+    if (options.MinimumSize == 0)
+    {
+        throw std::invalid_argument("Minimum size must be non-zero");
+    }
+    m_device = std::move(device);
+    m_options = options;
+}
+
+uint32_t SurfacePool::SizeClass(uint32_t size) const
+{
+    uint64_t sizeClass = m_options.MinimumSize;
+    while (sizeClass < size)
+    {
+        if (m_options.Classing == SizeClassing::PowerOfTwo)
+        {
+            sizeClass *= 2;
+        }
+        else
+        {
+            // Keep the classes a multiple of 4 so they stay on nice boundaries.
+            sizeClass = ((sizeClass * 5 / 4) + 3) & ~static_cast<uint64_t>(3);
+        }
+    }
+    return static_cast<uint32_t>(std::min<uint64_t>(sizeClass, std::numeric_limits<uint32_t>::max()));
+}
+
+PooledSurface SurfacePool::Acquire(SurfaceFormat format, uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0)
+    {
+        throw std::invalid_argument("Surface size must be non-zero");
+    }
+    ClassKey key = { format, SizeClass(width), SizeClass(height) };
+    auto classPixels = static_cast<uint64_t>(key.Width) * key.Height;
+
+    PooledSurface result;
+    result.Width = width;
+    result.Height = height;
+    {
+        std::lock_guard lock(m_lock);
+        m_stats.Acquires++;
+        m_stats.PixelsRequested += static_cast<uint64_t>(width) * height;
+        m_stats.PixelsAllocated += classPixels;
+        auto found = m_idle.find(key);
+        if (found != m_idle.end() && !found->second.empty())
+        {
+            result.Surface = std::move(found->second.back().Surface);
+            found->second.pop_back();
+            m_idlePixels -= classPixels;
+            m_idleCount--;
+            m_stats.Hits++;
+            return result;
+        }
+        m_stats.SurfacesCreated++;
+    }
+
+    // Creating the surface doesn't need the lock.
+    result.Surface = m_device->CreateSurface(format);
+    result.Surface->Resize(key.Width, key.Height);
+    return result;
+}
+
+void SurfacePool::Release(PooledSurface surface)
+{
+    if (!surface.Surface)
+    {
+        return;
+    }
+    ClassKey key = { surface.Surface->Format(), surface.Surface->Width(), surface.Surface->Height() };
+    if (key.Width != SizeClass(surface.Width) || key.Height != SizeClass(surface.Height))
+    {
+        throw std::invalid_argument("Surface doesn't belong to this pool");
+    }
+
+    std::lock_guard lock(m_lock);
+    m_idle[key].push_back({ std::move(surface.Surface), m_releaseCount++ });
+    m_idlePixels += static_cast<uint64_t>(key.Width) * key.Height;
+    m_idleCount++;
+    m_stats.SurfacesReleased++;
+    TrimLocked(m_options.MaxIdlePixels);
+}
+
+size_t SurfacePool::Trim(uint64_t maxIdlePixels)
+{
+    std::lock_guard lock(m_lock);
+    return TrimLocked(maxIdlePixels);
+}
+
+size_t SurfacePool::TrimLocked(uint64_t maxIdlePixels)
+{
+    size_t trimmed = 0;
+    while (m_idlePixels > maxIdlePixels)
+    {
+        // Each class's list is in release order, so the oldest in the pool is
+        // at the front of one of them.
+        auto oldest = m_idle.end();
+        for (auto it = m_idle.begin(); it != m_idle.end(); it++)
+        {
+            if (!it->second.empty() && (oldest == m_idle.end() || it->second.front().ReleasedAt < oldest->second.front().ReleasedAt))
+            {
+                oldest = it;
+            }
+        }
+        auto& surfaces = oldest->second;
+        surfaces.erase(surfaces.begin());
+        m_idlePixels -= static_cast<uint64_t>(oldest->first.Width) * oldest->first.Height;
+        m_idleCount--;
+        if (surfaces.empty())
+        {
+            m_idle.erase(oldest);
+        }
+        trimmed++;
+    }
+    m_stats.SurfacesTrimmed += trimmed;
+    return trimmed;
+}
+
+uint64_t SurfacePool::IdlePixels()
+{
+    std::lock_guard lock(m_lock);
+    return m_idlePixels;
+}
+
+size_t SurfacePool::IdleSurfaces()
+{
+    std::lock_guard lock(m_lock);
+    return m_idleCount;
+}
+
+SurfacePoolStats SurfacePool::Stats()
+{
+    std::lock_guard lock(m_lock);
+    return m_stats;
+}
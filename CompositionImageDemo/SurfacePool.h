@@ -0,0 +1,104 @@
+#pragma once
+#include "RenderDevice.h"
+
+//  PowerOfTwo - Fewest classes, so the best reuse, but up to 3/4 of a surface
+//               can be padding.
+//  Step125    - Each class is 1.25x the one before it. More classes, but at
+//               most about a third of a surface is padding.
+enum class SizeClassing
+{
+    PowerOfTwo,
+    Step125,
+};
+
+struct SurfacePoolOptions
+{
+    SizeClassing Classing = SizeClassing::Step125;
+    // The smallest class. Anything smaller gets a surface this size.
+    uint32_t MinimumSize = 64;
+    // Idle surfaces are kept until they add up to this many pixels, after which
+    // the ones that have been idle longest are let go.
+    uint64_t MaxIdlePixels = 32 * 1024 * 1024;
+};
+
+struct SurfacePoolStats
+{
+    uint64_t Acquires = 0;
+    uint64_t Hits = 0;
+    uint64_t SurfacesCreated = 0;
+    uint64_t SurfacesReleased = 0;
+    uint64_t SurfacesTrimmed = 0;
+    // Over every acquire: the pixels asked for, and the pixels handed out.
+    uint64_t PixelsRequested = 0;
+    uint64_t PixelsAllocated = 0;
+
+    double HitRate() const { return Acquires > 0 ? static_cast<double>(Hits) / Acquires : 0.0; }
+    // The fraction of handed out pixels that were padding.
+    double WastedPixelRatio() const { return PixelsAllocated > 0 ? 1.0 - static_cast<double>(PixelsRequested) / PixelsAllocated : 0.0; }
+};
+
+// A surface from the pool. The surface is the size of its class, and the image
+// goes in the top-left Width x Height pixels of it. Whatever shows the surface
+// needs to crop it to that, rather than the surface being resized.
+struct PooledSurface
+{
+    std::shared_ptr<SurfaceBackend> Surface;
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+};
+
+// Hands out surfaces bucketed by size class, so loading an image can reuse a
+// surface some other image was done with instead of resizing one (which
+// reallocates its space in the atlas). Each dimension is rounded up to its
+// class on its own. Released surfaces are reused most recently released first.
+class SurfacePool
+{
+public:
+    SurfacePool(std::shared_ptr<RenderDevice> device, SurfacePoolOptions const& options = {});
+
+    PooledSurface Acquire(SurfaceFormat format, uint32_t width, uint32_t height);
+    // The surface's contents are left as they are, so they shouldn't be shown
+    // until something new has been uploaded.
+    void Release(PooledSurface surface);
+    // Lets go of idle surfaces, longest idle first, until no more than
+    // maxIdlePixels are left. Call with 0 when memory is tight. Returns the
+    // number of surfaces let go.
+    size_t Trim(uint64_t maxIdlePixels = 0);
+
+    uint64_t IdlePixels();
+    size_t IdleSurfaces();
+    SurfacePoolStats Stats();
+
+    uint32_t SizeClass(uint32_t size) const;
+
+private:
+    struct ClassKey
+    {
+        SurfaceFormat Format;
+        uint32_t Width;
+        uint32_t Height;
+
+        bool operator<(ClassKey const& other) const
+        {
+            return std::tie(Format, Width, Height) < std::tie(other.Format, other.Width, other.Height);
+        }
+    };
+
+    struct IdleSurface
+    {
+        std::shared_ptr<SurfaceBackend> Surface;
+        uint64_t ReleasedAt;
+    };
+
+    size_t TrimLocked(uint64_t maxIdlePixels);
+
+    std::shared_ptr<RenderDevice> m_device;
+    SurfacePoolOptions m_options;
+
+    std::mutex m_lock;
+    std::map<ClassKey, std::vector<IdleSurface>> m_idle;
+    uint64_t m_idlePixels = 0;
+    size_t m_idleCount = 0;
+    uint64_t m_releaseCount = 0;
+    SurfacePoolStats m_stats;
+};
@@ -0,0 +1,211 @@
+#include "pch.h"
+#include "TileManager.h"
+
+TileManager::TileManager(uint32_t imageWidth, uint32_t imageHeight, uint32_t tileSize, uint32_t maxResidentTiles)
+{
+    if (imageWidth == 0 || imageHeight == 0 || tileSize == 0)
+    {
+        throw std::invalid_argument("Image and tile sizes must be non-zero");
+    }
+    m_imageWidth = imageWidth;
+    m_imageHeight = imageHeight;
+    m_tileSize = tileSize;
+    m_maxResidentTiles = maxResidentTiles;
+    m_columns = (imageWidth + tileSize - 1) / tileSize;
+    m_rows = (imageHeight + tileSize - 1) / tileSize;
+    m_tiles.resize(static_cast<size_t>(m_columns) * m_rows);
+}
+
+SurfaceRect TileManager::TileRect(TileCoord tile) const
+{
+    CheckTile(tile);
+    auto x = tile.Column * m_tileSize;
+    auto y = tile.Row * m_tileSize;
+    return
+    {
+        static_cast<int32_t>(x),
+        static_cast<int32_t>(y),
+        std::min(m_tileSize, m_imageWidth - x),
+        std::min(m_tileSize, m_imageHeight - y),
+    };
+}
+
+void TileManager::SetViewport(SurfaceRect const& viewport)
+{
+    m_stats.ViewportChanges++;
+    m_generation++;
+
+    auto left = std::clamp<int64_t>(viewport.X, 0, m_imageWidth);
+    auto top = std::clamp<int64_t>(viewport.Y, 0, m_imageHeight);
+    auto right = std::clamp<int64_t>(viewport.X + static_cast<int64_t>(viewport.Width), 0, m_imageWidth);
+    auto bottom = std::clamp<int64_t>(viewport.Y + static_cast<int64_t>(viewport.Height), 0, m_imageHeight);
+    m_hasViewport = right > left && bottom > top;
+    if (m_hasViewport)
+    {
+        m_firstColumn = static_cast<uint32_t>(left / m_tileSize);
+        m_lastColumn = static_cast<uint32_t>((right - 1) / m_tileSize);
+        m_firstRow = static_cast<uint32_t>(top / m_tileSize);
+        m_lastRow = static_cast<uint32_t>((bottom - 1) / m_tileSize);
+    }
+
+    // Anything queued that scrolled out of view isn't worth loading anymore.
+    for (auto index : m_queue)
+    {
+        if (!IsVisible(index))
+        {
+            m_tiles[index].State = TileState::Empty;
+            m_stats.LoadsCancelled++;
+        }
+    }
+    m_queue.clear();
+    if (!m_hasViewport)
+    {
+        return;
+    }
+
+    std::vector<uint32_t> wanted;
+    for (auto row = m_firstRow; row <= m_lastRow; row++)
+    {
+        for (auto column = m_firstColumn; column <= m_lastColumn; column++)
+        {
+            auto index = Index({ column, row });
+            auto& info = m_tiles[index];
+            info.LastVisible = m_generation;
+            if (info.State == TileState::Empty || info.State == TileState::Queued)
+            {
+                info.State = TileState::Queued;
+                wanted.push_back(index);
+            }
+        }
+    }
+
+    // Fill in from the middle of the viewport outwards, that's where people look.
+    // Distances are doubled so we can stay in integers.
+    auto centerX = left + right;
+    auto centerY = top + bottom;
+    auto distance = [&](uint32_t index)
+    {
+        auto rect = TileRect(Coord(index));
+        auto dx = (2 * static_cast<int64_t>(rect.X) + rect.Width) - centerX;
+        auto dy = (2 * static_cast<int64_t>(rect.Y) + rect.Height) - centerY;
+        return dx * dx + dy * dy;
+    };
+    std::stable_sort(wanted.begin(), wanted.end(), [&](uint32_t first, uint32_t second)
+        {
+            return distance(first) < distance(second);
+        });
+    m_queue.assign(wanted.begin(), wanted.end());
+}
+
+std::vector<TileCoord> TileManager::VisibleTiles() const
+{
+    std::vector<TileCoord> result;
+    if (m_hasViewport)
+    {
+        for (auto row = m_firstRow; row <= m_lastRow; row++)
+        {
+            for (auto column = m_firstColumn; column <= m_lastColumn; column++)
+            {
+                result.push_back({ column, row });
+            }
+        }
+    }
+    return result;
+}
+
+std::optional<TileCoord> TileManager::NextTileToLoad()
+{
+    if (m_queue.empty())
+    {
+        return std::nullopt;
+    }
+    auto index = m_queue.front();
+    m_queue.pop_front();
+    m_tiles[index].State = TileState::Loading;
+    return Coord(index);
+}
+
+std::vector<TileCoord> TileManager::TileLoaded(TileCoord tile)
+{
+    CheckTile(tile);
+    auto index = Index(tile);
+    auto& info = m_tiles[index];
+    if (info.State != TileState::Loading)
+    {
+        throw std::logic_error("Tile wasn't loading");
+    }
+    info.State = TileState::Resident;
+    m_resident.push_back(index);
+    m_stats.TilesLoaded++;
+
+    std::vector<TileCoord> evicted;
+    while (m_resident.size() > m_maxResidentTiles)
+    {
+        // Least recently visible first. The resident list is small (it's
+        // bounded by the budget), so a linear scan is fine.
+        auto victim = m_resident.end();
+        for (auto it = m_resident.begin(); it != m_resident.end(); it++)
+        {
+            if (IsVisible(*it))
+            {
+                continue;
+            }
+            if (victim == m_resident.end() || m_tiles[*it].LastVisible < m_tiles[*victim].LastVisible)
+            {
+                victim = it;
+            }
+        }
+        if (victim == m_resident.end())
+        {
+            // Everything resident is on screen.
+            break;
+        }
+        m_tiles[*victim].State = TileState::Empty;
+        evicted.push_back(Coord(*victim));
+        m_resident.erase(victim);
+        m_stats.TilesEvicted++;
+    }
+    return evicted;
+}
+
+void TileManager::TileFailed(TileCoord tile)
+{
+    CheckTile(tile);
+    auto index = Index(tile);
+    auto& info = m_tiles[index];
+    if (info.State != TileState::Loading)
+    {
+        throw std::logic_error("Tile wasn't loading");
+    }
+    if (IsVisible(index))
+    {
+        info.State = TileState::Queued;
+        m_queue.push_back(index);
+    }
+    else
+    {
+        info.State = TileState::Empty;
+    }
+}
+
+bool TileManager::IsResident(TileCoord tile) const
+{
+    CheckTile(tile);
+    return m_tiles[Index(tile)].State == TileState::Resident;
+}
+
+bool TileManager::IsVisible(uint32_t index) const
+{
+    auto tile = Coord(index);
+    return m_hasViewport &&
+        tile.Column >= m_firstColumn && tile.Column <= m_lastColumn &&
+        tile.Row >= m_firstRow && tile.Row <= m_lastRow;
+}
+
+void TileManager::CheckTile(TileCoord tile) const
+{
+    if (tile.Column >= m_columns || tile.Row >= m_rows)
+    {
+        throw std::out_of_range("Tile is outside of the image");
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "SurfaceBackend.h"
+
+struct TileCoord
+{
+    uint32_t Column = 0;
+    uint32_t Row = 0;
+
+    bool operator==(TileCoord const& other) const { return Column == other.Column && Row == other.Row; }
+    bool operator!=(TileCoord const& other) const { return !(*this == other); }
+};
+
+struct TileManagerStats
+{
+    uint64_t ViewportChanges = 0;
+    uint64_t TilesLoaded = 0;
+    uint64_t TilesEvicted = 0;
+    // Tiles that were queued but scrolled out of view before they were loaded.
+    uint64_t LoadsCancelled = 0;
+};
+
+// Splits an image that is too big for a single texture into fixed-size tiles
+// and decides which of them should be resident. It doesn't touch any pixels,
+// the caller decodes and uploads the tiles it hands out and trims the ones it
+// evicts. That keeps it independent of the surface it's used with.
+//
+// Visible tiles are loaded closest to the middle of the viewport first. Once
+// there are more than maxResidentTiles resident, the tiles that have gone the
+// longest without being visible are evicted. Visible tiles are never evicted,
+// even if that means going over budget.
+class TileManager
+{
+public:
+    TileManager(uint32_t imageWidth, uint32_t imageHeight, uint32_t tileSize = 512, uint32_t maxResidentTiles = 64);
+
+    uint32_t Columns() const { return m_columns; }
+    uint32_t Rows() const { return m_rows; }
+    uint32_t TileSize() const { return m_tileSize; }
+    // The part of the image a tile covers. Tiles on the right and bottom edges
+    // may be smaller than the tile size.
+    SurfaceRect TileRect(TileCoord tile) const;
+
+    // The viewport is in image coordinates. Queues any visible tiles that
+    // aren't resident, and drops queued tiles that are no longer visible.
+    void SetViewport(SurfaceRect const& viewport);
+    std::vector<TileCoord> VisibleTiles() const;
+
+    // Returns the next tile the caller should decode and upload, or
+    // std::nullopt if everything visible is resident or already loading.
+    std::optional<TileCoord> NextTileToLoad();
+    // Marks the tile as resident and returns the tiles that should be evicted
+    // to stay within budget.
+    std::vector<TileCoord> TileLoaded(TileCoord tile);
+    // For when a load fails. The tile is queued again if it's still visible.
+    void TileFailed(TileCoord tile);
+
+    bool IsResident(TileCoord tile) const;
+    size_t ResidentCount() const { return m_resident.size(); }
+    size_t QueuedCount() const { return m_queue.size(); }
+    TileManagerStats const& Stats() const { return m_stats; }
+
+private:
+    enum class TileState : uint8_t
+    {
+        Empty,
+        Queued,
+        Loading,
+        Resident,
+    };
+
+    struct TileInfo
+    {
+        TileState State = TileState::Empty;
+        // The viewport generation the tile was last visible in.
+        uint64_t LastVisible = 0;
+    };
+
+    uint32_t Index(TileCoord tile) const { return tile.Row * m_columns + tile.Column; }
+    TileCoord Coord(uint32_t index) const { return { index % m_columns, index / m_columns }; }
+    bool IsVisible(uint32_t index) const;
+    void CheckTile(TileCoord tile) const;
+
+    uint32_t m_imageWidth = 0;
+    uint32_t m_imageHeight = 0;
+    uint32_t m_tileSize = 0;
+    uint32_t m_maxResidentTiles = 0;
+    uint32_t m_columns = 0;
+    uint32_t m_rows = 0;
+    std::vector<TileInfo> m_tiles;
+
+    // Visible tiles, as a range of columns and rows. Empty until the first viewport is set.
+    uint32_t m_firstColumn = 0;
+    uint32_t m_lastColumn = 0;
+    uint32_t m_firstRow = 0;
+    uint32_t m_lastRow = 0;
+    bool m_hasViewport = false;
+    uint64_t m_generation = 0;
+
+    // Indices, in the order they should be loaded.
+    std::deque<uint32_t> m_queue;
+    std::vector<uint32_t> m_resident;
+    TileManagerStats m_stats;
+};
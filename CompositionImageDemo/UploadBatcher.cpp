@@ -0,0 +1,401 @@
+#include "pch.h"
+#include "UploadBatcher.h"
+
+namespace
+{
+    uint64_t Area(SurfaceRect const& rect)
+    {
+        return static_cast<uint64_t>(rect.Width) * rect.Height;
+    }
+
+    bool Intersects(SurfaceRect const& first, SurfaceRect const& second)
+    {
+        return first.X < second.X + static_cast<int64_t>(second.Width) && second.X < first.X + static_cast<int64_t>(first.Width) &&
+            first.Y < second.Y + static_cast<int64_t>(second.Height) && second.Y < first.Y + static_cast<int64_t>(first.Height);
+    }
+}
+
+UploadBatcher::UploadBatcher(
+    UploadBatcherOptions const& options,
+    ScheduleFlushHandler scheduleFlush,
+    BatchHandler beginBatch,
+    BatchHandler endBatch)
+{
+    if (!scheduleFlush)
+    {
+        throw std::invalid_argument("An upload batcher needs a way to schedule flushes");
+    }
+    m_options = options;
+    m_scheduleFlush = std::move(scheduleFlush);
+    m_beginBatch = std::move(beginBatch);
+    m_endBatch = std::move(endBatch);
+}
+
+void UploadBatcher::Enqueue(
+    std::shared_ptr<SurfaceBackend> const& surface,
+    std::optional<SurfaceRect> const& rect,
+    uint8_t const* pixels,
+    uint32_t rowPitch,
+    uint32_t width,
+    uint32_t height,
+    std::function<void()> onUploaded)
+{
+    // The copy is made before taking the lock, which is only held to add the
+    // upload to the batch. Other threads can queue their own uploads meanwhile.
+    auto packedPitch = width * surface->BytesPerPixel();
+    auto copy = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(packedPitch) * height);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        std::memcpy(copy->data() + static_cast<size_t>(y) * packedPitch, pixels + static_cast<size_t>(y) * rowPitch, packedPitch);
+    }
+    auto data = copy->data();
+    Enqueue(surface, rect, std::move(copy), data, packedPitch, width, height, std::move(onUploaded));
+}
+
+void UploadBatcher::Enqueue(
+    std::shared_ptr<SurfaceBackend> const& surface,
+    std::optional<SurfaceRect> const& rect,
+    std::shared_ptr<void const> owner,
+    uint8_t const* pixels,
+    uint32_t rowPitch,
+    uint32_t width,
+    uint32_t height,
+    std::function<void()> onUploaded)
+{
+    if (rect && (rect->Width != width || rect->Height != height))
+    {
+        throw std::invalid_argument("Pixels don't match the size of the rect");
+    }
+
+    PendingUpload upload;
+    upload.Surface = surface;
+    upload.Rect = rect;
+    upload.Width = width;
+    upload.Height = height;
+    upload.RowPitch = rowPitch;
+    upload.Owner = std::move(owner);
+    upload.Pixels = pixels;
+    upload.OnUploaded = std::move(onUploaded);
+    auto size = static_cast<uint64_t>(width) * surface->BytesPerPixel() * height;
+
+    std::optional<std::chrono::milliseconds> scheduleDelay;
+    {
+        std::lock_guard lock(m_lock);
+        if (m_pending.empty())
+        {
+            m_batchStart = std::chrono::steady_clock::now();
+            scheduleDelay = m_options.MaxLatency;
+        }
+        m_pending.push_back(std::move(upload));
+        m_pendingBytes += size;
+        if (!m_sizeFlushRequested && (m_pendingBytes >= m_options.MaxBatchBytes || m_pending.size() >= m_options.MaxBatchUploads))
+        {
+            m_sizeFlushRequested = true;
+            m_stats.SizeFlushes++;
+            scheduleDelay = std::chrono::milliseconds(0);
+        }
+    }
+
+    if (scheduleDelay)
+    {
+        m_scheduleFlush(*scheduleDelay);
+    }
+}
+
+void UploadBatcher::Enqueue(std::shared_ptr<SurfaceBackend> const& surface, PixelBuffer const& image, std::function<void()> onUploaded)
+{
+    Enqueue(surface, std::nullopt, image.Bytes.data(), image.Stride(), image.Width, image.Height, std::move(onUploaded));
+}
+
+void UploadBatcher::Enqueue(std::shared_ptr<SurfaceBackend> const& surface, PackedPixelBuffer const& image, std::function<void()> onUploaded)
+{
+    Enqueue(surface, std::nullopt, reinterpret_cast<uint8_t const*>(image.Pixels.data()), image.Stride(), image.Width, image.Height, std::move(onUploaded));
+}
+
+size_t UploadBatcher::Flush()
+{
+    // Take the batch and write it without holding the lock, so other threads
+    // can keep queueing uploads for the next one while we write.
+    std::vector<PendingUpload> batch;
+    uint64_t bytes = 0;
+    std::chrono::steady_clock::time_point batchStart;
+    std::vector<std::shared_ptr<UploadRing>> uploadRings;
+    {
+        std::lock_guard lock(m_lock);
+        if (m_pending.empty())
+        {
+            return 0;
+        }
+        uploadRings = m_uploadRings;
+        batch = std::move(m_pending);
+        m_pending.clear();
+        bytes = m_pendingBytes;
+        m_pendingBytes = 0;
+        m_sizeFlushRequested = false;
+        batchStart = m_batchStart;
+    }
+
+    // Group the uploads by surface, keeping the order within each surface.
+    // A whole-surface upload replaces everything queued for that surface
+    // before it.
+    std::vector<SurfaceBackend*> order;
+    std::map<SurfaceBackend*, std::vector<PendingUpload*>> groups;
+    uint64_t superseded = 0;
+    for (auto& upload : batch)
+    {
+        auto& group = groups[upload.Surface.get()];
+        if (group.empty())
+        {
+            order.push_back(upload.Surface.get());
+        }
+        if (!upload.Rect)
+        {
+            superseded += group.size();
+            group.clear();
+        }
+        group.push_back(&upload);
+    }
+
+    // The copies out of the rings have to be issued before the fence is, and
+    // that has to happen inside the batch, so it goes out with it.
+    auto submitRings = [&]()
+    {
+        for (auto& ring : uploadRings)
+        {
+            ring->Submit();
+        }
+    };
+
+    uint64_t draws = 0;
+    if (m_beginBatch)
+    {
+        m_beginBatch();
+    }
+    try
+    {
+        if (!uploadRings.empty())
+        {
+            for (auto surface : order)
+            {
+                auto ring = std::find_if(uploadRings.begin(), uploadRings.end(), [surface](auto const& candidate) { return candidate->Format() == surface->Format(); });
+                if (ring == uploadRings.end())
+                {
+                    continue;
+                }
+                for (auto upload : groups[surface])
+                {
+                    Stage(*upload, **ring);
+                }
+            }
+            // The pages have to be unmapped before anything can copy out of them.
+            for (auto& ring : uploadRings)
+            {
+                ring->Close();
+            }
+        }
+        for (auto surface : order)
+        {
+            draws += WriteGroup(groups[surface]);
+        }
+    }
+    catch (DeviceLostError const&)
+    {
+        submitRings();
+        if (m_endBatch)
+        {
+            m_endBatch();
+        }
+        // Put the batch back in front of anything queued since, so it's written
+        // (and its callbacks called) once there's a device again. It's staged
+        // again then, in the new device's rings.
+        for (auto& upload : batch)
+        {
+            upload.Staged.clear();
+        }
+        {
+            std::lock_guard lock(m_lock);
+            m_pendingBytes += bytes;
+            m_batchStart = std::min(m_batchStart, batchStart);
+            batch.insert(batch.end(), std::make_move_iterator(m_pending.begin()), std::make_move_iterator(m_pending.end()));
+            m_pending = std::move(batch);
+            m_stats.LostBatches++;
+        }
+        throw;
+    }
+    catch (...)
+    {
+        submitRings();
+        if (m_endBatch)
+        {
+            m_endBatch();
+        }
+        throw;
+    }
+    submitRings();
+    if (m_endBatch)
+    {
+        m_endBatch();
+    }
+
+    auto count = batch.size();
+    {
+        std::lock_guard lock(m_lock);
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - batchStart);
+        m_stats.Batches++;
+        m_stats.Uploads += count;
+        m_stats.BytesUploaded += bytes;
+        m_stats.Draws += draws;
+        m_stats.Superseded += superseded;
+        m_stats.LargestBatch = std::max(m_stats.LargestBatch, static_cast<uint32_t>(count));
+        m_stats.TotalLatency += latency;
+        m_stats.MaxLatency = std::max(m_stats.MaxLatency, latency);
+    }
+
+    // Callbacks run last, so they're free to queue more uploads.
+    for (auto& upload : batch)
+    {
+        if (upload.OnUploaded)
+        {
+            upload.OnUploaded();
+        }
+    }
+    return count;
+}
+
+UploadBatcherStats UploadBatcher::Stats()
+{
+    std::lock_guard lock(m_lock);
+    return m_stats;
+}
+
+void UploadBatcher::SetUploadRings(std::vector<std::shared_ptr<UploadRing>> uploadRings)
+{
+    std::lock_guard lock(m_lock);
+    m_uploadRings = std::move(uploadRings);
+}
+
+void UploadBatcher::Stage(PendingUpload& upload, UploadRing& ring)
+{
+    upload.Staged.clear();
+    auto rowBytes = static_cast<size_t>(upload.Width) * BytesPerPixel(ring.Format());
+    uint32_t row = 0;
+    while (row < upload.Height)
+    {
+        // If the ring runs out part way through, the rest is written from the
+        // upload's own pixels.
+        auto allocation = ring.Allocate(upload.Width, upload.Height - row);
+        if (!allocation)
+        {
+            break;
+        }
+        for (uint32_t y = 0; y < allocation->Height; y++)
+        {
+            std::memcpy(allocation->Data + static_cast<size_t>(y) * allocation->RowPitch, upload.Pixels + static_cast<size_t>(row + y) * upload.RowPitch, rowBytes);
+        }
+        row += allocation->Height;
+        upload.Staged.push_back(*allocation);
+    }
+}
+
+void UploadBatcher::Draw(SurfaceBackend& surface, SurfaceRect const* rect, PendingUpload const& upload)
+{
+    if (rect == nullptr && (surface.Width() != upload.Width || surface.Height() != upload.Height))
+    {
+        surface.Resize(upload.Width, upload.Height);
+    }
+    auto offset = surface.BeginDraw(rect);
+    // Make sure that EndDraw gets called even if the write fails.
+    try
+    {
+        Write(surface, offset, upload);
+    }
+    catch (...)
+    {
+        surface.EndDraw();
+        throw;
+    }
+    surface.EndDraw();
+}
+
+void UploadBatcher::Write(SurfaceBackend& surface, SurfacePoint atlasPosition, PendingUpload const& upload)
+{
+    uint32_t row = 0;
+    for (auto const& band : upload.Staged)
+    {
+        surface.CopyPixels({ atlasPosition.X, atlasPosition.Y + static_cast<int32_t>(row) }, band);
+        row += band.Height;
+    }
+    if (row < upload.Height)
+    {
+        surface.WritePixels({ atlasPosition.X, atlasPosition.Y + static_cast<int32_t>(row) }, upload.Width, upload.Height - row,
+            upload.Pixels + static_cast<size_t>(row) * upload.RowPitch, upload.RowPitch);
+    }
+}
+
+uint64_t UploadBatcher::WriteGroup(std::vector<PendingUpload*> const& group)
+{
+    auto& surface = *group.front()->Surface;
+    uint64_t draws = 0;
+    size_t first = 0;
+    if (!group.front()->Rect)
+    {
+        Draw(surface, nullptr, *group.front());
+        draws++;
+        first = 1;
+    }
+    if (first == group.size())
+    {
+        return draws;
+    }
+
+    // If the rects tile their bounds exactly (like a row of image tiles or a
+    // set of bands), they can all be written inside one BeginDraw. Otherwise
+    // each rect gets its own, since anything in the update rect that we don't
+    // write would be lost.
+    auto bounds = *group[first]->Rect;
+    uint64_t area = 0;
+    auto disjoint = true;
+    for (auto i = first; i < group.size(); i++)
+    {
+        auto const& rect = *group[i]->Rect;
+        auto left = std::min(bounds.X, rect.X);
+        auto top = std::min(bounds.Y, rect.Y);
+        auto right = std::max(bounds.X + static_cast<int64_t>(bounds.Width), rect.X + static_cast<int64_t>(rect.Width));
+        auto bottom = std::max(bounds.Y + static_cast<int64_t>(bounds.Height), rect.Y + static_cast<int64_t>(rect.Height));
+        bounds = { left, top, static_cast<uint32_t>(right - left), static_cast<uint32_t>(bottom - top) };
+        area += Area(rect);
+        for (auto j = first; j < i && disjoint; j++)
+        {
+            disjoint = !Intersects(rect, *group[j]->Rect);
+        }
+    }
+
+    if (disjoint && area == Area(bounds))
+    {
+        auto offset = surface.BeginDraw(&bounds);
+        try
+        {
+            for (auto i = first; i < group.size(); i++)
+            {
+                auto& upload = *group[i];
+                SurfacePoint position = { offset.X + (upload.Rect->X - bounds.X), offset.Y + (upload.Rect->Y - bounds.Y) };
+                Write(surface, position, upload);
+            }
+        }
+        catch (...)
+        {
+            surface.EndDraw();
+            throw;
+        }
+        surface.EndDraw();
+        return draws + 1;
+    }
+
+    for (auto i = first; i < group.size(); i++)
+    {
+        auto& upload = *group[i];
+        Draw(surface, &*upload.Rect, upload);
+        draws++;
+    }
+    return draws;
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include "SurfaceBackend.h"
+#include "UploadRing.h"
+
+struct UploadBatcherOptions
+{
+    // A flush is requested right away once this much is waiting...
+    uint64_t MaxBatchBytes = 32 * 1024 * 1024;
+    // ...or this many uploads.
+    uint32_t MaxBatchUploads = 256;
+    // Otherwise uploads wait at most this long, roughly a frame.
+    std::chrono::milliseconds MaxLatency = std::chrono::milliseconds(16);
+};
+
+struct UploadBatcherStats
+{
+    uint64_t Batches = 0;
+    uint64_t Uploads = 0;
+    uint64_t BytesUploaded = 0;
+    // BeginDraw/EndDraw pairs. Neighbouring rects on the same surface share one.
+    uint64_t Draws = 0;
+    // Whole-surface uploads that were replaced by a later one before they were flushed.
+    uint64_t Superseded = 0;
+    // Batches that were flushed early because they hit a size limit.
+    uint64_t SizeFlushes = 0;
+    // Flushes the device was lost during. Their uploads stay queued.
+    uint64_t LostBatches = 0;
+    uint32_t LargestBatch = 0;
+    // Time from the first upload in a batch being queued to the batch being flushed.
+    std::chrono::microseconds TotalLatency = {};
+    std::chrono::microseconds MaxLatency = {};
+};
+
+// Collects uploads from any thread and writes them to their surfaces together,
+// so a burst of decodes (say, a page of thumbnails) costs one trip to the
+// context rather than one per image. The batcher doesn't flush on its own, it
+// asks for a flush through the ScheduleFlush callback: with the configured
+// latency when a batch starts, and with zero once the batch hits a size limit.
+// Flush should then be called on the thread that owns the surfaces. Neither
+// the copy Enqueue makes nor the writes Flush makes happen under the lock, so
+// queueing never waits for a flush or for another thread's copy.
+//
+// BeginBatch and EndBatch bracket every flush, which is where a context lock
+// can be taken and the context flushed once for the whole batch.
+//
+// With upload rings (one per surface format), Flush first stages the batch's
+// pixels in the ring, then has the surfaces copy them out, and submits the ring
+// before EndBatch. Whatever the ring can't take is written straight from the
+// queued pixels, like it is with no rings at all.
+class UploadBatcher
+{
+public:
+    using ScheduleFlushHandler = std::function<void(std::chrono::milliseconds delay)>;
+    using BatchHandler = std::function<void()>;
+
+    UploadBatcher(
+        UploadBatcherOptions const& options,
+        ScheduleFlushHandler scheduleFlush,
+        BatchHandler beginBatch = nullptr,
+        BatchHandler endBatch = nullptr);
+
+    // Copies the pixels, so the caller's buffer can go away straight after. With
+    // no rect, the surface is resized to the image and the whole thing is
+    // replaced. Otherwise the pixels are the contents of the rect. onUploaded is
+    // called from Flush once the pixels have been written.
+    void Enqueue(
+        std::shared_ptr<SurfaceBackend> const& surface,
+        std::optional<SurfaceRect> const& rect,
+        uint8_t const* pixels,
+        uint32_t rowPitch,
+        uint32_t width,
+        uint32_t height,
+        std::function<void()> onUploaded = nullptr);
+    // Doesn't copy. The upload holds on to 'owner', which has to keep 'pixels'
+    // alive and unchanged until they've been written.
+    void Enqueue(
+        std::shared_ptr<SurfaceBackend> const& surface,
+        std::optional<SurfaceRect> const& rect,
+        std::shared_ptr<void const> owner,
+        uint8_t const* pixels,
+        uint32_t rowPitch,
+        uint32_t width,
+        uint32_t height,
+        std::function<void()> onUploaded = nullptr);
+    void Enqueue(std::shared_ptr<SurfaceBackend> const& surface, PixelBuffer const& image, std::function<void()> onUploaded = nullptr);
+    void Enqueue(std::shared_ptr<SurfaceBackend> const& surface, PackedPixelBuffer const& image, std::function<void()> onUploaded = nullptr);
+
+    // Writes everything that's waiting. Returns the number of uploads written.
+    // Only call it from one thread at a time. If the device is lost part way
+    // through, the whole batch stays queued and DeviceLostError is thrown.
+    size_t Flush();
+
+    UploadBatcherOptions const& Options() const { return m_options; }
+    UploadBatcherStats Stats();
+
+    // Takes effect from the next flush. Rings belong to a device, so they're
+    // replaced along with it.
+    void SetUploadRings(std::vector<std::shared_ptr<UploadRing>> uploadRings);
+
+private:
+    struct PendingUpload
+    {
+        std::shared_ptr<SurfaceBackend> Surface;
+        std::optional<SurfaceRect> Rect;
+        uint32_t Width = 0;
+        uint32_t Height = 0;
+        uint32_t RowPitch = 0;
+        // Whatever keeps the pixels alive: the caller's buffer, or our own copy.
+        std::shared_ptr<void const> Owner;
+        uint8_t const* Pixels = nullptr;
+        std::function<void()> OnUploaded;
+        // Bands of rows staged in an upload ring, top to bottom, during a
+        // flush. Rows below the last band are written from Pixels.
+        std::vector<UploadAllocation> Staged;
+    };
+
+    static void Stage(PendingUpload& upload, UploadRing& ring);
+    // Returns the number of BeginDraw/EndDraw pairs it took.
+    uint64_t WriteGroup(std::vector<PendingUpload*> const& group);
+    // Draws one upload. With no rect, the surface is resized to fit it.
+    static void Draw(SurfaceBackend& surface, SurfaceRect const* rect, PendingUpload const& upload);
+    static void Write(SurfaceBackend& surface, SurfacePoint atlasPosition, PendingUpload const& upload);
+
+    UploadBatcherOptions m_options;
+    ScheduleFlushHandler m_scheduleFlush;
+    BatchHandler m_beginBatch;
+    BatchHandler m_endBatch;
+
+    std::mutex m_lock;
+    std::vector<PendingUpload> m_pending;
+    uint64_t m_pendingBytes = 0;
+    bool m_sizeFlushRequested = false;
+    std::vector<std::shared_ptr<UploadRing>> m_uploadRings;
+    std::chrono::steady_clock::time_point m_batchStart;
+    UploadBatcherStats m_stats;
+};
@@ -0,0 +1,289 @@
+#include "pch.h"
+#include "UploadRing.h"
+
+uint64_t CpuUploadFence::Signal()
+{
+    std::lock_guard lock(m_lock);
+    m_signaled++;
+    if (m_signaled > m_latency)
+    {
+        m_completed = std::max(m_completed, m_signaled - m_latency);
+    }
+    return m_signaled;
+}
+
+uint64_t CpuUploadFence::CompletedValue()
+{
+    std::lock_guard lock(m_lock);
+    return m_completed;
+}
+
+void CpuUploadFence::Wait(uint64_t value)
+{
+    {
+        std::lock_guard lock(m_lock);
+        m_waits++;
+    }
+    Complete(value);
+}
+
+void CpuUploadFence::Complete(uint64_t value)
+{
+    std::lock_guard lock(m_lock);
+    m_completed = std::max(m_completed, std::min(value, m_signaled));
+}
+
+uint64_t CpuUploadFence::Waits()
+{
+    std::lock_guard lock(m_lock);
+    return m_waits;
+}
+
+CpuUploadPage::CpuUploadPage(SurfaceFormat format, uint32_t width, uint32_t height)
+{
+    m_rowPitch = width * BytesPerPixel(format);
+    m_memory.resize(static_cast<size_t>(m_rowPitch) * height);
+}
+
+uint8_t* CpuUploadPage::Map(uint32_t& rowPitch)
+{
+    if (m_mapped)
+    {
+        throw std::logic_error("Upload page is already mapped");
+    }
+    m_mapped = true;
+    m_mapCount++;
+    rowPitch = m_rowPitch;
+    return m_memory.data();
+}
+
+void CpuUploadPage::Unmap()
+{
+    if (!m_mapped)
+    {
+        throw std::logic_error("Upload page isn't mapped");
+    }
+    m_mapped = false;
+}
+
+UploadRing::UploadRing(SurfaceFormat format, UploadRingOptions const& options, std::shared_ptr<UploadFence> fence, PageFactory createPage)
+{
+    // 16384 is the largest texture D3D11 will make.
+    if (options.PageCount == 0 || options.PageWidth == 0 || options.PageHeight == 0 ||
+        options.PageWidth > 16384 || options.PageHeight > 16384)
+    {
+        throw std::invalid_argument("Invalid upload ring layout");
+    }
+    if (!fence || !createPage)
+    {
+        throw std::invalid_argument("An upload ring needs a fence and somewhere to get pages from");
+    }
+    m_format = format;
+    m_options = options;
+    m_bytesPerPixel = BytesPerPixel(format);
+    m_fence = std::move(fence);
+    m_createPage = std::move(createPage);
+    m_pages.resize(options.PageCount);
+}
+
+std::optional<UploadAllocation> UploadRing::Allocate(uint32_t width, uint32_t rows)
+{
+    if (width == 0 || rows == 0)
+    {
+        throw std::invalid_argument("Upload size must be non-zero");
+    }
+    if (width > m_options.PageWidth)
+    {
+        std::lock_guard lock(m_statsLock);
+        m_stats.OversizeFallbacks++;
+        return std::nullopt;
+    }
+
+    // Anything taller than a page is going to be split anyway, so its bands
+    // can use up the bottoms of pages.
+    auto split = rows > m_options.PageHeight;
+    if (m_current >= 0 && m_pages[m_current].State == PageState::Open)
+    {
+        if (auto allocation = Place(m_pages[m_current], width, rows, split))
+        {
+            return allocation;
+        }
+        m_pages[m_current].State = PageState::Filled;
+    }
+    if (!OpenNextPage())
+    {
+        std::lock_guard lock(m_statsLock);
+        m_stats.FullFallbacks++;
+        return std::nullopt;
+    }
+    // Anything no wider than a page fits on an empty one.
+    return Place(m_pages[m_current], width, rows, split);
+}
+
+std::optional<UploadAllocation> UploadRing::Place(Page& page, uint32_t width, uint32_t rows, bool split)
+{
+    auto pageHeight = m_options.PageHeight;
+    // How many rows fit on a shelf starting at y.
+    auto rowsAt = [&](uint32_t y) -> uint32_t
+    {
+        if (y >= pageHeight)
+        {
+            return 0;
+        }
+        auto room = pageHeight - y;
+        if (split)
+        {
+            return std::min(rows, room);
+        }
+        return rows <= room ? rows : 0;
+    };
+
+    uint32_t height = 0;
+    if (page.ShelfX + width <= m_options.PageWidth)
+    {
+        height = rowsAt(page.ShelfY);
+    }
+    if (height == 0)
+    {
+        auto nextShelf = page.ShelfY + page.ShelfHeight;
+        height = rowsAt(nextShelf);
+        if (height == 0)
+        {
+            return std::nullopt;
+        }
+        page.ShelfY = nextShelf;
+        page.ShelfX = 0;
+        page.ShelfHeight = 0;
+    }
+
+    UploadAllocation allocation;
+    allocation.Page = page.Memory.get();
+    allocation.X = page.ShelfX;
+    allocation.Y = page.ShelfY;
+    allocation.Width = width;
+    allocation.Height = height;
+    allocation.RowPitch = page.RowPitch;
+    allocation.Data = page.Data + static_cast<size_t>(allocation.Y) * page.RowPitch + static_cast<size_t>(allocation.X) * m_bytesPerPixel;
+    page.ShelfX += width;
+    page.ShelfHeight = std::max(page.ShelfHeight, height);
+    auto bytes = static_cast<uint64_t>(width) * height * m_bytesPerPixel;
+    page.BytesAllocated += bytes;
+
+    std::lock_guard lock(m_statsLock);
+    m_stats.Allocations++;
+    m_stats.BytesAllocated += bytes;
+    if (height < rows)
+    {
+        m_stats.Splits++;
+    }
+    return allocation;
+}
+
+bool UploadRing::OpenNextPage()
+{
+    auto next = static_cast<int32_t>((m_current + 1) % m_pages.size());
+    auto& page = m_pages[next];
+    if (page.State == PageState::Open || page.State == PageState::Filled)
+    {
+        // We've come all the way around within one batch.
+        return false;
+    }
+    if (page.State == PageState::Submitted)
+    {
+        if (m_fence->CompletedValue() < page.FenceValue)
+        {
+            auto start = std::chrono::steady_clock::now();
+            m_fence->Wait(page.FenceValue);
+            auto waited = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+            std::lock_guard lock(m_statsLock);
+            m_stats.Stalls++;
+            m_stats.StallTime += waited;
+        }
+        page.State = PageState::Free;
+        std::lock_guard lock(m_statsLock);
+        m_pagesInUse--;
+    }
+
+    if (!page.Memory)
+    {
+        page.Memory = m_createPage();
+        std::lock_guard lock(m_statsLock);
+        m_stats.PagesCreated++;
+    }
+    page.Data = page.Memory->Map(page.RowPitch);
+    page.Mapped = true;
+    page.State = PageState::Open;
+    page.ShelfX = 0;
+    page.ShelfY = 0;
+    page.ShelfHeight = 0;
+    page.BytesAllocated = 0;
+    m_current = next;
+
+    std::lock_guard lock(m_statsLock);
+    m_pagesInUse++;
+    m_stats.PeakPagesInUse = std::max(m_stats.PeakPagesInUse, m_pagesInUse);
+    return true;
+}
+
+void UploadRing::Close()
+{
+    for (auto& page : m_pages)
+    {
+        if (page.Mapped)
+        {
+            page.Memory->Unmap();
+            page.Mapped = false;
+            page.Data = nullptr;
+        }
+        // There's no writing to it once it's unmapped, the GPU is about to
+        // read from it.
+        if (page.State == PageState::Open)
+        {
+            page.State = PageState::Filled;
+        }
+    }
+}
+
+void UploadRing::Submit()
+{
+    Close();
+    auto filled = std::any_of(m_pages.begin(), m_pages.end(), [](auto const& page) { return page.State == PageState::Filled; });
+    if (!filled)
+    {
+        return;
+    }
+
+    // One fence value for everything in the batch.
+    auto value = m_fence->Signal();
+    auto completed = m_fence->CompletedValue();
+    auto pageBytes = static_cast<uint64_t>(m_options.PageWidth) * m_options.PageHeight * m_bytesPerPixel;
+    std::lock_guard lock(m_statsLock);
+    for (auto& page : m_pages)
+    {
+        if (page.State == PageState::Filled)
+        {
+            page.State = PageState::Submitted;
+            page.FenceValue = value;
+            m_stats.PagesSubmitted++;
+            m_stats.BytesUnused += pageBytes - page.BytesAllocated;
+        }
+        // Let go of pages the GPU is done with, so Utilization is current.
+        if (page.State == PageState::Submitted && page.FenceValue <= completed)
+        {
+            page.State = PageState::Free;
+            m_pagesInUse--;
+        }
+    }
+}
+
+double UploadRing::Utilization()
+{
+    std::lock_guard lock(m_statsLock);
+    return static_cast<double>(m_pagesInUse) / m_options.PageCount;
+}
+
+UploadRingStats UploadRing::Stats()
+{
+    std::lock_guard lock(m_statsLock);
+    return m_stats;
+}
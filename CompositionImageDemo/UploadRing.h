@@ -0,0 +1,212 @@
+#pragma once
+#include "SurfaceBackend.h"
+
+// Tracks when the GPU has finished with work we've handed it. Signal marks
+// everything submitted so far and returns a value that completes once that
+// work is done. Values increase by one with every signal.
+class UploadFence
+{
+public:
+    virtual ~UploadFence() = default;
+
+    virtual uint64_t Signal() = 0;
+    virtual uint64_t CompletedValue() = 0;
+    // Blocks until the value has completed.
+    virtual void Wait(uint64_t value) = 0;
+};
+
+// A stand-in for a GPU fence. It pretends the GPU runs 'latency' signals
+// behind us, and waiting on a value completes it (as if we blocked until the
+// GPU caught up). Complete can be used to let the GPU catch up early.
+class CpuUploadFence : public UploadFence
+{
+public:
+    CpuUploadFence(uint32_t latency = 2) : m_latency(latency) {}
+
+    uint64_t Signal() override;
+    uint64_t CompletedValue() override;
+    void Wait(uint64_t value) override;
+
+    void Complete(uint64_t value);
+    uint64_t Waits();
+
+private:
+    std::mutex m_lock;
+    uint32_t m_latency = 0;
+    uint64_t m_signaled = 0;
+    uint64_t m_completed = 0;
+    uint64_t m_waits = 0;
+};
+
+// One block of upload memory, holding rows of pixels in one format. On D3D11
+// it's a staging texture, which has to be mapped to be written, unmapped
+// before the GPU can copy out of it, and can't be mapped again without waiting
+// for every copy still reading from it. So the ring fences whole pages.
+class UploadPage
+{
+public:
+    virtual ~UploadPage() = default;
+
+    // Returns the first row, and sets rowPitch to the distance between rows.
+    virtual uint8_t* Map(uint32_t& rowPitch) = 0;
+    virtual void Unmap() = 0;
+};
+
+// A page in system memory, for SoftwareRenderDevice and the tests. Like a
+// staging texture, surfaces refuse to copy from it while it's mapped.
+class CpuUploadPage : public UploadPage
+{
+public:
+    CpuUploadPage(SurfaceFormat format, uint32_t width, uint32_t height);
+
+    uint8_t* Map(uint32_t& rowPitch) override;
+    void Unmap() override;
+
+    bool IsMapped() const { return m_mapped; }
+    uint8_t const* Data() const { return m_memory.data(); }
+    uint32_t RowPitch() const { return m_rowPitch; }
+    uint64_t MapCount() const { return m_mapCount; }
+
+private:
+    std::vector<uint8_t> m_memory;
+    uint32_t m_rowPitch = 0;
+    bool m_mapped = false;
+    uint64_t m_mapCount = 0;
+};
+
+// A block of a page that pixels can be written to. Rows go at Data, RowPitch
+// bytes apart, and the block is at (X, Y) in the page.
+struct UploadAllocation
+{
+    UploadPage* Page = nullptr;
+    uint32_t X = 0;
+    uint32_t Y = 0;
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint8_t* Data = nullptr;
+    uint32_t RowPitch = 0;
+};
+
+struct UploadRingOptions
+{
+    // In pixels. Uploads wider than a page are written straight from their
+    // own memory, taller ones are split over more than one page.
+    uint32_t PageWidth = 4096;
+    uint32_t PageHeight = 512;
+    // 0 turns the ring off.
+    uint32_t PageCount = 6;
+};
+
+struct UploadRingStats
+{
+    uint64_t Allocations = 0;
+    // Allocations that came back shorter than asked for, because the upload
+    // was too tall for one page.
+    uint64_t Splits = 0;
+    // Requests wider than a page.
+    uint64_t OversizeFallbacks = 0;
+    // Requests made while every page was full of work that hadn't been
+    // submitted yet.
+    uint64_t FullFallbacks = 0;
+    // Times we had to wait on the fence for a page, and for how long.
+    uint64_t Stalls = 0;
+    std::chrono::microseconds StallTime = {};
+    uint64_t PagesSubmitted = 0;
+    uint64_t PagesCreated = 0;
+    uint64_t BytesAllocated = 0;
+    // What was left of pages when they were submitted.
+    uint64_t BytesUnused = 0;
+    uint32_t PeakPagesInUse = 0;
+
+    // How much of each submitted page carried pixels, from 0 to 1.
+    double PackingEfficiency() const
+    {
+        auto total = BytesAllocated + BytesUnused;
+        return total > 0 ? static_cast<double>(BytesAllocated) / total : 0.0;
+    }
+};
+
+// A persistent set of upload pages that is used in order and reused once the
+// GPU is done with them, so staging an upload doesn't need to allocate.
+// Uploads are packed onto a page in rows of blocks (shelves), and a page is
+// mapped while it's being filled. Close unmaps everything that's been filled
+// since the last Submit, which is when the surfaces can copy out of it.
+// Submit then tags those pages with a fence value, and they're mapped again
+// once that value completes.
+//
+// Pages are created the first time they're needed. A ring belongs to one
+// thread at a time (the one flushing uploads), only Stats and Utilization can
+// be called from anywhere.
+class UploadRing
+{
+public:
+    using PageFactory = std::function<std::unique_ptr<UploadPage>()>;
+
+    UploadRing(SurfaceFormat format, UploadRingOptions const& options, std::shared_ptr<UploadFence> fence, PageFactory createPage);
+
+    // Returns a block 'width' wide and between 1 and 'rows' rows high, so
+    // images taller than a page can be staged a band at a time. Returns
+    // std::nullopt if the request can't be served from the ring. Callers
+    // should write those pixels straight from their own memory. Waits on the
+    // fence if the next page is still in use by the GPU.
+    std::optional<UploadAllocation> Allocate(uint32_t width, uint32_t rows);
+    // Unmaps the pages that have been written to since the last Submit. Call
+    // before copying out of them.
+    void Close();
+    // Call once the copies out of the closed pages have been issued.
+    void Submit();
+
+    SurfaceFormat Format() const { return m_format; }
+    UploadRingOptions const& Options() const { return m_options; }
+    // Fraction of the pages that are being filled or waiting on the GPU,
+    // from 0 to 1.
+    double Utilization();
+    UploadRingStats Stats();
+
+private:
+    enum class PageState
+    {
+        Free,
+        // Mapped, with room left.
+        Open,
+        // Written to, waiting for Submit.
+        Filled,
+        // Waiting on FenceValue.
+        Submitted,
+    };
+
+    struct Page
+    {
+        std::unique_ptr<UploadPage> Memory;
+        PageState State = PageState::Free;
+        uint64_t FenceValue = 0;
+        uint8_t* Data = nullptr;
+        uint32_t RowPitch = 0;
+        bool Mapped = false;
+        // The shelf being filled, and how far along it we are.
+        uint32_t ShelfY = 0;
+        uint32_t ShelfHeight = 0;
+        uint32_t ShelfX = 0;
+        uint64_t BytesAllocated = 0;
+    };
+
+    // Finds room on the open page, starting a new shelf if need be.
+    std::optional<UploadAllocation> Place(Page& page, uint32_t width, uint32_t rows, bool split);
+    // Opens the next page, waiting on the GPU if it has to. Returns false if
+    // every page is in this batch already.
+    bool OpenNextPage();
+
+    SurfaceFormat m_format;
+    UploadRingOptions m_options;
+    uint32_t m_bytesPerPixel = 0;
+    std::shared_ptr<UploadFence> m_fence;
+    PageFactory m_createPage;
+
+    std::vector<Page> m_pages;
+    // The page being filled, or -1 before the first allocation.
+    int32_t m_current = -1;
+
+    std::mutex m_statsLock;
+    UploadRingStats m_stats;
+    uint32_t m_pagesInUse = 0;
+};
@@ -0,0 +1,157 @@
+#include "pch.h"
+#include "UploadScheduler.h"
+
+UploadScheduler::UploadScheduler(UploadSchedulerOptions const& options, FrameHandler endFrame, Clock clock)
+{
+    if (options.CostSmoothing <= 0.0 || options.CostSmoothing > 1.0)
+    {
+        throw std::invalid_argument("Cost smoothing must be in (0, 1]");
+    }
+    m_options = options;
+    m_endFrame = std::move(endFrame);
+    m_clock = clock ? std::move(clock) : []() { return std::chrono::steady_clock::now(); };
+    m_nanosecondsPerByte = options.InitialNanosecondsPerByte;
+    m_stats.NanosecondsPerByte = m_nanosecondsPerByte;
+}
+
+size_t UploadScheduler::Schedule(int32_t priority, uint64_t bytes, UploadHandler upload)
+{
+    if (!upload)
+    {
+        throw std::invalid_argument("Upload can't be empty");
+    }
+    std::lock_guard lock(m_lock);
+    m_queue.push({ priority, m_nextSequence++, bytes, std::move(upload) });
+    m_queuedBytes += bytes;
+    m_stats.MaxQueueDepth = std::max(m_stats.MaxQueueDepth, m_queue.size());
+    return m_queue.size();
+}
+
+size_t UploadScheduler::RunFrame()
+{
+    // Pick this frame's uploads up front, so uploads can be scheduled while
+    // these ones run.
+    std::vector<QueuedUpload> frame;
+    UploadFrameStats frameStats;
+    {
+        std::lock_guard lock(m_lock);
+        auto budget = std::chrono::duration_cast<std::chrono::nanoseconds>(m_options.FrameTimeBudget);
+        while (!m_queue.empty())
+        {
+            auto const& next = m_queue.top();
+            auto cost = EstimateCostLocked(next.Bytes);
+            if (!frame.empty() &&
+                (frameStats.EstimatedTime + cost > budget || frameStats.Bytes + next.Bytes > m_options.FrameByteBudget))
+            {
+                break;
+            }
+            frameStats.EstimatedTime += cost;
+            frameStats.Bytes += next.Bytes;
+            // top() is const, but we're about to pop it anyway.
+            frame.push_back(std::move(const_cast<QueuedUpload&>(next)));
+            m_queue.pop();
+        }
+        m_queuedBytes -= frameStats.Bytes;
+    }
+    if (frame.empty())
+    {
+        return 0;
+    }
+
+    auto start = m_clock();
+    for (size_t i = 0; i < frame.size(); i++)
+    {
+        try
+        {
+            frame[i].Upload();
+        }
+        catch (...)
+        {
+            // The ones that didn't get to run go back in the queue, in the
+            // same order, for the next frame.
+            std::lock_guard lock(m_lock);
+            for (auto j = i + 1; j < frame.size(); j++)
+            {
+                m_queuedBytes += frame[j].Bytes;
+                m_queue.push(std::move(frame[j]));
+            }
+            throw;
+        }
+    }
+    if (m_endFrame)
+    {
+        m_endFrame();
+    }
+    frameStats.Time = std::chrono::duration_cast<std::chrono::nanoseconds>(m_clock() - start);
+    frameStats.Uploads = static_cast<uint32_t>(frame.size());
+
+    std::lock_guard lock(m_lock);
+    // Learn the cost per byte from what the frame actually took, once the fixed
+    // cost of each upload is taken out.
+    if (frameStats.Bytes > 0)
+    {
+        auto overhead = static_cast<double>(m_options.UploadOverhead.count()) * frame.size();
+        auto measured = std::max(0.0, static_cast<double>(frameStats.Time.count()) - overhead) / static_cast<double>(frameStats.Bytes);
+        m_nanosecondsPerByte += m_options.CostSmoothing * (measured - m_nanosecondsPerByte);
+    }
+
+    frameStats.QueueDepth = m_queue.size();
+    m_stats.Frames++;
+    m_stats.Uploads += frameStats.Uploads;
+    m_stats.BytesUploaded += frameStats.Bytes;
+    if (frameStats.QueueDepth > 0)
+    {
+        m_stats.DeferredFrames++;
+    }
+    if (frameStats.Time > m_options.FrameTimeBudget)
+    {
+        m_stats.FramesOverBudget++;
+    }
+    m_stats.TotalFrameTime += frameStats.Time;
+    m_stats.MaxFrameTime = std::max(m_stats.MaxFrameTime, frameStats.Time);
+    m_stats.NanosecondsPerByte = m_nanosecondsPerByte;
+    m_stats.LastFrame = frameStats;
+
+    m_recentFrames.push_back(frameStats);
+    while (m_recentFrames.size() > m_options.FrameHistory)
+    {
+        m_recentFrames.pop_front();
+    }
+    return frame.size();
+}
+
+size_t UploadScheduler::QueueDepth()
+{
+    std::lock_guard lock(m_lock);
+    return m_queue.size();
+}
+
+uint64_t UploadScheduler::QueuedBytes()
+{
+    std::lock_guard lock(m_lock);
+    return m_queuedBytes;
+}
+
+std::chrono::nanoseconds UploadScheduler::EstimateCost(uint64_t bytes)
+{
+    std::lock_guard lock(m_lock);
+    return EstimateCostLocked(bytes);
+}
+
+std::chrono::nanoseconds UploadScheduler::EstimateCostLocked(uint64_t bytes) const
+{
+    auto perByte = std::chrono::nanoseconds(static_cast<int64_t>(static_cast<double>(bytes) * m_nanosecondsPerByte));
+    return m_options.UploadOverhead + perByte;
+}
+
+UploadSchedulerStats UploadScheduler::Stats()
+{
+    std::lock_guard lock(m_lock);
+    return m_stats;
+}
+
+std::vector<UploadFrameStats> UploadScheduler::RecentFrames()
+{
+    std::lock_guard lock(m_lock);
+    return { m_recentFrames.begin(), m_recentFrames.end() };
+}
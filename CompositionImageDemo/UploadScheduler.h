@@ -0,0 +1,118 @@
+#pragma once
+
+struct UploadSchedulerOptions
+{
+    // Uploads stop being started once a frame is expected to take this long...
+    std::chrono::microseconds FrameTimeBudget = std::chrono::microseconds(4000);
+    // ...or to write this many bytes. A frame always runs at least one upload,
+    // so nothing can get stuck behind a budget it will never fit in.
+    uint64_t FrameByteBudget = 16 * 1024 * 1024;
+    // The fixed part of the cost of an upload, on top of its bytes.
+    std::chrono::nanoseconds UploadOverhead = std::chrono::microseconds(50);
+    // The cost per byte we start out with, before anything has been measured.
+    double InitialNanosecondsPerByte = 0.25;
+    // How much weight each measured frame gets in the cost estimate.
+    double CostSmoothing = 0.2;
+    // How many frames RecentFrames keeps.
+    uint32_t FrameHistory = 120;
+};
+
+struct UploadFrameStats
+{
+    uint32_t Uploads = 0;
+    uint64_t Bytes = 0;
+    std::chrono::nanoseconds Time = {};
+    std::chrono::nanoseconds EstimatedTime = {};
+    // Uploads still waiting once the frame was done.
+    size_t QueueDepth = 0;
+};
+
+struct UploadSchedulerStats
+{
+    uint64_t Frames = 0;
+    uint64_t Uploads = 0;
+    uint64_t BytesUploaded = 0;
+    // Frames that left uploads waiting for a later frame.
+    uint64_t DeferredFrames = 0;
+    // Frames that took longer than the time budget.
+    uint64_t FramesOverBudget = 0;
+    std::chrono::nanoseconds TotalFrameTime = {};
+    std::chrono::nanoseconds MaxFrameTime = {};
+    size_t MaxQueueDepth = 0;
+    double NanosecondsPerByte = 0.0;
+    UploadFrameStats LastFrame;
+};
+
+// Spreads uploads out over frames, so a burst of finished loads doesn't all
+// land on the device in one frame and cause a hitch. Each RunFrame starts
+// uploads in priority order (highest first, oldest first within a priority)
+// until the next one would push the frame over its time or byte budget. The
+// rest wait for the next frame.
+//
+// Time is estimated from the size of the upload, with a cost per byte that is
+// learned from how long past frames actually took. The clock can be replaced,
+// so the scheduler can be driven by a simulated frame clock.
+class UploadScheduler
+{
+public:
+    using Clock = std::function<std::chrono::steady_clock::time_point()>;
+    using UploadHandler = std::function<void()>;
+    using FrameHandler = std::function<void()>;
+
+    // endFrame is called at the end of every frame that ran uploads, and is
+    // counted as part of the frame. That's where a batch of uploads should be
+    // flushed.
+    UploadScheduler(UploadSchedulerOptions const& options, FrameHandler endFrame = nullptr, Clock clock = nullptr);
+
+    // Can be called from any thread. 'bytes' is what the upload will write.
+    // Returns the number of uploads waiting, including this one.
+    size_t Schedule(int32_t priority, uint64_t bytes, UploadHandler upload);
+    // Runs this frame's share of the uploads. Returns the number that ran. If
+    // an upload throws, the ones after it stay queued.
+    size_t RunFrame();
+
+    size_t QueueDepth();
+    uint64_t QueuedBytes();
+    std::chrono::nanoseconds EstimateCost(uint64_t bytes);
+
+    UploadSchedulerOptions const& Options() const { return m_options; }
+    UploadSchedulerStats Stats();
+    // Oldest first.
+    std::vector<UploadFrameStats> RecentFrames();
+
+private:
+    struct QueuedUpload
+    {
+        int32_t Priority;
+        uint64_t Sequence;
+        uint64_t Bytes;
+        UploadHandler Upload;
+    };
+
+    struct QueueOrder
+    {
+        bool operator()(QueuedUpload const& first, QueuedUpload const& second) const
+        {
+            // std::priority_queue puts the largest on top.
+            if (first.Priority != second.Priority)
+            {
+                return first.Priority < second.Priority;
+            }
+            return first.Sequence > second.Sequence;
+        }
+    };
+
+    std::chrono::nanoseconds EstimateCostLocked(uint64_t bytes) const;
+
+    UploadSchedulerOptions m_options;
+    FrameHandler m_endFrame;
+    Clock m_clock;
+
+    std::mutex m_lock;
+    std::priority_queue<QueuedUpload, std::vector<QueuedUpload>, QueueOrder> m_queue;
+    uint64_t m_nextSequence = 0;
+    uint64_t m_queuedBytes = 0;
+    double m_nanosecondsPerByte = 0.0;
+    UploadSchedulerStats m_stats;
+    std::deque<UploadFrameStats> m_recentFrames;
+};
@@ -1,14 +1,28 @@
 ﻿#include "pch.h"
 #include "MainWindow.h"
+#include "ImageTransform.h"
+#include "Placeholder.h"
+#include "CompositionRenderDevice.h"
+#include "CompositionTileLoader.h"
+#include "ImagePipeline.h"
+#include "DecodedImageCache.h"
+#include "DiskPixelCache.h"
+#include "SharedImageCache.h"
+#include "ContentHash.h"
+#include "PixelRetention.h"
+#include "CompressedImageTier.h"
+#include "SessionSnapshot.h"
 
 namespace winrt
 {
     using namespace Windows::Foundation;
     using namespace Windows::Foundation::Numerics;
+    using namespace Windows::Graphics;
     using namespace Windows::Graphics::Imaging;
     using namespace Windows::Graphics::DirectX;
     using namespace Windows::Storage;
     using namespace Windows::Storage::Streams;
+    using namespace Windows::System;
     using namespace Windows::UI;
     using namespace Windows::UI::Composition;
 }
@@ -20,15 +34,43 @@ namespace util
     using namespace robmikh::common::desktop;
 }
 
+// Called with a tiny, blurry preview of the image (already oriented) and the
+// size the full image will be.
+using PlaceholderHandler = std::function<void(PixelBuffer const& placeholder, uint32_t width, uint32_t height)>;
+
+std::future<winrt::BitmapDecoder> OpenImageAsync(std::vector<uint8_t> bytes);
 // We can only use IAsyncOperation with WinRT objects
-std::future<winrt::com_ptr<ID3D11Texture2D>> CreateTextureFromImageAsync(winrt::com_ptr<ID3D11Device> const& d3dDevice);
-void CopyTexutreIntoCompositionSurface(
-    winrt::CompositionDrawingSurface const& surface,
-    winrt::com_ptr<ID3D11Texture2D> const& sourceTexture,
-    winrt::com_ptr<ID3D11DeviceContext> const& d3dContext);
+std::future<PixelBuffer> DecodeImageAsync(
+    winrt::BitmapDecoder const& decoder,
+    PlaceholderHandler const& onPlaceholder);
+std::shared_ptr<ImagePipeline> CreateImagePipeline(
+    std::shared_ptr<RenderDevice> const& renderDevice,
+    ImagePipelineOptions const& options,
+    winrt::DispatcherQueue const& dispatcherQueue);
+winrt::fire_and_forget FlushUploadsAsync(
+    std::weak_ptr<ImagePipeline> imagePipeline,
+    winrt::DispatcherQueue dispatcherQueue,
+    std::chrono::milliseconds delay);
+void ShowSessionSnapshot(
+    std::filesystem::path const& snapshotPath,
+    std::shared_ptr<SurfaceBackend> const& placeholderSurface,
+    winrt::SpriteVisual const& placeholderVisual,
+    std::shared_ptr<ImagePipeline> const& imagePipeline,
+    std::shared_ptr<StartupTimer> const& startupTimer);
+void ReportStartupTimes(StartupTimes const& times);
 winrt::fire_and_forget LoadImageIntoSurface(
-    winrt::CompositionDrawingSurface const& surface,
-    winrt::com_ptr<ID3D11Device> const& d3dDevice);
+    std::shared_ptr<SurfaceBackend> const& surface,
+    std::shared_ptr<SurfaceBackend> const& placeholderSurface,
+    winrt::SpriteVisual const& placeholderVisual,
+    std::shared_ptr<ImagePipeline> const& imagePipeline,
+    std::shared_ptr<DecodedImageCache> const& imageCache,
+    std::shared_ptr<SharedImageCache> const& sharedImageCache,
+    std::shared_ptr<CompressedImageTier> const& compressedTier,
+    std::shared_ptr<DiskPixelCache> const& diskCache,
+    std::shared_ptr<PixelRetention> const& pixelRetention,
+    std::shared_ptr<SessionRecorder> const& sessionRecorder,
+    std::shared_ptr<StartupTimer> const& startupTimer,
+    std::shared_ptr<CompositionTileLoader> const& tileLoader);
 winrt::fire_and_forget RegisterForDeviceLost(
     wil::shared_event const& eventHandle,
     winrt::com_ptr<ID3D11Device> const& d3dDevice,
@@ -36,6 +78,10 @@ winrt::fire_and_forget RegisterForDeviceLost(
 
 int __stdcall WinMain(HINSTANCE, HINSTANCE, PSTR, int)
 {
+    // Startup is timed from here to the first pixels on screen, and to the real
+    // image being up.
+    auto startupTimer = std::make_shared<StartupTimer>();
+
     // Initialize COM
     winrt::init_apartment(winrt::apartment_type::single_threaded);
 
@@ -43,7 +89,8 @@ int __stdcall WinMain(HINSTANCE, HINSTANCE, PSTR, int)
     auto controller = util::CreateDispatcherQueueControllerForCurrentThread();
 
     // Create our window and visual tree
-    auto window = MainWindow(L"CompositionImageDemo", 800, 600);
+    winrt::SizeInt32 windowSize = { 800, 600 };
+    auto window = MainWindow(L"CompositionImageDemo", windowSize.Width, windowSize.Height);
     auto compositor = winrt::Compositor();
     auto target = window.CreateWindowTarget(compositor);
     auto root = compositor.CreateSpriteVisual();
@@ -64,29 +111,116 @@ int __stdcall WinMain(HINSTANCE, HINSTANCE, PSTR, int)
     // CreateGraphicsDevice. You can find the code for this helper here:
     //  https://github.com/robmikh/robmikh.common/blob/bc06cf890e80e4c5e9140b351117bd3abf25d35e/robmikh.common/include/robmikh.common/composition.interop.h#L8
     auto compositionGraphics = util::CreateCompositionGraphicsDevice(compositor, d3dDevice.get());
+    // Everything else talks to the device through this wrapper, which keeps track of
+    // the D3D device behind the CompositionGraphicsDevice as it gets replaced. The
+    // load pipeline only sees the RenderDevice interface, so it can also run
+    // headless on a SoftwareRenderDevice.
+    auto renderDevice = std::make_shared<CompositionRenderDevice>(compositionGraphics);
     // We're going to defer the image load, but you could also do it ahead of time.
     // In order to defer it, we create a surface up front with the minimum size. Later
     // we can resize the same surface and dump our pixels into it.
-    auto surface = compositionGraphics.CreateDrawingSurface(
-        { 1,1 }, 
-        winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized, 
-        winrt::DirectXAlphaMode::Premultiplied);
+    // The surface is made before we know anything about the image, so it's always
+    // B8G8R8A8, which keeps every bit of the decoded image. The loader converts the
+    // decoded pixels to whatever format the surface was created with, so a
+    // B5G6R5 (opaque) or B4G4R4A4 surface works too. Those use half the memory,
+    // which can be a better trade for things like thumbnail grids.
+    // The surface is a virtual surface so that it can hold images bigger than the
+    // largest texture the GPU supports. Those are loaded in tiles, and only the
+    // tiles that are on screen are loaded. For everything else it behaves just like
+    // a regular drawing surface.
+    auto surface = renderDevice->CreateCompositionSurface(SurfaceFormat::B8G8R8A8, true);
+
+    // While the image decodes, we show a tiny blurred version of it stretched to the
+    // size of the real thing. It gets its own small surface.
+    auto placeholderSurface = renderDevice->CreateCompositionSurface(SurfaceFormat::B8G8R8A8);
+    auto placeholder = compositor.CreateSpriteVisual();
+    placeholder.AnchorPoint({ 0.5f, 0.5f });
+    placeholder.RelativeOffsetAdjustment({ 0.5f, 0.5f, 0.0f });
+    auto placeholderBrush = compositor.CreateSurfaceBrush(placeholderSurface->Surface());
+    placeholderBrush.Stretch(winrt::CompositionStretch::Fill);
+    placeholderBrush.BitmapInterpolationMode(winrt::CompositionBitmapInterpolationMode::Linear);
+    placeholder.Brush(placeholderBrush);
+    root.Children().InsertAtTop(placeholder);
 
     // Create the visuals we will use to present the iamge
     auto content = compositor.CreateSpriteVisual();
     content.AnchorPoint({ 0.5f, 0.5f });
     content.RelativeOffsetAdjustment({ 0.5f, 0.5f, 0.0f });
     content.RelativeSizeAdjustment({ 1.0f, 1.0f });
-    auto brush = compositor.CreateSurfaceBrush(surface);
+    auto brush = compositor.CreateSurfaceBrush(surface->Surface());
     // Here is where we can change things about how the surface is displayed.
     brush.Stretch(winrt::CompositionStretch::None);
     content.Brush(brush);
     root.Children().InsertAtTop(content);
 
+    // Any processing we want done to the image between decoding and uploading it. The
+    // filters are run together on one tile of the image at a time. For example:
+    //  pipelineOptions.Filters.Exposure(0.5f).Contrast(1.1f).Sharpen(0.5f, 1);
+    ImagePipelineOptions pipelineOptions;
+
+    // Decoded images aren't written to their surfaces straight away. They're queued
+    // up and written together, at most a frame later, so loading lots of images
+    // doesn't mean lots of separate trips to the D3D context. The pixels are staged
+    // in a ring of staging textures that gets reused from one batch to the next, and
+    // copied into the surfaces' atlases on the GPU. The pipeline makes new rings
+    // whenever the device is replaced.
+    auto dispatcherQueue = controller.DispatcherQueue();
+    auto imagePipeline = CreateImagePipeline(renderDevice, pipelineOptions, dispatcherQueue);
+
+    // Whatever was on screen when the app last closed is shown straight away, from
+    // a snapshot of the pixels. That's before the image file has even been opened.
+    // The real image replaces it once it's loaded. The recorder keeps track of what's
+    // on screen so the snapshot can be written again when we exit.
+    auto snapshotPath = std::filesystem::temp_directory_path() / L"CompositionImageDemo" / L"Session.snapshot";
+    ShowSessionSnapshot(snapshotPath, placeholderSurface, placeholder, imagePipeline, startupTimer);
+    auto sessionRecorder = std::make_shared<SessionRecorder>();
+    sessionRecorder->SetView(windowSize.Width, windowSize.Height);
+
+    // Images too big for one texture are loaded a tile at a time, and the tiles that
+    // come into view are loaded as the window changes size.
+    auto tileLoader = std::make_shared<CompositionTileLoader>(dispatcherQueue, imagePipeline, windowSize);
+    window.SizeChanged([tileLoader, sessionRecorder](winrt::SizeInt32 const& size)
+        {
+            tileLoader->SetViewSize(size);
+            sessionRecorder->SetView(size.Width, size.Height);
+        });
+
+    // Decoded images are kept around for a while, so loading the same image again
+    // (like when we redraw after the device is replaced) skips the decode.
+    const uint64_t imageCacheBudget = 256 * 1024 * 1024;
+    auto imageCache = std::make_shared<DecodedImageCache>(imageCacheBudget);
+    // What that cache evicts drops down to a tier that keeps it losslessly compressed.
+    // Getting an image back from there is slower than from the cache above, but a lot
+    // faster than decoding it again.
+    auto compressedTier = std::make_shared<CompressedImageTier>();
+    imageCache->OnEvicted([compressedTier](ImageKey const& key, DecodedImageCache::Image const& image)
+        {
+            compressedTier->Demote(key, *image);
+        });
+    // Other copies of the app running at the same time share what they've decoded
+    // through named shared memory, so an image one of them has decoded is only a
+    // copy for the rest. If the segment can't be set up, each one decodes on its own.
+    std::shared_ptr<SharedImageCache> sharedImageCache;
+    try
+    {
+        sharedImageCache = std::make_shared<SharedImageCache>("CompositionImageDemo.DecodedImages");
+    }
+    catch (std::exception const&)
+    {
+    }
+    // Decoded pixels are also kept on disk, so the next time the app starts they
+    // can be read straight back without decoding the file.
+    auto diskCache = std::make_shared<DiskPixelCache>(std::filesystem::temp_directory_path() / L"CompositionImageDemo" / L"PixelCache");
+    // What's on each surface is also held onto (this shares the buffer with the cache
+    // above), so putting the surfaces back after the device is replaced is just an
+    // upload, however many images there are. If memory is tighter, the retention can
+    // keep a downscaled or block compressed copy instead.
+    auto pixelRetention = std::make_shared<PixelRetention>(imagePipeline);
+
     // The bulk of this sample goes on in this function.
-    // It will (1) load a file from disk, (2) decode the image and place it in a texture,
-    // and (3) it will copy the contents of the texture to the provided composition surface.
-    LoadImageIntoSurface(surface, d3dDevice);
+    // It will (1) load a file from disk, (2) decode the image into system memory,
+    // and (3) it will write the pixels straight into the provided composition surface.
+    LoadImageIntoSurface(surface, placeholderSurface, placeholder, imagePipeline, imageCache, sharedImageCache, compressedTier, diskCache, pixelRetention, sessionRecorder, startupTimer, tileLoader);
 
     // Sometimes the GPU might have to reset due to errors. When ths happens, we'll
     // need to create a new D3D device and redraw our surface. We can get D3D to signal
@@ -95,18 +229,22 @@ int __stdcall WinMain(HINSTANCE, HINSTANCE, PSTR, int)
     wil::shared_event deviceLostEvent(wil::EventOptions::ManualReset);
     RegisterForDeviceLost(deviceLostEvent, d3dDevice, compositionGraphics);
 
-    // When we get a new D3D device, the RenderingDeviceReplaced event will fire. Here
-    // we'll register for the event and redraw the surface when it fires. You can 
-    // exercise this code by using "dxcap.exe -forcetdr". You can get dxcap by going
-    // to Settings -> Apps -> Optional features -> Graphics Tools. If the image is 
-    // still there after all the flashing, it worked!
-    auto eventToken = compositionGraphics.RenderingDeviceReplaced([surface](auto&& compGraphics, auto&&)
+    // When we get a new D3D device, the RenderingDeviceReplaced event will fire, and
+    // the render device passes it on once it has switched over. The pipeline is
+    // already set up for the new device by the time our handler runs, so all that's
+    // left is to redraw the surface, from the retained pixels if we have them, or
+    // by loading the image again if we don't. You can exercise this code by using
+    // "dxcap.exe -forcetdr". You can get dxcap by going to Settings -> Apps ->
+    // Optional features -> Graphics Tools. If the image is still there after all the
+    // flashing, it worked!
+    renderDevice->DeviceReplaced([surface, placeholderSurface, placeholder, imagePipeline, imageCache, sharedImageCache, compressedTier, diskCache, pixelRetention, sessionRecorder, startupTimer, tileLoader]()
         {
-            auto graphicsDeviceInterop = compGraphics.as<ABI::Windows::UI::Composition::ICompositionGraphicsDeviceInterop>();
-            winrt::com_ptr<IUnknown> unknown;
-            winrt::check_hresult(graphicsDeviceInterop->GetRenderingDevice(unknown.put()));
-            auto d3dDevice = unknown.as<ID3D11Device>();
-            LoadImageIntoSurface(surface, d3dDevice);
+            if (pixelRetention->IsRetained(surface))
+            {
+                pixelRetention->RestoreAll();
+                return;
+            }
+            LoadImageIntoSurface(surface, placeholderSurface, placeholder, imagePipeline, imageCache, sharedImageCache, compressedTier, diskCache, pixelRetention, sessionRecorder, startupTimer, tileLoader);
         });
     
     // Message pump
@@ -116,100 +254,342 @@ int __stdcall WinMain(HINSTANCE, HINSTANCE, PSTR, int)
         TranslateMessage(&msg);
         DispatchMessageW(&msg);
     }
+
+    // Remember what was on screen for next time.
+    try
+    {
+        SaveSessionSnapshot(snapshotPath, sessionRecorder->Capture());
+    }
+    catch (std::exception const&)
+    {
+        // Without a snapshot the next launch is just a cold one.
+    }
     return util::ShutdownDispatcherQueueControllerAndWait(controller, static_cast<int>(msg.wParam));
 }
 
+// The bytes are moved in, the coroutine owns them.
+std::future<winrt::BitmapDecoder> OpenImageAsync(std::vector<uint8_t> bytes)
+{
+    // You'll need to get a stream to your file. We've already read the whole file
+    // to hash it, so the decoder reads from a copy in memory.
+    winrt::InMemoryRandomAccessStream stream;
+    winrt::DataWriter writer(stream);
+    writer.WriteBytes(bytes);
+    co_await writer.StoreAsync();
+    writer.DetachStream();
+    stream.Seek(0);
+
+    // Create the decoder for our image. The decoder keeps the stream alive.
+    co_return co_await winrt::BitmapDecoder::CreateAsync(stream);
+}
+
 // We can only use IAsyncOperation with WinRT objects
-std::future<winrt::com_ptr<ID3D11Texture2D>> CreateTextureFromImageAsync(winrt::com_ptr<ID3D11Device> const& d3dDevice)
+std::future<PixelBuffer> DecodeImageAsync(
+    winrt::BitmapDecoder const& decoder,
+    PlaceholderHandler const& onPlaceholder)
 {
     // Get our own references for the coroutine
-    auto device = d3dDevice;
+    auto imageDecoder = decoder;
+    auto placeholderHandler = onPlaceholder;
 
-    // You'll need to get a stream to your file. This demo uses a local image.
-    auto currentPath = std::filesystem::current_path();
-    auto folder = co_await winrt::StorageFolder::GetFolderFromPathAsync(currentPath.wstring());
-    auto file = co_await folder.GetFileAsync(L"tripphoto1.jpg");
-
-    winrt::com_ptr<ID3D11Texture2D> texture;
+    PixelBuffer image;
+    auto orientation = ImageOrientation::Normal;
     {
-        auto stream = co_await file.OpenReadAsync();
-
-        // Create the decoder for our image
-        auto decoder = co_await winrt::BitmapDecoder::CreateAsync(stream);
         // Since this image is a jpg it only has a single frame
-        auto frame = co_await decoder.GetFrameAsync(0);
-        auto width = frame.PixelWidth();
-        auto height = frame.PixelHeight();
+        auto frame = co_await imageDecoder.GetFrameAsync(0);
         WINRT_ASSERT(frame.BitmapPixelFormat() == winrt::BitmapPixelFormat::Bgra8);
 
+        // Cameras often store their pixels sideways and use the EXIF orientation
+        // tag to say which way is up. Not every format supports the tag.
+        try
+        {
+            std::vector<winrt::hstring> propertyNames = { L"System.Photo.Orientation" };
+            auto properties = co_await imageDecoder.BitmapProperties().GetPropertiesAsync(std::move(propertyNames));
+            if (auto value = properties.TryLookup(L"System.Photo.Orientation"))
+            {
+                auto tag = winrt::unbox_value<uint16_t>(value.Value());
+                if (tag >= 1 && tag <= 8)
+                {
+                    orientation = static_cast<ImageOrientation>(tag);
+                }
+            }
+        }
+        catch (winrt::hresult_error const&)
+        {
+            // No orientation, use the pixels as they are.
+        }
+
+        if (placeholderHandler)
+        {
+            // Asking for 1/8th of the size lets the JPEG decoder stop at the DC
+            // coefficients of each 8x8 block, so this is much quicker than a full
+            // decode. CreatePlaceholder only samples a fixed number of pixels from
+            // what comes back.
+            winrt::BitmapTransform transform;
+            transform.ScaledWidth(std::max(1u, frame.PixelWidth() / 8));
+            transform.ScaledHeight(std::max(1u, frame.PixelHeight() / 8));
+            transform.InterpolationMode(winrt::BitmapInterpolationMode::NearestNeighbor);
+            auto previewData = co_await frame.GetPixelDataAsync(
+                winrt::BitmapPixelFormat::Bgra8,
+                winrt::BitmapAlphaMode::Premultiplied,
+                transform,
+                winrt::ExifOrientationMode::IgnoreExifOrientation,
+                winrt::ColorManagementMode::DoNotColorManage);
+            auto previewBytes = previewData.DetachPixelData();
+            PixelBuffer preview(transform.ScaledWidth(), transform.ScaledHeight());
+            preview.Bytes.assign(previewBytes.begin(), previewBytes.end());
+
+            auto placeholder = CreatePlaceholder(preview);
+            auto width = frame.PixelWidth();
+            auto height = frame.PixelHeight();
+            if (orientation != ImageOrientation::Normal)
+            {
+                TransformImageInPlace(placeholder, orientation);
+                if (SwapsDimensions(orientation))
+                {
+                    std::swap(width, height);
+                }
+            }
+            placeholderHandler(placeholder, width, height);
+        }
+
         auto pixelData = co_await frame.GetPixelDataAsync();
         auto bytes = pixelData.DetachPixelData();
+        image.Width = frame.PixelWidth();
+        image.Height = frame.PixelHeight();
+        image.Bytes.assign(bytes.begin(), bytes.end());
+    }
 
-        // Now we need to create a D3D texture
-        D3D11_TEXTURE2D_DESC desc = {};
-        desc.Width = width;
-        desc.Height = height;
-        desc.MipLevels = 1;
-        desc.ArraySize = 1;
-        desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
-        desc.SampleDesc.Count = 1;
-
-        D3D11_SUBRESOURCE_DATA initData = {};
-        initData.pSysMem = bytes.data();
-        // This describes how many bytes wide our image is.
-        // Each BGRA pixel is 4 bytes.
-        initData.SysMemPitch = width * 4;
-
-        winrt::check_hresult(device->CreateTexture2D(&desc, &initData, texture.put()));
+    // Rotate/flip the pixels before they go to the GPU, so the surface
+    // can be displayed as-is.
+    if (orientation != ImageOrientation::Normal)
+    {
+        TransformImageInPlace(image, orientation);
     }
-    co_return texture;
+    co_return image;
 }
 
-void CopyTexutreIntoCompositionSurface(
-    winrt::CompositionDrawingSurface const& surface,
-    winrt::com_ptr<ID3D11Texture2D> const& sourceTexture,
-    winrt::com_ptr<ID3D11DeviceContext> const& d3dContext)
+std::shared_ptr<ImagePipeline> CreateImagePipeline(
+    std::shared_ptr<RenderDevice> const& renderDevice,
+    ImagePipelineOptions const& options,
+    winrt::DispatcherQueue const& dispatcherQueue)
 {
-    // Since we're going to interop with D3D, we'll need the inteorp COM interface from the surface.
-    auto surfaceInterop = surface.as<ABI::Windows::UI::Composition::ICompositionDrawingSurfaceInterop>();
-
-    // Make sure our surface is the correct size for our image.
-    D3D11_TEXTURE2D_DESC desc = {};
-    sourceTexture->GetDesc(&desc);
-    winrt::check_hresult(surfaceInterop->Resize({ static_cast<LONG>(desc.Width), static_cast<LONG>(desc.Height) }));
-
-    // Here we get the underlying D3D texture for our surface. Because composition surfaces come from an
-    // atlas, we need to copy our data at an offset. 
-    POINT offset = {};
-    winrt::com_ptr<ID3D11Texture2D> surfaceTexture;
-    winrt::check_hresult(surfaceInterop->BeginDraw(nullptr, winrt::guid_of<ID3D11Texture2D>(), surfaceTexture.put_void(), &offset));
-    // Make sure that you call EndDraw when you're finished.
-    auto scopeExit = wil::scope_exit([surfaceInterop]()
+    // The pipeline can't hand itself to the flush callback, so we fill this in afterwards.
+    auto pipelineReference = std::make_shared<std::weak_ptr<ImagePipeline>>();
+    auto imagePipeline = std::make_shared<ImagePipeline>(
+        renderDevice,
+        options,
+        [pipelineReference, dispatcherQueue](std::chrono::milliseconds delay)
         {
-            winrt::check_hresult(surfaceInterop->EndDraw());
+            FlushUploadsAsync(*pipelineReference, dispatcherQueue, delay);
         });
+    *pipelineReference = imagePipeline;
+    return imagePipeline;
+}
+
+winrt::fire_and_forget FlushUploadsAsync(
+    std::weak_ptr<ImagePipeline> imagePipeline,
+    winrt::DispatcherQueue dispatcherQueue,
+    std::chrono::milliseconds delay)
+{
+    if (delay.count() > 0)
+    {
+        co_await winrt::resume_after(delay);
+    }
+    // Surfaces are drawn to from the UI thread.
+    co_await winrt::resume_foreground(dispatcherQueue);
+    if (auto pipeline = imagePipeline.lock())
+    {
+        pipeline->Flush();
+    }
+}
+
+void ShowSessionSnapshot(
+    std::filesystem::path const& snapshotPath,
+    std::shared_ptr<SurfaceBackend> const& placeholderSurface,
+    winrt::SpriteVisual const& placeholderVisual,
+    std::shared_ptr<ImagePipeline> const& imagePipeline,
+    std::shared_ptr<StartupTimer> const& startupTimer)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto snapshot = LoadSessionSnapshot(snapshotPath);
+    auto loadTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    bool found = snapshot && !snapshot->Items.empty();
+    startupTimer->SnapshotLoaded(loadTime, found);
+    if (!found)
+    {
+        return;
+    }
+
+    // This sample only shows one image, centered, so there's one item: the middle
+    // of the image (or all of it, if it's smaller than the window). The placeholder
+    // visual is centered as well, so sizing it to the pixels puts them right where
+    // they were. It goes ahead of anything else waiting to be uploaded.
+    auto& item = snapshot->Items.front();
+    auto placeholder = placeholderVisual;
+    auto timer = startupTimer;
+    auto width = static_cast<float>(item.Bounds.Width);
+    auto height = static_cast<float>(item.Bounds.Height);
+    const int32_t snapshotPriority = 1;
+    imagePipeline->Upload(placeholderSurface, item.Pixels, std::nullopt, [placeholder, timer, width, height]()
+        {
+            placeholder.Size({ width, height });
+            placeholder.IsVisible(true);
+            timer->FirstPixels();
+        }, snapshotPriority);
+}
 
-    d3dContext->CopySubresourceRegion(
-        surfaceTexture.get(), 
-        0, // We only have one subresource
-        offset.x, 
-        offset.y, 
-        0, // z
-        sourceTexture.get(), 
-        0, // We only have one subresource
-        nullptr); // Copy the entire thing
+void ReportStartupTimes(StartupTimes const& times)
+{
+    auto milliseconds = [](std::optional<std::chrono::microseconds> const& time)
+    {
+        return time ? time->count() / 1000.0 : 0.0;
+    };
+    wchar_t message[256] = {};
+    swprintf_s(message, L"%s startup: snapshot load %.1f ms, first pixels %.1f ms, image shown %.1f ms\n",
+        times.Warm ? L"Warm" : L"Cold",
+        milliseconds(times.SnapshotLoad),
+        milliseconds(times.FirstPixels),
+        milliseconds(times.ImageShown));
+    OutputDebugStringW(message);
 }
 
 winrt::fire_and_forget LoadImageIntoSurface(
-    winrt::CompositionDrawingSurface const& surface,
-    winrt::com_ptr<ID3D11Device> const& d3dDevice)
+    std::shared_ptr<SurfaceBackend> const& surface,
+    std::shared_ptr<SurfaceBackend> const& placeholderSurface,
+    winrt::SpriteVisual const& placeholderVisual,
+    std::shared_ptr<ImagePipeline> const& imagePipeline,
+    std::shared_ptr<DecodedImageCache> const& imageCache,
+    std::shared_ptr<SharedImageCache> const& sharedImageCache,
+    std::shared_ptr<CompressedImageTier> const& compressedTier,
+    std::shared_ptr<DiskPixelCache> const& diskCache,
+    std::shared_ptr<PixelRetention> const& pixelRetention,
+    std::shared_ptr<SessionRecorder> const& sessionRecorder,
+    std::shared_ptr<StartupTimer> const& startupTimer,
+    std::shared_ptr<CompositionTileLoader> const& tileLoader)
 {
-    winrt::com_ptr<ID3D11DeviceContext> d3dContext;
-    d3dDevice->GetImmediateContext(d3dContext.put());
+    // Get our own references for the coroutine
+    auto imageBackend = surface;
+    auto placeholderBackend = placeholderSurface;
+    auto pipeline = imagePipeline;
+    auto cache = imageCache;
+    auto sharedCache = sharedImageCache;
+    auto tier = compressedTier;
+    auto pixelCache = diskCache;
+    auto retention = pixelRetention;
+    auto recorder = sessionRecorder;
+    auto timer = startupTimer;
+    auto tiles = tileLoader;
+    auto size = tileLoader->ViewSize();
+    auto placeholder = placeholderVisual;
+    auto showPlaceholder = [placeholder, placeholderBackend, pipeline, timer](PixelBuffer const& preview, uint32_t width, uint32_t height)
+    {
+        // The placeholder is tiny and only useful if it shows up quickly, so it goes
+        // ahead of anything else waiting to be uploaded.
+        const int32_t placeholderPriority = 1;
+        pipeline->Upload(placeholderBackend, std::make_shared<PixelBuffer const>(preview), std::nullopt, [placeholder, timer, width, height]()
+            {
+                placeholder.Size({ static_cast<float>(width), static_cast<float>(height) });
+                placeholder.IsVisible(true);
+                timer->FirstPixels();
+            }, placeholderPriority);
+    };
 
-    auto imageTexture = co_await CreateTextureFromImageAsync(d3dDevice);
+    auto hidePlaceholder = [placeholder, timer]()
+    {
+        // The real image is up, we don't need the placeholder (or the snapshot) anymore.
+        placeholder.IsVisible(false);
+        if (timer->ImageShown())
+        {
+            ReportStartupTimes(timer->Times());
+        }
+    };
+
+    // Hashing and reading the file shouldn't hold up the UI thread.
+    co_await winrt::resume_background();
+
+    // This demo uses a local image. The caches are keyed by the contents of the
+    // file rather than its path, so the same image under another name (or from
+    // another URL) is only decoded once. The hash is worked out as the file is read.
+    auto path = std::filesystem::current_path() / L"tripphoto1.jpg";
+    auto file = ReadFileWithHash(path);
+    auto key = ImageKeyForContent(file.Hash, file.Bytes.size());
+    auto showImage = [imageBackend, pipeline, retention, recorder, key, size, hidePlaceholder](std::shared_ptr<PixelBuffer const> const& pixels)
+    {
+        pipeline->Upload(imageBackend, pixels, std::nullopt, hidePlaceholder);
+        retention->Retain(imageBackend, pixels);
+        // The brush centers the image, so the middle of it is what's on screen.
+        auto width = static_cast<int32_t>(pixels->Width);
+        auto height = static_cast<int32_t>(pixels->Height);
+        SurfaceRect visible = {};
+        visible.X = std::max(0, (width - size.Width) / 2);
+        visible.Y = std::max(0, (height - size.Height) / 2);
+        visible.Width = static_cast<uint32_t>(std::min(width, size.Width));
+        visible.Height = static_cast<uint32_t>(std::min(height, size.Height));
+        SurfacePoint position = {};
+        position.X = std::max(0, (size.Width - width) / 2);
+        position.Y = std::max(0, (size.Height - height) / 2);
+        recorder->Show(key, pixels, visible, position);
+    };
+    if (auto cached = cache->Find(key))
+    {
+        showImage(cached);
+        co_return;
+    }
+    // Another copy of the app decoded it. The pipeline and the retention hold onto
+    // a PixelBuffer, so the shared pixels are copied out, which is still a lot
+    // cheaper than a decode.
+    if (auto shared = sharedCache ? sharedCache->Find(key) : nullptr)
+    {
+        auto cached = cache->Insert(key, shared->Copy());
+        showImage(cached);
+        co_return;
+    }
+    if (auto hit = tier->Find(key, cache->Budget()))
+    {
+        // Images that keep getting hit go back up to the raw cache.
+        auto pixels = hit->Promote ?
+            cache->Insert(key, std::move(hit->Pixels)) :
+            std::make_shared<PixelBuffer const>(std::move(hit->Pixels));
+        showImage(pixels);
+        co_return;
+    }
+    // Reading from the disk cache is a copy out of a mapped file, there's no decode.
+    if (auto stored = pixelCache->Load(key))
+    {
+        auto cached = cache->Insert(key, std::move(*stored));
+        showImage(cached);
+        co_return;
+    }
+
+    auto decoder = co_await OpenImageAsync(std::move(file.Bytes));
+    // Images bigger than the largest texture the GPU supports can't be uploaded in
+    // one go. Those are loaded a tile at a time, and only where they're visible.
+    const uint32_t maxTextureSize = D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION;
+    if (decoder.PixelWidth() > maxTextureSize || decoder.PixelHeight() > maxTextureSize)
+    {
+        co_await tiles->ShowAsync(imageBackend, decoder);
+        co_return;
+    }
 
-    CopyTexutreIntoCompositionSurface(surface, imageTexture, d3dContext);
+    // The pipeline runs the filters and converts the pixels to the surface's format.
+    // If the snapshot is up, it's a better stand-in than the blurry placeholder.
+    PlaceholderHandler onPlaceholder = showPlaceholder;
+    if (timer->Times().Warm)
+    {
+        onPlaceholder = nullptr;
+    }
+    auto image = co_await DecodeImageAsync(decoder, onPlaceholder);
+    auto cached = cache->Insert(key, std::move(image));
+    showImage(cached);
+    if (sharedCache)
+    {
+        sharedCache->Insert(key, *cached);
+    }
+    // Writing the index after every image adds up when a lot of them are loaded
+    // at once, so it's written at most every few seconds (and by the destructor).
+    pixelCache->Store(key, *cached);
+    pixelCache->FlushIfDue();
     co_return;
 }
 
@@ -1,5 +1,10 @@
 ﻿#pragma once
 
+// Everything but the STL (and SIMD) sections is Windows only. The parts of the
+// load pipeline that don't touch the OS only need the STL, so they can also be
+// built and profiled on other platforms. The few that do (like mapping files)
+// use POSIX there.
+#ifdef _WIN32
 // Windows
 #include <windows.h>
 
@@ -30,10 +35,20 @@
 #include <dxgi1_6.h>
 #include <d2d1_3.h>
 #include <wincodec.h>
+#else
+// POSIX, for memory mapped files
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+// and for checking whether another process is still running
+#include <signal.h>
+#endif
 
 // STL
 #include <vector>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <atomic>
 #include <memory>
@@ -41,7 +56,34 @@
 #include <filesystem>
 #include <future>
 #include <chrono>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 
+// SIMD
+// The ARM builds fall back to the scalar paths.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define IMAGE_DEMO_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
 // robmikh.common
 #include <robmikh.common/composition.interop.h>
 #include <robmikh.common/direct3d11.interop.h>
@@ -52,4 +94,5 @@
 #include <robmikh.common/composition.desktop.interop.h>
 #include <robmikh.common/hwnd.interop.h>
 #include <robmikh.common/capture.desktop.interop.h>
-#include <robmikh.common/DesktopWindow.h>
\ No newline at end of file
+#include <robmikh.common/DesktopWindow.h>
+#endif
@@ -0,0 +1,46 @@
+#include "BenchHarness.h"
+#include "AtlasPacker.h"
+
+// The placement side of a thumbnail grid: how long packing takes, how many
+// pages it needs (each one is a surface, instead of one surface per image), and
+// what churn does to it. The surfaces themselves are CompositionAtlas, which
+// needs a compositor to run.
+BENCH(atlas, "ImageAtlas packing of thumbnail-sized images [count] [pageSize]")
+{
+    uint32_t count = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 5000;
+    uint32_t pageSize = arguments.size() > 1 ? static_cast<uint32_t>(std::stoul(arguments[1])) : 2048;
+
+    // Thumbnails 96 to 160 pixels on a side, like a grid of photos of mixed
+    // aspect ratios.
+    std::vector<std::pair<uint32_t, uint32_t>> sizes;
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        sizes.push_back({ 96 + (seed >> 26), 96 + ((seed >> 20) & 0x3f) });
+    }
+
+    ImageAtlas atlas(pageSize, pageSize);
+    std::vector<AtlasImageId> ids;
+    auto start = std::chrono::steady_clock::now();
+    for (auto [width, height] : sizes)
+    {
+        ids.push_back(atlas.Insert(width, height));
+    }
+    auto insertTime = std::chrono::steady_clock::now() - start;
+    std::printf("%u images in %u pages of %ux%u: %.1f%% packed, %.3f ms (%.2f us per insert)\n",
+        count, atlas.PageCount(), pageSize, pageSize, atlas.PackingEfficiency() * 100,
+        Milliseconds(insertTime), std::chrono::duration<double, std::micro>(insertTime).count() / count);
+
+    // Scroll away from half of them.
+    for (size_t i = 0; i < ids.size(); i += 2)
+    {
+        atlas.Remove(ids[i]);
+    }
+    std::printf("Removed half: %.1f%% packed, %.1f%% holes\n", atlas.PackingEfficiency() * 100, atlas.FragmentedFraction() * 100);
+    start = std::chrono::steady_clock::now();
+    auto moves = atlas.Defragment();
+    auto defragmentTime = std::chrono::steady_clock::now() - start;
+    std::printf("Defragmented in %.3f ms: %zu images moved, %u pages, %.1f%% packed\n",
+        Milliseconds(defragmentTime), moves.size(), atlas.PageCount(), atlas.PackingEfficiency() * 100);
+}
@@ -0,0 +1,98 @@
+#include "TestHarness.h"
+#include "AtlasPacker.h"
+
+namespace
+{
+    bool Overlaps(AtlasEntry const& first, AtlasEntry const& second)
+    {
+        return first.Page == second.Page &&
+            first.Rect.X < second.Rect.X + static_cast<int32_t>(second.Rect.Width) &&
+            second.Rect.X < first.Rect.X + static_cast<int32_t>(first.Rect.Width) &&
+            first.Rect.Y < second.Rect.Y + static_cast<int32_t>(second.Rect.Height) &&
+            second.Rect.Y < first.Rect.Y + static_cast<int32_t>(first.Rect.Height);
+    }
+
+    void CheckLayout(ImageAtlas const& atlas, std::vector<AtlasImageId> const& ids)
+    {
+        std::vector<AtlasEntry> entries;
+        for (auto id : ids)
+        {
+            auto entry = atlas.Find(id);
+            CHECK(entry.has_value());
+            CHECK(entry->Page < atlas.PageCount());
+            CHECK(entry->Rect.X >= 0 && entry->Rect.X + entry->Rect.Width <= atlas.PageWidth());
+            CHECK(entry->Rect.Y >= 0 && entry->Rect.Y + entry->Rect.Height <= atlas.PageHeight());
+            for (auto const& other : entries)
+            {
+                CHECK(!Overlaps(*entry, other));
+            }
+            entries.push_back(*entry);
+        }
+    }
+}
+
+TEST(AtlasPacker, SkylinePacksWithoutOverlapUntilFull)
+{
+    SkylinePacker packer(256, 256);
+    std::vector<SurfaceRect> placed;
+    while (auto position = packer.Pack(40, 30))
+    {
+        placed.push_back({ position->X, position->Y, 40, 30 });
+    }
+    // 6 columns of 8 rows fit in 256x256.
+    CHECK_EQ(placed.size(), size_t(6 * 8));
+    CHECK_EQ(packer.UsedArea(), uint64_t(placed.size() * 40 * 30));
+    packer.Reset();
+    CHECK(packer.Pack(256, 256).has_value());
+    CHECK(!packer.Pack(1, 1).has_value());
+}
+
+TEST(AtlasPacker, ThumbnailsShareAFewPages)
+{
+    ImageAtlas atlas(1024, 1024);
+    std::vector<AtlasImageId> ids;
+    uint32_t seed = 7;
+    for (int i = 0; i < 500; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        ids.push_back(atlas.Insert(48 + (seed >> 26), 48 + ((seed >> 20) & 0x3f)));
+    }
+    CheckLayout(atlas, ids);
+    CHECK(atlas.PackingEfficiency() > 0.7);
+    CHECK_THROWS(atlas.Insert(2048, 10), std::invalid_argument);
+}
+
+TEST(AtlasPacker, DefragmentingReclaimsRemovedSpace)
+{
+    ImageAtlas atlas(512, 512);
+    std::vector<AtlasImageId> ids;
+    for (int i = 0; i < 200; i++)
+    {
+        ids.push_back(atlas.Insert(60, 60));
+    }
+    auto pages = atlas.PageCount();
+    std::vector<AtlasImageId> kept;
+    for (size_t i = 0; i < ids.size(); i++)
+    {
+        if (i % 3 == 0)
+        {
+            kept.push_back(ids[i]);
+        }
+        else
+        {
+            atlas.Remove(ids[i]);
+        }
+    }
+    CHECK(atlas.NeedsDefragment());
+    auto moves = atlas.Defragment();
+    CHECK(!moves.empty());
+    CHECK(atlas.PageCount() < pages);
+    CHECK_EQ(atlas.FragmentedFraction(), 0.0);
+    CheckLayout(atlas, kept);
+    for (auto const& move : moves)
+    {
+        auto entry = atlas.Find(move.Id);
+        CHECK(entry.has_value());
+        CHECK_EQ(entry->Rect.X, move.To.Rect.X);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "TestHarness.h"
+
+// Benchmarks register themselves by name, like tests, and are run by
+// ImageDemoBench rather than ctest. Each prints its own results.
+struct BenchCase
+{
+    char const* Name;
+    char const* Description;
+    void (*Run)(std::vector<std::string> const& arguments);
+};
+
+std::vector<BenchCase>& RegisteredBenches();
+
+struct BenchRegistration
+{
+    BenchRegistration(char const* name, char const* description, void (*run)(std::vector<std::string> const&))
+    {
+        RegisteredBenches().push_back({ name, description, run });
+    }
+};
+
+#define BENCH(name, description) \
+    static void Bench_##name(std::vector<std::string> const& arguments); \
+    static BenchRegistration Bench_##name##_registration(#name, description, Bench_##name); \
+    static void Bench_##name([[maybe_unused]] std::vector<std::string> const& arguments)
+
+// Runs func repeatedly for at least minimumTime and returns the fastest run.
+template <typename Func>
+std::chrono::nanoseconds FastestOf(Func&& func, std::chrono::milliseconds minimumTime = std::chrono::milliseconds(300), uint32_t minimumRuns = 3)
+{
+    auto fastest = std::chrono::nanoseconds::max();
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t run = 0; run < minimumRuns || std::chrono::steady_clock::now() - start < minimumTime; run++)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        func();
+        fastest = std::min(fastest, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin));
+    }
+    return fastest;
+}
+
+inline double Milliseconds(std::chrono::nanoseconds time)
+{
+    return time.count() / 1e6;
+}
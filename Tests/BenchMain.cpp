@@ -0,0 +1,41 @@
+#include "BenchHarness.h"
+#include <cstdio>
+
+std::vector<BenchCase>& RegisteredBenches()
+{
+    static std::vector<BenchCase> benches;
+    return benches;
+}
+
+// ImageDemoBench <name> [arguments...] runs one benchmark. With no name, lists them.
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::printf("Usage: ImageDemoBench <benchmark> [arguments...]\n\n");
+        for (auto& bench : RegisteredBenches())
+        {
+            std::printf("  %-20s %s\n", bench.Name, bench.Description);
+        }
+        return 1;
+    }
+    for (auto& bench : RegisteredBenches())
+    {
+        if (bench.Name == std::string(argv[1]))
+        {
+            std::vector<std::string> arguments(argv + 2, argv + argc);
+            try
+            {
+                bench.Run(arguments);
+            }
+            catch (std::exception const& error)
+            {
+                std::printf("%s failed: %s\n", bench.Name, error.what());
+                return 1;
+            }
+            return 0;
+        }
+    }
+    std::printf("No benchmark named '%s'\n", argv[1]);
+    return 1;
+}
@@ -0,0 +1,67 @@
+#include "BenchHarness.h"
+#include "BlockCompression.h"
+#include "Simd.h"
+
+// How fast each format encodes at each quality, in megapixels a second, with
+// the SSE2 paths (bounds, the BC1 index search and the transparency check)
+// on and off. The transparent image has a gradient in the alpha, so BC3 and
+// BC7 have real work to do on that channel too.
+//
+// Nothing in the single image sample compresses images, so this is the only
+// place the encoders run at full size.
+BENCH(blockcompression, "BC1/BC3/BC7 encode throughput, with and without SSE2 [width] [height]")
+{
+    uint32_t width = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 1024;
+    uint32_t height = arguments.size() > 1 ? static_cast<uint32_t>(std::stoul(arguments[1])) : 768;
+
+    auto opaque = TestImage(width, height);
+    auto transparent = opaque;
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            auto pixel = transparent.Row(y) + x * 4;
+            auto alpha = static_cast<uint8_t>(x * 255 / std::max(1u, width - 1));
+            for (int channel = 0; channel < 3; channel++)
+            {
+                pixel[channel] = std::min(pixel[channel], alpha);
+            }
+            pixel[3] = alpha;
+        }
+    }
+    auto megapixels = static_cast<double>(width) * height / 1e6;
+
+    std::printf("%ux%u, MP/s\n", width, height);
+    std::printf("%-8s %-9s %10s %10s %8s\n", "format", "quality", "sse2", "scalar", "speedup");
+    constexpr std::pair<CompressionQuality, char const*> qualities[] = {
+        { CompressionQuality::Fast, "fast" }, { CompressionQuality::Balanced, "balanced" }, { CompressionQuality::Best, "best" } };
+    constexpr std::pair<BlockFormat, char const*> formats[] = {
+        { BlockFormat::BC1, "BC1" }, { BlockFormat::BC3, "BC3" }, { BlockFormat::BC7, "BC7" } };
+    for (auto [format, formatName] : formats)
+    {
+        auto& image = format == BlockFormat::BC1 ? opaque : transparent;
+        for (auto [quality, qualityName] : qualities)
+        {
+            double rates[2];
+            for (int scalar = 0; scalar < 2; scalar++)
+            {
+                SetSimdEnabled(scalar == 0);
+                auto time = FastestOf([&]() { CompressImage(image, format, quality); }, std::chrono::milliseconds(300), 2);
+                rates[scalar] = megapixels / (Milliseconds(time) / 1e3);
+            }
+            SetSimdEnabled(true);
+            std::printf("%-8s %-9s %10.1f %10.1f %7.2fx\n", formatName, qualityName, rates[0], rates[1], rates[0] / rates[1]);
+        }
+    }
+
+    auto checkTime = [&](bool simd)
+        {
+            SetSimdEnabled(simd);
+            return FastestOf([&]() { HasTransparentPixels(opaque); });
+        };
+    auto vectorCheck = checkTime(true);
+    auto scalarCheck = checkTime(false);
+    SetSimdEnabled(true);
+    std::printf("HasTransparentPixels on the opaque image: %.3f ms with SSE2, %.3f ms without\n",
+        Milliseconds(vectorCheck), Milliseconds(scalarCheck));
+}
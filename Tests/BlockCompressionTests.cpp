@@ -0,0 +1,111 @@
+#include "TestHarness.h"
+#include "BlockCompression.h"
+#include "Simd.h"
+
+TEST(BlockCompression, OpaqueImagesRoundTripAsBc1)
+{
+    auto image = TestImage(130, 66);
+    CHECK(ChooseBlockFormat(image, CompressionQuality::Balanced) == BlockFormat::BC1);
+    auto compressed = CompressImage(image, BlockFormat::BC1, CompressionQuality::Balanced);
+    CHECK_EQ(compressed.Blocks.size(), size_t(33 * 17 * 8));
+    auto decompressed = DecompressImage(compressed);
+    CHECK_EQ(decompressed.Width, image.Width);
+    CHECK(ComputePsnr(image, decompressed) > 30.0);
+}
+
+TEST(BlockCompression, TransparentImagesKeepTheirAlpha)
+{
+    auto image = TestImage(64, 64);
+    for (uint32_t y = 0; y < image.Height; y++)
+    {
+        for (uint32_t x = 0; x < image.Width; x++)
+        {
+            // Premultiplied, so the color can't be more than the alpha.
+            auto pixel = image.Row(y) + x * 4;
+            auto alpha = static_cast<uint8_t>(x * 4);
+            for (int channel = 0; channel < 3; channel++)
+            {
+                pixel[channel] = std::min(pixel[channel], alpha);
+            }
+            pixel[3] = alpha;
+        }
+    }
+    CHECK(HasTransparentPixels(image));
+    for (auto format : { BlockFormat::BC3, BlockFormat::BC7 })
+    {
+        auto decompressed = DecompressImage(CompressImage(image, format, CompressionQuality::Best));
+        CHECK(ComputePsnr(image, decompressed) > 30.0);
+    }
+}
+
+TEST(BlockCompression, SavedImagesLoadBack)
+{
+    auto directory = TestDirectory("BlockCompression");
+    auto compressed = CompressImage(TestImage(40, 24), BlockFormat::BC7, CompressionQuality::Fast);
+    SaveCompressedImage(directory / "image.dds", compressed);
+    auto loaded = LoadCompressedImage(directory / "image.dds");
+    CHECK(loaded.has_value());
+    CHECK(loaded->Format == BlockFormat::BC7);
+    CHECK(loaded->Blocks == compressed.Blocks);
+    CHECK(!LoadCompressedImage(directory / "missing.dds"));
+}
+
+TEST(BlockCompression, HeadersThatClaimMoreThanTheFileHoldsAreRejected)
+{
+    auto directory = TestDirectory("BlockCompressionCorrupt");
+    auto path = directory / "image.dds";
+    SaveCompressedImage(path, CompressImage(TestImage(16, 16), BlockFormat::BC1, CompressionQuality::Fast));
+
+    // A header for a 65535x65535 image in front of the 16x16 image's blocks.
+    // Loading it must not try to allocate the 2 GB the header asks for.
+    std::vector<uint8_t> bytes(std::filesystem::file_size(path));
+    std::ifstream(path, std::ios::binary).read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+    uint32_t huge = 65535;
+    std::memcpy(bytes.data() + 3 * 4, &huge, sizeof(huge));
+    std::memcpy(bytes.data() + 4 * 4, &huge, sizeof(huge));
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(reinterpret_cast<char const*>(bytes.data()), bytes.size());
+    CHECK(!LoadCompressedImage(path));
+
+    // Widths just under 4 GB, where adding 3 to round up to whole blocks
+    // would wrap around to 0 blocks, and no bytes needed at all.
+    for (uint32_t width : { 0xFFFFFFFDu, 0xFFFFFFFEu, 0xFFFFFFFFu })
+    {
+        std::memcpy(bytes.data() + 3 * 4, "\x10\0\0\0", 4);
+        std::memcpy(bytes.data() + 4 * 4, &width, sizeof(width));
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(reinterpret_cast<char const*>(bytes.data()), bytes.size());
+        CHECK(!LoadCompressedImage(path));
+    }
+
+    // And one that's cut short.
+    bytes.resize(bytes.size() - 1);
+    std::memcpy(bytes.data() + 3 * 4, "\x10\0\0\0", 4);
+    std::memcpy(bytes.data() + 4 * 4, "\x10\0\0\0", 4);
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(reinterpret_cast<char const*>(bytes.data()), bytes.size());
+    CHECK(!LoadCompressedImage(path));
+}
+
+TEST(BlockCompression, VectorAndScalarEncodersAgree)
+{
+    auto image = TestImage(67, 45);
+    // Some flat blocks too, where both endpoints come out the same.
+    for (uint32_t y = 0; y < 16; y++)
+    {
+        std::memset(image.Row(y), 0x80, 16 * 4);
+    }
+    for (auto format : { BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC7 })
+    {
+        for (auto quality : { CompressionQuality::Fast, CompressionQuality::Balanced, CompressionQuality::Best })
+        {
+            auto vector = CompressImage(image, format, quality);
+            SetSimdEnabled(false);
+            auto scalar = CompressImage(image, format, quality);
+            SetSimdEnabled(true);
+            CHECK(vector.Blocks == scalar.Blocks);
+        }
+    }
+    image.Row(44)[66 * 4 + 3] = 254;
+    SetSimdEnabled(false);
+    CHECK(HasTransparentPixels(image));
+    SetSimdEnabled(true);
+    CHECK(HasTransparentPixels(image));
+}
@@ -0,0 +1,97 @@
+#include "BenchHarness.h"
+#include "CompressedImageTier.h"
+#include "DiskPixelCache.h"
+
+namespace
+{
+    ImageKey Key(uint64_t id)
+    {
+        return ImageKeyForContent(id, 1000 + id);
+    }
+
+    // Mostly flat, like a screenshot or UI art, which QOI does well on.
+    PixelBuffer Screenshot(uint32_t width, uint32_t height)
+    {
+        PixelBuffer image(width, height);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            auto row = image.Row(y);
+            for (uint32_t x = 0; x < width; x++)
+            {
+                auto panel = (x / 97 + y / 61) % 3;
+                row[x * 4 + 0] = static_cast<uint8_t>(40 + panel * 60);
+                row[x * 4 + 1] = static_cast<uint8_t>(y % 61 < 2 ? 20 : 180);
+                row[x * 4 + 2] = static_cast<uint8_t>(220 - panel * 30);
+                row[x * 4 + 3] = 255;
+            }
+        }
+        return image;
+    }
+}
+
+// What a hit costs in each tier, for a few image sizes: the raw cache hands
+// back a shared buffer, the compressed tier decodes QOI into a new one, and
+// the disk cache copies the pixels out of its mapped segments (warm, so the
+// segments are in the page cache). A miss in all three means decoding the
+// file again, which is what they're all there to avoid.
+BENCH(tiers, "Hit latency in the raw, compressed and disk tiers [images]")
+{
+    uint32_t count = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 8;
+    auto directory = TestDirectory("CompressedImageTierBench");
+
+    std::printf("%-10s %-11s %10s %12s %12s %12s\n", "image", "content", "qoi ratio", "raw us", "qoi us", "disk us");
+    uint64_t id = 0;
+    for (uint32_t size : { 256u, 1024u, 2048u })
+    {
+        for (auto screenshot : { true, false })
+        {
+            auto image = screenshot ? Screenshot(size, size) : TestImage(size, size);
+            auto bytes = static_cast<uint64_t>(image.Bytes.size()) * count;
+
+            DecodedImageCache raw(bytes * 2);
+            CompressedTierOptions tierOptions;
+            tierOptions.BudgetBytes = bytes * 2;
+            tierOptions.MaxCompressedRatio = 1.0;
+            tierOptions.PromoteAfterHits = std::numeric_limits<uint32_t>::max();
+            CompressedImageTier tier(tierOptions);
+            DiskPixelCacheOptions diskOptions;
+            diskOptions.MaxBytes = bytes * 2 + diskOptions.SegmentBytes;
+            DiskPixelCache disk(directory, diskOptions);
+
+            auto first = id;
+            for (uint32_t i = 0; i < count; i++, id++)
+            {
+                raw.Insert(Key(id), image);
+                tier.Demote(Key(id), image);
+                disk.Store(Key(id), image);
+            }
+            // Map the segments before timing.
+            for (auto i = first; i < id; i++)
+            {
+                disk.Load(Key(i));
+            }
+
+            auto time = [&](auto&& find)
+            {
+                auto fastest = FastestOf([&]()
+                    {
+                        for (auto i = first; i < id; i++)
+                        {
+                            if (!find(Key(i)))
+                            {
+                                throw std::runtime_error("A tier lost an image");
+                            }
+                        }
+                    });
+                return Milliseconds(fastest) * 1000 / count;
+            };
+            auto rawTime = time([&](ImageKey const& key) { return raw.Find(key) != nullptr; });
+            auto tierTime = time([&](ImageKey const& key) { return tier.Find(key).has_value(); });
+            auto diskTime = time([&](ImageKey const& key) { return disk.Load(key).has_value(); });
+
+            auto name = std::to_string(size) + "x" + std::to_string(size);
+            std::printf("%-10s %-11s %10.2f %12.2f %12.1f %12.1f\n", name.c_str(), screenshot ? "screenshot" : "photo",
+                tier.Stats().CompressionRatio(), rawTime, tierTime, diskTime);
+        }
+    }
+}
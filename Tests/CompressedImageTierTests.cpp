@@ -0,0 +1,134 @@
+#include "TestHarness.h"
+#include "CompressedImageTier.h"
+
+namespace
+{
+    ImageKey Key(uint64_t id)
+    {
+        return ImageKeyForContent(id, 1000 + id);
+    }
+
+    // Flat bands of color, which QOI turns into a handful of runs.
+    PixelBuffer Flat(uint32_t width, uint32_t height, uint8_t shade = 80)
+    {
+        PixelBuffer image(width, height);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            auto row = image.Row(y);
+            for (uint32_t x = 0; x < width; x++)
+            {
+                row[x * 4 + 0] = shade;
+                row[x * 4 + 1] = static_cast<uint8_t>(y / 8);
+                row[x * 4 + 2] = 200;
+                row[x * 4 + 3] = 255;
+            }
+        }
+        return image;
+    }
+
+    // Every byte random, which no lossless codec can do anything with.
+    PixelBuffer Noise(uint32_t width, uint32_t height)
+    {
+        PixelBuffer image(width, height);
+        uint32_t state = 12345;
+        for (auto& byte : image.Bytes)
+        {
+            state = state * 1664525u + 1013904223u;
+            byte = static_cast<uint8_t>(state >> 24);
+        }
+        return image;
+    }
+}
+
+TEST(CompressedImageTier, DemotedImagesComeBackExactly)
+{
+    CompressedImageTier tier;
+    auto image = Flat(100, 70);
+    tier.Demote(Key(1), image);
+    auto stats = tier.Stats();
+    CHECK_EQ(stats.Demotions, uint64_t(1));
+    CHECK(stats.CompressionRatio() < 0.1);
+    auto hit = tier.Find(Key(1));
+    CHECK(hit.has_value());
+    CHECK(hit->Pixels.Bytes == image.Bytes);
+    CHECK(!hit->Promote);
+    CHECK(!tier.Find(Key(2)).has_value());
+}
+
+TEST(CompressedImageTier, LargeNoisyImagesAreRejectedBySample)
+{
+    CompressedImageTier tier;
+    tier.Demote(Key(1), Noise(256, 1024));
+    auto stats = tier.Stats();
+    CHECK_EQ(stats.Incompressible, uint64_t(1));
+    CHECK_EQ(stats.RejectedBySample, uint64_t(1));
+    CHECK(!tier.Find(Key(1)).has_value());
+
+    // Too small to sample: the whole image is compressed and then dropped.
+    tier.Demote(Key(2), Noise(64, 64));
+    stats = tier.Stats();
+    CHECK_EQ(stats.Incompressible, uint64_t(2));
+    CHECK_EQ(stats.RejectedBySample, uint64_t(1));
+}
+
+TEST(CompressedImageTier, TheSampleLetsCompressibleImagesThrough)
+{
+    CompressedImageTier tier;
+    tier.Demote(Key(1), Flat(256, 1024));
+    CHECK_EQ(tier.Stats().Demotions, uint64_t(1));
+    CHECK_EQ(tier.Stats().Incompressible, uint64_t(0));
+}
+
+TEST(CompressedImageTier, OnlyPromotesWhatTheRawCacheCanHold)
+{
+    CompressedTierOptions options;
+    options.PromoteAfterHits = 1;
+    CompressedImageTier tier(options);
+    auto image = Flat(64, 64);
+    tier.Demote(Key(1), image);
+
+    // Bigger than the raw cache: it stays here, however often it's hit.
+    for (int i = 0; i < 3; i++)
+    {
+        auto hit = tier.Find(Key(1), image.Bytes.size() - 1);
+        CHECK(hit.has_value());
+        CHECK(!hit->Promote);
+    }
+    CHECK_EQ(tier.Stats().Promotions, uint64_t(0));
+
+    auto hit = tier.Find(Key(1), image.Bytes.size());
+    CHECK(hit->Promote);
+    CHECK(hit->Pixels.Bytes == image.Bytes);
+    CHECK(!tier.Find(Key(1)).has_value());
+}
+
+TEST(CompressedImageTier, EvictsLeastRecentlyUsed)
+{
+    CompressedImageTier probe;
+    probe.Demote(Key(0), Flat(64, 64));
+    auto entryBytes = probe.Stats().BytesUsed;
+
+    CompressedTierOptions options;
+    options.BudgetBytes = entryBytes * 2;
+    options.PromoteAfterHits = 100;
+    CompressedImageTier tier(options);
+    tier.Demote(Key(1), Flat(64, 64, 1));
+    tier.Demote(Key(2), Flat(64, 64, 2));
+    CHECK(tier.Find(Key(1)).has_value());
+    tier.Demote(Key(3), Flat(64, 64, 3));
+    CHECK_EQ(tier.Stats().Evictions, uint64_t(1));
+    CHECK(tier.Find(Key(1)).has_value());
+    CHECK(!tier.Find(Key(2)).has_value());
+    CHECK(tier.Find(Key(3)).has_value());
+}
+
+TEST(CompressedImageTier, RejectsOptionsItCantWorkWith)
+{
+    CompressedTierOptions noHits;
+    noHits.PromoteAfterHits = 0;
+    CHECK_THROWS(CompressedImageTier{ noHits }, std::invalid_argument);
+    // The sample divides the image up by it.
+    CompressedTierOptions noRows;
+    noRows.BandHeight = 0;
+    CHECK_THROWS(CompressedImageTier{ noRows }, std::invalid_argument);
+}
@@ -0,0 +1,96 @@
+#include "TestHarness.h"
+#include "ContentHash.h"
+#include "Simd.h"
+
+namespace
+{
+    std::vector<uint8_t> TestBytes(size_t size, uint32_t seed = 1)
+    {
+        std::vector<uint8_t> bytes(size);
+        for (auto& byte : bytes)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            byte = static_cast<uint8_t>(seed >> 24);
+        }
+        return bytes;
+    }
+
+    // Around the stripe (64 bytes) and block (1 KB) edges, and something big.
+    constexpr size_t Sizes[] = { 0, 1, 7, 63, 64, 65, 127, 128, 1023, 1024, 1025, 3000, 65536, 100003 };
+}
+
+TEST(ContentHash, VectorAndScalarGiveTheSameDigest)
+{
+    for (auto size : Sizes)
+    {
+        auto bytes = TestBytes(size);
+        auto vector = ContentHasher::Hash(bytes.data(), bytes.size());
+        SetSimdEnabled(false);
+        auto scalar = ContentHasher::Hash(bytes.data(), bytes.size());
+        SetSimdEnabled(true);
+        CHECK_EQ(vector, scalar);
+    }
+}
+
+TEST(ContentHash, SplittingTheInputDoesntChangeTheDigest)
+{
+    auto bytes = TestBytes(5000);
+    auto whole = ContentHasher::Hash(bytes.data(), bytes.size());
+    for (size_t chunk : { 1, 3, 63, 64, 65, 100, 1024, 4999 })
+    {
+        ContentHasher hasher;
+        for (size_t offset = 0; offset < bytes.size(); offset += chunk)
+        {
+            hasher.Update(bytes.data() + offset, std::min(chunk, bytes.size() - offset));
+        }
+        CHECK_EQ(hasher.Digest(), whole);
+        CHECK_EQ(hasher.Length(), uint64_t(5000));
+    }
+
+    // Uneven pieces, with some empty ones.
+    ContentHasher hasher;
+    uint32_t seed = 5;
+    size_t offset = 0;
+    while (offset < bytes.size())
+    {
+        seed = seed * 1664525u + 1013904223u;
+        auto count = std::min<size_t>((seed >> 16) % 300, bytes.size() - offset);
+        hasher.Update(bytes.data() + offset, count);
+        offset += count;
+    }
+    CHECK_EQ(hasher.Digest(), whole);
+}
+
+TEST(ContentHash, DigestCanBeTakenPartWay)
+{
+    auto bytes = TestBytes(3000);
+    ContentHasher hasher;
+    hasher.Update(bytes.data(), 1500);
+    CHECK_EQ(hasher.Digest(), ContentHasher::Hash(bytes.data(), 1500));
+    hasher.Update(bytes.data() + 1500, 1500);
+    CHECK_EQ(hasher.Digest(), ContentHasher::Hash(bytes.data(), bytes.size()));
+}
+
+TEST(ContentHash, DifferentContentGetsDifferentDigests)
+{
+    std::vector<uint64_t> digests;
+    for (auto size : Sizes)
+    {
+        auto bytes = TestBytes(size);
+        digests.push_back(ContentHasher::Hash(bytes.data(), bytes.size()));
+    }
+    std::sort(digests.begin(), digests.end());
+    CHECK(std::adjacent_find(digests.begin(), digests.end()) == digests.end());
+
+    // One bit anywhere, or a trailing zero, is enough.
+    auto bytes = TestBytes(2048, 9);
+    auto original = ContentHasher::Hash(bytes.data(), bytes.size());
+    for (size_t position : { size_t(0), size_t(63), size_t(1000), size_t(2047) })
+    {
+        bytes[position] ^= 1;
+        CHECK(ContentHasher::Hash(bytes.data(), bytes.size()) != original);
+        bytes[position] ^= 1;
+    }
+    bytes.push_back(0);
+    CHECK(ContentHasher::Hash(bytes.data(), bytes.size()) != original);
+}
@@ -0,0 +1,102 @@
+#include "BenchHarness.h"
+#include "DecodedImageCache.h"
+
+namespace
+{
+    ImageKey Key(uint64_t id)
+    {
+        return ImageKeyForContent(id, 1000 + id);
+    }
+
+    struct RunResult
+    {
+        std::chrono::nanoseconds Time;
+        DecodedImageCacheStats Stats;
+    };
+
+    // threadCount threads each make operations calls to FindOrLoad, half of
+    // them for the most popular tenth of the keys. The cache holds a quarter
+    // of the keys, so a good share of the loads evict something.
+    RunResult Run(uint32_t shardCount, uint32_t threadCount, uint32_t operations, uint32_t keyCount, PixelBuffer const& image)
+    {
+        DecodedImageCache cache(image.Bytes.size() * keyCount / 4, shardCount);
+        std::atomic<bool> go = false;
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < threadCount; t++)
+        {
+            threads.emplace_back([&, t]()
+                {
+                    uint32_t seed = 17 + t * 7919;
+                    while (!go)
+                    {
+                        std::this_thread::yield();
+                    }
+                    for (uint32_t i = 0; i < operations; i++)
+                    {
+                        seed = seed * 1664525u + 1013904223u;
+                        auto id = (seed >> 16) % ((seed & 1) ? std::max(1u, keyCount / 10) : keyCount);
+                        cache.FindOrLoad(Key(id), [&]() { return image; });
+                    }
+                });
+        }
+        auto start = std::chrono::steady_clock::now();
+        go = true;
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        return { std::chrono::steady_clock::now() - start, cache.Stats() };
+    }
+}
+
+// Loads from several threads at once into a cache that's always full, so
+// lookups, inserts and the evictions they cause all contend. Compares one
+// shard (a single lock) with the default sixteen, whose evictions only lock
+// the shard they take from. Then the cost of an insert that has to evict,
+// from one thread, as the number of shards grows.
+//
+// The sample only loads one image, so this is the only place the cache sees
+// more than one loader at a time.
+BENCH(decodedcache, "DecodedImageCache under concurrent loads [maxThreads] [operations per thread] [keys]")
+{
+    uint32_t maxThreads = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 8;
+    uint32_t operations = arguments.size() > 1 ? static_cast<uint32_t>(std::stoul(arguments[1])) : 200000;
+    uint32_t keyCount = arguments.size() > 2 ? static_cast<uint32_t>(std::stoul(arguments[2])) : 4000;
+    auto image = TestImage(16, 16);
+
+    std::printf("%u operations a thread over %u keys, room for %u, %u hardware threads\n", operations, keyCount, keyCount / 4,
+        std::thread::hardware_concurrency());
+    std::printf("%-8s %-8s %12s %10s %12s\n", "shards", "threads", "Mops/s", "hits", "evictions");
+    for (uint32_t shardCount : { 1u, 16u })
+    {
+        for (uint32_t threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+        {
+            auto result = Run(shardCount, threadCount, operations, keyCount, image);
+            auto total = static_cast<double>(operations) * threadCount;
+            auto lookups = result.Stats.Hits + result.Stats.Misses + result.Stats.SharedLoads;
+            std::printf("%-8u %-8u %12.2f %9.1f%% %12llu\n", shardCount, threadCount, total / (Milliseconds(result.Time) * 1000),
+                lookups > 0 ? 100.0 * result.Stats.Hits / lookups : 0.0, static_cast<unsigned long long>(result.Stats.Evictions));
+        }
+    }
+
+    // Every insert pushes the oldest entry out, wherever it is.
+    constexpr uint32_t inserts = 20000;
+    std::printf("\n%-8s %16s\n", "shards", "ns/evicting insert");
+    for (uint32_t shardCount : { 1u, 4u, 16u, 64u })
+    {
+        DecodedImageCache cache(image.Bytes.size() * 1000, shardCount);
+        uint64_t id = 0;
+        for (; id < 1000; id++)
+        {
+            cache.Insert(Key(id), image);
+        }
+        auto time = FastestOf([&]()
+            {
+                for (uint32_t i = 0; i < inserts; i++)
+                {
+                    cache.Insert(Key(id++), image);
+                }
+            });
+        std::printf("%-8u %16.1f\n", shardCount, static_cast<double>(time.count()) / inserts);
+    }
+}
@@ -0,0 +1,135 @@
+#include "TestHarness.h"
+#include "DecodedImageCache.h"
+
+namespace
+{
+    ImageKey Key(uint64_t id)
+    {
+        return ImageKeyForContent(id, 1000 + id);
+    }
+
+    // 64x64 BGRA, so 16K each.
+    constexpr uint64_t ImageBytes = 64 * 64 * 4;
+}
+
+TEST(DecodedImageCache, ImagesBiggerThanAShardAreCached)
+{
+    // Each of the 16 shards would only get 4K of this to itself.
+    DecodedImageCache cache(ImageBytes * 4, 16);
+    cache.Insert(Key(1), TestImage(64, 64));
+    CHECK(cache.Find(Key(1)) != nullptr);
+    CHECK_EQ(cache.Stats().Rejections, uint64_t(0));
+    CHECK_EQ(cache.Stats().BytesUsed, ImageBytes);
+}
+
+TEST(DecodedImageCache, EvictsTheLeastRecentlyUsedFromAnyShard)
+{
+    DecodedImageCache cache(ImageBytes * 3, 16);
+    std::vector<uint64_t> evicted;
+    cache.OnEvicted([&](ImageKey const& key, DecodedImageCache::Image const& image)
+        {
+            CHECK(image != nullptr);
+            evicted.push_back(key.ContentHash);
+        });
+    cache.Insert(Key(1), TestImage(64, 64, 1));
+    cache.Insert(Key(2), TestImage(64, 64, 2));
+    cache.Insert(Key(3), TestImage(64, 64, 3));
+    CHECK(cache.Find(Key(1)) != nullptr);
+    cache.Insert(Key(4), TestImage(64, 64, 4));
+    CHECK(evicted == std::vector<uint64_t>{ 2 });
+    CHECK(cache.Find(Key(2)) == nullptr);
+    CHECK(cache.Find(Key(1)) != nullptr);
+    CHECK_EQ(cache.Stats().BytesUsed, ImageBytes * 3);
+    CHECK_EQ(cache.Stats().Evictions, uint64_t(1));
+}
+
+TEST(DecodedImageCache, ImagesBiggerThanTheBudgetAreHandedBackQuietly)
+{
+    DecodedImageCache cache(ImageBytes * 2, 4);
+    uint32_t evictions = 0;
+    cache.OnEvicted([&](ImageKey const&, DecodedImageCache::Image const&) { evictions++; });
+    cache.Insert(Key(1), TestImage(64, 64));
+    auto image = cache.Insert(Key(2), TestImage(128, 128));
+    CHECK(image != nullptr);
+    CHECK_EQ(image->Width, 128u);
+    CHECK(cache.Find(Key(2)) == nullptr);
+    // Nothing was pushed out for it, and it isn't passed on to the next tier.
+    CHECK(cache.Find(Key(1)) != nullptr);
+    CHECK_EQ(evictions, 0u);
+    CHECK_EQ(cache.Stats().Rejections, uint64_t(1));
+}
+
+TEST(DecodedImageCache, ReplacingAndErasingKeepTheCount)
+{
+    DecodedImageCache cache(ImageBytes * 4);
+    cache.Insert(Key(1), TestImage(64, 64, 1));
+    cache.Insert(Key(1), TestImage(64, 64, 2));
+    CHECK_EQ(cache.Stats().BytesUsed, ImageBytes);
+    CHECK(cache.Find(Key(1))->Bytes == TestImage(64, 64, 2).Bytes);
+    cache.Insert(Key(2), TestImage(64, 64));
+    cache.Erase(Key(1));
+    CHECK_EQ(cache.Stats().BytesUsed, ImageBytes);
+    cache.Clear();
+    CHECK_EQ(cache.Stats().BytesUsed, uint64_t(0));
+}
+
+TEST(DecodedImageCache, LoadsAreSharedAndFailuresPassedOn)
+{
+    DecodedImageCache cache(ImageBytes * 4);
+    std::atomic<uint32_t> loads = 0;
+    std::vector<std::thread> threads;
+    std::vector<DecodedImageCache::Image> images(4);
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        threads.emplace_back([&, i]()
+            {
+                images[i] = cache.FindOrLoad(Key(1), [&]()
+                    {
+                        loads++;
+                        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                        return TestImage(64, 64);
+                    });
+            });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    CHECK_EQ(loads.load(), 1u);
+    for (auto& image : images)
+    {
+        CHECK(image == images[0]);
+    }
+
+    CHECK_THROWS(cache.FindOrLoad(Key(2), []() -> PixelBuffer { throw std::runtime_error("bad file"); }), std::runtime_error);
+    CHECK(cache.Find(Key(2)) == nullptr);
+}
+
+TEST(DecodedImageCache, ConcurrentInsertsStayWithinBudget)
+{
+    DecodedImageCache cache(ImageBytes * 10, 8);
+    std::atomic<uint64_t> evictedBytes = 0;
+    cache.OnEvicted([&](ImageKey const&, DecodedImageCache::Image const& image) { evictedBytes += image->Bytes.size(); });
+    auto image = TestImage(64, 64);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&, t]()
+            {
+                for (uint64_t i = 0; i < 200; i++)
+                {
+                    cache.Insert(Key(t * 1000 + i), image);
+                    cache.Find(Key(t * 1000 + i / 2));
+                }
+            });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    auto stats = cache.Stats();
+    CHECK_EQ(stats.BytesUsed, ImageBytes * 10);
+    CHECK_EQ(stats.Insertions, uint64_t(800));
+    CHECK_EQ(stats.Evictions, uint64_t(790));
+    CHECK_EQ(evictedBytes.load(), ImageBytes * 790);
+}
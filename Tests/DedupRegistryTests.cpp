@@ -0,0 +1,116 @@
+#include "TestHarness.h"
+#include "DedupRegistry.h"
+#include "ContentHash.h"
+#include "SoftwareSurfaceBackend.h"
+
+namespace
+{
+    // The same bytes get the same key, wherever they were read from.
+    ImageKey KeyFor(PixelBuffer const& encoded)
+    {
+        return ImageKeyForContent(ContentHasher::Hash(encoded.Bytes.data(), encoded.Bytes.size()), encoded.Bytes.size());
+    }
+
+    SharedImage Loaded(PixelBuffer const& image, uint32_t surfaceWidth, uint32_t surfaceHeight)
+    {
+        auto surface = std::make_shared<SoftwareSurfaceBackend>();
+        surface->Resize(surfaceWidth, surfaceHeight);
+        return { std::make_shared<PixelBuffer const>(image), surface };
+    }
+}
+
+TEST(DedupRegistry, CopiesOfTheSameContentShareOneImage)
+{
+    DedupRegistry registry;
+    auto image = TestImage(10, 10);
+    auto key = KeyFor(image);
+    CHECK(!registry.Acquire(key).has_value());
+    auto added = registry.Add(key, Loaded(image, 20, 20));
+
+    // A second copy of the same bytes, as if from another path.
+    auto copy = TestImage(10, 10);
+    auto shared = registry.Acquire(KeyFor(copy));
+    CHECK(shared.has_value());
+    CHECK(shared->Pixels == added.Pixels);
+    CHECK(shared->Surface == added.Surface);
+    CHECK_EQ(registry.References(key), size_t(2));
+
+    // Different content doesn't.
+    CHECK(!registry.Acquire(KeyFor(TestImage(10, 10, 2))).has_value());
+}
+
+TEST(DedupRegistry, TheFirstAddWins)
+{
+    DedupRegistry registry;
+    auto image = TestImage(8, 8);
+    auto key = KeyFor(image);
+    auto first = registry.Add(key, Loaded(image, 8, 8));
+    auto second = registry.Add(key, Loaded(image, 8, 8));
+    CHECK(second.Pixels == first.Pixels);
+    CHECK(second.Surface == first.Surface);
+    CHECK_EQ(registry.References(key), size_t(2));
+    auto stats = registry.Stats();
+    CHECK_EQ(stats.Loads, uint64_t(2));
+    CHECK_EQ(stats.DeduplicatedLoads, uint64_t(1));
+    CHECK_EQ(stats.UniqueImages, uint64_t(1));
+}
+
+TEST(DedupRegistry, TheLastReleaseLetsGo)
+{
+    DedupRegistry registry;
+    auto image = TestImage(8, 8);
+    auto key = KeyFor(image);
+    auto added = registry.Add(key, Loaded(image, 8, 8));
+    registry.Acquire(key);
+    registry.Acquire(key);
+    CHECK(!registry.Release(key));
+    CHECK(!registry.Release(key));
+    CHECK(registry.Release(key));
+    CHECK_EQ(registry.References(key), size_t(0));
+    CHECK(!registry.Acquire(key).has_value());
+    CHECK_THROWS(registry.Release(key), std::invalid_argument);
+    // Whoever still holds the image keeps it alive.
+    CHECK(added.Pixels->Bytes == image.Bytes);
+
+    auto stats = registry.Stats();
+    CHECK_EQ(stats.UniqueImages, uint64_t(0));
+    CHECK_EQ(stats.References, uint64_t(0));
+    CHECK_EQ(stats.UniqueBytes, uint64_t(0));
+}
+
+TEST(DedupRegistry, StatsCountTheBytesSaved)
+{
+    DedupRegistry registry;
+    auto empty = registry.Stats();
+    CHECK_EQ(empty.DeduplicationRatio(), 1.0);
+    CHECK_EQ(empty.BytesSaved(), uint64_t(0));
+
+    // 400 bytes of pixels and a 1600 byte surface, shown three times.
+    auto image = TestImage(10, 10);
+    auto key = KeyFor(image);
+    auto added = registry.Add(key, Loaded(image, 20, 20));
+    registry.Acquire(key);
+    registry.Acquire(key);
+    // And something else that's only shown once.
+    auto other = TestImage(5, 5, 3);
+    registry.Add(KeyFor(other), { std::make_shared<PixelBuffer const>(other), nullptr });
+
+    auto stats = registry.Stats();
+    CHECK_EQ(stats.Loads, uint64_t(4));
+    CHECK_EQ(stats.DeduplicatedLoads, uint64_t(2));
+    CHECK_EQ(stats.UniqueImages, uint64_t(2));
+    CHECK_EQ(stats.References, uint64_t(4));
+    CHECK_EQ(stats.UniqueBytes, uint64_t(2000 + 100));
+    CHECK_EQ(stats.ReferencedBytes, uint64_t(6000 + 100));
+    CHECK_EQ(stats.BytesSaved(), uint64_t(4000));
+    CHECK_EQ(stats.DeduplicationRatio(), 6100.0 / 2100.0);
+
+    // A surface that grows after it was added counts at its new size.
+    added.Surface->Resize(40, 40);
+    stats = registry.Stats();
+    CHECK_EQ(stats.UniqueBytes, uint64_t(400 + 6400 + 100));
+    CHECK_EQ(stats.BytesSaved(), uint64_t(2 * 6800));
+
+    registry.Release(key);
+    CHECK_EQ(registry.Stats().BytesSaved(), uint64_t(6800));
+}
@@ -0,0 +1,53 @@
+#include "TestHarness.h"
+#include "DirtyRects.h"
+#include "SoftwareSurfaceBackend.h"
+
+TEST(DirtyRects, ClipsAndDropsEmptyRects)
+{
+    auto rects = CoalesceDirtyRects({ { -10, -10, 20, 20 }, { 90, 90, 50, 50 }, { 200, 0, 10, 10 }, { 5, 5, 0, 4 } }, 100, 100);
+    CHECK_EQ(rects.size(), size_t(2));
+    for (auto const& rect : rects)
+    {
+        CHECK(rect.X >= 0 && rect.Y >= 0);
+        CHECK(rect.X + rect.Width <= 100u && rect.Y + rect.Height <= 100u);
+    }
+}
+
+TEST(DirtyRects, MergesNeighboursButNotFarApartRects)
+{
+    // Overlapping and touching rects become one.
+    auto close = CoalesceDirtyRects({ { 0, 0, 100, 100 }, { 50, 50, 100, 100 }, { 150, 0, 10, 10 } }, 1000, 1000);
+    CHECK_EQ(close.size(), size_t(1));
+    // Big rects on opposite corners would mean uploading most of the surface.
+    auto far = CoalesceDirtyRects({ { 0, 0, 200, 200 }, { 800, 800, 200, 200 } }, 1000, 1000);
+    CHECK_EQ(far.size(), size_t(2));
+}
+
+TEST(DirtyRects, OnlyTheDirtyPartsAreUploaded)
+{
+    SoftwareSurfaceBackend surface(SurfaceFormat::B8G8R8A8, { 5, 9 });
+    auto first = TestImage(256, 256);
+    DirtyRectStats stats;
+    // The surface doesn't match yet, so everything goes up.
+    UpdateDirtyRects(surface, first, { { 0, 0, 8, 8 } }, stats);
+    CHECK(surface.ReadPixels() == first.Bytes);
+    CHECK_EQ(stats.BytesUploaded, uint64_t(first.Bytes.size()));
+
+    auto second = first;
+    std::vector<SurfaceRect> dirty = { { 10, 10, 20, 20 }, { 200, 180, 40, 30 } };
+    for (auto const& rect : dirty)
+    {
+        for (uint32_t y = rect.Y; y < rect.Y + rect.Height; y++)
+        {
+            std::memset(second.Row(y) + rect.X * 4, 0x7f, rect.Width * 4);
+        }
+    }
+    auto written = surface.BytesWritten();
+    stats = {};
+    UpdateDirtyRects(surface, second, dirty, stats);
+    CHECK(surface.ReadPixels() == second.Bytes);
+    CHECK_EQ(stats.RectsUploaded, uint64_t(2));
+    CHECK_EQ(stats.BytesUploaded, uint64_t((20 * 20 + 40 * 30) * 4));
+    CHECK_EQ(surface.BytesWritten() - written, stats.BytesUploaded);
+    CHECK_EQ(stats.BytesSaved, uint64_t(first.Bytes.size()) - stats.BytesUploaded);
+}
@@ -0,0 +1,115 @@
+#include "BenchHarness.h"
+#include "DiskPixelCache.h"
+
+namespace
+{
+    ImageKey Key(uint64_t id)
+    {
+        return ImageKeyForContent(id, 1000 + id);
+    }
+
+    double Megabytes(uint64_t bytes)
+    {
+        return static_cast<double>(bytes) / (1024 * 1024);
+    }
+
+    // Every thread loads every image once. Returns how long that took.
+    std::chrono::nanoseconds LoadAll(DiskPixelCache& cache, uint32_t imageCount, uint32_t threadCount)
+    {
+        std::atomic<bool> go = false;
+        std::atomic<uint32_t> misses = 0;
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < threadCount; t++)
+        {
+            threads.emplace_back([&, t]()
+                {
+                    while (!go)
+                    {
+                        std::this_thread::yield();
+                    }
+                    // Start each thread somewhere else so they don't march in step.
+                    for (uint32_t i = 0; i < imageCount; i++)
+                    {
+                        if (!cache.Load(Key((i + t * imageCount / threadCount) % imageCount)))
+                        {
+                            misses++;
+                        }
+                    }
+                });
+        }
+        auto start = std::chrono::steady_clock::now();
+        go = true;
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        auto time = std::chrono::steady_clock::now() - start;
+        if (misses > 0)
+        {
+            throw std::runtime_error("The disk cache lost an image");
+        }
+        return time;
+    }
+}
+
+// Loads from a disk cache that's already open and mapped (the warm case: the
+// segments are in the page cache, so this is the cost of finding the record
+// and copying it out), with and without checking checksums on every read, and
+// from several threads at once. Then what a store costs, and what it costs to
+// write the index now that it syncs the segments first.
+BENCH(diskcache, "Warm loads from DiskPixelCache [images] [size] [maxThreads]")
+{
+    uint32_t imageCount = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 128;
+    uint32_t size = arguments.size() > 1 ? static_cast<uint32_t>(std::stoul(arguments[1])) : 256;
+    uint32_t maxThreads = arguments.size() > 2 ? static_cast<uint32_t>(std::stoul(arguments[2])) : 4;
+    auto image = TestImage(size, size);
+    auto totalBytes = static_cast<uint64_t>(image.Bytes.size()) * imageCount;
+    auto directory = TestDirectory("DiskPixelCacheBench");
+
+    DiskPixelCacheOptions options;
+    options.MaxBytes = totalBytes * 2 + options.SegmentBytes;
+    std::chrono::nanoseconds storeTime{};
+    std::chrono::nanoseconds flushTime{};
+    {
+        DiskPixelCache cache(directory, options);
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < imageCount; i++)
+        {
+            cache.Store(Key(i), image);
+        }
+        storeTime = std::chrono::steady_clock::now() - start;
+        start = std::chrono::steady_clock::now();
+        cache.Flush();
+        flushTime = std::chrono::steady_clock::now() - start;
+    }
+    std::printf("%u images of %ux%u, %.1f MB\n", imageCount, size, size, Megabytes(totalBytes));
+    std::printf("store: %.1f us an image, flush (sync and index): %.2f ms\n\n", Milliseconds(storeTime) * 1000 / imageCount,
+        Milliseconds(flushTime));
+
+    std::printf("%-8s %-8s %14s %10s\n", "verify", "threads", "us/load", "MB/s");
+    for (auto verify : { false, true })
+    {
+        options.VerifyOnRead = verify;
+        DiskPixelCache cache(directory, options);
+        // Map everything once, so what's timed is the warm path.
+        LoadAll(cache, imageCount, 1);
+        for (uint32_t threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+        {
+            auto time = FastestOf([&]() { LoadAll(cache, imageCount, threadCount); });
+            auto loads = static_cast<double>(imageCount) * threadCount;
+            std::printf("%-8s %-8u %14.1f %10.0f\n", verify ? "yes" : "no", threadCount, Milliseconds(time) * 1000 / loads,
+                Megabytes(totalBytes) * threadCount / (Milliseconds(time) / 1000));
+        }
+    }
+
+    // For scale: the copy on its own.
+    std::vector<uint8_t> copy;
+    auto copyTime = FastestOf([&]()
+        {
+            for (uint32_t i = 0; i < imageCount; i++)
+            {
+                copy.assign(image.Bytes.begin(), image.Bytes.end());
+            }
+        });
+    std::printf("\ncopy alone: %.1f us an image\n", Milliseconds(copyTime) * 1000 / imageCount);
+}
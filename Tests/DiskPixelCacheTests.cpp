@@ -0,0 +1,113 @@
+#include "TestHarness.h"
+#include "DiskPixelCache.h"
+
+namespace
+{
+    ImageKey Key(uint64_t id)
+    {
+        ImageKey key;
+        key.Path = "photos/" + std::to_string(id) + ".jpg";
+        key.FileSize = 1000 + id;
+        key.ModifiedTime = 42;
+        return key;
+    }
+
+    DiskPixelCacheOptions SmallSegments()
+    {
+        DiskPixelCacheOptions options;
+        options.SegmentBytes = 256 * 1024;
+        options.MaxBytes = 1024 * 1024;
+        return options;
+    }
+}
+
+TEST(DiskPixelCache, ImagesSurviveAReopen)
+{
+    auto directory = TestDirectory("DiskPixelCacheReopen");
+    auto image = TestImage(50, 30);
+    {
+        DiskPixelCache cache(directory);
+        cache.Store(Key(1), image);
+        auto loaded = cache.Load(Key(1));
+        CHECK(loaded.has_value());
+        CHECK(loaded->Bytes == image.Bytes);
+        CHECK(!cache.Load(Key(2)).has_value());
+    }
+    DiskPixelCache cache(directory);
+    auto loaded = cache.Load(Key(1));
+    CHECK(loaded.has_value());
+    CHECK_EQ(loaded->Width, 50u);
+    CHECK(loaded->Bytes == image.Bytes);
+    // The destructor wrote the index, so nothing had to be scanned for.
+    CHECK_EQ(cache.Stats().RecordsRecovered, uint64_t(0));
+}
+
+TEST(DiskPixelCache, RecordsWrittenAfterTheIndexAreRecovered)
+{
+    auto directory = TestDirectory("DiskPixelCacheRecover");
+    {
+        DiskPixelCache cache(directory);
+        cache.Store(Key(1), TestImage(20, 20, 1));
+        cache.Flush();
+        cache.Store(Key(2), TestImage(20, 20, 2));
+        // Pretend we crashed before the index was written again.
+        std::filesystem::copy_file(directory / "index.bin", directory / "index.old");
+    }
+    std::filesystem::rename(directory / "index.old", directory / "index.bin");
+    DiskPixelCache cache(directory);
+    CHECK_EQ(cache.Stats().RecordsRecovered, uint64_t(1));
+    CHECK(cache.Load(Key(2))->Bytes == TestImage(20, 20, 2).Bytes);
+}
+
+TEST(DiskPixelCache, StrayFilesInTheDirectoryAreIgnored)
+{
+    auto directory = TestDirectory("DiskPixelCacheStray");
+    {
+        DiskPixelCache cache(directory);
+        cache.Store(Key(1), TestImage(20, 20));
+    }
+    // Twelve characters ending in .seg, but not a segment id.
+    for (auto name : { "zzzzzzzz.seg", "-0000001.seg", "0x000001.seg", "1234.seg" })
+    {
+        std::ofstream(directory / name) << "not a segment";
+    }
+    DiskPixelCache cache(directory);
+    CHECK(cache.Load(Key(1)).has_value());
+    CHECK(std::filesystem::exists(directory / "zzzzzzzz.seg"));
+}
+
+TEST(DiskPixelCache, FlushIfDueWritesTheIndexOncePerInterval)
+{
+    auto directory = TestDirectory("DiskPixelCacheFlushIfDue");
+    auto options = SmallSegments();
+    options.FlushInterval = std::chrono::hours(1);
+    DiskPixelCache cache(directory, options);
+    for (uint64_t i = 0; i < 10; i++)
+    {
+        cache.Store(Key(i), TestImage(16, 16, static_cast<uint32_t>(i)));
+        cache.FlushIfDue();
+    }
+    // The first one is written straight away, the rest wait for the interval.
+    CHECK_EQ(cache.Stats().IndexWrites, uint64_t(1));
+    cache.Flush();
+    CHECK_EQ(cache.Stats().IndexWrites, uint64_t(2));
+    // Nothing new, nothing to write.
+    cache.Flush();
+    CHECK_EQ(cache.Stats().IndexWrites, uint64_t(2));
+    CHECK(!std::filesystem::exists(directory / "index.tmp"));
+}
+
+TEST(DiskPixelCache, OldSegmentsAreDeletedOverBudget)
+{
+    auto directory = TestDirectory("DiskPixelCacheEvict");
+    DiskPixelCache cache(directory, SmallSegments());
+    // 64K each, so four to a segment and sixteen to the budget.
+    for (uint64_t i = 0; i < 40; i++)
+    {
+        cache.Store(Key(i), TestImage(128, 128, static_cast<uint32_t>(i)));
+    }
+    CHECK(cache.SizeBytes() <= SmallSegments().MaxBytes);
+    CHECK(cache.Stats().SegmentsEvicted > 0);
+    CHECK(!cache.Load(Key(0)).has_value());
+    CHECK(cache.Load(Key(39))->Bytes == TestImage(128, 128, 39).Bytes);
+}
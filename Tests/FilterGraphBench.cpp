@@ -0,0 +1,35 @@
+#include "BenchHarness.h"
+#include "FilterGraph.h"
+
+// A few chains, each run fused (Apply, one tile at a time through the whole
+// chain) and unfused (ApplyUnfused, one pass over the image per filter).
+// The point chains show what keeping the intermediates in cache buys when
+// the filters themselves are cheap, the blur chains how much the tile
+// borders cost when they grow with the radius.
+//
+// The sample ships with no filters (main.cpp only has an example chain in a
+// comment), so this is the only place a chain runs on a full size image.
+BENCH(filters, "FilterGraph fused against unfused execution [width] [height]")
+{
+    uint32_t width = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 4032;
+    uint32_t height = arguments.size() > 1 ? static_cast<uint32_t>(std::stoul(arguments[1])) : 3024;
+    auto image = TestImage(width, height);
+    auto megapixels = static_cast<double>(width) * height / 1e6;
+
+    std::pair<char const*, FilterGraph> chains[] = {
+        { "exposure+contrast", FilterGraph().Exposure(0.5f).Contrast(1.1f) },
+        { "sample (main.cpp)", FilterGraph().Exposure(0.5f).Contrast(1.1f).Sharpen(0.5f, 1) },
+        { "4 point filters", FilterGraph().Exposure(0.25f).Contrast(1.1f).Exposure(-0.25f).Contrast(0.9f) },
+        { "3x blur r2", FilterGraph().BoxBlur(2).BoxBlur(2).BoxBlur(2) },
+        { "3x blur r8", FilterGraph().BoxBlur(8).BoxBlur(8).BoxBlur(8) },
+    };
+    std::printf("%ux%u\n", width, height);
+    std::printf("%-18s %10s %10s %8s %10s\n", "chain", "fused ms", "unfused", "speedup", "MP/s");
+    for (auto& [name, graph] : chains)
+    {
+        auto fused = FastestOf([&]() { graph.Apply(image); }, std::chrono::milliseconds(300), 2);
+        auto unfused = FastestOf([&]() { graph.ApplyUnfused(image); }, std::chrono::milliseconds(300), 2);
+        std::printf("%-18s %10.2f %10.2f %7.2fx %10.0f\n", name, Milliseconds(fused), Milliseconds(unfused),
+            Milliseconds(unfused) / Milliseconds(fused), megapixels / (Milliseconds(fused) / 1e3));
+    }
+}
@@ -0,0 +1,60 @@
+#include "TestHarness.h"
+#include "FilterGraph.h"
+
+namespace
+{
+    int LargestDifference(PixelBuffer const& first, PixelBuffer const& second)
+    {
+        int largest = 0;
+        for (size_t i = 0; i < first.Bytes.size(); i++)
+        {
+            largest = std::max(largest, std::abs(first.Bytes[i] - second.Bytes[i]));
+        }
+        return largest;
+    }
+}
+
+TEST(FilterGraph, FusedMatchesUnfused)
+{
+    // Big enough for several tiles, and not a multiple of the tile size, so
+    // the borders between tiles and at the edges of the image get checked.
+    auto image = TestImage(300, 170);
+    FilterGraph graph;
+    graph.Exposure(0.5f).Contrast(1.2f).BoxBlur(2).BoxBlur(2).Sharpen(0.6f, 1);
+    auto fused = graph.Apply(image);
+    auto unfused = graph.ApplyUnfused(image);
+    CHECK_EQ(fused.Width, image.Width);
+    CHECK_EQ(fused.Height, image.Height);
+    CHECK(LargestDifference(fused, unfused) <= 2);
+}
+
+TEST(FilterGraph, NeutralFiltersLeaveTheImageAlone)
+{
+    auto image = TestImage(65, 33);
+    FilterGraph graph;
+    graph.Exposure(0.0f).Contrast(1.0f).BoxBlur(0);
+    CHECK(LargestDifference(graph.Apply(image), image) <= 1);
+    CHECK(FilterGraph().Empty());
+}
+
+TEST(FilterGraph, ColorStaysWithinAlpha)
+{
+    auto image = TestImage(40, 40);
+    for (size_t i = 3; i < image.Bytes.size(); i += 4)
+    {
+        image.Bytes[i] = 128;
+        for (size_t channel = i - 3; channel < i; channel++)
+        {
+            image.Bytes[channel] = std::min<uint8_t>(image.Bytes[channel], 128);
+        }
+    }
+    FilterGraph graph;
+    graph.Exposure(3.0f).Sharpen(2.0f, 2);
+    auto result = graph.Apply(image);
+    for (size_t i = 3; i < result.Bytes.size(); i += 4)
+    {
+        CHECK(result.Bytes[i - 3] <= result.Bytes[i]);
+        CHECK(result.Bytes[i - 2] <= result.Bytes[i]);
+        CHECK(result.Bytes[i - 1] <= result.Bytes[i]);
+    }
+}
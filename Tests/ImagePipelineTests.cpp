@@ -0,0 +1,146 @@
+#include "TestHarness.h"
+#include "ImagePipeline.h"
+#include "SoftwareRenderDevice.h"
+
+namespace
+{
+    struct TestPipeline
+    {
+        std::shared_ptr<SoftwareRenderDevice> Device = std::make_shared<SoftwareRenderDevice>();
+        std::vector<std::chrono::milliseconds> FlushRequests;
+        std::shared_ptr<ImagePipeline> Pipeline;
+
+        TestPipeline(ImagePipelineOptions const& options = {})
+        {
+            Pipeline = std::make_shared<ImagePipeline>(Device, options, [this](std::chrono::milliseconds delay)
+                {
+                    FlushRequests.push_back(delay);
+                });
+        }
+
+        // Runs frames until nothing is waiting, like the UI thread would.
+        size_t FlushAll()
+        {
+            size_t count = 0;
+            for (int frame = 0; frame < 100 && Pipeline->QueueDepth() > 0; frame++)
+            {
+                count += Pipeline->Flush();
+            }
+            return count;
+        }
+    };
+}
+
+TEST(ImagePipeline, UploadsLandOnTheSurface)
+{
+    TestPipeline test;
+    auto surface = test.Device->CreateSoftwareSurface(SurfaceFormat::B8G8R8A8);
+    auto image = std::make_shared<PixelBuffer const>(TestImage(90, 70));
+    auto uploaded = false;
+    test.Pipeline->Upload(surface, image, std::nullopt, [&]() { uploaded = true; });
+    CHECK_EQ(test.FlushRequests.size(), size_t(1));
+    CHECK(!uploaded);
+    CHECK_EQ(test.FlushAll(), size_t(1));
+    CHECK(uploaded);
+    CHECK_EQ(surface->Width(), 90u);
+    CHECK(surface->ReadPixels() == image->Bytes);
+    CHECK_EQ(test.Device->UploadBatches(), uint64_t(1));
+}
+
+TEST(ImagePipeline, PixelsAreSharedNotCopied)
+{
+    TestPipeline test;
+    auto surface = test.Device->CreateSoftwareSurface(SurfaceFormat::B8G8R8A8);
+    auto image = std::make_shared<PixelBuffer const>(TestImage(64, 64));
+    test.Pipeline->Upload(surface, image);
+    // The scheduler holds the same buffer until it's written...
+    CHECK(image.use_count() > 1);
+    test.FlushAll();
+    // ...and lets go of it afterwards.
+    CHECK_EQ(image.use_count(), long(1));
+    CHECK(surface->ReadPixels() == image->Bytes);
+}
+
+TEST(ImagePipeline, ConvertsToTheSurfaceFormat)
+{
+    ImagePipelineOptions options;
+    options.Dither = DitherMode::None;
+    TestPipeline test(options);
+    auto surface = test.Device->CreateSoftwareSurface(SurfaceFormat::B5G6R5);
+    auto image = std::make_shared<PixelBuffer const>(TestImage(33, 17));
+    test.Pipeline->Upload(surface, image);
+    test.FlushAll();
+    auto expected = ConvertPixels(*image, PackedPixelFormat::B5G6R5, DitherMode::None);
+    auto pixels = surface->ReadPixels();
+    CHECK_EQ(pixels.size(), expected.Pixels.size() * 2);
+    CHECK(std::memcmp(pixels.data(), expected.Pixels.data(), pixels.size()) == 0);
+}
+
+TEST(ImagePipeline, FiltersRunOnWholeImagesOnly)
+{
+    ImagePipelineOptions options;
+    options.Filters.Exposure(1.0f);
+    TestPipeline test(options);
+    auto image = std::make_shared<PixelBuffer const>(TestImage(40, 40));
+
+    auto whole = test.Device->CreateSoftwareSurface(SurfaceFormat::B8G8R8A8);
+    test.Pipeline->Upload(whole, image);
+    auto region = test.Device->CreateSoftwareSurface(SurfaceFormat::B8G8R8A8);
+    region->Resize(40, 40);
+    test.Pipeline->Upload(region, image, SurfaceRect{ 0, 0, 40, 40 });
+    test.FlushAll();
+
+    CHECK(whole->ReadPixels() == options.Filters.Apply(*image).Bytes);
+    CHECK(region->ReadPixels() == image->Bytes);
+}
+
+TEST(ImagePipeline, BatchesThatHitALimitAreWrittenStraightAway)
+{
+    ImagePipelineOptions options;
+    options.Batching.MaxBatchUploads = 2;
+    options.Scheduling.FrameTimeBudget = std::chrono::seconds(1);
+    TestPipeline test(options);
+    std::vector<std::shared_ptr<SoftwareSurfaceBackend>> surfaces;
+    uint32_t uploaded = 0;
+    for (uint32_t i = 0; i < 5; i++)
+    {
+        surfaces.push_back(test.Device->CreateSoftwareSurface(SurfaceFormat::B8G8R8A8));
+        test.Pipeline->Upload(surfaces.back(), std::make_shared<PixelBuffer const>(TestImage(16, 16, i)), std::nullopt, [&]() { uploaded++; });
+    }
+    // One frame: two full batches as they fill up, and the rest at the end.
+    CHECK_EQ(test.Pipeline->Flush(), size_t(5));
+    CHECK_EQ(uploaded, 5u);
+    CHECK_EQ(test.Device->UploadBatches(), uint64_t(3));
+    CHECK_EQ(test.Pipeline->BatcherStats().SizeFlushes, uint64_t(2));
+    CHECK_EQ(test.Pipeline->BatcherStats().LargestBatch, 2u);
+}
+
+TEST(ImagePipeline, UploadsOutliveTheDevice)
+{
+    TestPipeline test;
+    auto first = test.Device->CreateSoftwareSurface(SurfaceFormat::B8G8R8A8);
+    auto second = test.Device->CreateSoftwareSurface(SurfaceFormat::B8G8R8A8);
+    auto image = std::make_shared<PixelBuffer const>(TestImage(24, 24));
+    uint32_t uploaded = 0;
+    test.Pipeline->Upload(first, image, std::nullopt, [&]() { uploaded++; });
+
+    test.Device->SimulateDeviceLoss();
+    CHECK_EQ(test.Pipeline->Flush(), size_t(1));
+    CHECK_EQ(uploaded, 0u);
+    CHECK_EQ(test.Pipeline->LostBatches(), uint64_t(1));
+    // More arrives while there's no device. It joins the batch that's waiting.
+    test.Pipeline->Upload(second, image, std::nullopt, [&]() { uploaded++; });
+    test.FlushAll();
+    CHECK_EQ(uploaded, 0u);
+
+    test.FlushRequests.clear();
+    test.Device->ReplaceDevice();
+    CHECK_EQ(test.Pipeline->DeviceReplacements(), uint64_t(1));
+    CHECK_EQ(test.FlushRequests.size(), size_t(1));
+    CHECK_EQ(test.FlushRequests[0].count(), 0ll);
+    test.Pipeline->Flush();
+    CHECK_EQ(uploaded, 2u);
+    CHECK(first->ReadPixels() == image->Bytes);
+    CHECK(second->ReadPixels() == image->Bytes);
+    CHECK_EQ(test.Pipeline->BatcherStats().Uploads, uint64_t(2));
+}
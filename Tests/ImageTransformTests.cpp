@@ -0,0 +1,76 @@
+#include "TestHarness.h"
+#include "ImageTransform.h"
+#include "Simd.h"
+
+namespace
+{
+    ImageOrientation const AllOrientations[] =
+    {
+        ImageOrientation::Normal,
+        ImageOrientation::FlipHorizontal,
+        ImageOrientation::Rotate180,
+        ImageOrientation::FlipVertical,
+        ImageOrientation::Transpose,
+        ImageOrientation::Rotate90,
+        ImageOrientation::Transverse,
+        ImageOrientation::Rotate270,
+    };
+}
+
+TEST(ImageTransform, TiledKernelsMatchTheNaiveVersion)
+{
+    // Sizes that aren't a multiple of the 16 pixel tile, and ones smaller
+    // than a tile, with and without the SSE2 kernels.
+    for (auto simd : { true, false })
+    {
+        SetSimdEnabled(simd);
+        for (auto [width, height] : { std::pair{ 37u, 53u }, std::pair{ 64u, 16u }, std::pair{ 5u, 3u }, std::pair{ 1u, 1u } })
+        {
+            auto image = TestImage(width, height);
+            for (auto orientation : AllOrientations)
+            {
+                auto expected = TransformImageNaive(image, orientation);
+                auto actual = TransformImage(image, orientation);
+                CHECK_EQ(actual.Width, expected.Width);
+                CHECK_EQ(actual.Height, expected.Height);
+                CHECK(actual.Bytes == expected.Bytes);
+                CHECK_EQ(actual.Width, SwapsDimensions(orientation) ? height : width);
+            }
+        }
+    }
+    SetSimdEnabled(true);
+}
+
+TEST(ImageTransform, InPlaceMatchesTheCopy)
+{
+    for (auto simd : { true, false })
+    {
+        SetSimdEnabled(simd);
+        for (auto [width, height] : { std::pair{ 48u, 48u }, std::pair{ 33u, 33u }, std::pair{ 40u, 21u } })
+        {
+            auto image = TestImage(width, height);
+            for (auto orientation : AllOrientations)
+            {
+                auto inPlace = image;
+                TransformImageInPlace(inPlace, orientation);
+                auto expected = TransformImageNaive(image, orientation);
+                CHECK_EQ(inPlace.Width, expected.Width);
+                CHECK(inPlace.Bytes == expected.Bytes);
+            }
+        }
+    }
+    SetSimdEnabled(true);
+}
+
+TEST(ImageTransform, RotationsCompose)
+{
+    auto image = TestImage(70, 45);
+    auto rotated = image;
+    for (int i = 0; i < 4; i++)
+    {
+        rotated = TransformImage(rotated, ImageOrientation::Rotate90);
+    }
+    CHECK(rotated.Bytes == image.Bytes);
+    auto twice = TransformImage(TransformImage(image, ImageOrientation::Rotate90), ImageOrientation::Rotate90);
+    CHECK(twice.Bytes == TransformImage(image, ImageOrientation::Rotate180).Bytes);
+}
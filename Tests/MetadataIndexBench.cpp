@@ -0,0 +1,101 @@
+#include "BenchHarness.h"
+#include "MetadataIndex.h"
+
+namespace
+{
+    // Just the signature and IHDR, which is all ProbeImage reads.
+    std::vector<uint8_t> Png(uint32_t width, uint32_t height)
+    {
+        std::vector<uint8_t> file = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n', 0, 0, 0, 13, 'I', 'H', 'D', 'R' };
+        for (auto value : { width, height })
+        {
+            for (int shift = 24; shift >= 0; shift -= 8)
+            {
+                file.push_back(static_cast<uint8_t>(value >> shift));
+            }
+        }
+        file.insert(file.end(), { 8, 6, 0, 0, 0, 0, 0, 0, 0 });
+        return file;
+    }
+
+    template <typename Func>
+    std::chrono::nanoseconds TimeOnce(Func&& func)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        return std::chrono::steady_clock::now() - start;
+    }
+}
+
+// Listing a folder of images with the index. Cold is the first time the folder
+// is opened, with no index: every file is probed, then the index is saved.
+// Warm is every time after that: the saved index is loaded, refreshed (which
+// only needs the directory listing, since nothing changed) and listed. Then
+// what List costs on its own in each order, once everything is in memory.
+//
+// Making the files takes a while, and they're kept between runs of the same
+// size. The sample only shows one image, so this is the only place a folder
+// this big is indexed.
+BENCH(metadataindex, "Cold and warm listings of a big folder with MetadataIndex [files]")
+{
+    uint32_t count = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 100000;
+    auto root = std::filesystem::temp_directory_path() / "ImageDemoTests" / "MetadataIndexBench";
+    auto images = root / ("images" + std::to_string(count));
+    if (!std::filesystem::exists(images / "done"))
+    {
+        std::filesystem::remove_all(images);
+        std::filesystem::create_directories(images);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            auto file = Png(640 + i % 1000, 480 + i % 700);
+            char name[32];
+            std::snprintf(name, sizeof(name), "IMG_%07u.png", i);
+            std::ofstream(images / name, std::ios::binary).write(reinterpret_cast<char const*>(file.data()), file.size());
+        }
+        std::ofstream(images / "done") << count;
+    }
+    auto indexPath = root / ("index" + std::to_string(count) + ".bin");
+    std::filesystem::remove(indexPath);
+
+    MetadataRefreshStats coldStats;
+    size_t listed = 0;
+    std::chrono::nanoseconds saveTime{};
+    auto coldTime = TimeOnce([&]()
+        {
+            MetadataIndex index(indexPath);
+            coldStats = index.Refresh(images);
+            listed = index.List().size();
+            saveTime = TimeOnce([&]() { index.Save(); });
+        });
+    std::printf("%u files, index is %.1f MB\n", count, std::filesystem::file_size(indexPath) / 1048576.0);
+    std::printf("cold: %.0f ms (%llu probed, %zu listed, saving took %.1f ms)\n", Milliseconds(coldTime),
+        static_cast<unsigned long long>(coldStats.Probed), listed, Milliseconds(saveTime));
+
+    std::chrono::nanoseconds loadTime{};
+    std::chrono::nanoseconds refreshTime{};
+    std::chrono::nanoseconds listTime{};
+    MetadataRefreshStats warmStats;
+    auto warmTime = FastestOf([&]()
+        {
+            std::optional<MetadataIndex> index;
+            loadTime = TimeOnce([&]() { index.emplace(indexPath); });
+            refreshTime = TimeOnce([&]() { warmStats = index->Refresh(images); });
+            listTime = TimeOnce([&]() { listed = index->List().size(); });
+        });
+    std::printf("warm: %.0f ms (load %.1f ms, refresh %.1f ms with %llu unchanged, list %.1f ms)\n", Milliseconds(warmTime),
+        Milliseconds(loadTime), Milliseconds(refreshTime), static_cast<unsigned long long>(warmStats.Unchanged),
+        Milliseconds(listTime));
+
+    MetadataIndex index(indexPath);
+    std::pair<MetadataOrder, char const*> orders[] = {
+        { MetadataOrder::Path, "path" },
+        { MetadataOrder::CaptureTime, "capture time" },
+        { MetadataOrder::FileSize, "file size" },
+    };
+    std::printf("\n%-14s %10s\n", "List by", "ms");
+    for (auto [order, name] : orders)
+    {
+        auto time = FastestOf([&]() { listed = index.List(order).size(); });
+        std::printf("%-14s %10.1f\n", name, Milliseconds(time));
+    }
+}
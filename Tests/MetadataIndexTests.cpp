@@ -0,0 +1,215 @@
+#include "TestHarness.h"
+#include "MetadataIndex.h"
+#include "ContentHash.h"
+
+namespace
+{
+    // Little endian TIFF, built up a field at a time.
+    struct TiffWriter
+    {
+        std::vector<uint8_t> Bytes;
+
+        void Put16(uint32_t value)
+        {
+            Bytes.push_back(static_cast<uint8_t>(value));
+            Bytes.push_back(static_cast<uint8_t>(value >> 8));
+        }
+        void Put32(uint32_t value)
+        {
+            Put16(value & 0xffff);
+            Put16(value >> 16);
+        }
+        void Entry(uint32_t tag, uint32_t type, uint32_t count, uint32_t value)
+        {
+            Put16(tag);
+            Put16(type);
+            Put32(count);
+            Put32(value);
+        }
+    };
+
+    constexpr uint32_t Short = 3;
+    constexpr uint32_t Long = 4;
+    constexpr uint32_t Ascii = 2;
+
+    // SOI, an APP1 with the EXIF block, then a baseline frame header.
+    std::vector<uint8_t> Jpeg(std::vector<uint8_t> const& tiff, uint32_t width, uint32_t height)
+    {
+        std::vector<uint8_t> file = { 0xFF, 0xD8, 0xFF, 0xE1 };
+        auto length = tiff.size() + 8;
+        file.push_back(static_cast<uint8_t>(length >> 8));
+        file.push_back(static_cast<uint8_t>(length));
+        file.insert(file.end(), { 'E', 'x', 'i', 'f', 0, 0 });
+        file.insert(file.end(), tiff.begin(), tiff.end());
+        file.insert(file.end(), { 0xFF, 0xC0, 0, 11, 8,
+            static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height),
+            static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width), 1, 1, 0x11, 0 });
+        file.insert(file.end(), { 0xFF, 0xD9 });
+        return file;
+    }
+
+    void WriteFile(std::filesystem::path const& path, std::vector<uint8_t> const& bytes)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<char const*>(bytes.data()), bytes.size());
+    }
+
+    std::vector<uint8_t> ReadFile(std::filesystem::path const& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+    }
+
+    std::vector<uint8_t> Png(uint32_t width, uint32_t height)
+    {
+        std::vector<uint8_t> file = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n', 0, 0, 0, 13, 'I', 'H', 'D', 'R' };
+        for (auto value : { width, height })
+        {
+            for (int shift = 24; shift >= 0; shift -= 8)
+            {
+                file.push_back(static_cast<uint8_t>(value >> shift));
+            }
+        }
+        file.insert(file.end(), { 8, 6, 0, 0, 0, 0, 0, 0, 0 });
+        return file;
+    }
+
+    // 2021-06-30 14:05:59.
+    constexpr int64_t TestDate = 1625061959;
+}
+
+TEST(MetadataIndex, ProbesExifOrientationAndCaptureTime)
+{
+    TiffWriter tiff;
+    tiff.Bytes = { 'I', 'I' };
+    tiff.Put16(42);
+    tiff.Put32(8);
+    // IFD0 at 8: orientation, DateTime and the EXIF pointer. 2 + 3 * 12 + 4 = 42 bytes.
+    tiff.Put16(3);
+    tiff.Entry(0x0112, Short, 1, 6);
+    tiff.Entry(0x0132, Ascii, 20, 8 + 42 + 18);
+    tiff.Entry(0x8769, Long, 1, 8 + 42);
+    tiff.Put32(0);
+    // The EXIF IFD at 50, with DateTimeOriginal. 2 + 12 + 4 = 18 bytes.
+    tiff.Put16(1);
+    tiff.Entry(0x9003, Ascii, 20, 8 + 42 + 18 + 20);
+    tiff.Put32(0);
+    for (auto date : { "2020:01:01 00:00:00", "2021:06:30 14:05:59" })
+    {
+        tiff.Bytes.insert(tiff.Bytes.end(), date, date + 20);
+    }
+
+    auto directory = TestDirectory("MetadataExif");
+    WriteFile(directory / "photo.jpg", Jpeg(tiff.Bytes, 640, 480));
+    auto metadata = ProbeImage(directory / "photo.jpg");
+    CHECK(metadata.has_value());
+    CHECK(metadata->Format == ImageFileFormat::Jpeg);
+    CHECK_EQ(metadata->Width, 640u);
+    CHECK_EQ(metadata->Height, 480u);
+    CHECK(metadata->Orientation == ImageOrientation::Rotate90);
+    CHECK_EQ(metadata->DisplayWidth(), 480u);
+    // DateTimeOriginal wins over DateTime.
+    CHECK_EQ(metadata->CaptureTime, TestDate);
+}
+
+TEST(MetadataIndex, OffsetsThatWrapAroundAreIgnored)
+{
+    // Every offset here is just short of 4 GB, so offset + length wraps
+    // around to something small in 32 bits, and looks like it's in bounds.
+    TiffWriter tiff;
+    tiff.Bytes = { 'I', 'I' };
+    tiff.Put16(42);
+    tiff.Put32(8);
+    tiff.Put16(4);
+    tiff.Entry(0x0112, Short, 1, 3);
+    tiff.Entry(0x0132, Ascii, 20, 0xFFFFFFF0);
+    tiff.Entry(0x0132, Ascii, 0xFFFFFFFF, 0x10);
+    tiff.Entry(0x8769, Long, 1, 0xFFFFFFFE);
+    tiff.Put32(0);
+
+    auto directory = TestDirectory("MetadataExifWrap");
+    WriteFile(directory / "crafted.jpg", Jpeg(tiff.Bytes, 100, 50));
+    auto metadata = ProbeImage(directory / "crafted.jpg");
+    CHECK(metadata.has_value());
+    CHECK_EQ(metadata->Width, 100u);
+    CHECK(metadata->Orientation == ImageOrientation::Rotate180);
+    CHECK_EQ(metadata->CaptureTime, int64_t(0));
+
+    // And an IFD that starts past the end, with the entry offsets wrapping.
+    TiffWriter far;
+    far.Bytes = { 'I', 'I' };
+    far.Put16(42);
+    far.Put32(0xFFFFFFFA);
+    WriteFile(directory / "far.jpg", Jpeg(far.Bytes, 10, 20));
+    metadata = ProbeImage(directory / "far.jpg");
+    CHECK(metadata.has_value());
+    CHECK_EQ(metadata->Height, 20u);
+}
+
+TEST(MetadataIndex, RefreshAndReload)
+{
+    auto directory = TestDirectory("MetadataIndex");
+    auto images = directory / "images";
+    std::filesystem::create_directories(images);
+    WriteFile(images / "b.png", Png(300, 200));
+    WriteFile(images / "a.png", Png(30, 20));
+    WriteFile(images / "notes.txt", { 'h', 'i' });
+    WriteFile(images / "broken.jpg", { 0xFF, 0xD8, 0xFF });
+
+    auto indexPath = directory / "index.bin";
+    {
+        MetadataIndex index(indexPath);
+        auto stats = index.Refresh(images);
+        CHECK_EQ(stats.Probed, uint64_t(3));
+        CHECK_EQ(index.Count(), size_t(3));
+        index.Save();
+    }
+
+    MetadataIndex index(indexPath);
+    CHECK_EQ(index.Count(), size_t(3));
+    auto listed = index.List(MetadataOrder::Path);
+    CHECK_EQ(listed[0].Path.filename(), std::filesystem::path("a.png"));
+    CHECK_EQ(listed[0].Width, 30u);
+    auto b = index.Find(images / "b.png");
+    CHECK(b.has_value());
+    CHECK_EQ(b->Height, 200u);
+    CHECK(index.Find(images / "broken.jpg")->Format == ImageFileFormat::Unknown);
+
+    // Nothing changed, so nothing is probed again.
+    auto stats = index.Refresh(images);
+    CHECK_EQ(stats.Unchanged, uint64_t(3));
+    CHECK_EQ(stats.Probed, uint64_t(0));
+}
+
+TEST(MetadataIndex, BadIndexFilesStartEmpty)
+{
+    auto directory = TestDirectory("MetadataIndexBad");
+    WriteFile(directory / "a.png", Png(30, 20));
+    auto indexPath = directory / "index.bin";
+    {
+        MetadataIndex index(indexPath);
+        index.Refresh(directory);
+        index.Save();
+    }
+    auto good = ReadFile(indexPath);
+
+    // A count far bigger than the file, with a valid checksum, so only the
+    // bounds checks stand in the way.
+    for (uint64_t count : { uint64_t(2), uint64_t(1) << 40, uint64_t(0x0fffffffffffffff), ~uint64_t(0) })
+    {
+        auto bytes = good;
+        std::memcpy(bytes.data() + 8, &count, sizeof(count));
+        auto checksum = ContentHasher::Hash(bytes.data(), bytes.size() - sizeof(uint64_t));
+        std::memcpy(bytes.data() + bytes.size() - sizeof(checksum), &checksum, sizeof(checksum));
+        WriteFile(indexPath, bytes);
+        MetadataIndex index(indexPath);
+        CHECK_EQ(index.Count(), size_t(0));
+    }
+
+    // Cut short.
+    WriteFile(indexPath, std::vector<uint8_t>(good.begin(), good.end() - 5));
+    CHECK_EQ(MetadataIndex(indexPath).Count(), size_t(0));
+
+    WriteFile(indexPath, good);
+    CHECK_EQ(MetadataIndex(indexPath).Count(), size_t(1));
+}
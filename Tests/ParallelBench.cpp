@@ -0,0 +1,76 @@
+#include "BenchHarness.h"
+#include "Parallel.h"
+#include "QoiCodec.h"
+
+namespace
+{
+    // What ParallelFor used to do: start the threads for every call.
+    template <typename Func>
+    void SpawnPerCall(uint32_t count, uint32_t threadCount, Func&& func)
+    {
+        std::atomic<uint32_t> next = 0;
+        auto worker = [&]()
+        {
+            for (auto i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+            {
+                func(i);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (uint32_t i = 1; i < threadCount; i++)
+        {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+}
+
+// The cost of going parallel at all, separate from how many cores there are:
+// the same job split over the same number of threads, with the threads
+// started for each call, or taken from a pool that's already running.
+BENCH(parallel, "ParallelFor per-call overhead: threads started per call vs the pool [threads]")
+{
+    uint32_t threadCount = arguments.empty() ? 8 : static_cast<uint32_t>(std::stoul(arguments[0]));
+    ParallelPool pool(threadCount - 1);
+    std::function<void(uint32_t)> const nothing = [](uint32_t) {};
+    auto spawned = FastestOf([&]() { SpawnPerCall(64, threadCount, [](uint32_t) {}); });
+    auto pooled = FastestOf([&]() { pool.Run(64, threadCount - 1, nothing); });
+    std::printf("Empty job over %u threads: %.1f us starting threads, %.1f us from the pool\n",
+        threadCount, spawned.count() / 1e3, pooled.count() / 1e3);
+
+    // Whole QOI encodes, band by band, at a few sizes.
+    std::printf("%-12s %14s %14s %14s\n", "image", "spawned", "pooled", "ParallelFor");
+    for (auto size : { 64u, 256u, 1024u, 4032u })
+    {
+        auto image = TestImage(size, size * 3 / 4);
+        auto encode = [&](auto&& parallel)
+        {
+            auto bands = (image.Height + 63) / 64;
+            std::vector<std::vector<uint8_t>> output(bands);
+            return FastestOf([&]()
+                {
+                    parallel(bands, [&](uint32_t band)
+                        {
+                            auto rows = std::min(64u, image.Height - band * 64);
+                            PixelBuffer slice(image.Width, rows);
+                            std::memcpy(slice.Bytes.data(), image.Row(band * 64), slice.Bytes.size());
+                            output[band] = EncodeQoi(slice, rows).Data;
+                        });
+                });
+        };
+        auto spawnedTime = encode([&](uint32_t count, auto&& func) { SpawnPerCall(count, threadCount, func); });
+        auto pooledTime = encode([&](uint32_t count, auto&& func)
+            {
+                std::function<void(uint32_t)> const work = std::ref(func);
+                pool.Run(count, threadCount - 1, work);
+            });
+        auto parallelForTime = FastestOf([&]() { EncodeQoi(image); });
+        std::printf("%4ux%-7u %11.3f ms %11.3f ms %11.3f ms\n", size, size * 3 / 4,
+            Milliseconds(spawnedTime), Milliseconds(pooledTime), Milliseconds(parallelForTime));
+    }
+    std::printf("(%u hardware threads)\n", std::thread::hardware_concurrency());
+}
@@ -0,0 +1,128 @@
+#include "TestHarness.h"
+#include "Parallel.h"
+#include <set>
+
+TEST(Parallel, CallsEveryIndexOnce)
+{
+    std::vector<std::atomic<uint32_t>> calls(1000);
+    ParallelFor(static_cast<uint32_t>(calls.size()), [&](uint32_t i) { calls[i]++; });
+    for (auto& count : calls)
+    {
+        CHECK_EQ(count.load(), 1u);
+    }
+}
+
+TEST(Parallel, SmallJobsStayOnTheCallingThread)
+{
+    auto caller = std::this_thread::get_id();
+    std::atomic<bool> elsewhere = false;
+    ParallelFor(64, [&](uint32_t)
+        {
+            if (std::this_thread::get_id() != caller)
+            {
+                elsewhere = true;
+            }
+        }, MinimumPixelsPerThread);
+    CHECK(!elsewhere);
+}
+
+TEST(Parallel, RethrowsTheFirstException)
+{
+    std::atomic<uint32_t> calls = 0;
+    CHECK_THROWS(ParallelFor(10000, [&](uint32_t i)
+        {
+            calls++;
+            if (i == 10)
+            {
+                throw std::runtime_error("boom");
+            }
+        }), std::runtime_error);
+    // Work stops being handed out once something throws.
+    CHECK(calls < 10000u);
+
+    // And the pool still works afterwards.
+    std::atomic<uint32_t> after = 0;
+    ParallelFor(100, [&](uint32_t) { after++; });
+    CHECK_EQ(after.load(), 100u);
+}
+
+TEST(Parallel, NestedAndConcurrentCallsFinish)
+{
+    // Every thread in the pool can be busy with someone else's job, and
+    // callers still finish because they work on their own.
+    std::atomic<uint64_t> total = 0;
+    std::vector<std::thread> callers;
+    for (uint32_t t = 0; t < 8; t++)
+    {
+        callers.emplace_back([&total]()
+            {
+                for (uint32_t round = 0; round < 20; round++)
+                {
+                    ParallelFor(16, [&](uint32_t)
+                        {
+                            ParallelFor(16, [&](uint32_t) { total++; });
+                        });
+                }
+            });
+    }
+    for (auto& caller : callers)
+    {
+        caller.join();
+    }
+    CHECK_EQ(total.load(), uint64_t(8 * 20 * 16 * 16));
+}
+
+// The shared pool has no threads at all on a single core machine, so these
+// use one of their own.
+TEST(Parallel, PoolThreadsShareTheWork)
+{
+    ParallelPool pool(3);
+    std::mutex lock;
+    std::set<std::thread::id> threads;
+    std::vector<std::atomic<uint32_t>> calls(256);
+    std::function<void(uint32_t)> const work = [&](uint32_t i)
+    {
+        calls[i]++;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        std::lock_guard guard(lock);
+        threads.insert(std::this_thread::get_id());
+    };
+    pool.Run(static_cast<uint32_t>(calls.size()), 3, work);
+    for (auto& count : calls)
+    {
+        CHECK_EQ(count.load(), 1u);
+    }
+    CHECK(threads.size() > 1);
+}
+
+TEST(Parallel, PoolSurvivesExceptionsAndConcurrentCallers)
+{
+    ParallelPool pool(3);
+    std::function<void(uint32_t)> const failing = [](uint32_t i)
+    {
+        if (i == 5)
+        {
+            throw std::runtime_error("boom");
+        }
+    };
+    CHECK_THROWS(pool.Run(100, 3, failing), std::runtime_error);
+
+    std::atomic<uint64_t> total = 0;
+    std::function<void(uint32_t)> const counting = [&](uint32_t) { total++; };
+    std::vector<std::thread> callers;
+    for (uint32_t t = 0; t < 6; t++)
+    {
+        callers.emplace_back([&]()
+            {
+                for (uint32_t round = 0; round < 200; round++)
+                {
+                    pool.Run(32, 3, counting);
+                }
+            });
+    }
+    for (auto& caller : callers)
+    {
+        caller.join();
+    }
+    CHECK_EQ(total.load(), uint64_t(6 * 200 * 32));
+}
@@ -0,0 +1,50 @@
+#include "BenchHarness.h"
+#include "PixelFormatConversion.h"
+#include "Simd.h"
+
+// How close each conversion gets to copy speed. The baseline copies the BGRA8
+// image into a fresh buffer, which is the least any conversion has to do:
+// read every source byte and write a new image. Ordered dithering is
+// supposed to run close to that, and error diffusion is the slow one.
+BENCH(convert, "ConvertPixels throughput against a plain copy [width] [height]")
+{
+    uint32_t width = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 4032;
+    uint32_t height = arguments.size() > 1 ? static_cast<uint32_t>(std::stoul(arguments[1])) : 3024;
+    auto image = TestImage(width, height);
+    auto megapixels = static_cast<double>(width) * height / 1e6;
+
+    std::vector<uint8_t> copy;
+    auto copyTime = FastestOf([&]()
+        {
+            copy.assign(image.Bytes.begin(), image.Bytes.end());
+        });
+    std::printf("%ux%u, a copy takes %.2f ms (%.0f MP/s)\n", width, height, Milliseconds(copyTime),
+        megapixels / (Milliseconds(copyTime) / 1e3));
+
+    std::printf("%-9s %-10s %10s %10s %10s\n", "format", "dither", "ms", "MP/s", "x copy");
+    constexpr std::pair<PackedPixelFormat, char const*> formats[] = {
+        { PackedPixelFormat::B5G6R5, "B5G6R5" }, { PackedPixelFormat::B4G4R4A4, "B4G4R4A4" } };
+    constexpr std::pair<DitherMode, char const*> dithers[] = {
+        { DitherMode::None, "none" }, { DitherMode::Ordered, "ordered" }, { DitherMode::ErrorDiffusion, "diffusion" } };
+    for (auto [format, formatName] : formats)
+    {
+        for (auto [dither, ditherName] : dithers)
+        {
+            for (auto simd : { true, false })
+            {
+                // Error diffusion has no SSE2 path.
+                if (!simd && dither == DitherMode::ErrorDiffusion)
+                {
+                    continue;
+                }
+                SetSimdEnabled(simd);
+                auto time = FastestOf([&]() { ConvertPixels(image, format, dither); });
+                std::printf("%-9s %-10s %10.2f %10.0f %9.2fx\n", formatName,
+                    (std::string(ditherName) + (simd ? "" : "*")).c_str(), Milliseconds(time),
+                    megapixels / (Milliseconds(time) / 1e3), Milliseconds(time) / Milliseconds(copyTime));
+            }
+        }
+    }
+    SetSimdEnabled(true);
+    std::printf("* without SSE2\n");
+}
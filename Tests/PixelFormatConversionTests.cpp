@@ -0,0 +1,213 @@
+#include "TestHarness.h"
+#include "PixelFormatConversion.h"
+#include "Simd.h"
+
+namespace
+{
+    // The test image with a noisy alpha, premultiplied the way decoded images
+    // are.
+    PixelBuffer TransparentImage(uint32_t width, uint32_t height)
+    {
+        auto image = TestImage(width, height);
+        uint32_t noise = 12345;
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                noise = noise * 1664525u + 1013904223u;
+                auto pixel = image.Row(y) + x * 4;
+                auto alpha = noise >> 24;
+                for (int channel = 0; channel < 3; channel++)
+                {
+                    pixel[channel] = static_cast<uint8_t>((pixel[channel] * alpha + 127) / 255);
+                }
+                pixel[3] = static_cast<uint8_t>(alpha);
+            }
+        }
+        return image;
+    }
+
+    // A smooth gradient in every channel, which is where dithering matters.
+    PixelBuffer GradientImage(uint32_t width, uint32_t height)
+    {
+        PixelBuffer image(width, height);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                auto pixel = image.Row(y) + x * 4;
+                pixel[0] = static_cast<uint8_t>(x * 255 / (width - 1));
+                pixel[1] = static_cast<uint8_t>(40 + y / 4);
+                pixel[2] = static_cast<uint8_t>(x / 2 + y / 4);
+                pixel[3] = 255;
+            }
+        }
+        return image;
+    }
+
+    constexpr PackedPixelFormat AllFormats[] = { PackedPixelFormat::B5G6R5, PackedPixelFormat::B4G4R4A4 };
+}
+
+TEST(PixelFormatConversion, VectorAndScalarPathsAgree)
+{
+    // The SSE2 loop does eight pixels at a time, so widths that aren't a
+    // multiple of 8 finish in the scalar loop.
+    for (uint32_t width : { 8u, 64u, 1u, 7u, 13u, 37u })
+    {
+        auto image = TransparentImage(width, 9);
+        for (auto format : AllFormats)
+        {
+            for (auto dither : { DitherMode::None, DitherMode::Ordered })
+            {
+                auto vector = ConvertPixels(image, format, dither);
+                SetSimdEnabled(false);
+                auto scalar = ConvertPixels(image, format, dither);
+                SetSimdEnabled(true);
+                CHECK(vector.Pixels == scalar.Pixels);
+            }
+        }
+    }
+}
+
+TEST(PixelFormatConversion, PremultipliedColorNeverExceedsAlpha)
+{
+    auto image = TransparentImage(45, 70);
+    for (auto simd : { true, false })
+    {
+        SetSimdEnabled(simd);
+        for (auto dither : { DitherMode::None, DitherMode::Ordered, DitherMode::ErrorDiffusion })
+        {
+            auto packed = ConvertPixels(image, PackedPixelFormat::B4G4R4A4, dither);
+            uint32_t over = 0;
+            for (auto pixel : packed.Pixels)
+            {
+                auto alpha = pixel >> 12;
+                for (int shift = 0; shift < 12; shift += 4)
+                {
+                    over += ((pixel >> shift) & 0xf) > alpha;
+                }
+            }
+            CHECK_EQ(over, 0u);
+        }
+    }
+    SetSimdEnabled(true);
+}
+
+TEST(PixelFormatConversion, RoundTripsWithinAStep)
+{
+    auto image = TransparentImage(50, 40);
+    for (auto format : AllFormats)
+    {
+        int levels[4] = { 31, 63, 31, 255 };
+        if (format == PackedPixelFormat::B4G4R4A4)
+        {
+            levels[0] = levels[1] = levels[2] = levels[3] = 15;
+        }
+        for (auto dither : { DitherMode::None, DitherMode::Ordered, DitherMode::ErrorDiffusion })
+        {
+            auto expanded = ExpandPixels(ConvertPixels(image, format, dither));
+            int worst[4] = {};
+            double total[4] = {};
+            for (uint32_t y = 0; y < image.Height; y++)
+            {
+                for (uint32_t i = 0; i < image.Width * 4; i++)
+                {
+                    auto error = std::abs(expanded.Row(y)[i] - image.Row(y)[i]);
+                    worst[i % 4] = std::max(worst[i % 4], error);
+                    total[i % 4] += error;
+                }
+            }
+            for (int channel = 0; channel < 4; channel++)
+            {
+                if (format == PackedPixelFormat::B5G6R5 && channel == 3)
+                {
+                    // Alpha is dropped, so everything comes back opaque.
+                    continue;
+                }
+                auto step = 255.0 / levels[channel];
+                auto pixelCount = static_cast<double>(image.Width) * image.Height;
+                if (dither == DitherMode::None)
+                {
+                    // Rounding to the nearest level, plus one for the expansion.
+                    CHECK(worst[channel] <= step / 2 + 1);
+                }
+                else if (dither == DitherMode::Ordered)
+                {
+                    CHECK(worst[channel] <= step + 1);
+                }
+                // Error diffusion can push single pixels further, but on
+                // average it's no worse than rounding.
+                CHECK(total[channel] / pixelCount <= step / 2);
+            }
+        }
+    }
+}
+
+TEST(PixelFormatConversion, ErrorDiffusionBandsHaveNoSeams)
+{
+    // Error diffusion runs in bands of 64 rows. Four bands, checked at the
+    // three boundaries between them.
+    auto image = GradientImage(200, 256);
+    for (auto format : AllFormats)
+    {
+        auto expanded = ExpandPixels(ConvertPixels(image, format, DitherMode::ErrorDiffusion));
+        auto rowDifference = [&](uint32_t y)
+            {
+                double total = 0;
+                for (uint32_t i = 0; i < image.Width * 3; i++)
+                {
+                    auto offset = i / 3 * 4 + i % 3;
+                    total += std::abs(expanded.Row(y)[offset] - expanded.Row(y + 1)[offset]);
+                }
+                return total / image.Width;
+            };
+        // The average error over 8x4 windows, worst channel.
+        auto windowError = [&](uint32_t top, uint32_t left)
+            {
+                double worst = 0;
+                for (int channel = 0; channel < 3; channel++)
+                {
+                    double error = 0;
+                    for (auto y = top; y < top + 4; y++)
+                    {
+                        for (auto x = left; x < left + 8; x++)
+                        {
+                            error += expanded.Row(y)[x * 4 + channel] - image.Row(y)[x * 4 + channel];
+                        }
+                    }
+                    worst = std::max(worst, std::abs(error / 32));
+                }
+                return worst;
+            };
+
+        double insideDifference = 0;
+        uint32_t insideRows = 0;
+        double insideError = 0;
+        double seamError = 0;
+        for (uint32_t y = 0; y + 1 < image.Height; y++)
+        {
+            if ((y + 1) % 64 != 0)
+            {
+                insideDifference += rowDifference(y);
+                insideRows++;
+            }
+        }
+        insideDifference /= insideRows;
+        for (uint32_t top = 0; top + 4 <= image.Height; top += 2)
+        {
+            for (uint32_t left = 0; left + 8 <= image.Width; left += 8)
+            {
+                auto& worst = top % 64 == 62 ? seamError : insideError;
+                worst = std::max(worst, windowError(top, left));
+            }
+        }
+        // Windows straddling a boundary are no further off than any others...
+        CHECK(seamError <= insideError);
+        // ...and the rows either side of it aren't unusually alike, which is
+        // what a band starting over from no error looks like.
+        for (uint32_t boundary = 64; boundary < image.Height; boundary += 64)
+        {
+            CHECK(rowDifference(boundary - 1) >= insideDifference * 0.6);
+        }
+    }
+}
@@ -0,0 +1,134 @@
+#include "BenchHarness.h"
+#include "PixelRetention.h"
+#include "SoftwareRenderDevice.h"
+#include "ContentHash.h"
+#include "QoiCodec.h"
+
+namespace
+{
+    struct Screen
+    {
+        std::shared_ptr<SoftwareRenderDevice> Device = std::make_shared<SoftwareRenderDevice>();
+        std::shared_ptr<ImagePipeline> Pipeline;
+        std::vector<std::shared_ptr<SoftwareSurfaceBackend>> Surfaces;
+
+        Screen(size_t count)
+        {
+            Pipeline = std::make_shared<ImagePipeline>(Device, ImagePipelineOptions{}, [](std::chrono::milliseconds) {});
+            for (size_t i = 0; i < count; i++)
+            {
+                Surfaces.push_back(Device->CreateSoftwareSurface(SurfaceFormat::B8G8R8A8));
+            }
+        }
+
+        // Returns how many frames it took.
+        uint32_t FlushAll()
+        {
+            uint32_t frames = 0;
+            while (Pipeline->QueueDepth() > 0)
+            {
+                Pipeline->Flush();
+                frames++;
+            }
+            return frames;
+        }
+
+        void LoseDevice()
+        {
+            Device->SimulateDeviceLoss();
+            Device->ReplaceDevice();
+        }
+    };
+
+    struct RestoreResult
+    {
+        std::chrono::nanoseconds Time{};
+        uint32_t Frames = 0;
+    };
+}
+
+// How long it takes to get a screen full of images back after the device is
+// lost: from the new device being ready until the last upload is written.
+// Restoring from PixelRetention in each of its modes is compared with what the
+// app has to do without it, which is read every file again, decode it and
+// upload it.
+//
+// There's no portable JPEG or PNG decoder to time, so the files hold the
+// images as QOI, which decodes several times faster than either. Re-decoding
+// real photos takes longer than shown here.
+BENCH(retention, "Time to restore after device loss, retained against re-decoded [images] [width] [height]")
+{
+    uint32_t count = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 16;
+    uint32_t width = arguments.size() > 1 ? static_cast<uint32_t>(std::stoul(arguments[1])) : 1024;
+    uint32_t height = arguments.size() > 2 ? static_cast<uint32_t>(std::stoul(arguments[2])) : 768;
+
+    auto directory = TestDirectory("PixelRetentionBench");
+    std::vector<std::shared_ptr<PixelBuffer const>> images;
+    std::vector<QoiImage> encoded;
+    uint64_t fileBytes = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        images.push_back(std::make_shared<PixelBuffer const>(TestImage(width, height, i + 1)));
+        encoded.push_back(EncodeQoi(*images.back()));
+        std::ofstream file(directory / (std::to_string(i) + ".qoi"), std::ios::binary);
+        file.write(reinterpret_cast<char const*>(encoded.back().Data.data()), encoded.back().Data.size());
+        fileBytes += encoded.back().Data.size();
+    }
+    auto pixelBytes = static_cast<uint64_t>(width) * height * 4 * count;
+    std::printf("%u images of %ux%u, %.1f MB of pixels, %.1f MB of files\n\n", count, width, height, pixelBytes / 1048576.0,
+        fileBytes / 1048576.0);
+    std::printf("%-12s %12s %10s %8s\n", "restore from", "retained MB", "ms", "frames");
+
+    // Without retention: the files are read, hashed and decoded again.
+    {
+        Screen screen(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            screen.Pipeline->Upload(screen.Surfaces[i], images[i]);
+        }
+        screen.FlushAll();
+        RestoreResult result;
+        result.Time = FastestOf([&]()
+            {
+                screen.LoseDevice();
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    auto file = ReadFileWithHash(directory / (std::to_string(i) + ".qoi"));
+                    auto source = encoded[i];
+                    source.Data = std::move(file.Bytes);
+                    screen.Pipeline->Upload(screen.Surfaces[i], std::make_shared<PixelBuffer const>(DecodeQoi(source)));
+                }
+                result.Frames = screen.FlushAll();
+            });
+        std::printf("%-12s %12.1f %10.2f %8u\n", "files", 0.0, Milliseconds(result.Time), result.Frames);
+    }
+
+    std::pair<RetentionMode, char const*> modes[] = {
+        { RetentionMode::Full, "full" },
+        { RetentionMode::Downscaled, "downscaled" },
+        { RetentionMode::Compressed, "compressed" },
+    };
+    for (auto [mode, name] : modes)
+    {
+        Screen screen(count);
+        RetentionOptions options;
+        options.Mode = mode;
+        options.BudgetBytes = pixelBytes * 2;
+        PixelRetention retention(screen.Pipeline, options);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            screen.Pipeline->Upload(screen.Surfaces[i], images[i]);
+            retention.Retain(screen.Surfaces[i], images[i]);
+        }
+        screen.FlushAll();
+        RestoreResult result;
+        result.Time = FastestOf([&]()
+            {
+                screen.LoseDevice();
+                retention.RestoreAll();
+                result.Frames = screen.FlushAll();
+            });
+        std::printf("%-12s %12.1f %10.2f %8u\n", name, retention.Stats().RetainedBytes / 1048576.0, Milliseconds(result.Time),
+            result.Frames);
+    }
+}
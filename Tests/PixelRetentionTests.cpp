@@ -0,0 +1,107 @@
+#include "TestHarness.h"
+#include "PixelRetention.h"
+#include "SoftwareRenderDevice.h"
+
+namespace
+{
+    struct TestRetention
+    {
+        std::shared_ptr<SoftwareRenderDevice> Device = std::make_shared<SoftwareRenderDevice>();
+        std::shared_ptr<ImagePipeline> Pipeline;
+        std::unique_ptr<PixelRetention> Retention;
+
+        TestRetention(RetentionOptions const& options = {})
+        {
+            Pipeline = std::make_shared<ImagePipeline>(Device, ImagePipelineOptions{}, [](std::chrono::milliseconds) {});
+            Retention = std::make_unique<PixelRetention>(Pipeline, options);
+        }
+
+        void FlushAll()
+        {
+            for (int frame = 0; frame < 100 && Pipeline->QueueDepth() > 0; frame++)
+            {
+                Pipeline->Flush();
+            }
+        }
+    };
+}
+
+TEST(PixelRetention, ReplacingAnImageKeepsTheTotals)
+{
+    TestRetention test;
+    auto surface = test.Device->CreateSoftwareSurface(SurfaceFormat::B8G8R8A8);
+    CHECK(test.Retention->Retain(surface, std::make_shared<PixelBuffer const>(TestImage(40, 40))));
+    CHECK(test.Retention->Retain(surface, std::make_shared<PixelBuffer const>(TestImage(20, 10))));
+    auto stats = test.Retention->Stats();
+    CHECK_EQ(stats.RetainedImages, uint64_t(1));
+    CHECK_EQ(stats.RetainedBytes, uint64_t(20 * 10 * 4));
+    CHECK_EQ(stats.FullSizeBytes, uint64_t(20 * 10 * 4));
+}
+
+TEST(PixelRetention, ConcurrentRetainsDontLeakBytes)
+{
+    TestRetention test;
+    auto surface = test.Device->CreateSoftwareSurface(SurfaceFormat::B8G8R8A8);
+    std::vector<std::shared_ptr<PixelBuffer const>> images;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        images.push_back(std::make_shared<PixelBuffer const>(TestImage(8 + i, 8)));
+    }
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&, t]()
+            {
+                for (uint32_t i = 0; i < 500; i++)
+                {
+                    test.Retention->Retain(surface, images[(t + i) % images.size()]);
+                }
+            });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    // Whichever image won, the totals are for exactly one of them.
+    auto stats = test.Retention->Stats();
+    CHECK_EQ(stats.RetainedImages, uint64_t(1));
+    CHECK_EQ(stats.RetainedBytes, stats.FullSizeBytes);
+    CHECK(stats.RetainedBytes >= 8 * 8 * 4u && stats.RetainedBytes <= 11 * 8 * 4u);
+}
+
+TEST(PixelRetention, AnImageThatDoesntFitForgetsTheOldOne)
+{
+    RetentionOptions options;
+    options.BudgetBytes = 32 * 32 * 4;
+    TestRetention test(options);
+    auto surface = test.Device->CreateSoftwareSurface(SurfaceFormat::B8G8R8A8);
+    CHECK(test.Retention->Retain(surface, std::make_shared<PixelBuffer const>(TestImage(32, 32))));
+    CHECK(!test.Retention->Retain(surface, std::make_shared<PixelBuffer const>(TestImage(64, 64))));
+    CHECK(!test.Retention->IsRetained(surface));
+    CHECK_EQ(test.Retention->Stats().RetainedBytes, uint64_t(0));
+    CHECK_EQ(test.Retention->Stats().Rejected, uint64_t(1));
+}
+
+TEST(PixelRetention, CompressedImagesAreRestoredAfterDeviceLoss)
+{
+    RetentionOptions options;
+    options.Mode = RetentionMode::Compressed;
+    TestRetention test(options);
+    auto surface = test.Device->CreateSoftwareSurface(SurfaceFormat::B8G8R8A8);
+    auto image = std::make_shared<PixelBuffer const>(TestImage(64, 48));
+    test.Pipeline->Upload(surface, image);
+    test.FlushAll();
+    CHECK(test.Retention->Retain(surface, image));
+    // BC1: half a byte a pixel.
+    CHECK_EQ(test.Retention->Stats().RetainedBytes, uint64_t(64 * 48 / 2));
+
+    test.Device->SimulateDeviceLoss();
+    test.Device->ReplaceDevice();
+    auto restored = false;
+    CHECK_EQ(test.Retention->RestoreAll([&]() { restored = true; }), size_t(1));
+    test.FlushAll();
+    CHECK(restored);
+    CHECK_EQ(surface->Width(), 64u);
+    CHECK_EQ(surface->Height(), 48u);
+    CHECK_EQ(surface->ReadPixels().size(), image->Bytes.size());
+}
@@ -0,0 +1,34 @@
+#include "BenchHarness.h"
+#include "Placeholder.h"
+
+// The placeholder has to be on screen well before the real image, so the
+// target is under 1 ms for everything after the decoder hands back its
+// pixels. The loader samples a 1/8th scale preview (504x378 for a 12 MP
+// photo), but the sampling grid is fixed, so the cost shouldn't depend on
+// the size of the source: the full size image is there to check that. Then
+// the same for BlurHash, which is what a placeholder stored with the
+// metadata would cost to show. The scaled decode itself happens in WIC and
+// isn't measured here.
+BENCH(placeholder, "CreatePlaceholder and BlurHash timings against the 1 ms target [width] [height]")
+{
+    uint32_t width = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 4032;
+    uint32_t height = arguments.size() > 1 ? static_cast<uint32_t>(std::stoul(arguments[1])) : 3024;
+    constexpr double target = 1.0;
+    auto report = [target](char const* name, std::chrono::nanoseconds time)
+        {
+            std::printf("%-34s %8.3f ms  %s\n", name, Milliseconds(time), Milliseconds(time) < target ? "under 1 ms" : "over 1 ms");
+        };
+
+    auto preview = TestImage(std::max(1u, width / 8), std::max(1u, height / 8));
+    auto full = TestImage(width, height);
+    std::printf("%ux%u source, %ux%u preview\n", width, height, preview.Width, preview.Height);
+    report("CreatePlaceholder, preview", FastestOf([&]() { CreatePlaceholder(preview); }));
+    report("CreatePlaceholder, preview, 64", FastestOf([&]() { CreatePlaceholder(preview, 64); }));
+    report("CreatePlaceholder, full size", FastestOf([&]() { CreatePlaceholder(full); }));
+
+    std::string hash;
+    report("EncodeBlurHash 4x3, preview", FastestOf([&]() { hash = EncodeBlurHash(preview); }));
+    report("EncodeBlurHash 9x9, preview", FastestOf([&]() { EncodeBlurHash(preview, 9, 9); }));
+    report("DecodeBlurHash 4x3 to 32x24", FastestOf([&]() { DecodeBlurHash(hash, 32, 24); }));
+    std::printf("The 4x3 hash is \"%s\"\n", hash.c_str());
+}
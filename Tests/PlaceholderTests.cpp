@@ -0,0 +1,62 @@
+#include "TestHarness.h"
+#include "Placeholder.h"
+
+TEST(Placeholder, KeepsTheAspectRatioWithinTheMaximumSize)
+{
+    auto placeholder = CreatePlaceholder(TestImage(4000, 1000), 32);
+    CHECK_EQ(placeholder.Width, 32u);
+    CHECK_EQ(placeholder.Height, 8u);
+
+    // Smaller than the maximum already.
+    auto small = CreatePlaceholder(TestImage(10, 20), 32);
+    CHECK(small.Width <= 10u && small.Height <= 20u);
+    CHECK(small.Width >= 1u && small.Height >= 1u);
+}
+
+TEST(Placeholder, AveragesTheSource)
+{
+    // A flat image should stay flat.
+    PixelBuffer image(300, 200);
+    for (size_t i = 0; i < image.Bytes.size(); i += 4)
+    {
+        image.Bytes[i + 0] = 40;
+        image.Bytes[i + 1] = 120;
+        image.Bytes[i + 2] = 200;
+        image.Bytes[i + 3] = 255;
+    }
+    auto placeholder = CreatePlaceholder(image);
+    for (size_t i = 0; i < placeholder.Bytes.size(); i += 4)
+    {
+        CHECK(std::abs(placeholder.Bytes[i + 0] - 40) <= 1);
+        CHECK(std::abs(placeholder.Bytes[i + 1] - 120) <= 1);
+        CHECK(std::abs(placeholder.Bytes[i + 2] - 200) <= 1);
+        CHECK_EQ(placeholder.Bytes[i + 3], uint8_t(255));
+    }
+}
+
+TEST(Placeholder, BlurHashRoundTrips)
+{
+    auto image = TestImage(120, 80);
+    auto hash = EncodeBlurHash(image, 4, 3);
+    // One character for the size, one for the maximum AC value, four for the
+    // DC and two for each AC component.
+    CHECK_EQ(hash.size(), size_t(1 + 1 + 4 + 2 * (4 * 3 - 1)));
+    auto decoded = DecodeBlurHash(hash, 32, 24);
+    CHECK(decoded.has_value());
+    CHECK_EQ(decoded->Width, 32u);
+    CHECK_EQ(decoded->Height, 24u);
+    // Blue runs from left to right in the test image, and should still.
+    auto left = decoded->Row(12)[0];
+    auto right = decoded->Row(12)[31 * 4];
+    CHECK(right > left + 64);
+}
+
+TEST(Placeholder, MalformedBlurHashesAreRejected)
+{
+    CHECK(!DecodeBlurHash("", 8, 8));
+    CHECK(!DecodeBlurHash("L", 8, 8));
+    auto hash = EncodeBlurHash(TestImage(16, 16));
+    CHECK(!DecodeBlurHash(hash.substr(0, hash.size() - 1), 8, 8));
+    hash[3] = '!';
+    CHECK(!DecodeBlurHash(hash, 8, 8));
+}
@@ -0,0 +1,90 @@
+#include "BenchHarness.h"
+#include "Prefetcher.h"
+
+namespace
+{
+    // Stands in for reading and decoding a file: loadTime of waiting, checking
+    // for cancellation every millisecond like a real loader would between steps.
+    Prefetcher::Loader SlowLoader(std::chrono::milliseconds loadTime)
+    {
+        return [loadTime](size_t, std::atomic<bool> const& cancelled) -> std::shared_ptr<PixelBuffer const>
+        {
+            auto end = std::chrono::steady_clock::now() + loadTime;
+            while (std::chrono::steady_clock::now() < end)
+            {
+                if (cancelled)
+                {
+                    return nullptr;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return std::make_shared<PixelBuffer const>(64, 64);
+        };
+    }
+
+    void PrintStats(char const* name, std::chrono::nanoseconds waited, size_t steps, PrefetchStats const& stats)
+    {
+        std::printf("%-22s %9.1f ms %8.1f%% %8.1f%% %8.1f%% %7llu %7llu\n", name,
+            Milliseconds(waited) / steps, stats.Coverage() * 100, stats.Accuracy() * 100, stats.WastedFraction() * 100,
+            static_cast<unsigned long long>(stats.LateHits), static_cast<unsigned long long>(stats.Cancelled));
+    }
+}
+
+// A slideshow where each image takes loadTime to decode and is looked at for
+// dwellTime. Without prefetching the user waits the whole decode on every
+// step. With it, the next images are decoded while the current one is up.
+// The second run turns back half way through, which shows what's cancelled
+// or thrown away when the prediction is wrong.
+//
+// Nothing in the single image sample navigates between images, so this is
+// the only place the prefetcher runs end to end.
+BENCH(prefetch, "Prefetcher in a slideshow: time waiting per step [loadMs] [dwellMs] [steps]")
+{
+    auto loadTime = std::chrono::milliseconds(arguments.size() > 0 ? std::stoul(arguments[0]) : 30);
+    auto dwellTime = std::chrono::milliseconds(arguments.size() > 1 ? std::stoul(arguments[1]) : 20);
+    size_t steps = arguments.size() > 2 ? std::stoul(arguments[2]) : 40;
+    constexpr size_t itemCount = 1000;
+    auto loader = SlowLoader(loadTime);
+
+    std::printf("%zu steps, %lld ms to load, %lld ms on each image\n", steps,
+        static_cast<long long>(loadTime.count()), static_cast<long long>(dwellTime.count()));
+    std::printf("%-22s %12s %9s %9s %9s %7s %7s\n", "", "wait/step", "coverage", "accuracy", "wasted", "late", "cancel");
+
+    std::chrono::nanoseconds waited{};
+    for (size_t step = 0; step < steps; step++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::atomic<bool> cancelled = false;
+        loader(step, cancelled);
+        waited += std::chrono::steady_clock::now() - start;
+        std::this_thread::sleep_for(dwellTime);
+    }
+    PrintStats("no prefetch", waited, steps, {});
+
+    for (auto turnBack : { false, true })
+    {
+        Prefetcher prefetcher(itemCount, loader);
+        waited = {};
+        size_t item = 500;
+        int32_t direction = 1;
+        for (size_t step = 0; step < steps; step++)
+        {
+            if (turnBack && step == steps / 2)
+            {
+                direction = -1;
+            }
+            item += direction;
+            auto start = std::chrono::steady_clock::now();
+            auto image = prefetcher.Take(item);
+            if (!image)
+            {
+                std::atomic<bool> cancelled = false;
+                image = loader(item, cancelled);
+            }
+            waited += std::chrono::steady_clock::now() - start;
+            prefetcher.HintSequence(item, direction);
+            std::this_thread::sleep_for(dwellTime);
+        }
+        PrintStats(turnBack ? "prefetch, turning back" : "prefetch", waited, steps, prefetcher.Stats());
+    }
+}
@@ -0,0 +1,79 @@
+#include "BenchHarness.h"
+#include "ImagePyramid.h"
+
+// Two parts. First, what a pyramid costs: how long building one takes and how
+// much memory it holds on top of the full image. Then a gallery session,
+// where images are shown as grid thumbnails, in a preview pane and fullscreen
+// in a random order, with one pyramid per image against a decoded cache keyed
+// by display size (a decode for every size an image is shown at).
+//
+// Nothing in the single image sample shows an image at more than one size, so
+// this is the only place the cache runs end to end.
+BENCH(pyramid, "ImagePyramid build cost and PyramidCache in a gallery session [width] [height] [images] [budgetPyramids]")
+{
+    uint32_t width = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 4032;
+    uint32_t height = arguments.size() > 1 ? static_cast<uint32_t>(std::stoul(arguments[1])) : 3024;
+    uint32_t imageCount = arguments.size() > 2 ? static_cast<uint32_t>(std::stoul(arguments[2])) : 40;
+    // How many of the session's pyramids fit in the budget both caches get.
+    uint32_t budgetPyramids = arguments.size() > 3 ? static_cast<uint32_t>(std::stoul(arguments[3])) : 12;
+
+    auto image = TestImage(width, height);
+    std::unique_ptr<ImagePyramid> pyramid;
+    auto buildTime = FastestOf([&]() { pyramid = std::make_unique<ImagePyramid>(image); }, std::chrono::milliseconds(500), 2);
+    auto halveTime = FastestOf([&]() { HalveImage(image); }, std::chrono::milliseconds(500), 2);
+    std::printf("%ux%u: %u levels in %.1f ms (the first halving is %.1f ms, %.0f MP/s), %.1f MB, %.2fx the image\n",
+        width, height, pyramid->LevelCount(), Milliseconds(buildTime), Milliseconds(halveTime),
+        static_cast<double>(width) * height / 1e6 / (Milliseconds(halveTime) / 1e3),
+        pyramid->Bytes() / 1048576.0, static_cast<double>(pyramid->Bytes()) / image.Bytes.size());
+
+    // The session uses smaller images so it doesn't take all day.
+    constexpr uint32_t sessionWidth = 1600;
+    constexpr uint32_t sessionHeight = 1200;
+    constexpr std::pair<uint32_t, uint32_t> displaySizes[] = { { 160, 120 }, { 800, 600 }, { 1600, 1200 } };
+    // Pretend every decode takes this long, since that's what a hit saves.
+    const auto decodeTime = std::chrono::milliseconds(40);
+    auto sessionImage = TestImage(sessionWidth, sessionHeight);
+    auto budget = budgetPyramids * ImagePyramid(sessionImage).Bytes();
+
+    PyramidCache cache(budget);
+    DecodedImageCache sized(budget);
+    uint64_t sizedDecodes = 0;
+    std::chrono::nanoseconds buildTotal{};
+    uint32_t seed = 9;
+    uint32_t views = imageCount * 10;
+    for (uint32_t view = 0; view < views; view++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        // Mostly thumbnails, most of the time on a handful of images.
+        auto id = (seed >> 16) % ((seed & 3) == 0 ? imageCount : std::max(1u, imageCount / 4));
+        auto [displayWidth, displayHeight] = displaySizes[(seed >> 8) % 8 < 5 ? 0 : ((seed >> 8) % 8 < 7 ? 1 : 2)];
+        auto key = ImageKeyForContent(id, 1000 + id);
+
+        if (!cache.Find(key, displayWidth, displayHeight))
+        {
+            auto start = std::chrono::steady_clock::now();
+            cache.Insert(key, sessionImage, std::chrono::duration_cast<std::chrono::microseconds>(decodeTime), displayWidth, displayHeight);
+            buildTotal += std::chrono::steady_clock::now() - start;
+        }
+        sized.FindOrLoad(ImageKeyForContent(id, 1000 + id, displayWidth, displayHeight), [&]()
+            {
+                sizedDecodes++;
+                return PixelBuffer(displayWidth, displayHeight);
+            });
+    }
+
+    auto stats = cache.Stats();
+    std::printf("Session: %u views of %u images at 3 sizes, %.0f MB budget\n", views, imageCount, budget / 1048576.0);
+    std::printf("  pyramids:      %4llu decodes, %.1f%% hits, %.1f ms building each, %.1f s of decoding avoided\n",
+        static_cast<unsigned long long>(stats.Misses), stats.HitRate() * 100,
+        Milliseconds(buildTotal) / std::max<uint64_t>(1, stats.Insertions), stats.DecodeTimeAvoided.count() / 1e6);
+    std::printf("  by level:     ");
+    for (uint32_t level = 0; level < stats.LevelHits.size(); level++)
+    {
+        if (stats.LevelHits[level] > 0)
+        {
+            std::printf(" %u: %.1f%%", level, stats.LevelHitRate(level) * 100);
+        }
+    }
+    std::printf("\n  per size:      %4llu decodes\n", static_cast<unsigned long long>(sizedDecodes));
+}
@@ -0,0 +1,166 @@
+#include "TestHarness.h"
+#include "QoiCodec.h"
+
+namespace
+{
+    PixelBuffer Row(std::vector<std::array<uint8_t, 4>> const& pixels)
+    {
+        PixelBuffer image(static_cast<uint32_t>(pixels.size()), 1);
+        for (size_t i = 0; i < pixels.size(); i++)
+        {
+            std::memcpy(image.Bytes.data() + i * 4, pixels[i].data(), 4);
+        }
+        return image;
+    }
+
+    PixelBuffer Solid(uint32_t width, uint32_t height, std::array<uint8_t, 4> color)
+    {
+        PixelBuffer image(width, height);
+        for (size_t i = 0; i < image.Bytes.size(); i += 4)
+        {
+            std::memcpy(image.Bytes.data() + i, color.data(), 4);
+        }
+        return image;
+    }
+
+    void CheckRoundTrip(PixelBuffer const& image, uint32_t bandHeight = 64)
+    {
+        auto encoded = EncodeQoi(image, bandHeight);
+        CHECK_EQ(encoded.Width, image.Width);
+        CHECK_EQ(encoded.Height, image.Height);
+        auto decoded = DecodeQoi(encoded);
+        CHECK(decoded.Bytes == image.Bytes);
+    }
+}
+
+TEST(QoiCodec, EachOpComesOutAsExpected)
+{
+    // In memory order, B G R A.
+    auto image = Row({
+        { 0, 0, 0, 255 },      // Same as the starting pixel: a run of one.
+        { 1, 1, 1, 255 },      // All three within -2..1: a diff.
+        { 25, 21, 19, 255 },   // Green +20, the others within 8 of it: luma.
+        { 200, 0, 100, 255 },  // Too far for either: rgb.
+        { 200, 0, 100, 128 },  // Alpha changed: rgba.
+        { 1, 1, 1, 255 },      // Seen before: its slot in the index.
+        { 1, 1, 1, 255 },
+        { 1, 1, 1, 255 },      // And a run of two to finish.
+    });
+    auto encoded = EncodeQoi(image);
+    std::vector<uint8_t> expected = {
+        0xC0,
+        0x7F,
+        0xB4, 0xC6,
+        0xFE, 200, 0, 100,
+        0xFF, 200, 0, 100, 128,
+        0x04,
+        0xC1,
+    };
+    CHECK(encoded.Data == expected);
+    CHECK(DecodeQoi(encoded).Bytes == image.Bytes);
+}
+
+TEST(QoiCodec, LongRunsAreSplit)
+{
+    // Runs stop at 62, since 63 and 64 would look like rgb and rgba.
+    for (uint32_t width : { 61u, 62u, 63u, 64u, 124u, 200u })
+    {
+        auto image = Solid(width, 1, { 10, 20, 30, 255 });
+        auto encoded = EncodeQoi(image);
+        // One rgb for the first pixel, then runs of at most 62.
+        auto runs = (width - 1 + 61) / 62;
+        CHECK_EQ(encoded.Data.size(), size_t(4 + runs));
+        for (size_t i = 4; i < encoded.Data.size(); i++)
+        {
+            CHECK((encoded.Data[i] & 0xC0) == 0xC0);
+            CHECK(encoded.Data[i] < 0xFE);
+        }
+        CheckRoundTrip(image);
+    }
+    // A run that carries on from one row to the next.
+    CheckRoundTrip(Solid(50, 9, { 0, 0, 0, 255 }));
+}
+
+TEST(QoiCodec, IndexHitsAndDeltasRoundTrip)
+{
+    // Alternating colors are all index hits after the first two.
+    std::vector<std::array<uint8_t, 4>> pixels;
+    for (int i = 0; i < 40; i++)
+    {
+        pixels.push_back(i % 2 ? std::array<uint8_t, 4>{ 90, 10, 240, 255 } : std::array<uint8_t, 4>{ 5, 200, 60, 255 });
+    }
+    auto alternating = Row(pixels);
+    auto encoded = EncodeQoi(alternating);
+    CHECK_EQ(encoded.Data.size(), size_t(4 + 4 + 38));
+    CheckRoundTrip(alternating);
+
+    // Steps of every size, including ones that wrap around, in every channel
+    // and with alpha changing now and then.
+    pixels.clear();
+    std::array<uint8_t, 4> pixel = { 128, 128, 128, 255 };
+    uint32_t seed = 7;
+    for (int i = 0; i < 4000; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        auto step = static_cast<int>((seed >> 24) % 80) - 40;
+        pixel[i % 3] = static_cast<uint8_t>(pixel[i % 3] + step);
+        pixel[1] = static_cast<uint8_t>(pixel[1] + step / 3);
+        if (i % 97 == 0)
+        {
+            pixel[3] = static_cast<uint8_t>(seed >> 8);
+        }
+        pixels.push_back(pixel);
+    }
+    CheckRoundTrip(Row(pixels));
+    CheckRoundTrip(TestImage(123, 45));
+}
+
+TEST(QoiCodec, BandsStartAfresh)
+{
+    auto image = TestImage(37, 50);
+    for (uint32_t bandHeight : { 1u, 7u, 16u, 49u, 50u, 51u, 1000u })
+    {
+        auto encoded = EncodeQoi(image, bandHeight);
+        CHECK_EQ(encoded.BandHeight, bandHeight);
+        CHECK_EQ(encoded.BandOffsets.size(), size_t((50 + bandHeight - 1) / bandHeight));
+        CHECK_EQ(encoded.BandOffsets[0], uint64_t(0));
+        CheckRoundTrip(image, bandHeight);
+    }
+
+    // Each band is its own stream, so a run doesn't carry over into the next
+    // one, and the last band can be short.
+    auto solid = Solid(10, 10, { 0, 0, 0, 255 });
+    auto encoded = EncodeQoi(solid, 4);
+    CHECK(encoded.BandOffsets == std::vector<uint64_t>({ 0, 1, 2 }));
+    CHECK(encoded.Data == std::vector<uint8_t>({ 0xC0 | 39, 0xC0 | 39, 0xC0 | 19 }));
+    CheckRoundTrip(solid, 4);
+
+    // Decoding into rows with padding leaves the padding alone.
+    encoded = EncodeQoi(image, 8);
+    std::vector<uint8_t> padded(static_cast<size_t>(37 * 4 + 12) * 50, 0xAB);
+    DecodeQoi(encoded, padded.data(), 37 * 4 + 12);
+    for (uint32_t y = 0; y < 50; y++)
+    {
+        auto row = padded.data() + static_cast<size_t>(y) * (37 * 4 + 12);
+        CHECK(std::equal(row, row + 37 * 4, image.Row(y)));
+        CHECK(std::all_of(row + 37 * 4, row + 37 * 4 + 12, [](uint8_t byte) { return byte == 0xAB; }));
+    }
+}
+
+TEST(QoiCodec, BadDataThrows)
+{
+    CHECK_THROWS(EncodeQoi(TestImage(4, 4), 0), std::invalid_argument);
+
+    auto encoded = EncodeQoi(TestImage(20, 20), 8);
+    auto truncated = encoded;
+    truncated.Data.resize(truncated.Data.size() - 3);
+    CHECK_THROWS(DecodeQoi(truncated), std::runtime_error);
+
+    auto missingBand = encoded;
+    missingBand.BandOffsets.pop_back();
+    CHECK_THROWS(DecodeQoi(missingBand), std::runtime_error);
+
+    auto outOfOrder = encoded;
+    std::swap(outOfOrder.BandOffsets[0], outOfOrder.BandOffsets[1]);
+    CHECK_THROWS(DecodeQoi(outOfOrder), std::runtime_error);
+}
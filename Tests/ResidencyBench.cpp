@@ -0,0 +1,96 @@
+#include "BenchHarness.h"
+#include "ResidencyManager.h"
+#include "SoftwareRenderDevice.h"
+
+// Scrolling down a long strip of images with a budget that holds a fraction
+// of them, the way a gallery would use the manager: everything in view is
+// visible, Enforce runs once a frame, and restores reload straight away. It
+// reports how close to the budget it stays and what Enforce costs per frame.
+//
+// Surfaces are kept small so the bench measures the bookkeeping rather than
+// memory allocation. Nothing in the single image sample registers with the
+// manager yet, so this is the only place it runs end to end.
+BENCH(residency, "ResidencyManager while scrolling a long strip [surfaces] [budgetPercent]")
+{
+    uint32_t count = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 5000;
+    uint32_t budgetPercent = arguments.size() > 1 ? static_cast<uint32_t>(std::stoul(arguments[1])) : 20;
+    constexpr uint32_t visibleCount = 30;
+
+    auto now = std::chrono::steady_clock::time_point();
+    ResidencyManager manager({}, [&]() { return now; });
+    auto device = std::make_shared<SoftwareRenderDevice>();
+    std::vector<ResidencyId> ids;
+    std::vector<std::pair<uint32_t, uint32_t>> sizes;
+    uint64_t totalBytes = 0;
+    uint64_t reloadedBytes = 0;
+    uint32_t seed = 3;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t width = 32 + (seed >> 27);
+        uint32_t height = 32 + ((seed >> 22) & 0x1f);
+        auto surface = device->CreateSoftwareSurface(SurfaceFormat::B8G8R8A8);
+        surface->Resize(width, height);
+        totalBytes += static_cast<uint64_t>(width) * height * 4;
+        // Every other image still has its pixels cached.
+        ids.push_back(manager.Register(surface, i % 2 == 0, [&, width, height](std::shared_ptr<SurfaceBackend> const& restored)
+            {
+                restored->Resize(width, height);
+                reloadedBytes += static_cast<uint64_t>(width) * height * 4;
+            }));
+        manager.SetVisible(ids.back(), false);
+    }
+    manager.SetBudget(totalBytes * budgetPercent / 100);
+
+    // Down the strip and back up again, a row of the view at a time.
+    std::vector<uint32_t> firstVisible;
+    for (uint32_t first = 0; first + visibleCount <= count; first += 3)
+    {
+        firstVisible.push_back(first);
+    }
+    std::vector<uint32_t> backUp(firstVisible.rbegin(), firstVisible.rend());
+    firstVisible.insert(firstVisible.end(), backUp.begin(), backUp.end());
+
+    std::chrono::nanoseconds enforceTime{};
+    std::chrono::nanoseconds slowestFrame{};
+    uint64_t peakResident = 0;
+    uint32_t previous = 0;
+    bool firstFrame = true;
+    for (auto first : firstVisible)
+    {
+        now += std::chrono::milliseconds(16);
+        if (!firstFrame)
+        {
+            for (auto i = previous; i < previous + visibleCount; i++)
+            {
+                if (i < first || i >= first + visibleCount)
+                {
+                    manager.SetVisible(ids[i], false);
+                }
+            }
+        }
+        for (auto i = first; i < first + visibleCount; i++)
+        {
+            manager.SetVisible(ids[i], true);
+        }
+        auto start = std::chrono::steady_clock::now();
+        manager.Enforce();
+        auto frame = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        enforceTime += frame;
+        slowestFrame = std::max(slowestFrame, frame);
+        peakResident = std::max(peakResident, manager.ResidentBytes());
+        previous = first;
+        firstFrame = false;
+    }
+
+    auto stats = manager.Stats();
+    std::printf("%u surfaces, %.1f MB in all, budget %.1f MB (%u%%), %zu frames\n",
+        count, totalBytes / 1048576.0, manager.Budget() / 1048576.0, budgetPercent, firstVisible.size());
+    std::printf("Peak resident %.1f MB, %llu evictions (%llu expensive), %llu restores, %.1f MB reloaded\n",
+        peakResident / 1048576.0, static_cast<unsigned long long>(stats.Evictions),
+        static_cast<unsigned long long>(stats.ExpensiveEvictions), static_cast<unsigned long long>(stats.Restores),
+        reloadedBytes / 1048576.0);
+    std::printf("Enforce: %.2f us a frame on average, %.2f us at worst\n",
+        std::chrono::duration<double, std::micro>(enforceTime).count() / firstVisible.size(),
+        std::chrono::duration<double, std::micro>(slowestFrame).count());
+}
@@ -0,0 +1,202 @@
+#include "TestHarness.h"
+#include "SessionSnapshot.h"
+#include "ContentHash.h"
+
+namespace
+{
+    SnapshotItem Item(char const* path, SurfaceRect const& bounds, uint32_t seed)
+    {
+        SnapshotItem item;
+        item.Key = ImageKeyForContent(seed, 1000 + seed);
+        item.Key.Path = path;
+        item.Key.TargetWidth = bounds.Width;
+        item.Key.TargetHeight = bounds.Height;
+        item.Bounds = bounds;
+        item.Pixels = std::make_shared<PixelBuffer const>(TestImage(bounds.Width, bounds.Height, seed));
+        return item;
+    }
+
+    SessionSnapshot TwoItems()
+    {
+        SessionSnapshot snapshot;
+        snapshot.ViewWidth = 800;
+        snapshot.ViewHeight = 600;
+        snapshot.ScrollOffset = 1234.5;
+        // Odd sizes, so the second item's pixels only line up if they're padded.
+        snapshot.Items.push_back(Item("photos/first.jpg", { 0, 0, 37, 21 }, 1));
+        snapshot.Items.push_back(Item("photos/second.png", { -10, 300, 64, 48 }, 2));
+        return snapshot;
+    }
+
+    std::vector<uint8_t> ReadFile(std::filesystem::path const& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+    }
+
+    void WriteFile(std::filesystem::path const& path, std::vector<uint8_t> const& bytes)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<char const*>(bytes.data()), bytes.size());
+    }
+
+    // Rewrites the trailing checksum, so only the other checks can catch the
+    // change.
+    void Reseal(std::vector<uint8_t>& bytes)
+    {
+        auto checksum = ContentHasher::Hash(bytes.data(), bytes.size() - sizeof(uint64_t));
+        std::memcpy(bytes.data() + bytes.size() - sizeof(checksum), &checksum, sizeof(checksum));
+    }
+}
+
+TEST(SessionSnapshot, RoundTrips)
+{
+    auto path = TestDirectory("SessionSnapshot") / "snapshot.bin";
+    auto saved = TwoItems();
+    SaveSessionSnapshot(path, saved);
+    CHECK(!std::filesystem::exists(path.string() + ".tmp"));
+
+    auto loaded = LoadSessionSnapshot(path);
+    CHECK(loaded.has_value());
+    CHECK_EQ(loaded->ViewWidth, 800u);
+    CHECK_EQ(loaded->ViewHeight, 600u);
+    CHECK_EQ(loaded->ScrollOffset, 1234.5);
+    CHECK_EQ(loaded->Items.size(), size_t(2));
+    CHECK_EQ(loaded->PixelBytes(), saved.PixelBytes());
+    for (size_t i = 0; i < saved.Items.size(); i++)
+    {
+        auto& expected = saved.Items[i];
+        auto& item = loaded->Items[i];
+        CHECK(item.Key == expected.Key);
+        CHECK_EQ(item.Key.Path, expected.Key.Path);
+        CHECK_EQ(item.Bounds.X, expected.Bounds.X);
+        CHECK_EQ(item.Bounds.Y, expected.Bounds.Y);
+        CHECK_EQ(item.Bounds.Width, expected.Bounds.Width);
+        CHECK(item.Pixels->Bytes == expected.Pixels->Bytes);
+    }
+}
+
+TEST(SessionSnapshot, PixelsMustMatchTheBounds)
+{
+    auto path = TestDirectory("SessionSnapshotBounds") / "snapshot.bin";
+    auto snapshot = TwoItems();
+    snapshot.Items[1].Bounds.Width++;
+    CHECK_THROWS(SaveSessionSnapshot(path, snapshot), std::invalid_argument);
+    CHECK(!std::filesystem::exists(path));
+}
+
+TEST(SessionSnapshot, BadFilesLoadAsCold)
+{
+    auto directory = TestDirectory("SessionSnapshotBad");
+    auto path = directory / "snapshot.bin";
+    CHECK(!LoadSessionSnapshot(path).has_value());
+
+    SaveSessionSnapshot(path, TwoItems());
+    auto good = ReadFile(path);
+
+    // One flipped pixel, which only the checksum catches.
+    auto bytes = good;
+    bytes[bytes.size() - 20] ^= 1;
+    WriteFile(path, bytes);
+    CHECK(!LoadSessionSnapshot(path).has_value());
+
+    // Cut short.
+    WriteFile(path, std::vector<uint8_t>(good.begin(), good.begin() + 30));
+    CHECK(!LoadSessionSnapshot(path).has_value());
+
+    // Another version.
+    bytes = good;
+    bytes[4]++;
+    Reseal(bytes);
+    WriteFile(path, bytes);
+    CHECK(!LoadSessionSnapshot(path).has_value());
+
+    // Header and record fields pointing past the end, under a valid
+    // checksum: the item count, a path length that wraps around when added
+    // to the paths offset, and the first item's pixel offset.
+    for (auto [offset, value] : { std::pair<size_t, uint64_t>{ 8, 0xffffffff },
+        { 32, ~uint64_t(0) - 100 }, { 40 + 56, good.size() - 100 } })
+    {
+        bytes = good;
+        auto size = offset == 8 ? sizeof(uint32_t) : sizeof(uint64_t);
+        std::memcpy(bytes.data() + offset, &value, size);
+        Reseal(bytes);
+        WriteFile(path, bytes);
+        CHECK(!LoadSessionSnapshot(path).has_value());
+    }
+
+    WriteFile(path, good);
+    CHECK(LoadSessionSnapshot(path).has_value());
+}
+
+TEST(SessionSnapshot, CropClipsToTheImage)
+{
+    auto image = TestImage(20, 10);
+    auto crop = CropImage(image, { 15, -5, 10, 8 });
+    CHECK_EQ(crop.Width, 5u);
+    CHECK_EQ(crop.Height, 3u);
+    CHECK(std::memcmp(crop.Row(0), image.Row(0) + 15 * 4, 5 * 4) == 0);
+    CHECK(std::memcmp(crop.Row(2), image.Row(2) + 15 * 4, 5 * 4) == 0);
+
+    auto outside = CropImage(image, { 30, 0, 10, 10 });
+    CHECK_EQ(outside.Width, 0u);
+}
+
+TEST(SessionSnapshot, RecorderCapturesWhatIsVisible)
+{
+    SessionRecorder recorder;
+    recorder.SetView(640, 480, 12.0);
+    auto first = std::make_shared<PixelBuffer const>(TestImage(100, 80, 1));
+    auto second = std::make_shared<PixelBuffer const>(TestImage(50, 50, 2));
+    auto firstKey = ImageKeyForContent(1, 1001);
+    auto secondKey = ImageKeyForContent(2, 1002);
+
+    // Scrolled so the top 20 rows are above the view: the visible rect
+    // starts inside the image.
+    recorder.Show(firstKey, first, { 0, 20, 100, 60 }, { 10, 0 });
+    // Hanging off the left of the image, so its left edge is clipped.
+    recorder.Show(secondKey, second, { -5, 0, 30, 30 }, { 200, 100 });
+    auto snapshot = recorder.Capture();
+    CHECK_EQ(snapshot.ViewWidth, 640u);
+    CHECK_EQ(snapshot.ScrollOffset, 12.0);
+    CHECK_EQ(snapshot.Items.size(), size_t(2));
+    CHECK(snapshot.Items[0].Key == firstKey);
+    CHECK_EQ(snapshot.Items[0].Bounds.Height, 60u);
+    CHECK(std::memcmp(snapshot.Items[0].Pixels->Row(0), first->Row(20), first->Stride()) == 0);
+    CHECK_EQ(snapshot.Items[1].Bounds.X, 205);
+    CHECK_EQ(snapshot.Items[1].Bounds.Width, 25u);
+
+    // Something else at the same position replaces it, and hidden images
+    // aren't captured.
+    recorder.Show(firstKey, first, { 0, 0, 10, 10 }, { 200, 100 });
+    recorder.Hide(firstKey);
+    CHECK_EQ(recorder.Capture().Items.size(), size_t(0));
+}
+
+TEST(SessionSnapshot, StartupTimerKeepsTheFirstOfEach)
+{
+    auto now = std::chrono::steady_clock::time_point{};
+    StartupTimer timer([&now]() { return now; });
+    timer.SnapshotLoaded(std::chrono::microseconds(300), true);
+    now += std::chrono::milliseconds(5);
+    timer.FirstPixels();
+    now += std::chrono::milliseconds(5);
+    timer.FirstPixels();
+    now += std::chrono::milliseconds(40);
+    CHECK(timer.ImageShown());
+    now += std::chrono::milliseconds(5);
+    CHECK(!timer.ImageShown());
+
+    auto times = timer.Times();
+    CHECK(times.Warm);
+    CHECK_EQ(times.SnapshotLoad.count(), int64_t(300));
+    CHECK_EQ(times.FirstPixels->count(), int64_t(5000));
+    CHECK_EQ(times.ImageShown->count(), int64_t(50000));
+
+    // Cold: the real image is the first thing on screen.
+    StartupTimer cold([&now]() { return now; });
+    now += std::chrono::milliseconds(70);
+    CHECK(cold.ImageShown());
+    CHECK(!cold.Times().Warm);
+    CHECK_EQ(cold.Times().FirstPixels->count(), int64_t(70000));
+}
@@ -0,0 +1,173 @@
+#include "BenchHarness.h"
+#include "SharedImageCache.h"
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+
+namespace
+{
+    ImageKey Key(uint64_t id)
+    {
+        return ImageKeyForContent(id, 1000 + id);
+    }
+
+#ifndef _WIN32
+    // What each viewer process sends back when it's done.
+    struct ViewerReport
+    {
+        SharedImageCacheStats Stats;
+        // Images it looked at, which is what it would have decoded and held on
+        // its own with a big enough cache.
+        uint64_t DistinctImages = 0;
+        uint64_t Decodes = 0;
+        int64_t Nanoseconds = 0;
+    };
+
+    // Looks at views images from the library, half of the time one of the
+    // most popular tenth of it. A miss decodes the image (made up, plus
+    // decodeTime of waiting) and offers it to the cache.
+    ViewerReport RunViewer(std::string const& name, SharedImageCacheOptions const& options, uint32_t process,
+        uint32_t imageCount, uint32_t views, std::chrono::milliseconds decodeTime, uint32_t width, uint32_t height)
+    {
+        SharedImageCache cache(name, options);
+        ViewerReport report;
+        std::vector<bool> seen(imageCount);
+        uint32_t seed = 17 + process * 7919;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t view = 0; view < views; view++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            auto id = (seed >> 16) % ((seed & 1) ? std::max(1u, imageCount / 10) : imageCount);
+            if (!seen[id])
+            {
+                seen[id] = true;
+                report.DistinctImages++;
+            }
+            if (auto pixels = cache.Find(Key(id)))
+            {
+                continue;
+            }
+            report.Decodes++;
+            auto image = TestImage(width, height, id + 1);
+            std::this_thread::sleep_for(decodeTime);
+            cache.Insert(Key(id), image);
+        }
+        report.Nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        report.Stats = cache.Stats();
+        return report;
+    }
+#endif
+}
+
+// Several viewer processes over the same library, each with its own mapping
+// of one segment. Reports how often a process finds an image another one
+// decoded, and the memory the segment takes against every process keeping
+// its own copies. Then how long an insert takes when the index is full,
+// which is where the allocator spends its time under the lock.
+//
+// Nothing in the single image sample runs more than one viewer, so this is
+// the only place processes share the cache.
+BENCH(sharedcache, "SharedImageCache across processes: hit rates and memory [processes] [images] [views] [decodeMs]")
+{
+#ifdef _WIN32
+    std::printf("This benchmark starts the viewers with fork, so it only runs on POSIX systems.\n");
+#else
+    uint32_t processCount = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 4;
+    uint32_t imageCount = arguments.size() > 1 ? static_cast<uint32_t>(std::stoul(arguments[1])) : 200;
+    uint32_t views = arguments.size() > 2 ? static_cast<uint32_t>(std::stoul(arguments[2])) : 400;
+    auto decodeTime = std::chrono::milliseconds(arguments.size() > 3 ? std::stoul(arguments[3]) : 5);
+    constexpr uint32_t width = 512;
+    constexpr uint32_t height = 384;
+    const uint64_t imageBytes = width * height * 4;
+
+    std::string name = "CompositionImageDemoBench." + std::to_string(getpid());
+    SharedImageCacheOptions options;
+    // Room for about half the library, so popular images stay and the rest
+    // come and go.
+    options.ArenaBytes = imageBytes * imageCount / 2;
+    SharedImageCache::Remove(name);
+    SharedImageCache segment(name, options);
+
+    std::vector<std::pair<pid_t, int>> viewers;
+    for (uint32_t process = 0; process < processCount; process++)
+    {
+        int pipeEnds[2];
+        if (pipe(pipeEnds) != 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "pipe");
+        }
+        auto pid = fork();
+        if (pid == 0)
+        {
+            close(pipeEnds[0]);
+            auto report = RunViewer(name, options, process, imageCount, views, decodeTime, width, height);
+            auto written = write(pipeEnds[1], &report, sizeof(report));
+            _exit(written == sizeof(report) ? 0 : 1);
+        }
+        close(pipeEnds[1]);
+        viewers.emplace_back(pid, pipeEnds[0]);
+    }
+
+    std::printf("%u processes, %u images of %ux%u, %u views each, %lld ms to decode\n", processCount, imageCount, width, height,
+        views, static_cast<long long>(decodeTime.count()));
+    std::printf("%-8s %8s %10s %8s %10s %10s\n", "process", "decodes", "alone", "hits", "cross", "ms/view");
+    uint64_t decodes = 0;
+    uint64_t decodesAlone = 0;
+    for (uint32_t process = 0; process < viewers.size(); process++)
+    {
+        auto [pid, input] = viewers[process];
+        ViewerReport report;
+        auto got = read(input, &report, sizeof(report));
+        close(input);
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (got != sizeof(report))
+        {
+            std::printf("%-8u failed\n", process);
+            continue;
+        }
+        decodes += report.Decodes;
+        decodesAlone += report.DistinctImages;
+        std::printf("%-8u %8llu %10llu %7.1f%% %9.1f%% %10.2f\n", process, static_cast<unsigned long long>(report.Decodes),
+            static_cast<unsigned long long>(report.DistinctImages), report.Stats.HitRate() * 100,
+            report.Stats.CrossProcessHitRate() * 100, report.Nanoseconds / 1e6 / views);
+    }
+
+    auto stats = segment.SegmentStats();
+    std::printf("All:     %.1f%% hits, %.1f%% from another process, %llu evictions, %llu rejected\n",
+        stats.HitRate() * 100, stats.CrossProcessHitRate() * 100,
+        static_cast<unsigned long long>(stats.Evictions), static_cast<unsigned long long>(stats.Rejections));
+    std::printf("Decodes: %llu shared, at least %llu with a cache in each process\n",
+        static_cast<unsigned long long>(decodes), static_cast<unsigned long long>(decodesAlone));
+    std::printf("Memory:  %.1f MB segment (%.1f MB of images in it), %.1f MB if each process kept what it looked at\n",
+        segment.SegmentBytes() / 1048576.0, stats.BytesUsed / 1048576.0, decodesAlone * imageBytes / 1048576.0);
+
+    // Every slot full of small images, so each insert has to evict one.
+    const std::string fullName = name + ".full";
+    SharedImageCacheOptions fullOptions;
+    fullOptions.SlotCount = 4096;
+    fullOptions.ArenaBytes = fullOptions.SlotCount * 4096ull;
+    SharedImageCache::Remove(fullName);
+    {
+        SharedImageCache full(fullName, fullOptions);
+        auto small = TestImage(32, 32);
+        uint64_t id = 0;
+        for (; id < fullOptions.SlotCount * 2; id++)
+        {
+            full.Insert(Key(id), small);
+        }
+        constexpr uint32_t inserts = 2000;
+        auto insertTime = FastestOf([&]()
+            {
+                for (uint32_t i = 0; i < inserts; i++)
+                {
+                    full.Insert(Key(id++), small);
+                }
+            });
+        std::printf("Full:    %.2f us an insert with %u slots in use\n", Milliseconds(insertTime) * 1000 / inserts,
+            static_cast<unsigned>(full.SegmentStats().EntryCount));
+    }
+    SharedImageCache::Remove(fullName);
+    SharedImageCache::Remove(name);
+#endif
+}
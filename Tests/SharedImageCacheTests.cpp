@@ -0,0 +1,271 @@
+#include "TestHarness.h"
+#include "SharedImageCache.h"
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+
+namespace
+{
+    // Removes the segment before and after, so a failed run doesn't leave one
+    // with other options behind.
+    struct TestSegment
+    {
+        std::string Name;
+
+        TestSegment(char const* name) : Name(std::string("CompositionImageDemoTests.") + name)
+        {
+            SharedImageCache::Remove(Name);
+        }
+        ~TestSegment()
+        {
+            SharedImageCache::Remove(Name);
+        }
+    };
+
+    ImageKey Key(uint64_t id)
+    {
+        return ImageKeyForContent(id, 1000 + id);
+    }
+
+    bool Matches(SharedPixels const& pixels, PixelBuffer const& image)
+    {
+        return pixels.Width == image.Width && pixels.Height == image.Height &&
+            std::memcmp(pixels.Data, image.Bytes.data(), image.Bytes.size()) == 0;
+    }
+}
+
+TEST(SharedImageCache, InsertedImagesAreFoundFromAnotherMapping)
+{
+    TestSegment segment("Find");
+    SharedImageCacheOptions options;
+    options.ArenaBytes = 1024 * 1024;
+    SharedImageCache first(segment.Name, options);
+    SharedImageCache second(segment.Name, options);
+
+    auto image = TestImage(40, 30);
+    CHECK(!second.Find(Key(1)));
+    auto inserted = first.Insert(Key(1), image);
+    CHECK(inserted && Matches(*inserted, image));
+    auto found = second.Find(Key(1));
+    CHECK(found && Matches(*found, image));
+    CHECK(found->Copy().Bytes == image.Bytes);
+
+    auto stats = second.Stats();
+    CHECK_EQ(stats.Hits, uint64_t(1));
+    CHECK_EQ(stats.Misses, uint64_t(1));
+    // Both mappings are in this process.
+    CHECK_EQ(stats.CrossProcessHits, uint64_t(0));
+    auto segmentStats = first.SegmentStats();
+    CHECK_EQ(segmentStats.Insertions, uint64_t(1));
+    CHECK_EQ(segmentStats.EntryCount, uint64_t(1));
+
+    SharedImageCacheOptions other = options;
+    other.SlotCount *= 2;
+    CHECK_THROWS(SharedImageCache(segment.Name, other), std::runtime_error);
+}
+
+TEST(SharedImageCache, RacingInsertsOfOneImageStoreItOnce)
+{
+    TestSegment segment("Race");
+    SharedImageCacheOptions options;
+    options.ArenaBytes = 4 * 1024 * 1024;
+    constexpr uint32_t imageCount = 64;
+    std::vector<PixelBuffer> images;
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        images.push_back(TestImage(16, 16, i + 1));
+    }
+
+    // Each thread has its own mapping, like another process would, and they
+    // all insert the same images at the same time.
+    std::vector<std::unique_ptr<SharedImageCache>> caches;
+    for (int t = 0; t < 4; t++)
+    {
+        caches.push_back(std::make_unique<SharedImageCache>(segment.Name, options));
+    }
+    std::atomic<uint32_t> wrong = 0;
+    std::vector<std::thread> threads;
+    for (auto& cache : caches)
+    {
+        threads.emplace_back([&, cache = cache.get()]()
+            {
+                for (uint32_t i = 0; i < imageCount; i++)
+                {
+                    auto pixels = cache->Insert(Key(i), images[i]);
+                    if (pixels && !Matches(*pixels, images[i]))
+                    {
+                        wrong++;
+                    }
+                }
+            });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    CHECK_EQ(wrong.load(), 0u);
+    auto stats = caches[0]->SegmentStats();
+    CHECK_EQ(stats.Insertions, uint64_t(imageCount));
+    CHECK_EQ(stats.EntryCount, uint64_t(imageCount));
+    CHECK_EQ(stats.BytesUsed, uint64_t(imageCount) * 16 * 16 * 4);
+}
+
+TEST(SharedImageCache, HeldImagesAreSteppedOver)
+{
+    TestSegment segment("Held");
+    SharedImageCacheOptions options;
+    // The arena rounds up to 64 KB: four 16 KB images.
+    options.ArenaBytes = 64 * 1024;
+    SharedImageCache cache(segment.Name, options);
+
+    auto held = TestImage(64, 64, 100);
+    auto pinned = cache.Insert(Key(100), held);
+    CHECK(pinned);
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        CHECK(cache.Insert(Key(i), TestImage(64, 64, i + 1)));
+    }
+    // Everything else went around the ring several times, but never over it.
+    CHECK(Matches(*pinned, held));
+    CHECK(cache.Find(Key(100)));
+    CHECK(!cache.Find(Key(0)));
+    CHECK(cache.Find(Key(19)));
+
+    // With every image held, there's no room for another.
+    std::vector<std::shared_ptr<SharedPixels const>> all = { pinned };
+    for (uint32_t i = 17; i < 20; i++)
+    {
+        all.push_back(cache.Find(Key(i)));
+    }
+    CHECK(!cache.Insert(Key(50), TestImage(64, 64, 50)));
+    CHECK_EQ(cache.Stats().Rejections, uint64_t(1));
+    all.clear();
+    CHECK(cache.Insert(Key(50), TestImage(64, 64, 50)));
+}
+
+TEST(SharedImageCache, MixedSizesNeverOverlap)
+{
+    TestSegment segment("Sizes");
+    SharedImageCacheOptions options;
+    options.ArenaBytes = 256 * 1024;
+    options.SlotCount = 64;
+    options.Ways = 4;
+    SharedImageCache cache(segment.Name, options);
+
+    // A few are held for a while, so allocations have to step around them.
+    std::vector<std::pair<PixelBuffer, std::shared_ptr<SharedPixels const>>> held;
+    uint32_t seed = 7;
+    for (uint32_t i = 0; i < 2000; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        auto image = TestImage(8 + (seed >> 24) % 120, 8 + (seed >> 16) % 40, i + 1);
+        auto pixels = cache.Insert(Key(i), image);
+        if (pixels && (seed & 7) == 0)
+        {
+            held.emplace_back(std::move(image), std::move(pixels));
+        }
+        if (held.size() > 4)
+        {
+            held.erase(held.begin());
+        }
+        for (auto& [expected, stored] : held)
+        {
+            CHECK(Matches(*stored, expected));
+        }
+    }
+    auto stats = cache.SegmentStats();
+    CHECK(stats.Insertions > 1900);
+    CHECK(stats.BytesUsed <= 256 * 1024u);
+}
+
+#ifndef _WIN32
+TEST(SharedImageCache, ALockHeldByAKilledProcessIsTakenOver)
+{
+    TestSegment segment("Takeover");
+    SharedImageCacheOptions options;
+    options.ArenaBytes = 1024 * 1024;
+    SharedImageCache cache(segment.Name, options);
+    std::vector<PixelBuffer> images;
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        images.push_back(TestImage(32, 32, i + 1));
+        CHECK(cache.Insert(Key(i), images.back()));
+    }
+
+    // The child gets as far as claiming a slot and space for an image, tells
+    // us, and waits to be killed with the lock held.
+    int ready[2];
+    CHECK(pipe(ready) == 0);
+    auto child = fork();
+    CHECK(child >= 0);
+    if (child == 0)
+    {
+        try
+        {
+            SharedImageCache crashing(segment.Name, options);
+            crashing.SimulateCrashDuringInsert(Key(100));
+            char byte = 1;
+            if (write(ready[1], &byte, 1) != 1)
+            {
+                _exit(1);
+            }
+        }
+        catch (...)
+        {
+            _exit(1);
+        }
+        while (true)
+        {
+            pause();
+        }
+    }
+    char byte = 0;
+    CHECK(read(ready[0], &byte, 1) == 1);
+    close(ready[0]);
+    close(ready[1]);
+    kill(child, SIGKILL);
+    CHECK(waitpid(child, nullptr, 0) == child);
+
+    // Insert on another thread with its own mapping, so the test fails rather
+    // than hangs if the lock is never taken over.
+    auto inserter = std::make_shared<SharedImageCache>(segment.Name, options);
+    auto result = std::make_shared<std::promise<bool>>();
+    auto inserted = result->get_future();
+    std::thread([inserter, result, image = TestImage(32, 32, 50)]()
+        {
+            result->set_value(inserter->Insert(Key(50), image) != nullptr);
+        }).detach();
+    CHECK(inserted.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    CHECK(inserted.get());
+    CHECK_EQ(cache.SegmentStats().LockTakeovers, uint64_t(1));
+
+    // The slot the child claimed was given up, so its image can go in.
+    auto image = TestImage(32, 32, 100);
+    auto pixels = cache.Insert(Key(100), image);
+    CHECK(pixels && Matches(*pixels, image));
+    // Everything from before is still there, and enough new images to wrap
+    // around the arena go in over the top without overlapping.
+    for (uint32_t i = 0; i < images.size(); i++)
+    {
+        auto found = cache.Find(Key(i));
+        CHECK(found && Matches(*found, images[i]));
+    }
+    std::vector<std::shared_ptr<SharedPixels const>> held;
+    std::vector<PixelBuffer> more;
+    for (uint32_t i = 0; i < 40; i++)
+    {
+        more.push_back(TestImage(64, 64, 200 + i));
+        held.push_back(cache.Insert(Key(200 + i), more.back()));
+        if (held.size() > 3)
+        {
+            held.erase(held.begin());
+        }
+    }
+    for (uint32_t i = 36; i < 40; i++)
+    {
+        auto found = cache.Find(Key(200 + i));
+        CHECK(found && Matches(*found, more[i]));
+    }
+    CHECK_EQ(cache.SegmentStats().LockTakeovers, uint64_t(1));
+}
+#endif
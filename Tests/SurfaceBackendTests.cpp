@@ -0,0 +1,68 @@
+#include "TestHarness.h"
+#include "SoftwareSurfaceBackend.h"
+
+TEST(SurfaceBackend, UploadsLandAtTheAtlasOffset)
+{
+    SoftwareSurfaceBackend surface(SurfaceFormat::B8G8R8A8, { 24, 7 });
+    auto image = TestImage(50, 30);
+    UploadImage(surface, image);
+    CHECK_EQ(surface.Width(), 50u);
+    CHECK_EQ(surface.Height(), 30u);
+    CHECK(surface.ReadPixels() == image.Bytes);
+    // Straight into the atlas: one draw, one write, no extra copies.
+    CHECK_EQ(surface.DrawCount(), uint64_t(1));
+    CHECK_EQ(surface.WriteCount(), uint64_t(1));
+    CHECK_EQ(surface.BytesWritten(), uint64_t(image.Bytes.size()));
+}
+
+TEST(SurfaceBackend, RegionsOnlyTouchTheirRect)
+{
+    SoftwareSurfaceBackend surface(SurfaceFormat::B8G8R8A8, { 3, 5 });
+    auto image = TestImage(40, 40);
+    UploadImage(surface, image);
+
+    auto patch = TestImage(10, 6, 7);
+    SurfaceRect rect = { 12, 20, 10, 6 };
+    UploadRegion(surface, rect, patch.Bytes.data(), patch.Stride());
+    auto pixels = surface.ReadPixels();
+    for (uint32_t y = 0; y < 40; y++)
+    {
+        for (uint32_t x = 0; x < 40; x++)
+        {
+            auto inside = x >= 12 && x < 22 && y >= 20 && y < 26;
+            auto expected = inside ? patch.Row(y - 20) + (x - 12) * 4 : image.Row(y) + x * 4;
+            CHECK(std::memcmp(pixels.data() + (y * 40 + x) * 4, expected, 4) == 0);
+        }
+    }
+}
+
+TEST(SurfaceBackend, EnforcesTheDrawingRules)
+{
+    SoftwareSurfaceBackend surface;
+    surface.Resize(16, 16);
+    uint8_t pixels[4 * 4 * 4] = {};
+    CHECK_THROWS(surface.WritePixels({ 16, 16 }, 4, 4, pixels, 16), std::logic_error);
+
+    SurfaceRect rect = { 4, 4, 4, 4 };
+    auto offset = surface.BeginDraw(&rect);
+    CHECK_EQ(offset.X, 20);
+    CHECK_THROWS(surface.WritePixels({ offset.X + 1, offset.Y }, 4, 4, pixels, 16), std::out_of_range);
+    CHECK_THROWS(surface.Resize(8, 8), std::logic_error);
+    surface.EndDraw();
+
+    SurfaceRect outside = { 10, 10, 8, 8 };
+    CHECK_THROWS(surface.BeginDraw(&outside), std::out_of_range);
+}
+
+TEST(SurfaceBackend, LosingTheDeviceDropsTheContents)
+{
+    SoftwareSurfaceBackend surface;
+    auto image = TestImage(8, 8);
+    UploadImage(surface, image);
+    surface.SetDeviceLost(true);
+    CHECK_THROWS(UploadImage(surface, image), DeviceLostError);
+    surface.SetDeviceLost(false);
+    CHECK(surface.ReadPixels() == std::vector<uint8_t>(image.Bytes.size(), 0));
+    UploadImage(surface, image);
+    CHECK(surface.ReadPixels() == image.Bytes);
+}
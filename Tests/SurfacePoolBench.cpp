@@ -0,0 +1,73 @@
+#include "BenchHarness.h"
+#include "SurfacePool.h"
+#include "SoftwareRenderDevice.h"
+
+namespace
+{
+    // Photo-ish sizes: 200 to 1224 pixels on the long side, in a few aspect
+    // ratios, either way up.
+    std::vector<std::pair<uint32_t, uint32_t>> ImageSizes(uint32_t count)
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> sizes;
+        uint32_t seed = 7;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            uint32_t longSide = 200 + (seed >> 22);
+            static constexpr float aspects[] = { 1.0f, 4.0f / 3.0f, 3.0f / 2.0f, 16.0f / 9.0f };
+            uint32_t shortSide = static_cast<uint32_t>(longSide / aspects[(seed >> 8) & 3]);
+            if (seed & 0x10)
+            {
+                sizes.push_back({ longSide, shortSide });
+            }
+            else
+            {
+                sizes.push_back({ shortSide, longSide });
+            }
+        }
+        return sizes;
+    }
+}
+
+// Flicking through a folder with a few images on screen at a time, with each
+// image getting a surface of its own. Without the pool every image is a new
+// surface (or a resize, which is the same allocation in the atlas); with it,
+// most of them reuse one the last few images were done with.
+//
+// The pool isn't used by the sample's single image view yet, so this is the
+// only place it runs end to end.
+BENCH(surfacepool, "SurfacePool reuse while flicking through images [images] [onScreen]")
+{
+    uint32_t count = arguments.size() > 0 ? static_cast<uint32_t>(std::stoul(arguments[0])) : 2000;
+    uint32_t onScreen = arguments.size() > 1 ? static_cast<uint32_t>(std::stoul(arguments[1])) : 5;
+    auto sizes = ImageSizes(count);
+
+    std::printf("%u images, %u on screen at a time\n", count, onScreen);
+    std::printf("%-12s %10s %10s %10s %10s %12s\n", "classing", "created", "hit rate", "padding", "trimmed", "per image");
+    for (auto classing : { SizeClassing::PowerOfTwo, SizeClassing::Step125 })
+    {
+        auto device = std::make_shared<SoftwareRenderDevice>();
+        SurfacePoolOptions options;
+        options.Classing = classing;
+        SurfacePool pool(device, options);
+        std::deque<PooledSurface> visible;
+        auto start = std::chrono::steady_clock::now();
+        for (auto [width, height] : sizes)
+        {
+            visible.push_back(pool.Acquire(SurfaceFormat::B8G8R8A8, width, height));
+            if (visible.size() > onScreen)
+            {
+                pool.Release(std::move(visible.front()));
+                visible.pop_front();
+            }
+        }
+        auto time = std::chrono::steady_clock::now() - start;
+        auto stats = pool.Stats();
+        std::printf("%-12s %10llu %9.1f%% %9.1f%% %10llu %9.2f us\n",
+            classing == SizeClassing::PowerOfTwo ? "PowerOfTwo" : "Step125",
+            static_cast<unsigned long long>(stats.SurfacesCreated), stats.HitRate() * 100,
+            stats.WastedPixelRatio() * 100, static_cast<unsigned long long>(stats.SurfacesTrimmed),
+            std::chrono::duration<double, std::micro>(time).count() / count);
+    }
+    std::printf("%-12s %10u %9.1f%% %9.1f%%\n", "no pool", count, 0.0, 0.0);
+}
@@ -0,0 +1,35 @@
+#include "TestHarness.h"
+
+std::vector<TestCase>& RegisteredTests()
+{
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+std::filesystem::path TestDirectory(std::string const& name)
+{
+    auto directory = std::filesystem::temp_directory_path() / "CompositionImageDemoTests" / name;
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    return directory;
+}
+
+PixelBuffer TestImage(uint32_t width, uint32_t height, uint32_t seed)
+{
+    PixelBuffer image(width, height);
+    uint32_t noise = seed * 2654435761u;
+    for (uint32_t y = 0; y < height; y++)
+    {
+        auto row = image.Row(y);
+        for (uint32_t x = 0; x < width; x++)
+        {
+            noise = noise * 1664525u + 1013904223u;
+            auto grain = static_cast<int>((noise >> 28) & 0x7) - 4;
+            row[x * 4 + 0] = static_cast<uint8_t>(std::clamp(static_cast<int>(x * 255 / std::max(1u, width)) + grain, 0, 255));
+            row[x * 4 + 1] = static_cast<uint8_t>(std::clamp(static_cast<int>(y * 255 / std::max(1u, height)) + grain, 0, 255));
+            row[x * 4 + 2] = static_cast<uint8_t>(((x / 16 + y / 16 + seed) % 2) ? 200 : 60);
+            row[x * 4 + 3] = 255;
+        }
+    }
+    return image;
+}
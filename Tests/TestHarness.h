@@ -0,0 +1,72 @@
+#pragma once
+#include "pch.h"
+#include "PixelBuffer.h"
+
+// Just enough of a test framework to check the portable parts of the sample
+// without pulling in a dependency. Tests register themselves by suite, and
+// the runner takes a suite name to run only that suite.
+//
+//  TEST(QoiCodec, RoundTrips)
+//  {
+//      CHECK(DecodeQoi(EncodeQoi(image)).Bytes == image.Bytes);
+//  }
+
+class TestFailure : public std::runtime_error
+{
+public:
+    TestFailure(char const* file, int line, std::string const& message) :
+        std::runtime_error(std::string(file) + ":" + std::to_string(line) + ": " + message) {}
+};
+
+struct TestCase
+{
+    char const* Suite;
+    char const* Name;
+    void (*Run)();
+};
+
+std::vector<TestCase>& RegisteredTests();
+
+struct TestRegistration
+{
+    TestRegistration(char const* suite, char const* name, void (*run)())
+    {
+        RegisteredTests().push_back({ suite, name, run });
+    }
+};
+
+#define TEST(suite, name) \
+    static void suite##_##name(); \
+    static TestRegistration suite##_##name##_registration(#suite, #name, suite##_##name); \
+    static void suite##_##name()
+
+#define CHECK(condition) \
+    do { if (!(condition)) throw TestFailure(__FILE__, __LINE__, "CHECK(" #condition ") failed"); } while (false)
+
+#define CHECK_EQ(actual, expected) \
+    do \
+    { \
+        auto const& actualValue = (actual); \
+        auto const& expectedValue = (expected); \
+        if (!(actualValue == expectedValue)) \
+        { \
+            std::ostringstream message; \
+            message << "CHECK_EQ(" #actual ", " #expected ") failed: " << actualValue << " != " << expectedValue; \
+            throw TestFailure(__FILE__, __LINE__, message.str()); \
+        } \
+    } while (false)
+
+#define CHECK_THROWS(expression, exception) \
+    do \
+    { \
+        auto threw = false; \
+        try { expression; } catch (exception const&) { threw = true; } \
+        if (!threw) throw TestFailure(__FILE__, __LINE__, #expression " didn't throw " #exception); \
+    } while (false)
+
+// A fresh, empty directory under the system temp directory for the test to
+// write to.
+std::filesystem::path TestDirectory(std::string const& name);
+
+// An image with smooth gradients and some detail, something like a photo.
+PixelBuffer TestImage(uint32_t width, uint32_t height, uint32_t seed = 1);
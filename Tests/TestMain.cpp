@@ -0,0 +1,35 @@
+#include "TestHarness.h"
+#include <cstdio>
+
+// Runs every test, or only the ones in the suite named on the command line.
+int main(int argc, char** argv)
+{
+    std::string suite = argc > 1 ? argv[1] : "";
+    size_t run = 0;
+    size_t failed = 0;
+    for (auto& test : RegisteredTests())
+    {
+        if (!suite.empty() && suite != test.Suite)
+        {
+            continue;
+        }
+        run++;
+        try
+        {
+            test.Run();
+            std::printf("[ PASS ] %s.%s\n", test.Suite, test.Name);
+        }
+        catch (std::exception const& error)
+        {
+            failed++;
+            std::printf("[ FAIL ] %s.%s\n         %s\n", test.Suite, test.Name, error.what());
+        }
+    }
+    if (run == 0)
+    {
+        std::printf("No tests matched '%s'\n", suite.c_str());
+        return 1;
+    }
+    std::printf("%zu of %zu passed\n", run - failed, run);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+#include "TestHarness.h"
+#include "TileManager.h"
+
+namespace
+{
+    std::vector<TileCoord> LoadAll(TileManager& tiles, std::vector<TileCoord>* evicted = nullptr)
+    {
+        std::vector<TileCoord> loaded;
+        while (auto tile = tiles.NextTileToLoad())
+        {
+            loaded.push_back(*tile);
+            for (auto&& victim : tiles.TileLoaded(*tile))
+            {
+                if (evicted)
+                {
+                    evicted->push_back(victim);
+                }
+            }
+        }
+        return loaded;
+    }
+}
+
+TEST(TileManager, LoadsTheVisibleTilesFromTheMiddleOut)
+{
+    TileManager tiles(20000, 12000, 512);
+    CHECK_EQ(tiles.Columns(), 40u);
+    CHECK_EQ(tiles.Rows(), 24u);
+    // The right and bottom edges are partial tiles.
+    CHECK_EQ(tiles.TileRect({ 39, 23 }).Width, uint32_t(20000 - 39 * 512));
+
+    // An 800x600 window over the middle of the image, like the sample shows it.
+    tiles.SetViewport({ (20000 - 800) / 2, (12000 - 600) / 2, 800, 600 });
+    auto loaded = LoadAll(tiles);
+    CHECK_EQ(loaded.size(), tiles.VisibleTiles().size());
+    auto first = tiles.TileRect(loaded.front());
+    CHECK(first.X <= 10000 && first.X + first.Width > 10000);
+    CHECK(first.Y <= 6000 && first.Y + first.Height > 6000);
+    CHECK(!tiles.NextTileToLoad());
+}
+
+TEST(TileManager, GrowingTheViewLoadsOnlyTheNewTiles)
+{
+    TileManager tiles(20000, 12000, 512);
+    tiles.SetViewport({ 9600, 5700, 800, 600 });
+    auto before = LoadAll(tiles).size();
+    // The window gets bigger, so more of the image is on screen.
+    tiles.SetViewport({ 9000, 5000, 2000, 2000 });
+    auto added = LoadAll(tiles);
+    CHECK_EQ(before + added.size(), tiles.VisibleTiles().size());
+    for (auto tile : tiles.VisibleTiles())
+    {
+        CHECK(tiles.IsResident(tile));
+    }
+}
+
+TEST(TileManager, EvictsTilesThatLeftTheView)
+{
+    TileManager tiles(8192, 8192, 512, 8);
+    tiles.SetViewport({ 0, 0, 1024, 1024 });
+    LoadAll(tiles);
+    std::vector<TileCoord> evicted;
+    tiles.SetViewport({ 4096, 4096, 1024, 1024 });
+    LoadAll(tiles, &evicted);
+    tiles.SetViewport({ 6144, 6144, 1024, 1024 });
+    LoadAll(tiles, &evicted);
+    CHECK(tiles.ResidentCount() <= 8u);
+    CHECK(!evicted.empty());
+    // The first tiles to go are the ones that were visible longest ago.
+    CHECK(evicted.front().Column < 2 && evicted.front().Row < 2);
+}
+
+TEST(TileManager, ScrolledAwayTilesAreCancelledAndFailedOnesRetried)
+{
+    TileManager tiles(8192, 8192, 512);
+    tiles.SetViewport({ 0, 0, 2048, 2048 });
+    auto tile = tiles.NextTileToLoad();
+    CHECK(tile.has_value());
+    tiles.TileFailed(*tile);
+    CHECK_EQ(tiles.QueuedCount(), size_t(16));
+
+    tiles.SetViewport({ 6144, 6144, 512, 512 });
+    CHECK_EQ(tiles.QueuedCount(), size_t(1));
+    CHECK_EQ(tiles.Stats().LoadsCancelled, uint64_t(16));
+}
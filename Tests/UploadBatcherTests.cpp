@@ -0,0 +1,92 @@
+#include "TestHarness.h"
+#include "UploadBatcher.h"
+#include "SoftwareSurfaceBackend.h"
+
+TEST(UploadBatcher, TilesOfOneSurfaceShareADraw)
+{
+    std::vector<std::chrono::milliseconds> requests;
+    UploadBatcher batcher({}, [&](std::chrono::milliseconds delay) { requests.push_back(delay); });
+    auto surface = std::make_shared<SoftwareSurfaceBackend>(SurfaceFormat::B8G8R8A8, SurfacePoint{ 3, 4 });
+    surface->Resize(64, 32);
+    auto image = TestImage(64, 32);
+    auto uploaded = 0;
+    for (uint32_t x = 0; x < 64; x += 16)
+    {
+        SurfaceRect rect = { static_cast<int32_t>(x), 0, 16, 32 };
+        batcher.Enqueue(surface, rect, image.Row(0) + x * 4, image.Stride(), 16, 32, [&]() { uploaded++; });
+    }
+    // One flush is asked for, when the batch starts.
+    CHECK_EQ(requests.size(), size_t(1));
+    CHECK(uploaded == 0);
+    CHECK_EQ(batcher.Flush(), size_t(4));
+    CHECK(uploaded == 4);
+    CHECK(surface->ReadPixels() == image.Bytes);
+    CHECK_EQ(batcher.Stats().Draws, uint64_t(1));
+    CHECK_EQ(batcher.Flush(), size_t(0));
+}
+
+TEST(UploadBatcher, WholeImagesReplaceWhatWasQueuedBefore)
+{
+    UploadBatcher batcher({}, [](std::chrono::milliseconds) {});
+    auto surface = std::make_shared<SoftwareSurfaceBackend>();
+    auto first = TestImage(20, 20, 1);
+    auto second = TestImage(30, 10, 2);
+    batcher.Enqueue(surface, first);
+    batcher.Enqueue(surface, second);
+    batcher.Flush();
+    CHECK_EQ(surface->Width(), 30u);
+    CHECK(surface->ReadPixels() == second.Bytes);
+    CHECK_EQ(batcher.Stats().Superseded, uint64_t(1));
+}
+
+TEST(UploadBatcher, SizeLimitsAskForAFlushStraightAway)
+{
+    std::vector<std::chrono::milliseconds> requests;
+    UploadBatcherOptions options;
+    options.MaxBatchUploads = 3;
+    UploadBatcher batcher(options, [&](std::chrono::milliseconds delay) { requests.push_back(delay); });
+    auto image = TestImage(8, 8);
+    for (int i = 0; i < 5; i++)
+    {
+        batcher.Enqueue(std::make_shared<SoftwareSurfaceBackend>(), image);
+    }
+    CHECK_EQ(requests.size(), size_t(2));
+    CHECK(requests[0] == options.MaxLatency);
+    CHECK(requests[1] == std::chrono::milliseconds(0));
+    CHECK_EQ(batcher.Stats().SizeFlushes, uint64_t(1));
+}
+
+TEST(UploadBatcher, QueueingWhileFlushingLosesNothing)
+{
+    UploadBatcher batcher({}, [](std::chrono::milliseconds) {});
+    auto image = TestImage(256, 256);
+    std::atomic<uint32_t> uploaded = 0;
+    std::atomic<bool> done = false;
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; t++)
+    {
+        producers.emplace_back([&]()
+            {
+                for (int i = 0; i < 50; i++)
+                {
+                    batcher.Enqueue(std::make_shared<SoftwareSurfaceBackend>(), image, [&]() { uploaded++; });
+                }
+            });
+    }
+    std::thread flusher([&]()
+        {
+            while (!done)
+            {
+                batcher.Flush();
+            }
+            batcher.Flush();
+        });
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    done = true;
+    flusher.join();
+    CHECK_EQ(uploaded.load(), 200u);
+    CHECK_EQ(batcher.Stats().Uploads, uint64_t(200));
+}
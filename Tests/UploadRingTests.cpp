@@ -0,0 +1,271 @@
+#include "TestHarness.h"
+#include "UploadRing.h"
+#include "UploadBatcher.h"
+#include "ImagePipeline.h"
+#include "SoftwareRenderDevice.h"
+
+namespace
+{
+    // A ring of CpuUploadPages, keeping track of the pages it made.
+    struct TestRing
+    {
+        std::shared_ptr<CpuUploadFence> Fence;
+        std::vector<CpuUploadPage*> Pages;
+        std::unique_ptr<UploadRing> Ring;
+
+        TestRing(uint32_t pageWidth, uint32_t pageHeight, uint32_t pageCount, uint32_t latency = 2)
+        {
+            Fence = std::make_shared<CpuUploadFence>(latency);
+            UploadRingOptions options;
+            options.PageWidth = pageWidth;
+            options.PageHeight = pageHeight;
+            options.PageCount = pageCount;
+            Ring = std::make_unique<UploadRing>(SurfaceFormat::B8G8R8A8, options, Fence, [this, pageWidth, pageHeight]()
+                {
+                    auto page = std::make_unique<CpuUploadPage>(SurfaceFormat::B8G8R8A8, pageWidth, pageHeight);
+                    Pages.push_back(page.get());
+                    return page;
+                });
+        }
+    };
+}
+
+TEST(UploadRing, PacksUploadsOntoShelves)
+{
+    TestRing test(64, 32, 4);
+    auto& ring = *test.Ring;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        auto allocation = ring.Allocate(20, 10);
+        CHECK(allocation);
+        CHECK_EQ(allocation->X, 20 * i);
+        CHECK_EQ(allocation->Y, 0u);
+        CHECK_EQ(allocation->Height, 10u);
+        CHECK(allocation->Data == test.Pages[0]->Data() + allocation->X * 4);
+    }
+    // No room left on the first shelf, so the next one starts under it.
+    auto next = ring.Allocate(20, 8);
+    CHECK(next && next->X == 0 && next->Y == 10);
+    CHECK(next->Data == test.Pages[0]->Data() + 10 * test.Pages[0]->RowPitch());
+    // The shelf can grow to fit taller uploads, but not this one, which is too
+    // tall for what's left of the page.
+    auto tall = ring.Allocate(10, 25);
+    CHECK(tall && tall->Page != next->Page && tall->Y == 0);
+
+    auto stats = ring.Stats();
+    CHECK_EQ(stats.Allocations, uint64_t(5));
+    CHECK_EQ(stats.PagesCreated, uint64_t(2));
+    CHECK_EQ(stats.Splits, uint64_t(0));
+    CHECK_EQ(stats.PeakPagesInUse, 2u);
+    CHECK_EQ(ring.Utilization(), 0.5);
+}
+
+TEST(UploadRing, PagesAreReusedOnceTheFenceCompletes)
+{
+    // With no latency, every batch is done as soon as it's submitted.
+    TestRing test(16, 16, 2, 0);
+    auto& ring = *test.Ring;
+    for (uint32_t batch = 0; batch < 6; batch++)
+    {
+        // Each batch fills a page, so they go around the ring three times.
+        auto allocation = ring.Allocate(16, 16);
+        CHECK(allocation);
+        CHECK(allocation->Page == test.Pages[batch % 2]);
+        ring.Submit();
+        CHECK(!test.Pages[batch % 2]->IsMapped());
+        CHECK_EQ(ring.Utilization(), 0.0);
+    }
+    auto stats = ring.Stats();
+    CHECK_EQ(stats.PagesCreated, uint64_t(2));
+    CHECK_EQ(stats.PagesSubmitted, uint64_t(6));
+    CHECK_EQ(stats.Stalls, uint64_t(0));
+    CHECK_EQ(test.Fence->Waits(), uint64_t(0));
+    CHECK_EQ(test.Pages[0]->MapCount(), uint64_t(3));
+    CHECK_EQ(stats.PackingEfficiency(), 1.0);
+}
+
+TEST(UploadRing, WaitsForPagesTheGpuIsStillUsing)
+{
+    // The fence never catches up on its own.
+    TestRing test(16, 16, 2, 100);
+    auto& ring = *test.Ring;
+    for (uint32_t batch = 0; batch < 2; batch++)
+    {
+        CHECK(ring.Allocate(16, 16));
+        ring.Submit();
+    }
+    CHECK_EQ(ring.Utilization(), 1.0);
+    CHECK_EQ(ring.Stats().Stalls, uint64_t(0));
+
+    // Back to the first page, which is still waiting on its fence.
+    auto allocation = ring.Allocate(16, 16);
+    CHECK(allocation && allocation->Page == test.Pages[0]);
+    CHECK_EQ(ring.Stats().Stalls, uint64_t(1));
+    CHECK_EQ(test.Fence->Waits(), uint64_t(1));
+    ring.Submit();
+
+    // Once the GPU has caught up, there's nothing to wait for.
+    test.Fence->Complete(3);
+    CHECK(ring.Allocate(16, 16));
+    CHECK_EQ(ring.Stats().Stalls, uint64_t(1));
+}
+
+TEST(UploadRing, OversizeAndOverflowingUploadsFallBack)
+{
+    TestRing test(32, 16, 2);
+    auto& ring = *test.Ring;
+    // Wider than a page.
+    CHECK(!ring.Allocate(33, 1));
+    CHECK_EQ(ring.Stats().OversizeFallbacks, uint64_t(1));
+    CHECK_EQ(ring.Stats().PagesCreated, uint64_t(0));
+
+    // Taller than a page is fine, it comes back a page at a time...
+    auto first = ring.Allocate(32, 40);
+    CHECK(first && first->Height == 16);
+    auto second = ring.Allocate(32, 24);
+    CHECK(second && second->Height == 16 && second->Page != first->Page);
+    // ...until every page is part of this batch.
+    CHECK(!ring.Allocate(8, 8));
+    auto stats = ring.Stats();
+    CHECK_EQ(stats.Splits, uint64_t(2));
+    CHECK_EQ(stats.FullFallbacks, uint64_t(1));
+    CHECK_EQ(test.Fence->Waits(), uint64_t(0));
+
+    // The next batch has the ring back.
+    ring.Submit();
+    test.Fence->Complete(1);
+    CHECK(ring.Allocate(8, 8));
+}
+
+TEST(UploadRing, SplitsUseWhatsLeftOfAPage)
+{
+    TestRing test(32, 16, 4);
+    auto& ring = *test.Ring;
+    CHECK(ring.Allocate(32, 10));
+    // An image taller than a page starts in the six rows under the first one.
+    auto band = ring.Allocate(32, 20);
+    CHECK(band && band->Y == 10 && band->Height == 6);
+    band = ring.Allocate(32, 14);
+    CHECK(band && band->Y == 0 && band->Height == 14);
+    ring.Submit();
+    CHECK_EQ(ring.Stats().PackingEfficiency(), 30.0 / 32.0);
+}
+
+TEST(UploadRing, SurfacesOnlyCopyFromUnmappedPages)
+{
+    TestRing test(32, 32, 2);
+    auto& ring = *test.Ring;
+    auto image = TestImage(8, 6);
+    auto allocation = ring.Allocate(8, 6);
+    CHECK(allocation);
+    for (uint32_t y = 0; y < 6; y++)
+    {
+        std::memcpy(allocation->Data + y * allocation->RowPitch, image.Bytes.data() + y * image.Stride(), image.Stride());
+    }
+
+    SoftwareSurfaceBackend surface;
+    surface.Resize(8, 6);
+    auto offset = surface.BeginDraw(nullptr);
+    CHECK_THROWS(surface.CopyPixels(offset, *allocation), std::logic_error);
+    ring.Close();
+    CHECK(!test.Pages[0]->IsMapped());
+    surface.CopyPixels(offset, *allocation);
+    surface.EndDraw();
+    ring.Submit();
+    CHECK(surface.ReadPixels() == image.Bytes);
+    CHECK_EQ(surface.CopyCount(), uint64_t(1));
+
+    UploadRingOptions options;
+    options.PageCount = 0;
+    CHECK_THROWS(UploadRing(SurfaceFormat::B8G8R8A8, options, test.Fence, []() { return std::unique_ptr<UploadPage>(); }), std::invalid_argument);
+}
+
+TEST(UploadRing, BatchesAreStagedAndCopied)
+{
+    auto fence = std::make_shared<CpuUploadFence>(1);
+    UploadRingOptions options;
+    options.PageWidth = 64;
+    options.PageHeight = 32;
+    options.PageCount = 2;
+    auto ring = std::make_shared<UploadRing>(SurfaceFormat::B8G8R8A8, options, fence, []()
+        {
+            return std::make_unique<CpuUploadPage>(SurfaceFormat::B8G8R8A8, 64, 32);
+        });
+    UploadBatcher batcher({}, [](std::chrono::milliseconds) {});
+    batcher.SetUploadRings({ ring });
+
+    // One that fits, one split over both pages, one too wide for them, and
+    // one that only partly fits once the ring is full.
+    std::vector<std::pair<std::shared_ptr<SoftwareSurfaceBackend>, PixelBuffer>> uploads;
+    for (auto [width, height] : { std::pair{ 20u, 10u }, { 40u, 50u }, { 100u, 10u }, { 30u, 40u } })
+    {
+        uploads.emplace_back(std::make_shared<SoftwareSurfaceBackend>(), TestImage(width, height, width));
+    }
+    for (int batch = 0; batch < 2; batch++)
+    {
+        for (auto& [surface, image] : uploads)
+        {
+            batcher.Enqueue(surface, image);
+        }
+        CHECK_EQ(batcher.Flush(), size_t(4));
+        for (auto& [surface, image] : uploads)
+        {
+            CHECK(surface->ReadPixels() == image.Bytes);
+        }
+    }
+
+    auto stats = ring->Stats();
+    CHECK_EQ(stats.OversizeFallbacks, uint64_t(2));
+    CHECK_EQ(stats.FullFallbacks, uint64_t(2));
+    CHECK_EQ(stats.Splits, uint64_t(4));
+    // The second batch went around onto a page the first was still using.
+    CHECK_EQ(stats.Stalls, uint64_t(1));
+    CHECK_EQ(uploads[0].first->CopyCount(), uint64_t(2));
+    CHECK_EQ(uploads[1].first->CopyCount(), uint64_t(4));
+    CHECK_EQ(uploads[2].first->CopyCount(), uint64_t(0));
+    // Part of the last one was staged, the rest was written from its pixels.
+    CHECK_EQ(uploads[3].first->CopyCount(), uint64_t(2));
+    CHECK_EQ(uploads[3].first->WriteCount(), uint64_t(4));
+}
+
+TEST(UploadRing, PipelineStagesEveryFormat)
+{
+    auto device = std::make_shared<SoftwareRenderDevice>();
+    ImagePipelineOptions options;
+    options.Dither = DitherMode::None;
+    ImagePipeline pipeline(device, options, [](std::chrono::milliseconds) {});
+
+    std::vector<std::pair<std::shared_ptr<SoftwareSurfaceBackend>, std::vector<uint8_t>>> expected;
+    auto image = std::make_shared<PixelBuffer const>(TestImage(70, 50));
+    for (auto format : { SurfaceFormat::B8G8R8A8, SurfaceFormat::B5G6R5, SurfaceFormat::B4G4R4A4 })
+    {
+        auto surface = device->CreateSoftwareSurface(format);
+        pipeline.Upload(surface, image);
+        std::vector<uint8_t> pixels = image->Bytes;
+        if (format != SurfaceFormat::B8G8R8A8)
+        {
+            auto packed = ConvertPixels(*image, format == SurfaceFormat::B5G6R5 ? PackedPixelFormat::B5G6R5 : PackedPixelFormat::B4G4R4A4, DitherMode::None);
+            pixels.assign(reinterpret_cast<uint8_t const*>(packed.Pixels.data()), reinterpret_cast<uint8_t const*>(packed.Pixels.data() + packed.Pixels.size()));
+        }
+        expected.emplace_back(surface, std::move(pixels));
+    }
+    pipeline.Flush();
+    for (auto& [surface, pixels] : expected)
+    {
+        CHECK(surface->ReadPixels() == pixels);
+        CHECK_EQ(surface->CopyCount(), uint64_t(1));
+    }
+    auto stats = pipeline.RingStats();
+    CHECK_EQ(stats.Allocations, uint64_t(3));
+    CHECK_EQ(stats.PagesCreated, uint64_t(3));
+    CHECK(pipeline.RingUtilization() > 0.0);
+
+    // A new device means new rings, and the old pages are let go of.
+    device->SimulateDeviceLoss();
+    device->ReplaceDevice();
+    CHECK_EQ(pipeline.RingStats().Allocations, uint64_t(0));
+    pipeline.Upload(expected[0].first, image);
+    pipeline.Flush();
+    CHECK(expected[0].first->ReadPixels() == expected[0].second);
+    CHECK_EQ(pipeline.RingStats().PagesCreated, uint64_t(1));
+}
@@ -0,0 +1,223 @@
+#include "TestHarness.h"
+#include "UploadScheduler.h"
+
+namespace
+{
+    // A frame clock that only moves when an upload says so, so frame times
+    // are exactly what the test makes them.
+    struct SimulatedClock
+    {
+        std::chrono::steady_clock::time_point Now;
+
+        UploadScheduler::Clock Clock()
+        {
+            return [this]() { return Now; };
+        }
+
+        // An upload that takes the given time and records that it ran.
+        UploadScheduler::UploadHandler Upload(std::chrono::nanoseconds time, std::vector<int>* order = nullptr, int label = 0)
+        {
+            return [this, time, order, label]()
+            {
+                Now += time;
+                if (order)
+                {
+                    order->push_back(label);
+                }
+            };
+        }
+    };
+
+    // Costs exactly one nanosecond a byte plus 100 us an upload.
+    UploadSchedulerOptions SteadyOptions()
+    {
+        UploadSchedulerOptions options;
+        options.UploadOverhead = std::chrono::microseconds(100);
+        options.InitialNanosecondsPerByte = 1.0;
+        return options;
+    }
+
+    std::chrono::nanoseconds SteadyCost(uint64_t bytes)
+    {
+        return std::chrono::microseconds(100) + std::chrono::nanoseconds(bytes);
+    }
+}
+
+TEST(UploadScheduler, StopsAtTheTimeBudget)
+{
+    SimulatedClock clock;
+    auto options = SteadyOptions();
+    options.FrameTimeBudget = std::chrono::microseconds(1000);
+    UploadScheduler scheduler(options, nullptr, clock.Clock());
+
+    // 100.2 us each, so nine fit in a millisecond.
+    for (int i = 0; i < 15; i++)
+    {
+        scheduler.Schedule(0, 200, clock.Upload(SteadyCost(200)));
+    }
+    CHECK_EQ(scheduler.QueuedBytes(), uint64_t(3000));
+    CHECK_EQ(scheduler.RunFrame(), size_t(9));
+    CHECK_EQ(scheduler.QueueDepth(), size_t(6));
+    auto frame = scheduler.Stats().LastFrame;
+    CHECK(frame.EstimatedTime == SteadyCost(200) * 9);
+    CHECK(frame.Time == SteadyCost(200) * 9);
+    CHECK_EQ(scheduler.RunFrame(), size_t(6));
+    CHECK_EQ(scheduler.RunFrame(), size_t(0));
+
+    // Something bigger than the whole budget still gets a frame to itself.
+    scheduler.Schedule(0, 2000000, clock.Upload(SteadyCost(2000000)));
+    scheduler.Schedule(0, 10, clock.Upload(SteadyCost(10)));
+    CHECK_EQ(scheduler.RunFrame(), size_t(1));
+    CHECK_EQ(scheduler.Stats().FramesOverBudget, uint64_t(1));
+    CHECK_EQ(scheduler.RunFrame(), size_t(1));
+}
+
+TEST(UploadScheduler, StopsAtTheByteBudget)
+{
+    SimulatedClock clock;
+    auto options = SteadyOptions();
+    options.FrameTimeBudget = std::chrono::seconds(1);
+    options.FrameByteBudget = 1000;
+    UploadScheduler scheduler(options, nullptr, clock.Clock());
+
+    for (int i = 0; i < 10; i++)
+    {
+        scheduler.Schedule(0, 300, clock.Upload(SteadyCost(300)));
+    }
+    std::vector<size_t> frames;
+    while (auto count = scheduler.RunFrame())
+    {
+        frames.push_back(count);
+        CHECK(scheduler.Stats().LastFrame.Bytes <= 1000);
+    }
+    CHECK(frames == std::vector<size_t>({ 3, 3, 3, 1 }));
+    CHECK_EQ(scheduler.Stats().DeferredFrames, uint64_t(3));
+
+    scheduler.Schedule(0, 5000, clock.Upload(SteadyCost(5000)));
+    CHECK_EQ(scheduler.RunFrame(), size_t(1));
+    CHECK_EQ(scheduler.Stats().LastFrame.Bytes, uint64_t(5000));
+}
+
+TEST(UploadScheduler, HigherPrioritiesGoFirstAndTiesInOrder)
+{
+    SimulatedClock clock;
+    auto options = SteadyOptions();
+    options.FrameByteBudget = 300;
+    UploadScheduler scheduler(options, nullptr, clock.Clock());
+
+    std::vector<int> order;
+    std::vector<std::pair<int32_t, int>> uploads = { { 0, 1 }, { 5, 2 }, { 0, 3 }, { 5, 4 }, { 1, 5 }, { -2, 6 }, { 1, 7 } };
+    for (auto [priority, label] : uploads)
+    {
+        scheduler.Schedule(priority, 100, clock.Upload(SteadyCost(100), &order, label));
+    }
+    CHECK_EQ(scheduler.RunFrame(), size_t(3));
+    CHECK(order == std::vector<int>({ 2, 4, 5 }));
+
+    // Something more important that arrives later still jumps the queue.
+    scheduler.Schedule(3, 100, clock.Upload(SteadyCost(100), &order, 8));
+    while (scheduler.RunFrame() > 0)
+    {
+    }
+    CHECK(order == std::vector<int>({ 2, 4, 5, 8, 7, 1, 3, 6 }));
+}
+
+TEST(UploadScheduler, LearnsTheCostPerByte)
+{
+    SimulatedClock clock;
+    UploadSchedulerOptions options;
+    options.UploadOverhead = std::chrono::nanoseconds(0);
+    options.InitialNanosecondsPerByte = 0.25;
+    options.CostSmoothing = 0.5;
+    UploadScheduler scheduler(options, nullptr, clock.Clock());
+    CHECK(scheduler.EstimateCost(1000) == std::chrono::nanoseconds(250));
+
+    // Uploads really take 2 ns a byte.
+    scheduler.Schedule(0, 1000, clock.Upload(std::chrono::nanoseconds(2000)));
+    scheduler.RunFrame();
+    CHECK_EQ(scheduler.Stats().NanosecondsPerByte, 1.125);
+    for (int frame = 0; frame < 30; frame++)
+    {
+        scheduler.Schedule(0, 1000, clock.Upload(std::chrono::nanoseconds(2000)));
+        scheduler.RunFrame();
+    }
+    CHECK(std::abs(scheduler.Stats().NanosecondsPerByte - 2.0) < 1e-6);
+    CHECK(std::abs(scheduler.EstimateCost(1000).count() - 2000) <= 1);
+
+    // The fixed cost of each upload isn't counted against its bytes.
+    options.UploadOverhead = std::chrono::microseconds(10);
+    options.InitialNanosecondsPerByte = 2.0;
+    UploadScheduler withOverhead(options, nullptr, clock.Clock());
+    for (int i = 0; i < 4; i++)
+    {
+        withOverhead.Schedule(0, 1000, clock.Upload(std::chrono::microseconds(10) + std::chrono::nanoseconds(2000)));
+    }
+    withOverhead.RunFrame();
+    CHECK_EQ(withOverhead.Stats().NanosecondsPerByte, 2.0);
+}
+
+TEST(UploadScheduler, KeepsRecentFramesAndQueueDepth)
+{
+    SimulatedClock clock;
+    auto options = SteadyOptions();
+    options.FrameByteBudget = 200;
+    options.FrameHistory = 3;
+    auto endFrames = 0;
+    UploadScheduler scheduler(options, [&]()
+        {
+            // Flushing the batch is part of the frame.
+            clock.Now += std::chrono::microseconds(7);
+            endFrames++;
+        },
+        clock.Clock());
+
+    for (int i = 0; i < 9; i++)
+    {
+        CHECK_EQ(scheduler.Schedule(0, 100, clock.Upload(SteadyCost(100))), size_t(i + 1));
+    }
+    CHECK_EQ(scheduler.QueueDepth(), size_t(9));
+    for (int frame = 0; frame < 5; frame++)
+    {
+        scheduler.RunFrame();
+    }
+    CHECK_EQ(scheduler.RunFrame(), size_t(0));
+    // A frame with nothing to do doesn't count.
+    CHECK_EQ(endFrames, 5);
+
+    auto frames = scheduler.RecentFrames();
+    CHECK_EQ(frames.size(), size_t(3));
+    std::vector<size_t> depths;
+    for (auto const& frame : frames)
+    {
+        depths.push_back(frame.QueueDepth);
+    }
+    // Oldest first: the third, fourth and fifth frames.
+    CHECK(depths == std::vector<size_t>({ 3, 1, 0 }));
+    CHECK_EQ(frames[0].Uploads, 2u);
+    CHECK_EQ(frames[2].Uploads, 1u);
+    CHECK(frames[0].Time == SteadyCost(100) * 2 + std::chrono::microseconds(7));
+
+    auto stats = scheduler.Stats();
+    CHECK_EQ(stats.Frames, uint64_t(5));
+    CHECK_EQ(stats.Uploads, uint64_t(9));
+    CHECK_EQ(stats.BytesUploaded, uint64_t(900));
+    CHECK_EQ(stats.MaxQueueDepth, size_t(9));
+    CHECK_EQ(stats.DeferredFrames, uint64_t(4));
+    CHECK_EQ(scheduler.QueuedBytes(), uint64_t(0));
+}
+
+TEST(UploadScheduler, UploadsAfterOneThatThrowsStayQueued)
+{
+    SimulatedClock clock;
+    UploadScheduler scheduler(SteadyOptions(), nullptr, clock.Clock());
+    std::vector<int> order;
+    scheduler.Schedule(0, 100, clock.Upload(SteadyCost(100), &order, 1));
+    scheduler.Schedule(0, 100, []() { throw std::runtime_error("lost"); });
+    scheduler.Schedule(0, 100, clock.Upload(SteadyCost(100), &order, 3));
+    scheduler.Schedule(0, 100, clock.Upload(SteadyCost(100), &order, 4));
+    CHECK_THROWS(scheduler.RunFrame(), std::runtime_error);
+    CHECK_EQ(scheduler.QueueDepth(), size_t(2));
+    CHECK_EQ(scheduler.QueuedBytes(), uint64_t(200));
+    CHECK_EQ(scheduler.RunFrame(), size_t(2));
+    CHECK(order == std::vector<int>({ 1, 3, 4 }));
+}